@@ -0,0 +1,630 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QGuiApplication>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+#include <QProcess>
+#include <QScreen>
+#include <QTemporaryDir>
+#include <QVector>
+#include <QWindow>
+#include <qpa/qplatformnativeinterface.h>
+#ifdef PARTIAL_UPDATE
+#include <qpa/qplatformopenglcontext.h>
+#include <qpa/qplatformwindow.h>
+#endif
+
+#include <atomic>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <drm_fourcc.h>
+#include <gbm.h>
+
+#include "fakedrm.h"
+#ifdef PLANE_COMPOSITION
+#include "weboskmsdmabuf.h"
+#endif
+
+// Renders and flips frames in a loop on the simulated device of libfakedrm
+// and reports the cost per frame as JSON:
+//
+//   bench_flip [--frames N] [--output file] [scenario...]
+//
+// Each scenario runs in a child process of its own, the platform plugin
+// loads once per process. The report goes to --output, the file named by
+// WEBOS_BENCH_OUTPUT or stdout. ns_per_frame is the CPU time of the render
+// thread, allocations are counted on all threads except while fakedrm runs
+// what the kernel does on a real device.
+
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+}
+
+static std::atomic<bool> s_countAllocations(false);
+static std::atomic<quint64> s_allocations(0);
+
+static inline void countAllocation()
+{
+    if (s_countAllocations.load(std::memory_order_relaxed) && !fakedrm_in_kernel())
+        s_allocations.fetch_add(1, std::memory_order_relaxed);
+}
+
+extern "C" void *malloc(size_t size) noexcept
+{
+    countAllocation();
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t count, size_t size) noexcept
+{
+    countAllocation();
+    return __libc_calloc(count, size);
+}
+
+extern "C" void *realloc(void *ptr, size_t size) noexcept
+{
+    countAllocation();
+    return __libc_realloc(ptr, size);
+}
+
+// Leaves the producer side out of the allocation count
+class UncountedScope
+{
+public:
+    UncountedScope() : m_counting(s_countAllocations.exchange(false)) {}
+    ~UncountedScope() { s_countAllocations.store(m_counting); }
+
+private:
+    bool m_counting;
+};
+
+namespace {
+
+struct Scenario {
+    const char *name;
+    const char *integration;
+    // Overlay layers fed with dma-bufs every frame
+    int layers;
+    // Frames between visibility changes, 0 for none
+    int toggleInterval;
+    // Renders a small moving rect instead of the whole screen
+    bool damage;
+};
+
+const Scenario scenarios[] = {
+    { "kms", "eglfs_kms_webos", 0, 0, false },
+    { "kms_damage", "eglfs_kms_webos", 0, 0, true },
+#ifdef PLANE_COMPOSITION
+    { "kms_layers1", "eglfs_kms_webos", 1, 0, false },
+    { "kms_layers2", "eglfs_kms_webos", 2, 0, false },
+    { "kms_layers3", "eglfs_kms_webos", 3, 0, false },
+    { "kms_layers4", "eglfs_kms_webos", 4, 0, false },
+    { "kms_layers1_toggle", "eglfs_kms_webos", 1, 10, false },
+    { "kms_layers4_toggle", "eglfs_kms_webos", 4, 10, false },
+    { "kms_layers4_damage", "eglfs_kms_webos", 4, 0, true },
+#endif
+#ifdef STARFISH_INTEGRATION
+    { "starfish", "eglfs_starfish", 0, 0, false },
+    { "starfish_toggle", "eglfs_starfish", 0, 10, false },
+    { "starfish_damage", "eglfs_starfish", 0, 0, true },
+#endif
+};
+
+const int DefaultFrames = 300;
+const int WarmUpFrames = 60;
+const int RingSize = 3;
+
+const Scenario *findScenario(const QByteArray &name)
+{
+    for (const Scenario &scenario : scenarios) {
+        if (name == scenario.name)
+            return &scenario;
+    }
+    return nullptr;
+}
+
+qint64 cpuTime(clockid_t clock)
+{
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return qint64(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+bool setUp(const Scenario &scenario, const QTemporaryDir &runtimeDir)
+{
+    const bool starfish = qstrcmp(scenario.integration, "eglfs_starfish") == 0;
+
+    FakeDrmConfig config;
+    fakedrm_default_config(&config);
+    // fb1 takes an overlay plane. With plane composition the first overlay
+    // plane is the main one, the primary and three more take the layers
+    config.overlayPlanes = starfish ? 1 : 4;
+    fakedrm_configure(&config);
+
+    const QString configPath = runtimeDir.filePath(QStringLiteral("eglfs_config.json"));
+    QFile file(configPath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning("Cannot write %s", qPrintable(configPath));
+        return false;
+    }
+
+    const QByteArray device(fakedrm_device_path());
+    if (starfish) {
+        file.write("[{\"device\": \"" + device + "\", \"hwcursor\": false, \"outputs\": ["
+                   "{\"name\": \"fb0\", \"primary\": true, \"geometry\": \"1920x1080+0+0r0s1\"}, "
+                   "{\"name\": \"fb1\", \"geometry\": \"1920x1080+0+0r0s1\"}]}]");
+    } else {
+        file.write("[{\"device\": \"" + device + "\", \"hwcursor\": false, \"outputs\": ["
+                   "{\"name\": \"HDMI1\", \"primary\": true, \"useMultiPlanes\": "
+                   + QByteArray(scenario.layers ? "true" : "false") + "}]}]");
+    }
+    file.close();
+
+    qputenv("QT_QPA_PLATFORM", "eglfs_webos");
+    qputenv("QT_QPA_EGLFS_INTEGRATION", scenario.integration);
+    qputenv("QT_QPA_EGLFS_KMS_ATOMIC", "1");
+    qputenv("QT_QPA_EGLFS_DISABLE_INPUT", "1");
+    qputenv("QT_QPA_EGLFS_HIDECURSOR", "1");
+    qputenv("QT_QPA_EGLFS_CONFIG", QFile::encodeName(configPath));
+    qputenv("XDG_RUNTIME_DIR", QFile::encodeName(runtimeDir.path()));
+    if (starfish)
+        qputenv("QT_QPA_EGLFS_FB", "/dev/fb0:/dev/fb1");
+
+    // The plugins log every flip
+    if (!qEnvironmentVariableIsSet("QT_LOGGING_RULES"))
+        qputenv("QT_LOGGING_RULES", "*.debug=false;*.info=false");
+
+    if (QDir(QStringLiteral(WEBOS_PLUGIN_DIR)).exists()) {
+        QByteArray pluginPath(WEBOS_PLUGIN_DIR);
+        if (qEnvironmentVariableIsSet("QT_PLUGIN_PATH"))
+            pluginPath += ':' + qgetenv("QT_PLUGIN_PATH");
+        qputenv("QT_PLUGIN_PATH", pluginPath);
+    }
+
+    return true;
+}
+
+} // namespace
+
+class FlipBenchmark
+{
+public:
+    explicit FlipBenchmark(const Scenario &scenario);
+    ~FlipBenchmark();
+
+    bool initialize();
+    void frame();
+    QJsonObject measure(int frames);
+
+private:
+    typedef void (*SetScreenVisibleDirectly)(QScreen *, bool, QString);
+
+    void toggle();
+    QRect damageRect() const;
+
+    const Scenario &m_scenario;
+    QVector<QWindow *> m_windows;
+    QOpenGLContext m_context;
+    // The window shown, the other Starfish screen is off
+    int m_current = 0;
+    int m_frame = 0;
+    SetScreenVisibleDirectly m_setScreenVisible = nullptr;
+
+#ifdef PLANE_COMPOSITION
+    typedef void (*SetOverlayBufferObject)(const QScreen *, void *, QRectF, uint32_t);
+    typedef bool (*SetLayerDmaBuf)(const QScreen *, int, const WebOSKmsDmaBufDescriptor *, qint64);
+
+    struct Layer {
+        QRectF rect;
+        gbm_bo *ring[RingSize] = {};
+        int fds[RingSize] = { -1, -1, -1 };
+        bool visible = true;
+    };
+
+    bool initializeLayers();
+    gbm_bo *createBuffer(const QRectF &rect);
+    void showLayer(int index, bool visible);
+    void submitLayers();
+
+    gbm_device *m_gbmDevice = nullptr;
+    SetOverlayBufferObject m_setOverlayBufferObject = nullptr;
+    SetLayerDmaBuf m_setLayerDmaBuf = nullptr;
+    QVector<Layer> m_layers;
+#endif
+};
+
+FlipBenchmark::FlipBenchmark(const Scenario &scenario)
+    : m_scenario(scenario)
+{
+}
+
+FlipBenchmark::~FlipBenchmark()
+{
+#ifdef PLANE_COMPOSITION
+    // The fds belong to the buffer objects
+    for (const Layer &layer : m_layers) {
+        for (gbm_bo *bo : layer.ring) {
+            if (bo)
+                gbm_bo_destroy(bo);
+        }
+    }
+#endif
+    qDeleteAll(m_windows);
+}
+
+bool FlipBenchmark::initialize()
+{
+    QList<QScreen *> screens;
+    if (qstrcmp(m_scenario.integration, "eglfs_starfish") == 0) {
+        // fb0 and fb1, in that order
+        for (const char *name : { "fb0", "fb1" }) {
+            for (QScreen *screen : QGuiApplication::screens()) {
+                if (screen->name() == QLatin1String(name))
+                    screens.append(screen);
+            }
+        }
+        if (screens.size() != 2) {
+            qWarning("Expected the screens fb0 and fb1");
+            return false;
+        }
+
+        m_setScreenVisible = reinterpret_cast<SetScreenVisibleDirectly>(
+            QGuiApplication::platformNativeInterface()->nativeResourceForIntegration("setScreenVisibleDirectly"));
+        if (!m_setScreenVisible) {
+            qWarning("No setScreenVisibleDirectly");
+            return false;
+        }
+    } else {
+        screens.append(QGuiApplication::primaryScreen());
+    }
+
+    for (QScreen *screen : screens) {
+        QWindow *window = new QWindow(screen);
+        window->setSurfaceType(QSurface::OpenGLSurface);
+        window->showFullScreen();
+        m_windows.append(window);
+    }
+
+    if (m_setScreenVisible)
+        m_setScreenVisible(screens.first(), true, QStringLiteral("application"));
+
+    m_context.setFormat(m_windows.first()->requestedFormat());
+    if (!m_context.create()) {
+        qWarning("Cannot create an OpenGL context");
+        return false;
+    }
+
+#ifdef PLANE_COMPOSITION
+    if (m_scenario.layers && !initializeLayers())
+        return false;
+#endif
+
+    return true;
+}
+
+#ifdef PLANE_COMPOSITION
+bool FlipBenchmark::initializeLayers()
+{
+    m_setOverlayBufferObject = reinterpret_cast<SetOverlayBufferObject>(
+        QGuiApplication::platformFunction("setOverlayBufferObject"));
+    m_setLayerDmaBuf = reinterpret_cast<SetLayerDmaBuf>(QGuiApplication::platformFunction("setLayerDmaBuf"));
+    m_gbmDevice = static_cast<gbm_device *>(
+        QGuiApplication::platformNativeInterface()->nativeResourceForIntegration("gbm_device"));
+    if (!m_setOverlayBufferObject || !m_setLayerDmaBuf || !m_gbmDevice) {
+        qWarning("No overlay layer support");
+        return false;
+    }
+
+    // Side by side, like video tiles
+    m_layers.resize(m_scenario.layers);
+    for (int i = 0; i < m_layers.size(); i++) {
+        Layer &layer = m_layers[i];
+        layer.rect = QRectF(32 + i * 472, 32, 448, 252);
+        for (int slot = 0; slot < RingSize; slot++) {
+            layer.ring[slot] = createBuffer(layer.rect);
+            if (!layer.ring[slot])
+                return false;
+            layer.fds[slot] = gbm_bo_get_fd(layer.ring[slot]);
+        }
+        showLayer(i, true);
+    }
+
+    return true;
+}
+
+gbm_bo *FlipBenchmark::createBuffer(const QRectF &rect)
+{
+    UncountedScope uncounted;
+    gbm_bo *bo = gbm_bo_create(m_gbmDevice, uint32_t(rect.width()), uint32_t(rect.height()),
+                               GBM_FORMAT_XRGB8888, GBM_BO_USE_SCANOUT | GBM_BO_USE_RENDERING);
+    if (!bo)
+        qWarning("Cannot create a buffer object");
+    return bo;
+}
+
+void FlipBenchmark::showLayer(int index, bool visible)
+{
+    Layer &layer = m_layers[index];
+    layer.visible = visible;
+
+    // The geometry comes with a buffer object the plugin takes over
+    if (visible)
+        m_setOverlayBufferObject(m_windows.first()->screen(), createBuffer(layer.rect), layer.rect, index);
+    else
+        m_setOverlayBufferObject(m_windows.first()->screen(), nullptr, QRectF(), index);
+}
+
+void FlipBenchmark::submitLayers()
+{
+    const int slot = m_frame % RingSize;
+    for (int i = 0; i < m_layers.size(); i++) {
+        const Layer &layer = m_layers.at(i);
+        if (!layer.visible)
+            continue;
+
+        gbm_bo *bo = layer.ring[slot];
+        WebOSKmsDmaBufDescriptor descriptor;
+        descriptor.width = gbm_bo_get_width(bo);
+        descriptor.height = gbm_bo_get_height(bo);
+        descriptor.format = gbm_bo_get_format(bo);
+        descriptor.modifier = DRM_FORMAT_MOD_INVALID;
+        descriptor.planeCount = 1;
+        descriptor.fds[0] = layer.fds[slot];
+        descriptor.offsets[0] = gbm_bo_get_offset(bo, 0);
+        descriptor.pitches[0] = gbm_bo_get_stride(bo);
+        m_setLayerDmaBuf(m_windows.first()->screen(), i, &descriptor, 0);
+    }
+}
+#endif
+
+void FlipBenchmark::toggle()
+{
+    if (m_setScreenVisible) {
+        // The application policy turns the other screen off
+        m_current = (m_current + 1) % m_windows.size();
+        m_setScreenVisible(m_windows.at(m_current)->screen(), true, QStringLiteral("application"));
+        return;
+    }
+
+#ifdef PLANE_COMPOSITION
+    if (!m_layers.isEmpty())
+        showLayer(0, !m_layers.first().visible);
+#endif
+}
+
+QRect FlipBenchmark::damageRect() const
+{
+    // 256x256 going round the screen, 4 px per frame
+    const QSize size = m_windows.at(m_current)->size();
+    const int x = (m_frame * 4) % qMax(1, size.width() - 256);
+    const int y = (m_frame * 4 / qMax(1, size.width() - 256) * 64) % qMax(1, size.height() - 256);
+    return QRect(x, y, 256, 256);
+}
+
+void FlipBenchmark::frame()
+{
+    if (m_scenario.toggleInterval && m_frame && m_frame % m_scenario.toggleInterval == 0)
+        toggle();
+
+#ifdef PLANE_COMPOSITION
+    submitLayers();
+#endif
+
+    QWindow *window = m_windows.at(m_current);
+    m_context.makeCurrent(window);
+    QOpenGLFunctions *functions = m_context.functions();
+
+    if (m_scenario.damage) {
+        const QRect rect = damageRect();
+#ifdef PARTIAL_UPDATE
+#ifdef MINIMAL_UPDATE
+        m_context.handle()->updateDamageRegion(window->handle(), QList<QRectF>() << QRectF(rect));
+#else
+        m_context.handle()->updateDamageRegion(window->handle(), QRectF(rect));
+#endif
+#endif
+        functions->glEnable(GL_SCISSOR_TEST);
+        functions->glScissor(rect.x(), window->height() - rect.y() - rect.height(), rect.width(), rect.height());
+    }
+
+    const float shade = (m_frame % 16) / 16.0f;
+    functions->glClearColor(shade, shade, shade, 1.0f);
+    functions->glClear(GL_COLOR_BUFFER_BIT);
+
+    if (m_scenario.damage)
+        functions->glDisable(GL_SCISSOR_TEST);
+
+    m_context.swapBuffers(window);
+    m_frame++;
+}
+
+QJsonObject FlipBenchmark::measure(int frames)
+{
+    fakedrm_reset_stats();
+    s_allocations.store(0);
+
+    QElapsedTimer timer;
+    timer.start();
+    const qint64 threadStart = cpuTime(CLOCK_THREAD_CPUTIME_ID);
+    const qint64 processStart = cpuTime(CLOCK_PROCESS_CPUTIME_ID);
+    s_countAllocations.store(true);
+
+    for (int i = 0; i < frames; i++)
+        frame();
+
+    s_countAllocations.store(false);
+    const qint64 threadNsecs = cpuTime(CLOCK_THREAD_CPUTIME_ID) - threadStart;
+    const qint64 processNsecs = cpuTime(CLOCK_PROCESS_CPUTIME_ID) - processStart;
+    const qint64 wallNsecs = timer.nsecsElapsed();
+
+    FakeDrmStats stats;
+    fakedrm_stats(&stats);
+
+    const double divisor = frames;
+    QJsonObject result;
+    result.insert(QStringLiteral("scenario"), QLatin1String(m_scenario.name));
+    result.insert(QStringLiteral("integration"), QLatin1String(m_scenario.integration));
+    result.insert(QStringLiteral("layers"), m_scenario.layers);
+    result.insert(QStringLiteral("toggle_interval"), m_scenario.toggleInterval);
+    result.insert(QStringLiteral("damage"), m_scenario.damage);
+    result.insert(QStringLiteral("frames"), frames);
+    result.insert(QStringLiteral("ns_per_frame"), threadNsecs / divisor);
+    result.insert(QStringLiteral("process_cpu_ns_per_frame"), processNsecs / divisor);
+    result.insert(QStringLiteral("wall_ns_per_frame"), wallNsecs / divisor);
+    result.insert(QStringLiteral("allocs_per_frame"), double(s_allocations.load()) / divisor);
+    result.insert(QStringLiteral("ioctls_per_frame"), double(stats.ioctls) / divisor);
+    result.insert(QStringLiteral("commits_per_frame"), double(stats.atomicCommits) / divisor);
+    result.insert(QStringLiteral("test_commits_per_frame"), double(stats.testCommits) / divisor);
+    result.insert(QStringLiteral("properties_per_frame"), double(stats.propertiesWritten) / divisor);
+    result.insert(QStringLiteral("framebuffers_added_per_frame"), double(stats.framebuffersAdded) / divisor);
+    result.insert(QStringLiteral("damage_rects_per_frame"), double(stats.damageRects) / divisor);
+    result.insert(QStringLiteral("flip_events"), double(stats.flipEvents));
+    result.insert(QStringLiteral("vblanks"), double(stats.vblanks));
+    result.insert(QStringLiteral("busy_commits"), double(stats.busyCommits));
+    result.insert(QStringLiteral("rejected_commits"), double(stats.rejectedCommits));
+    return result;
+}
+
+static int runScenario(int argc, char **argv, const Scenario &scenario, int frames)
+{
+    QTemporaryDir runtimeDir;
+    if (!runtimeDir.isValid() || !setUp(scenario, runtimeDir))
+        return 1;
+
+    QGuiApplication app(argc, argv);
+
+    QJsonObject result;
+    {
+        FlipBenchmark benchmark(scenario);
+        if (!benchmark.initialize())
+            return 1;
+
+        for (int i = 0; i < WarmUpFrames; i++)
+            benchmark.frame();
+
+        result = benchmark.measure(frames);
+    }
+
+    // The last line of stdout, the plugins log to stderr
+    printf("%s\n", QJsonDocument(result).toJson(QJsonDocument::Compact).constData());
+    return 0;
+}
+
+static int runAll(const QStringList &names, int frames, const QString &outputPath)
+{
+    for (const QString &name : names) {
+        if (!findScenario(name.toLatin1()))
+            qWarning("Unknown scenario %s", qPrintable(name));
+    }
+
+    QJsonArray results;
+    int failures = 0;
+    for (const Scenario &scenario : scenarios) {
+        if (!names.isEmpty() && !names.contains(QLatin1String(scenario.name)))
+            continue;
+
+        QProcess child;
+        child.setProcessChannelMode(QProcess::ForwardedErrorChannel);
+        child.start(QCoreApplication::applicationFilePath(),
+                    QStringList() << QStringLiteral("--run") << QLatin1String(scenario.name)
+                                  << QStringLiteral("--frames") << QString::number(frames));
+        if (!child.waitForFinished(-1) || child.exitStatus() != QProcess::NormalExit || child.exitCode() != 0) {
+            qWarning("Scenario %s failed", scenario.name);
+            failures++;
+            continue;
+        }
+
+        const QJsonDocument document = QJsonDocument::fromJson(child.readAllStandardOutput().trimmed().split('\n').last());
+        if (!document.isObject()) {
+            qWarning("Scenario %s gave no result", scenario.name);
+            failures++;
+            continue;
+        }
+
+        const QJsonObject result = document.object();
+        qInfo("%-20s %10.0f ns/frame %6.2f allocs/frame %6.2f ioctls/frame", scenario.name,
+              result.value(QStringLiteral("ns_per_frame")).toDouble(),
+              result.value(QStringLiteral("allocs_per_frame")).toDouble(),
+              result.value(QStringLiteral("ioctls_per_frame")).toDouble());
+        results.append(result);
+    }
+
+    QJsonObject report;
+    report.insert(QStringLiteral("benchmark"), QStringLiteral("flip"));
+    report.insert(QStringLiteral("frames"), frames);
+    report.insert(QStringLiteral("results"), results);
+    const QByteArray json = QJsonDocument(report).toJson();
+
+    if (outputPath.isEmpty()) {
+        fwrite(json.constData(), 1, size_t(json.size()), stdout);
+    } else {
+        QFile file(outputPath);
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate) || file.write(json) != json.size()) {
+            qWarning("Cannot write %s", qPrintable(outputPath));
+            return 1;
+        }
+    }
+
+    return failures ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+    int frames = DefaultFrames;
+    QString outputPath = qEnvironmentVariable("WEBOS_BENCH_OUTPUT");
+    QByteArray run;
+    QStringList names;
+
+    for (int i = 1; i < argc; i++) {
+        const QByteArray arg(argv[i]);
+        if (arg == "--frames" && i + 1 < argc)
+            frames = atoi(argv[++i]);
+        else if (arg == "--output" && i + 1 < argc)
+            outputPath = QString::fromLocal8Bit(argv[++i]);
+        else if (arg == "--run" && i + 1 < argc)
+            run = argv[++i];
+        else
+            names.append(QString::fromLocal8Bit(arg));
+    }
+
+    if (frames <= 0)
+        frames = DefaultFrames;
+
+    if (!run.isEmpty()) {
+        const Scenario *scenario = findScenario(run);
+        if (!scenario) {
+            qWarning("Unknown scenario %s", run.constData());
+            return 1;
+        }
+        return runScenario(argc, argv, *scenario, frames);
+    }
+
+    QCoreApplication app(argc, argv);
+    return runAll(names, frames, outputPath);
+}
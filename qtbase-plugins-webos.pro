@@ -18,3 +18,10 @@ TEMPLATE = subdirs
 
 CONFIG += ordered
 SUBDIRS += src
+
+# Opt-in with CONFIG+=webos_tests, they run on the build host
+# and the benchmarks need libfakedrm of tests/
+webos_tests:!cross_compile {
+    SUBDIRS += tests benchmarks
+}
+
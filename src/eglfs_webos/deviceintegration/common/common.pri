@@ -0,0 +1,39 @@
+# Copyright (c) 2024 LG Electronics, Inc.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+# http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# SPDX-License-Identifier: Apache-2.0
+
+include($$PWD/config.pri)
+
+SOURCES += \
+        $$PWD/weboskmsatomicstate.cpp \
+        $$PWD/weboskmscallstats.cpp \
+        $$PWD/weboskmscursorplane.cpp \
+        $$PWD/weboskmsfence.cpp \
+        $$PWD/weboskmsflipcost.cpp \
+        $$PWD/weboskmsformats.cpp \
+        $$PWD/weboskmshotplug.cpp \
+        $$PWD/weboskmsvariablerefresh.cpp
+
+HEADERS += \
+        $$PWD/weboskmsatomicstate.h \
+        $$PWD/weboskmscallstats.h \
+        $$PWD/weboskmscursorplane.h \
+        $$PWD/weboskmsfence.h \
+        $$PWD/weboskmsflipcost.h \
+        $$PWD/weboskmsformats.h \
+        $$PWD/weboskmshotplug.h \
+        $$PWD/weboskmsvariablerefresh.h
+
+INCLUDEPATH += $$PWD
@@ -0,0 +1,335 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include <string.h>
+#include <sys/stat.h>
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDebug>
+#include <QFile>
+#include <QFileInfo>
+#include <QGlobalStatic>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+
+#include "weboseglfsconfig.h"
+
+static const quint32 CacheMagic = 0x57454346; // "WECF"
+static const quint32 CacheVersion = 4;
+// Magic and versions, then modification and change time, device, inode
+// and size of the JSON file
+static const int VersionSize = 12;
+static const int StampSize = 52;
+static const int HashSize = 20;
+
+Q_GLOBAL_STATIC(WebOSEglFSConfig, eglfsConfig)
+
+const WebOSEglFSConfig &WebOSEglFSConfig::instance()
+{
+    return *eglfsConfig();
+}
+
+QMap<QString, QVariantMap> WebOSEglFSDeviceConfig::outputSettings() const
+{
+    QMap<QString, QVariantMap> settings;
+    for (const WebOSEglFSOutputConfig &output : outputs) {
+        if (output.name.isEmpty())
+            continue;
+
+        // Absent and default values read the same, except for "mode"
+        QVariantMap values = output.settings;
+        values.insert(QStringLiteral("name"), output.name);
+        if (output.primary)
+            values.insert(QStringLiteral("primary"), true);
+        if (output.useMultiPlanes)
+            values.insert(QStringLiteral("useMultiPlanes"), true);
+        if (!output.geometry.isEmpty())
+            values.insert(QStringLiteral("geometry"), output.geometry);
+        if (!output.format.isEmpty())
+            values.insert(QStringLiteral("format"), output.format);
+        if (!output.touchDevice.isEmpty())
+            values.insert(QStringLiteral("touchDevice"), output.touchDevice);
+        if (!output.keyboardDevice.isEmpty())
+            values.insert(QStringLiteral("keyboardDevice"), output.keyboardDevice);
+        if (!output.vrr.isEmpty())
+            values.insert(QStringLiteral("vrr"), output.vrr);
+        if (output.virtualOutput)
+            values.insert(QStringLiteral("virtual"), true);
+        if (!output.mode.isEmpty())
+            values.insert(QStringLiteral("mode"), output.mode);
+        settings.insert(output.name, values);
+    }
+    return settings;
+}
+
+// The change time and inode catch a file replaced by a rename or
+// written with its modification time restored, same size or not
+static QByteArray cacheStamp(const struct stat *st)
+{
+    qint64 modified = 0;
+    qint64 changed = 0;
+    quint64 device = 0;
+    quint64 inode = 0;
+    qint64 size = 0;
+    if (st) {
+        modified = qint64(st->st_mtim.tv_sec) * 1000000000 + st->st_mtim.tv_nsec;
+        changed = qint64(st->st_ctim.tv_sec) * 1000000000 + st->st_ctim.tv_nsec;
+        device = quint64(st->st_dev);
+        inode = quint64(st->st_ino);
+        size = qint64(st->st_size);
+    }
+
+    QByteArray stamp;
+    QDataStream stream(&stamp, QIODevice::WriteOnly);
+    stream << CacheMagic << CacheVersion << quint32(QT_VERSION) << modified << changed << device << inode << size;
+    Q_ASSERT(stamp.size() == StampSize);
+    return stamp;
+}
+
+WebOSEglFSConfig::WebOSEglFSConfig()
+{
+    const QString path = qEnvironmentVariable("QT_QPA_EGLFS_CONFIG");
+    if (path.isEmpty()) {
+        qWarning("No config file given");
+        return;
+    }
+
+    const QFileInfo info(path);
+    struct stat st;
+    const bool hasStamp = stat(QFile::encodeName(path).constData(), &st) == 0;
+    const QByteArray stamp = cacheStamp(hasStamp ? &st : nullptr);
+
+    QString cachePath;
+    const QString runtimeDir = qEnvironmentVariable("XDG_RUNTIME_DIR");
+    if (!runtimeDir.isEmpty() && hasStamp) {
+        const QByteArray pathHash = QCryptographicHash::hash(info.absoluteFilePath().toUtf8(), QCryptographicHash::Sha1);
+        cachePath = runtimeDir + QStringLiteral("/qt-eglfs-config-")
+            + QString::fromLatin1(pathHash.toHex().left(16)) + QStringLiteral(".cache");
+    }
+
+    if (!cachePath.isEmpty() && loadCache(cachePath, stamp, QByteArray())) {
+        qInfo() << "Using config file" << path << "from cache" << cachePath;
+        return;
+    }
+
+    QFile file(path);
+    if (!file.open(QFile::ReadOnly)) {
+        qWarning() << "Could not open config file" << path << "for reading";
+        return;
+    }
+    const QByteArray json = file.readAll();
+    file.close();
+
+    const QByteArray hash = QCryptographicHash::hash(json, QCryptographicHash::Sha1);
+    Q_ASSERT(hash.size() == HashSize);
+
+    // Touched but not changed, e.g. installed again by an update
+    if (!cachePath.isEmpty() && loadCache(cachePath, QByteArray(), hash)) {
+        qInfo() << "Using config file" << path << "from cache" << cachePath;
+        saveCache(cachePath, stamp, hash);
+        return;
+    }
+
+    if (!parse(json)) {
+        qWarning() << "Invalid config file" << path << "- no top-level JSON array";
+        return;
+    }
+    qInfo() << "Using config file" << path;
+
+    if (!cachePath.isEmpty())
+        saveCache(cachePath, stamp, hash);
+}
+
+const WebOSEglFSOutputConfig *WebOSEglFSConfig::output(const QString &name) const
+{
+    auto it = m_outputs.constFind(name);
+    if (it == m_outputs.constEnd())
+        return nullptr;
+    return &m_devices.at(it->first).outputs.at(it->second);
+}
+
+bool WebOSEglFSConfig::hasVirtualOutputs() const
+{
+    for (const WebOSEglFSDeviceConfig &device : m_devices) {
+        for (const WebOSEglFSOutputConfig &output : device.outputs) {
+            if (output.virtualOutput)
+                return true;
+        }
+    }
+    return false;
+}
+
+bool WebOSEglFSConfig::parse(const QByteArray &json)
+{
+    const QJsonDocument doc = QJsonDocument::fromJson(json);
+    if (!doc.isArray())
+        return false;
+
+    const QJsonArray devices = doc.array();
+    for (int i = 0; i < devices.size(); i++) {
+        const QJsonObject object = devices.at(i).toObject();
+
+        WebOSEglFSDeviceConfig device;
+        device.device = object.value(QLatin1String("device")).toString();
+        device.hasHwCursor = object.contains(QLatin1String("hwcursor"));
+        device.hwCursor = object.value(QLatin1String("hwcursor")).toBool();
+        device.connector = object.value(QLatin1String("connector")).toObject().toVariantMap();
+
+        const QJsonArray outputs = object.value(QLatin1String("outputs")).toArray();
+        for (int j = 0; j < outputs.size(); j++) {
+            const QJsonObject settings = outputs.at(j).toObject();
+
+            WebOSEglFSOutputConfig output;
+            output.name = settings.value(QLatin1String("name")).toString();
+            output.primary = settings.value(QLatin1String("primary")).toBool();
+            output.useMultiPlanes = settings.value(QLatin1String("useMultiPlanes")).toBool();
+            output.geometry = settings.value(QLatin1String("geometry")).toString();
+            output.format = settings.value(QLatin1String("format")).toString();
+            output.touchDevice = settings.value(QLatin1String("touchDevice")).toString();
+            output.keyboardDevice = settings.value(QLatin1String("keyboardDevice")).toString();
+            output.vrr = settings.value(QLatin1String("vrr")).toString();
+            output.virtualOutput = settings.value(QLatin1String("virtual")).toBool();
+            output.mode = settings.value(QLatin1String("mode")).toString();
+
+            // outputSettings() adds the keys above back
+            static const char *const fields[] = {
+                "name", "primary", "useMultiPlanes", "geometry", "format", "touchDevice",
+                "keyboardDevice", "vrr", "virtual", "mode"
+            };
+            for (auto it = settings.constBegin(); it != settings.constEnd(); ++it) {
+                bool field = false;
+                for (const char *name : fields)
+                    field = field || it.key() == QLatin1String(name);
+                if (!field)
+                    output.settings.insert(it.key(), it.value().toVariant());
+            }
+            device.outputs.append(output);
+        }
+
+        m_devices.append(device);
+    }
+
+    buildIndex();
+    return true;
+}
+
+bool WebOSEglFSConfig::loadCache(const QString &path, const QByteArray &stamp, const QByteArray &hash)
+{
+    const int headerSize = StampSize + HashSize;
+
+    QFile file(path);
+    if (!file.open(QFile::ReadOnly) || file.size() <= headerSize)
+        return false;
+
+    const uchar *data = file.map(0, file.size());
+    if (!data)
+        return false;
+
+    bool matches = stamp.size() == StampSize
+        ? memcmp(data, stamp.constData(), StampSize) == 0
+        : hash.size() == HashSize && memcmp(data + StampSize, hash.constData(), HashSize) == 0;
+    // A cache of another version may have the same content hash
+    if (matches && stamp.isEmpty())
+        matches = memcmp(data, cacheStamp(nullptr).constData(), VersionSize) == 0;
+
+    bool loaded = false;
+    if (matches) {
+        // Reads the mapping in place, without copying the cache
+        const QByteArray payload = QByteArray::fromRawData(reinterpret_cast<const char *>(data) + headerSize,
+                                                           int(file.size() - headerSize));
+        QDataStream stream(payload);
+        stream.setVersion(QDataStream::Qt_5_12);
+        stream >> m_devices;
+        loaded = stream.status() == QDataStream::Ok;
+    }
+
+    // The model owns its strings, the mapping can go
+    file.unmap(const_cast<uchar *>(data));
+
+    if (!loaded) {
+        m_devices.clear();
+        return false;
+    }
+
+    buildIndex();
+    return true;
+}
+
+void WebOSEglFSConfig::saveCache(const QString &path, const QByteArray &stamp, const QByteArray &hash) const
+{
+    // Replaced atomically, other processes may be reading the old one
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "Could not write config cache" << path;
+        return;
+    }
+
+    file.write(stamp);
+    file.write(hash);
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_12);
+    stream << m_devices;
+
+    if (stream.status() != QDataStream::Ok || !file.commit())
+        qWarning() << "Could not write config cache" << path;
+}
+
+void WebOSEglFSConfig::buildIndex()
+{
+    m_outputs.clear();
+    for (int i = 0; i < m_devices.size(); i++) {
+        const QVector<WebOSEglFSOutputConfig> &outputs = m_devices.at(i).outputs;
+        for (int j = 0; j < outputs.size(); j++) {
+            const QString &name = outputs.at(j).name;
+            if (name.isEmpty())
+                continue;
+            if (m_outputs.contains(name))
+                qWarning() << "Output" << name << "is duplicated";
+            m_outputs.insert(name, qMakePair(i, j));
+        }
+    }
+}
+
+QDataStream &operator<<(QDataStream &stream, const WebOSEglFSOutputConfig &output)
+{
+    return stream << output.name << output.primary << output.useMultiPlanes
+                  << output.geometry << output.format << output.touchDevice
+                  << output.keyboardDevice << output.vrr << output.virtualOutput
+                  << output.mode << output.settings;
+}
+
+QDataStream &operator>>(QDataStream &stream, WebOSEglFSOutputConfig &output)
+{
+    return stream >> output.name >> output.primary >> output.useMultiPlanes
+                  >> output.geometry >> output.format >> output.touchDevice
+                  >> output.keyboardDevice >> output.vrr >> output.virtualOutput
+                  >> output.mode >> output.settings;
+}
+
+QDataStream &operator<<(QDataStream &stream, const WebOSEglFSDeviceConfig &device)
+{
+    return stream << device.device << device.hasHwCursor << device.hwCursor
+                  << device.connector << device.outputs;
+}
+
+QDataStream &operator>>(QDataStream &stream, WebOSEglFSDeviceConfig &device)
+{
+    return stream >> device.device >> device.hasHwCursor >> device.hwCursor
+                  >> device.connector >> device.outputs;
+}
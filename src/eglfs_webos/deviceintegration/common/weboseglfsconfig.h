@@ -0,0 +1,93 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef WEBOSEGLFSCONFIG_H
+#define WEBOSEGLFSCONFIG_H
+
+#include <QHash>
+#include <QMap>
+#include <QPair>
+#include <QString>
+#include <QVariantMap>
+#include <QVector>
+
+class QDataStream;
+
+struct WebOSEglFSOutputConfig {
+    QString name;
+    bool primary = false;
+    bool useMultiPlanes = false;
+    QString geometry;
+    QString format;
+    QString touchDevice;
+    QString keyboardDevice;
+    QString vrr;
+    // Rendered off screen, "mode" is WIDTHxHEIGHT[@RATE]
+    bool virtualOutput = false;
+    QString mode;
+    // Keys of the output without a field above
+    QVariantMap settings;
+};
+
+struct WebOSEglFSDeviceConfig {
+    QString device;
+    bool hasHwCursor = false;
+    bool hwCursor = false;
+    QVariantMap connector;
+    QVector<WebOSEglFSOutputConfig> outputs;
+
+    // Every key of every output, as QKmsScreenConfig::outputSettings() has it
+    QMap<QString, QVariantMap> outputSettings() const;
+};
+
+// The QT_QPA_EGLFS_CONFIG file, parsed once per plugin. The parsed model
+// is cached in a binary file in the runtime directory, keyed by the
+// modification and change time, inode and size of the JSON file, so that
+// the boot path maps the cache without reading JSON. The content hash is
+// only checked when those differ.
+class WebOSEglFSConfig
+{
+public:
+    static const WebOSEglFSConfig &instance();
+
+    bool isEmpty() const { return m_devices.isEmpty(); }
+    const QVector<WebOSEglFSDeviceConfig> &devices() const { return m_devices; }
+    // The device the KMS integrations drive, nullptr without a config
+    const WebOSEglFSDeviceConfig *device() const { return m_devices.isEmpty() ? nullptr : &m_devices.first(); }
+    // Output of any device by name, nullptr if it is not configured
+    const WebOSEglFSOutputConfig *output(const QString &name) const;
+    bool hasVirtualOutputs() const;
+
+    WebOSEglFSConfig();
+
+private:
+    bool parse(const QByteArray &json);
+    // Matches either the stamp or the content hash, whichever is given
+    bool loadCache(const QString &path, const QByteArray &stamp, const QByteArray &hash);
+    void saveCache(const QString &path, const QByteArray &stamp, const QByteArray &hash) const;
+    void buildIndex();
+
+    QVector<WebOSEglFSDeviceConfig> m_devices;
+    // Name to device and output index
+    QHash<QString, QPair<int, int>> m_outputs;
+};
+
+QDataStream &operator<<(QDataStream &stream, const WebOSEglFSOutputConfig &output);
+QDataStream &operator>>(QDataStream &stream, WebOSEglFSOutputConfig &output);
+QDataStream &operator<<(QDataStream &stream, const WebOSEglFSDeviceConfig &device);
+QDataStream &operator>>(QDataStream &stream, WebOSEglFSDeviceConfig &device);
+
+#endif
@@ -0,0 +1,74 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+#include "weboskmsatomicstate.h"
+#include "weboskmscallstats.h"
+
+void WebOSKmsAtomicState::begin()
+{
+    if (m_invalid.fetchAndStoreAcquire(0))
+        m_values.clear();
+
+    m_written = 0;
+}
+
+void WebOSKmsAtomicState::add(drmModeAtomicReq *request, uint32_t object, uint32_t property, uint64_t value)
+{
+    // Not supported by the plane
+    if (!property)
+        return;
+
+    auto it = m_values.find(key(object, property));
+    if (it != m_values.end() && it.value() == value) {
+        m_statistics.skipped.fetchAndAddRelaxed(1);
+        WebOSKmsCallStats::count(WebOSKmsCallStats::PropertySkipped);
+        return;
+    }
+
+    if (drmModeAtomicAddProperty(request, object, property, value) < 0)
+        return;
+
+    if (it != m_values.end())
+        it.value() = value;
+    else
+        m_values.insert(key(object, property), value);
+    m_written++;
+    WebOSKmsCallStats::count(WebOSKmsCallStats::PropertyWritten);
+}
+
+void WebOSKmsAtomicState::end(bool committed)
+{
+    if (!committed)
+        m_values.clear();
+
+    m_statistics.commits.fetchAndAddRelaxed(1);
+    m_statistics.written.fetchAndAddRelaxed(m_written);
+    m_statistics.lastWritten.storeRelaxed(m_written);
+    if (m_written > m_statistics.peakWritten.loadRelaxed())
+        m_statistics.peakWritten.storeRelaxed(m_written);
+}
+
+void WebOSKmsAtomicState::forget(uint32_t object)
+{
+    auto it = m_values.begin();
+    while (it != m_values.end()) {
+        if (uint32_t(it.key() >> 32) == object)
+            it = m_values.erase(it);
+        else
+            ++it;
+    }
+}
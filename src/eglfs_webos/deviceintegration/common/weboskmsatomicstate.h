@@ -0,0 +1,67 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+#ifndef WEBOSKMSATOMICSTATE_H
+#define WEBOSKMSATOMICSTATE_H
+
+#include <QAtomicInt>
+#include <QAtomicInteger>
+#include <QHash>
+
+#include <xf86drmMode.h>
+
+// Property values of the last atomic commits of a screen.
+// A property left out of a commit keeps its value in the kernel, so only
+// properties that changed since the last commit are added to a request.
+// Apart from invalidate() it is used from one thread at a time.
+class WebOSKmsAtomicState
+{
+public:
+    // Written by the committing thread, read from any
+    struct Statistics {
+        QAtomicInteger<quint64> commits;
+        QAtomicInteger<quint64> written;
+        QAtomicInteger<quint64> skipped;
+        // Properties added to the last request
+        QAtomicInteger<quint32> lastWritten;
+        QAtomicInteger<quint32> peakWritten;
+    };
+
+    // Starts a new request
+    void begin();
+    // Adds the property to the request unless it already has the value
+    void add(drmModeAtomicReq *request, uint32_t object, uint32_t property, uint64_t value);
+    // A rejected request leaves the kernel state unknown to us
+    void end(bool committed);
+
+    // Written again on the next request, e.g. after a plane was turned off
+    void forget(uint32_t object);
+    // Safe from any thread, applies from the next begin()
+    void invalidate() { m_invalid.storeRelease(1); }
+
+    const Statistics *statistics() const { return &m_statistics; }
+
+private:
+    static quint64 key(uint32_t object, uint32_t property) { return (quint64(object) << 32) | property; }
+
+    QHash<quint64, uint64_t> m_values;
+    QAtomicInt m_invalid { 0 };
+    uint32_t m_written = 0;
+    Statistics m_statistics;
+};
+
+#endif
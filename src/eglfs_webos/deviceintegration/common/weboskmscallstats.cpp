@@ -0,0 +1,63 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+#include <QAtomicInteger>
+
+#include "weboskmscallstats.h"
+
+static QAtomicInteger<quint64> s_counts[WebOSKmsCallStats::CallCount];
+static thread_local quint64 t_ioctls = 0;
+
+static const char *callName(int call)
+{
+    switch (call) {
+    case WebOSKmsCallStats::AtomicCommit: return "atomic_commit";
+    case WebOSKmsCallStats::AtomicTestCommit: return "atomic_test_commit";
+    case WebOSKmsCallStats::PageFlip: return "page_flip";
+    case WebOSKmsCallStats::PropertyWritten: return "property_written";
+    case WebOSKmsCallStats::PropertySkipped: return "property_skipped";
+    case WebOSKmsCallStats::LegacyModeset: return "legacy_modeset";
+    case WebOSKmsCallStats::AddFramebuffer: return "add_framebuffer";
+    case WebOSKmsCallStats::RemoveFramebuffer: return "remove_framebuffer";
+    case WebOSKmsCallStats::PrimeImport: return "prime_import";
+    case WebOSKmsCallStats::GemClose: return "gem_close";
+    }
+    return "unknown";
+}
+
+void WebOSKmsCallStats::count(Call call, quint32 n)
+{
+    s_counts[call].fetchAndAddRelaxed(n);
+    if (call != PropertyWritten && call != PropertySkipped)
+        t_ioctls += n;
+}
+
+quint64 WebOSKmsCallStats::value(Call call)
+{
+    return s_counts[call].loadAcquire();
+}
+
+quint64 WebOSKmsCallStats::threadIoctls()
+{
+    return t_ioctls;
+}
+
+void WebOSKmsCallStats::dump(QByteArray *out)
+{
+    for (int i = 0; i < CallCount; i++)
+        out->append(callName(i)).append(' ').append(QByteArray::number(s_counts[i].loadAcquire())).append('\n');
+}
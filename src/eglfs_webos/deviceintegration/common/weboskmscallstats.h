@@ -0,0 +1,54 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+#ifndef WEBOSKMSCALLSTATS_H
+#define WEBOSKMSCALLSTATS_H
+
+#include <QByteArray>
+
+// Process wide counters of the DRM calls made by the plugin. Counting
+// is a relaxed atomic add, so it stays enabled on the flip path. Paired
+// with virtual outputs, it lets the cost of a frame be compared between
+// builds without a display attached.
+class WebOSKmsCallStats
+{
+public:
+    enum Call : quint8 {
+        AtomicCommit,
+        AtomicTestCommit,
+        PageFlip,
+        PropertyWritten,
+        PropertySkipped,
+        LegacyModeset,
+        AddFramebuffer,
+        RemoveFramebuffer,
+        PrimeImport,
+        GemClose,
+        CallCount
+    };
+
+    static void count(Call call, quint32 n = 1);
+    static quint64 value(Call call);
+    // Calls made by the current thread that enter the kernel,
+    // property writes only fill in a request
+    static quint64 threadIoctls();
+
+    // One "name count" line per call
+    static void dump(QByteArray *out);
+};
+
+#endif
@@ -0,0 +1,432 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+#include <QDebug>
+#include <QPainter>
+#include <QThread>
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <drm_fourcc.h>
+#include <gbm.h>
+#include <xf86drm.h>
+
+#include <private/qkmsdevice_p.h>
+
+#include "weboskmscursorplane.h"
+#include "weboskmsatomicstate.h"
+#include "weboskmscallstats.h"
+#include "weboskmsfence.h"
+
+class WebOSKmsCursorPlane::CommitThread : public QThread
+{
+public:
+    explicit CommitThread(WebOSKmsCursorPlane *plane)
+        : m_plane(plane)
+    {
+        setObjectName(QStringLiteral("WebOSKmsCursorCommit"));
+    }
+
+protected:
+    void run() override { m_plane->run(); }
+
+private:
+    WebOSKmsCursorPlane *m_plane = nullptr;
+};
+
+WebOSKmsCursorPlane::~WebOSKmsCursorPlane()
+{
+    stop();
+    if (m_thread)
+        m_thread->wait();
+
+    if (m_request)
+        drmModeAtomicFree(m_request);
+    if (m_commitFence >= 0)
+        close(m_commitFence);
+
+    for (int i = 0; i < 3; i++) {
+        if (m_framebuffers[i]) {
+            drmModeRmFB(m_drmFd, m_framebuffers[i]);
+            WebOSKmsCallStats::count(WebOSKmsCallStats::RemoveFramebuffer);
+        }
+        if (m_bos[i])
+            gbm_bo_destroy(m_bos[i]);
+    }
+}
+
+static uint32_t findCrtcPropertyId(int drmFd, uint32_t crtcId, const char *name)
+{
+    drmModeObjectPropertiesPtr objProps = drmModeObjectGetProperties(drmFd, crtcId, DRM_MODE_OBJECT_CRTC);
+    if (!objProps)
+        return 0;
+
+    uint32_t propertyId = 0;
+    for (uint32_t i = 0; i < objProps->count_props && !propertyId; i++) {
+        drmModePropertyPtr prop = drmModeGetProperty(drmFd, objProps->props[i]);
+        if (!prop)
+            continue;
+
+        if (!strcmp(prop->name, name))
+            propertyId = prop->prop_id;
+        drmModeFreeProperty(prop);
+    }
+
+    drmModeFreeObjectProperties(objProps);
+    return propertyId;
+}
+
+const QKmsPlane *WebOSKmsCursorPlane::findPlane(const QKmsOutput &output)
+{
+    if (output.crtc_index > 31)
+        return nullptr;
+
+    const uint32_t crtcBit = 1U << output.crtc_index;
+    const QKmsPlane *found = nullptr;
+    for (const QKmsPlane &plane : output.available_planes) {
+        if (plane.type != QKmsPlane::CursorPlane || !(uint32_t(plane.possibleCrtcs) & crtcBit))
+            continue;
+
+        // One that no other CRTC can take first
+        if (uint32_t(plane.possibleCrtcs) == crtcBit)
+            return &plane;
+        if (!found)
+            found = &plane;
+    }
+    return found;
+}
+
+bool WebOSKmsCursorPlane::initialize(int drmFd, gbm_device *gbm, uint32_t crtcId, const QKmsPlane &plane,
+                                     QMutex *commitMutex, WebOSKmsAtomicState *state, qreal refreshRate)
+{
+    if (!gbm || !commitMutex || !state)
+        return false;
+
+    if (!plane.framebufferPropertyId || !plane.crtcPropertyId
+        || !plane.crtcXPropertyId || !plane.crtcYPropertyId) {
+        qWarning() << "Cursor plane" << plane.id << "lacks atomic properties";
+        return false;
+    }
+
+    // Tells when an own commit is done, so a main flip waits no longer
+    const uint32_t outFencePropertyId = findCrtcPropertyId(drmFd, crtcId, "OUT_FENCE_PTR");
+    if (!outFencePropertyId) {
+        qWarning() << "Crtc" << crtcId << "lacks OUT_FENCE_PTR for cursor plane" << plane.id;
+        return false;
+    }
+
+    uint64_t width = 64;
+    uint64_t height = 64;
+    drmGetCap(drmFd, DRM_CAP_CURSOR_WIDTH, &width);
+    drmGetCap(drmFd, DRM_CAP_CURSOR_HEIGHT, &height);
+
+    m_drmFd = drmFd;
+    m_gbm = gbm;
+    m_crtcId = crtcId;
+    m_outFencePropertyId = outFencePropertyId;
+    m_size = QSize(int(width), int(height));
+    m_commitMutex = commitMutex;
+    m_state = state;
+    m_idleInterval = int(2000 / qMax(refreshRate, qreal(1)));
+    m_frameInterval = int(1000 / qMax(refreshRate, qreal(1))) + 1;
+
+    m_properties.framebuffer = plane.framebufferPropertyId;
+    m_properties.crtc = plane.crtcPropertyId;
+    m_properties.srcX = plane.srcXPropertyId;
+    m_properties.srcY = plane.srcYPropertyId;
+    m_properties.srcWidth = plane.srcwidthPropertyId;
+    m_properties.srcHeight = plane.srcheightPropertyId;
+    m_properties.crtcX = plane.crtcXPropertyId;
+    m_properties.crtcY = plane.crtcYPropertyId;
+    m_properties.crtcWidth = plane.crtcwidthPropertyId;
+    m_properties.crtcHeight = plane.crtcheightPropertyId;
+
+    m_flipTimer.start();
+    m_planeId = plane.id;
+
+    qInfo() << "Cursor plane" << m_planeId << "for crtc" << crtcId << "size" << m_size;
+    return true;
+}
+
+bool WebOSKmsCursorPlane::isActive() const
+{
+    QMutexLocker lock(&m_mutex);
+    return m_framebuffer != 0;
+}
+
+bool WebOSKmsCursorPlane::setImage(const QImage &image, const QPoint &hotspot)
+{
+    if (!isInitialized())
+        return false;
+
+    QMutexLocker imageLock(&m_imageMutex);
+
+    int index = -1;
+    {
+        QMutexLocker lock(&m_mutex);
+        // An image not taken by a request yet is replaced, so its buffer
+        // can be written again
+        if (m_framebuffer != m_taken)
+            m_framebuffer = m_taken;
+
+        for (int i = 0; i < 3 && index < 0; i++) {
+            if (!m_framebuffers[i] || (m_framebuffers[i] != m_taken && m_framebuffers[i] != m_previousTaken))
+                index = i;
+        }
+    }
+    Q_ASSERT(index >= 0);
+
+    if (!m_bos[index]) {
+        gbm_bo *bo = gbm_bo_create(m_gbm, m_size.width(), m_size.height(), GBM_FORMAT_ARGB8888,
+                                   GBM_BO_USE_CURSOR | GBM_BO_USE_WRITE);
+        if (!bo) {
+            qWarning() << "Failed to create cursor buffer" << m_size;
+            return false;
+        }
+
+        uint32_t handles[4] = { gbm_bo_get_handle(bo).u32 };
+        uint32_t pitches[4] = { gbm_bo_get_stride(bo) };
+        uint32_t offsets[4] = { 0 };
+        if (drmModeAddFB2(m_drmFd, m_size.width(), m_size.height(), DRM_FORMAT_ARGB8888,
+                          handles, pitches, offsets, &m_framebuffers[index], 0)) {
+            qWarning() << "Failed to add cursor framebuffer" << m_size;
+            gbm_bo_destroy(bo);
+            return false;
+        }
+        WebOSKmsCallStats::count(WebOSKmsCallStats::AddFramebuffer);
+        m_bos[index] = bo;
+    }
+
+    // Cursor buffers are tightly packed, unlike a QImage of the same size
+    QImage cursor(m_size, QImage::Format_ARGB32_Premultiplied);
+    cursor.fill(Qt::transparent);
+    {
+        QPainter painter(&cursor);
+        painter.drawImage(0, 0, image);
+    }
+
+    if (gbm_bo_write(m_bos[index], cursor.constBits(), cursor.bytesPerLine() * cursor.height())) {
+        qWarning() << "Failed to write cursor buffer";
+        return false;
+    }
+
+    QMutexLocker lock(&m_mutex);
+    m_framebuffer = m_framebuffers[index];
+    m_hotspot = hotspot;
+    m_dirty = true;
+
+    // Not needed until a client drives the plane
+    if (!m_thread) {
+        m_thread.reset(new CommitThread(this));
+        m_thread->start();
+    }
+    m_condition.wakeOne();
+    return true;
+}
+
+void WebOSKmsCursorPlane::setPosition(const QPoint &position)
+{
+    QMutexLocker lock(&m_mutex);
+    if (m_position == position)
+        return;
+
+    m_position = position;
+    m_dirty = true;
+    m_condition.wakeOne();
+}
+
+void WebOSKmsCursorPlane::setVisible(bool visible)
+{
+    QMutexLocker lock(&m_mutex);
+    if (m_visible == visible)
+        return;
+
+    m_visible = visible;
+    m_dirty = true;
+    m_condition.wakeOne();
+}
+
+void WebOSKmsCursorPlane::addProperties(drmModeAtomicReq *request, bool mainFlip)
+{
+    if (!isInitialized())
+        return;
+
+    if (mainFlip) {
+        waitForCommit();
+        m_lastMainFlip = m_flipTimer.elapsed();
+    }
+
+    uint32_t framebuffer = 0;
+    QPoint position;
+    bool visible = false;
+    {
+        QMutexLocker lock(&m_mutex);
+        if (!m_dirty)
+            return;
+
+        m_dirty = false;
+        framebuffer = m_framebuffer;
+        position = m_position - m_hotspot;
+        visible = m_visible;
+
+        if (visible && framebuffer && framebuffer != m_taken) {
+            m_previousTaken = m_taken;
+            m_taken = framebuffer;
+        }
+    }
+
+    if (!visible || !framebuffer) {
+        // Everything is written again once it is shown
+        m_state->forget(m_planeId);
+        m_state->add(request, m_planeId, m_properties.framebuffer, 0);
+        m_state->add(request, m_planeId, m_properties.crtc, 0);
+        return;
+    }
+
+    m_state->add(request, m_planeId, m_properties.framebuffer, framebuffer);
+    m_state->add(request, m_planeId, m_properties.crtc, m_crtcId);
+    m_state->add(request, m_planeId, m_properties.srcX, 0);
+    m_state->add(request, m_planeId, m_properties.srcY, 0);
+    m_state->add(request, m_planeId, m_properties.srcWidth, uint64_t(m_size.width()) << 16);
+    m_state->add(request, m_planeId, m_properties.srcHeight, uint64_t(m_size.height()) << 16);
+    // Signed, the pointer may hang off the top left edge
+    m_state->add(request, m_planeId, m_properties.crtcX, uint64_t(qint64(position.x())));
+    m_state->add(request, m_planeId, m_properties.crtcY, uint64_t(qint64(position.y())));
+    m_state->add(request, m_planeId, m_properties.crtcWidth, m_size.width());
+    m_state->add(request, m_planeId, m_properties.crtcHeight, m_size.height());
+}
+
+void WebOSKmsCursorPlane::waitForCommit()
+{
+    // An own commit still queued would make the commit fail with EBUSY
+    if (m_commitFence < 0)
+        return;
+
+    // Signals on the vblank the commit goes out with
+    if (!WebOSKmsFence::wait(m_commitFence, m_frameInterval * 2))
+        qWarning() << "Cursor commit of plane" << m_planeId << "did not complete";
+    close(m_commitFence);
+    m_commitFence = -1;
+}
+
+bool WebOSKmsCursorPlane::commitQueued()
+{
+    if (m_commitFence < 0)
+        return false;
+    if (!WebOSKmsFence::wait(m_commitFence, 0))
+        return true;
+
+    close(m_commitFence);
+    m_commitFence = -1;
+    return false;
+}
+
+void WebOSKmsCursorPlane::stop()
+{
+    QMutexLocker lock(&m_mutex);
+    m_stopped = true;
+    m_condition.wakeOne();
+}
+
+void WebOSKmsCursorPlane::run()
+{
+    QMutexLocker lock(&m_mutex);
+
+    while (!m_stopped) {
+        if (!m_dirty) {
+            m_condition.wait(&m_mutex);
+            continue;
+        }
+
+        lock.unlock();
+        int delay = commit();
+        lock.relock();
+
+        // The UI is flipping, check again whether it took the pointer
+        if (delay > 0 && !m_stopped)
+            m_condition.wait(&m_mutex, delay);
+    }
+}
+
+int WebOSKmsCursorPlane::commit()
+{
+    QMutexLocker lock(m_commitMutex);
+    const qint64 now = m_flipTimer.elapsed();
+
+    // Let the pointer go out with the main plane while the UI is flipping
+    if (m_lastMainFlip >= 0) {
+        const qint64 sinceFlip = now - m_lastMainFlip;
+        if (sinceFlip < m_idleInterval)
+            return int(m_idleInterval - sinceFlip);
+    }
+
+    // The previous commit is queued until the next vblank
+    if (commitQueued())
+        return int(qMax(m_frameInterval - (now - m_lastCommit), qint64(1)));
+
+    if (!m_request)
+        m_request = drmModeAtomicAlloc();
+    if (!m_request)
+        return 0;
+
+    uint32_t taken = 0;
+    uint32_t previousTaken = 0;
+    {
+        QMutexLocker pendingLock(&m_mutex);
+        taken = m_taken;
+        previousTaken = m_previousTaken;
+    }
+
+    drmModeAtomicSetCursor(m_request, 0);
+    m_state->begin();
+    addProperties(m_request, false);
+
+    if (drmModeAtomicGetCursor(m_request) == 0) {
+        m_state->end(true);
+        return 0;
+    }
+
+    // Not through the atomic state, the kernel writes it on every commit
+    m_outFence = -1;
+    drmModeAtomicAddProperty(m_request, m_crtcId, m_outFencePropertyId, uint64_t(uintptr_t(&m_outFence)));
+
+    // Nonblocking, so that a main flip never waits a vblank for the lock
+    int ret = drmModeAtomicCommit(m_drmFd, m_request, DRM_MODE_ATOMIC_NONBLOCK, nullptr);
+    WebOSKmsCallStats::count(WebOSKmsCallStats::AtomicCommit);
+    m_state->end(ret == 0);
+
+    if (ret == 0) {
+        m_commitFence = m_outFence;
+        m_lastCommit = now;
+        return 0;
+    }
+
+    QMutexLocker pendingLock(&m_mutex);
+    m_taken = taken;
+    m_previousTaken = previousTaken;
+
+    // A flip of the screen is still queued, try again next frame
+    if (ret == -EBUSY) {
+        m_dirty = true;
+        return m_frameInterval;
+    }
+
+    qWarning() << "Failed to commit cursor plane" << m_planeId << ret;
+    return 0;
+}
@@ -0,0 +1,141 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+#ifndef WEBOSKMSCURSORPLANE_H
+#define WEBOSKMSCURSORPLANE_H
+
+#include <QElapsedTimer>
+#include <QImage>
+#include <QMutex>
+#include <QPoint>
+#include <QScopedPointer>
+#include <QWaitCondition>
+
+#include <xf86drmMode.h>
+
+struct gbm_bo;
+struct gbm_device;
+struct QKmsOutput;
+struct QKmsPlane;
+class QThread;
+class WebOSKmsAtomicState;
+
+// Pointer on the cursor plane of a CRTC. The position can be set from the
+// input thread. It goes out with the next main flip while the UI renders
+// and is committed on its own thread otherwise, so moving the pointer over
+// a static UI does not wake the render loop. Own commits are nonblocking
+// and ask for an out fence, which tells when they have completed.
+class WebOSKmsCursorPlane
+{
+public:
+    WebOSKmsCursorPlane() = default;
+    ~WebOSKmsCursorPlane();
+    WebOSKmsCursorPlane(const WebOSKmsCursorPlane &) = delete;
+    WebOSKmsCursorPlane &operator=(const WebOSKmsCursorPlane &) = delete;
+
+    // The cursor plane of the output's CRTC or nullptr
+    static const QKmsPlane *findPlane(const QKmsOutput &output);
+
+    // Commits are serialized with the screen by commitMutex, which
+    // also guards the atomic state
+    bool initialize(int drmFd, gbm_device *gbm, uint32_t crtcId, const QKmsPlane &plane,
+                    QMutex *commitMutex, WebOSKmsAtomicState *state, qreal refreshRate);
+    bool isInitialized() const { return m_planeId != 0; }
+    // Set once a client drives the pointer through the plane
+    bool isActive() const;
+
+    // Safe from any thread
+    bool setImage(const QImage &image, const QPoint &hotspot);
+    void setPosition(const QPoint &position);
+    void setVisible(bool visible);
+
+    // Adds the pending pointer state to a request of the screen, which
+    // holds commitMutex. A main flip delays the own commits of the plane
+    // and waits out an own commit that may still be queued.
+    void addProperties(drmModeAtomicReq *request, bool mainFlip);
+    // Waits for the out fence of an own commit that is still queued, for
+    // other commits on the CRTC made while holding commitMutex
+    void waitForCommit();
+
+private:
+    class CommitThread;
+
+    struct Properties {
+        uint32_t framebuffer = 0;
+        uint32_t crtc = 0;
+        uint32_t srcX = 0;
+        uint32_t srcY = 0;
+        uint32_t srcWidth = 0;
+        uint32_t srcHeight = 0;
+        uint32_t crtcX = 0;
+        uint32_t crtcY = 0;
+        uint32_t crtcWidth = 0;
+        uint32_t crtcHeight = 0;
+    };
+
+    void run();
+    // Returns how long to wait while the UI is flipping
+    int commit();
+    // Whether the out fence of the last own commit is still pending
+    bool commitQueued();
+    void stop();
+
+    int m_drmFd = -1;
+    gbm_device *m_gbm = nullptr;
+    uint32_t m_crtcId = 0;
+    uint32_t m_planeId = 0;
+    uint32_t m_outFencePropertyId = 0;
+    Properties m_properties;
+    QSize m_size;
+    QMutex *m_commitMutex = nullptr;
+    WebOSKmsAtomicState *m_state = nullptr;
+    int m_idleInterval = 0;
+    int m_frameInterval = 0;
+
+    // Guarded by m_commitMutex
+    drmModeAtomicReq *m_request = nullptr;
+    QElapsedTimer m_flipTimer;
+    qint64 m_lastMainFlip = -1;
+    qint64 m_lastCommit = -1;
+    // Written by the kernel during the commit
+    int32_t m_outFence = -1;
+    // Signals once the last own commit is on the screen
+    int m_commitFence = -1;
+
+    // Triple buffered, an image is never written into the buffer of the
+    // last request nor into the one it replaces, which may still be shown
+    QMutex m_imageMutex;
+    gbm_bo *m_bos[3] = { nullptr, nullptr, nullptr };
+    uint32_t m_framebuffers[3] = { 0, 0, 0 };
+
+    // Pending pointer state, guarded by m_mutex
+    mutable QMutex m_mutex;
+    QWaitCondition m_condition;
+    uint32_t m_framebuffer = 0;
+    // Framebuffers of the last request and of the one before
+    uint32_t m_taken = 0;
+    uint32_t m_previousTaken = 0;
+    QPoint m_position;
+    QPoint m_hotspot;
+    bool m_visible = true;
+    bool m_dirty = false;
+    bool m_stopped = false;
+
+    QScopedPointer<QThread> m_thread;
+};
+
+#endif
@@ -0,0 +1,189 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+#include <QDebug>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "weboskmsfence.h"
+
+namespace {
+struct NativeFenceFunctions {
+    PFNEGLCREATESYNCKHRPROC createSync = nullptr;
+    PFNEGLDESTROYSYNCKHRPROC destroySync = nullptr;
+    PFNEGLDUPNATIVEFENCEFDANDROIDPROC dupNativeFenceFd = nullptr;
+};
+}
+
+static const NativeFenceFunctions &nativeFenceFunctions()
+{
+    static const NativeFenceFunctions functions = [] {
+        NativeFenceFunctions f;
+        f.createSync = reinterpret_cast<PFNEGLCREATESYNCKHRPROC>(eglGetProcAddress("eglCreateSyncKHR"));
+        f.destroySync = reinterpret_cast<PFNEGLDESTROYSYNCKHRPROC>(eglGetProcAddress("eglDestroySyncKHR"));
+        f.dupNativeFenceFd = reinterpret_cast<PFNEGLDUPNATIVEFENCEFDANDROIDPROC>(eglGetProcAddress("eglDupNativeFenceFDANDROID"));
+        return f;
+    }();
+    return functions;
+}
+
+static uint32_t findPropertyId(int drmFd, uint32_t objectId, uint32_t objectType, const char *name)
+{
+    drmModeObjectPropertiesPtr objProps = drmModeObjectGetProperties(drmFd, objectId, objectType);
+    if (!objProps)
+        return 0;
+
+    uint32_t propertyId = 0;
+    for (uint32_t i = 0; i < objProps->count_props && !propertyId; i++) {
+        drmModePropertyPtr prop = drmModeGetProperty(drmFd, objProps->props[i]);
+        if (!prop)
+            continue;
+
+        if (!strcmp(prop->name, name))
+            propertyId = prop->prop_id;
+        drmModeFreeProperty(prop);
+    }
+
+    drmModeFreeObjectProperties(objProps);
+    return propertyId;
+}
+
+WebOSKmsFence::~WebOSKmsFence()
+{
+    if (m_renderSync != EGL_NO_SYNC_KHR)
+        nativeFenceFunctions().destroySync(m_display, m_renderSync);
+    if (m_inFence >= 0)
+        close(m_inFence);
+    if (m_releaseFence >= 0)
+        close(m_releaseFence);
+}
+
+void WebOSKmsFence::initialize(int drmFd, uint32_t crtcId, uint32_t planeId)
+{
+    m_crtcId = crtcId;
+    m_planeId = planeId;
+    m_inFencePropertyId = findPropertyId(drmFd, planeId, DRM_MODE_OBJECT_PLANE, "IN_FENCE_FD");
+    m_outFencePropertyId = findPropertyId(drmFd, crtcId, DRM_MODE_OBJECT_CRTC, "OUT_FENCE_PTR");
+
+    qInfo() << "Explicit sync of crtc" << crtcId << "plane" << planeId
+            << "in fence" << (m_inFencePropertyId != 0) << "out fence" << (m_outFencePropertyId != 0);
+}
+
+void WebOSKmsFence::createRenderFence()
+{
+    if (!m_inFencePropertyId)
+        return;
+
+    const NativeFenceFunctions &egl = nativeFenceFunctions();
+
+    if (!m_nativeFenceChecked) {
+        m_nativeFenceChecked = true;
+        m_display = eglGetCurrentDisplay();
+        const char *extensions = m_display != EGL_NO_DISPLAY ? eglQueryString(m_display, EGL_EXTENSIONS) : nullptr;
+        m_hasNativeFence = extensions && strstr(extensions, "EGL_ANDROID_native_fence_sync")
+            && egl.createSync && egl.destroySync && egl.dupNativeFenceFd;
+        if (!m_hasNativeFence)
+            qInfo() << "No EGL_ANDROID_native_fence_sync, plane" << m_planeId << "stays implicitly synced";
+    }
+
+    if (!m_hasNativeFence)
+        return;
+
+    // Left over if the previous frame was not flipped
+    if (m_renderSync != EGL_NO_SYNC_KHR)
+        egl.destroySync(m_display, m_renderSync);
+
+    const EGLint attribs[] = {
+        EGL_SYNC_NATIVE_FENCE_FD_ANDROID, EGL_NO_NATIVE_FENCE_FD_ANDROID,
+        EGL_NONE
+    };
+    m_renderSync = egl.createSync(m_display, EGL_SYNC_NATIVE_FENCE_ANDROID, attribs);
+}
+
+void WebOSKmsFence::addProperties(drmModeAtomicReq *request, bool withRenderFence)
+{
+    if (withRenderFence && m_renderSync != EGL_NO_SYNC_KHR) {
+        const NativeFenceFunctions &egl = nativeFenceFunctions();
+
+        // eglSwapBuffers() has flushed it, so it has an fd by now
+        m_inFence = egl.dupNativeFenceFd(m_display, m_renderSync);
+        egl.destroySync(m_display, m_renderSync);
+        m_renderSync = EGL_NO_SYNC_KHR;
+
+        if (m_inFence >= 0)
+            drmModeAtomicAddProperty(request, m_planeId, m_inFencePropertyId, m_inFence);
+    }
+
+    if (m_outFencePropertyId && m_releaseFenceWanted.loadAcquire()) {
+        m_outFence = -1;
+        drmModeAtomicAddProperty(request, m_crtcId, m_outFencePropertyId, uint64_t(uintptr_t(&m_outFence)));
+    }
+}
+
+void WebOSKmsFence::committed(drmModeAtomicReq *request, bool success)
+{
+    // Would go out with the next commit of the request otherwise
+    if (!success) {
+        if (m_inFence >= 0)
+            drmModeAtomicAddProperty(request, m_planeId, m_inFencePropertyId, uint64_t(-1));
+        if (m_outFencePropertyId)
+            drmModeAtomicAddProperty(request, m_crtcId, m_outFencePropertyId, 0);
+    }
+
+    // The kernel holds its own reference
+    if (m_inFence >= 0) {
+        close(m_inFence);
+        m_inFence = -1;
+    }
+
+    // Only written by a successful commit
+    if (m_outFence < 0)
+        return;
+
+    QMutexLocker lock(&m_releaseMutex);
+    if (m_releaseFence >= 0)
+        close(m_releaseFence);
+    m_releaseFence = m_outFence;
+    m_outFence = -1;
+}
+
+int WebOSKmsFence::releaseFence()
+{
+    if (!m_outFencePropertyId)
+        return -1;
+
+    m_releaseFenceWanted.storeRelease(1);
+
+    QMutexLocker lock(&m_releaseMutex);
+    return m_releaseFence >= 0 ? fcntl(m_releaseFence, F_DUPFD_CLOEXEC, 0) : -1;
+}
+
+bool WebOSKmsFence::wait(int fenceFd, int timeoutMs)
+{
+    struct pollfd fds = { fenceFd, POLLIN, 0 };
+
+    int ret;
+    do {
+        ret = poll(&fds, 1, timeoutMs);
+    } while (ret < 0 && (errno == EINTR || errno == EAGAIN));
+
+    return ret > 0;
+}
@@ -0,0 +1,82 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+#ifndef WEBOSKMSFENCE_H
+#define WEBOSKMSFENCE_H
+
+#include <QAtomicInt>
+#include <QMutex>
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <xf86drmMode.h>
+
+// Explicit synchronisation of the commits of a screen. The native fence
+// of the rendering goes to the main plane as IN_FENCE_FD, so the commit
+// does not depend on the driver waiting for the GPU. On request, commits
+// also ask for an OUT_FENCE_PTR fence, which signals once the buffers
+// they replace have left the screen.
+class WebOSKmsFence
+{
+public:
+    WebOSKmsFence() = default;
+    ~WebOSKmsFence();
+    WebOSKmsFence(const WebOSKmsFence &) = delete;
+    WebOSKmsFence &operator=(const WebOSKmsFence &) = delete;
+
+    // Looks up IN_FENCE_FD of the plane and OUT_FENCE_PTR of the CRTC
+    void initialize(int drmFd, uint32_t crtcId, uint32_t planeId);
+    bool isInitialized() const { return m_inFencePropertyId != 0; }
+
+    // Render thread, with the context current and before eglSwapBuffers()
+    void createRenderFence();
+
+    // Adds the render fence, if withRenderFence and there is one, and the
+    // out fence if it was asked for. Must be followed by committed() with
+    // the same request before the next call.
+    void addProperties(drmModeAtomicReq *request, bool withRenderFence);
+    // A request that was not committed is kept clear of the closed fence
+    void committed(drmModeAtomicReq *request, bool success);
+
+    // Of the latest commit, -1 if there is none. The caller owns the fd.
+    // Safe from any thread, the first call turns the out fences on.
+    int releaseFence();
+
+    // For acquire fences the plane cannot take, false on timeout
+    static bool wait(int fenceFd, int timeoutMs);
+
+private:
+    uint32_t m_crtcId = 0;
+    uint32_t m_planeId = 0;
+    uint32_t m_inFencePropertyId = 0;
+    uint32_t m_outFencePropertyId = 0;
+
+    EGLDisplay m_display = EGL_NO_DISPLAY;
+    EGLSyncKHR m_renderSync = EGL_NO_SYNC_KHR;
+    bool m_nativeFenceChecked = false;
+    bool m_hasNativeFence = false;
+
+    int m_inFence = -1;
+    // Written by the kernel during the commit
+    int32_t m_outFence = -1;
+
+    QAtomicInt m_releaseFenceWanted { 0 };
+    QMutex m_releaseMutex;
+    int m_releaseFence = -1;
+};
+
+#endif
@@ -0,0 +1,61 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+#include <time.h>
+
+#include "weboskmscallstats.h"
+#include "weboskmsflipcost.h"
+
+static qint64 clockNsecs(clockid_t clock)
+{
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return qint64(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+WebOSKmsFlipCost::Scope::Scope(WebOSKmsFlipCost *cost)
+    : m_cost(cost)
+    , m_cpuStart(clockNsecs(CLOCK_THREAD_CPUTIME_ID))
+    , m_wallStart(clockNsecs(CLOCK_MONOTONIC))
+    , m_ioctlsStart(WebOSKmsCallStats::threadIoctls())
+{
+}
+
+WebOSKmsFlipCost::Scope::~Scope()
+{
+    const qint64 cpu = clockNsecs(CLOCK_THREAD_CPUTIME_ID) - m_cpuStart;
+
+    m_cost->m_cpuNsecs.fetchAndAddRelaxed(cpu);
+    m_cost->m_wallNsecs.fetchAndAddRelaxed(clockNsecs(CLOCK_MONOTONIC) - m_wallStart);
+    m_cost->m_ioctls.fetchAndAddRelaxed(WebOSKmsCallStats::threadIoctls() - m_ioctlsStart);
+    if (cpu > m_cost->m_peakCpuNsecs.loadAcquire())
+        m_cost->m_peakCpuNsecs.storeRelease(cpu);
+    m_cost->m_frames.fetchAndAddRelease(1);
+}
+
+void WebOSKmsFlipCost::dump(QByteArray *out, const QByteArray &title) const
+{
+    const quint64 frames = m_frames.loadAcquire();
+    const quint64 divisor = frames ? frames : 1;
+
+    out->append("# ").append(title).append('\n');
+    out->append("frames ").append(QByteArray::number(frames)).append('\n');
+    out->append("cpu_ns_per_frame ").append(QByteArray::number(m_cpuNsecs.loadAcquire() / qint64(divisor))).append('\n');
+    out->append("wall_ns_per_frame ").append(QByteArray::number(m_wallNsecs.loadAcquire() / qint64(divisor))).append('\n');
+    out->append("peak_cpu_ns ").append(QByteArray::number(m_peakCpuNsecs.loadAcquire())).append('\n');
+    out->append("ioctls_per_frame ").append(QByteArray::number(double(m_ioctls.loadAcquire()) / divisor, 'f', 2)).append('\n');
+}
@@ -0,0 +1,58 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+#ifndef WEBOSKMSFLIPCOST_H
+#define WEBOSKMSFLIPCOST_H
+
+#include <QAtomicInteger>
+#include <QByteArray>
+
+// Running cost of the flip() calls of a screen: CPU and wall time spent
+// in flip() and the DRM ioctls it made. Written by the thread that flips
+// and read from any thread, a snapshot may mix two frames.
+class WebOSKmsFlipCost
+{
+public:
+    class Scope
+    {
+    public:
+        explicit Scope(WebOSKmsFlipCost *cost);
+        ~Scope();
+
+    private:
+        WebOSKmsFlipCost *m_cost;
+        qint64 m_cpuStart;
+        qint64 m_wallStart;
+        quint64 m_ioctlsStart;
+    };
+
+    WebOSKmsFlipCost() = default;
+    WebOSKmsFlipCost(const WebOSKmsFlipCost &) = delete;
+    WebOSKmsFlipCost &operator=(const WebOSKmsFlipCost &) = delete;
+
+    // One "key value" line per figure, averages are per frame
+    void dump(QByteArray *out, const QByteArray &title) const;
+
+private:
+    QAtomicInteger<quint64> m_frames { 0 };
+    QAtomicInteger<qint64> m_cpuNsecs { 0 };
+    QAtomicInteger<qint64> m_wallNsecs { 0 };
+    QAtomicInteger<qint64> m_peakCpuNsecs { 0 };
+    QAtomicInteger<quint64> m_ioctls { 0 };
+};
+
+#endif
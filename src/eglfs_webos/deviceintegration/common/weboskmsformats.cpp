@@ -0,0 +1,126 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+#include <QDebug>
+
+#include <string.h>
+
+#include <drm_fourcc.h>
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+
+#include "weboskmsformats.h"
+
+static bool parseInFormats(int drmFd, uint32_t blobId, WebOSKmsFormatList *formats)
+{
+    drmModePropertyBlobPtr blob = drmModeGetPropertyBlob(drmFd, blobId);
+    if (!blob)
+        return false;
+
+    // Bounds of the offsets are checked by the kernel when it builds the blob
+    auto *header = static_cast<const struct drm_format_modifier_blob *>(blob->data);
+    auto *blobFormats = reinterpret_cast<const uint32_t *>(static_cast<const char *>(blob->data) + header->formats_offset);
+    auto *blobModifiers = reinterpret_cast<const struct drm_format_modifier *>(static_cast<const char *>(blob->data) + header->modifiers_offset);
+
+    for (uint32_t i = 0; i < header->count_formats; i++) {
+        for (uint32_t j = 0; j < header->count_modifiers; j++) {
+            const struct drm_format_modifier &mod = blobModifiers[j];
+
+            // Each modifier covers a window of 64 formats
+            if (i < mod.offset || i > mod.offset + 63)
+                continue;
+            if (!(mod.formats & (1ULL << (i - mod.offset))))
+                continue;
+
+            WebOSKmsFormatModifier entry;
+            entry.format = blobFormats[i];
+            entry.modifier = mod.modifier;
+            formats->append(entry);
+        }
+    }
+
+    drmModeFreePropertyBlob(blob);
+    return true;
+}
+
+WebOSKmsFormatList WebOSKmsFormats::queryPlane(int drmFd, uint32_t planeId)
+{
+    WebOSKmsFormatList formats;
+
+    drmModeObjectPropertiesPtr objProps = drmModeObjectGetProperties(drmFd, planeId, DRM_MODE_OBJECT_PLANE);
+    if (objProps) {
+        bool found = false;
+        for (uint32_t i = 0; i < objProps->count_props && !found; i++) {
+            drmModePropertyPtr prop = drmModeGetProperty(drmFd, objProps->props[i]);
+            if (!prop)
+                continue;
+
+            if ((prop->flags & DRM_MODE_PROP_BLOB) && !strcmp(prop->name, "IN_FORMATS"))
+                found = parseInFormats(drmFd, uint32_t(objProps->prop_values[i]), &formats);
+            drmModeFreeProperty(prop);
+        }
+        drmModeFreeObjectProperties(objProps);
+
+        if (found)
+            return formats;
+    }
+
+    drmModePlanePtr plane = drmModeGetPlane(drmFd, planeId);
+    if (!plane) {
+        qWarning() << "Failed to query formats of plane" << planeId;
+        return formats;
+    }
+
+    for (uint32_t i = 0; i < plane->count_formats; i++) {
+        WebOSKmsFormatModifier entry;
+        entry.format = plane->formats[i];
+        entry.modifier = DRM_FORMAT_MOD_INVALID;
+        formats.append(entry);
+    }
+
+    drmModeFreePlane(plane);
+    return formats;
+}
+
+QVector<uint64_t> WebOSKmsFormats::modifiers(const WebOSKmsFormatList &formats, uint32_t format)
+{
+    QVector<uint64_t> modifiers;
+    for (const WebOSKmsFormatModifier &entry : formats) {
+        if (entry.format == format && entry.modifier != DRM_FORMAT_MOD_INVALID)
+            modifiers.append(entry.modifier);
+    }
+    return modifiers;
+}
+
+bool WebOSKmsFormats::supports(const WebOSKmsFormatList &formats, uint32_t format, uint64_t modifier)
+{
+    for (const WebOSKmsFormatModifier &entry : formats) {
+        if (entry.format != format)
+            continue;
+        if (entry.modifier == modifier || entry.modifier == DRM_FORMAT_MOD_INVALID || modifier == DRM_FORMAT_MOD_INVALID)
+            return true;
+    }
+    return false;
+}
+
+void WebOSKmsFormats::unite(WebOSKmsFormatList *formats, const WebOSKmsFormatList &other)
+{
+    for (const WebOSKmsFormatModifier &entry : other) {
+        if (!formats->contains(entry))
+            formats->append(entry);
+    }
+}
@@ -0,0 +1,51 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+#ifndef WEBOSKMSFORMATS_H
+#define WEBOSKMSFORMATS_H
+
+#include <QVector>
+
+#include <stdint.h>
+
+// A DRM fourcc with a modifier a plane can scan it out with.
+// DRM_FORMAT_MOD_INVALID stands for the driver's implicit layout.
+struct WebOSKmsFormatModifier {
+    uint32_t format = 0;
+    uint64_t modifier = 0;
+
+    bool operator==(const WebOSKmsFormatModifier &o) const { return format == o.format && modifier == o.modifier; }
+};
+
+typedef QVector<WebOSKmsFormatModifier> WebOSKmsFormatList;
+
+class WebOSKmsFormats
+{
+public:
+    // From the IN_FORMATS blob of the plane. Planes without one list
+    // their formats with DRM_FORMAT_MOD_INVALID.
+    static WebOSKmsFormatList queryPlane(int drmFd, uint32_t planeId);
+
+    // Explicit modifiers of the format, empty if there are none
+    static QVector<uint64_t> modifiers(const WebOSKmsFormatList &formats, uint32_t format);
+    // An implicit modifier on either side matches any modifier
+    static bool supports(const WebOSKmsFormatList &formats, uint32_t format, uint64_t modifier);
+    // Appends the entries of other that formats lacks
+    static void unite(WebOSKmsFormatList *formats, const WebOSKmsFormatList &other);
+};
+
+#endif
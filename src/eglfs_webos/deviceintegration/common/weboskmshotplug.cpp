@@ -0,0 +1,216 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <QDebug>
+#include <QGuiApplication>
+#include <QSocketNotifier>
+#include <QWindow>
+#include <qpa/qplatformscreen.h>
+
+#include <libudev.h>
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+
+#include <private/qkmsdevice_p.h>
+
+#include "weboskmscallstats.h"
+#include "weboskmshotplug.h"
+
+WebOSKmsHotplug *WebOSKmsHotplug::create(const QString &devicePath, QObject *parent)
+{
+    // The configured path may be a by-path link, match the device number
+    struct stat st;
+    if (stat(devicePath.toUtf8().constData(), &st) != 0) {
+        qErrnoWarning(errno, "Hotplug: Cannot stat %s", qPrintable(devicePath));
+        return nullptr;
+    }
+
+    struct udev *udev = udev_new();
+    if (!udev) {
+        qWarning("Failed to get udev library context");
+        return nullptr;
+    }
+
+    struct udev_monitor *monitor = udev_monitor_new_from_netlink(udev, "udev");
+    if (!monitor) {
+        qWarning("Unable to create an udev monitor. No DRM hotplug.");
+        udev_unref(udev);
+        return nullptr;
+    }
+
+    udev_monitor_filter_add_match_subsystem_devtype(monitor, "drm", "drm_minor");
+    udev_monitor_enable_receiving(monitor);
+
+    return new WebOSKmsHotplug(udev, monitor, st.st_rdev, parent);
+}
+
+WebOSKmsHotplug::WebOSKmsHotplug(struct udev *udev, struct udev_monitor *monitor, dev_t devnum, QObject *parent)
+    : QDeviceDiscovery(Device_DRM, parent)
+    , m_udev(udev)
+    , m_monitor(monitor)
+    , m_devnum(devnum)
+    , m_notifier(new QSocketNotifier(udev_monitor_get_fd(monitor), QSocketNotifier::Read, this))
+{
+    connect(m_notifier, &QSocketNotifier::activated, this, &WebOSKmsHotplug::handleUDevNotification);
+}
+
+WebOSKmsHotplug::~WebOSKmsHotplug()
+{
+    udev_monitor_unref(m_monitor);
+    udev_unref(m_udev);
+}
+
+QStringList WebOSKmsHotplug::scanConnectedDevices()
+{
+    QStringList devices;
+
+    udev_enumerate *ue = udev_enumerate_new(m_udev);
+    udev_enumerate_add_match_subsystem(ue, "drm");
+    udev_enumerate_add_match_sysname(ue, "card[0-9]*");
+
+    if (udev_enumerate_scan_devices(ue) != 0) {
+        qWarning("Failed to scan devices");
+        udev_enumerate_unref(ue);
+        return devices;
+    }
+
+    udev_list_entry *entry;
+    udev_list_entry_foreach (entry, udev_enumerate_get_list_entry(ue)) {
+        udev_device *udevice = udev_device_new_from_syspath(m_udev, udev_list_entry_get_name(entry));
+        if (const char *devnode = udev_device_get_devnode(udevice))
+            devices << QString::fromUtf8(devnode);
+        udev_device_unref(udevice);
+    }
+    udev_enumerate_unref(ue);
+
+    return devices;
+}
+
+void WebOSKmsHotplug::handleUDevNotification()
+{
+    udev_device *dev = udev_monitor_receive_device(m_monitor);
+    if (!dev)
+        return;
+
+    const char *action = udev_device_get_action(dev);
+    const char *devnode = udev_device_get_devnode(dev);
+    if (!action || !devnode || strncmp(udev_device_get_sysname(dev), "card", 4) != 0) {
+        udev_device_unref(dev);
+        return;
+    }
+
+    if (!strcmp(action, "add")) {
+        emit deviceDetected(QString::fromUtf8(devnode));
+    } else if (!strcmp(action, "remove")) {
+        emit deviceRemoved(QString::fromUtf8(devnode));
+    } else if (!strcmp(action, "change") && udev_device_get_devnum(dev) == m_devnum) {
+        const char *hotplug = udev_device_get_property_value(dev, "HOTPLUG");
+        if (hotplug && !strcmp(hotplug, "1")) {
+            // Sent along since Linux 5.17
+            const char *connector = udev_device_get_property_value(dev, "CONNECTOR");
+            const uint32_t connectorId = connector ? uint32_t(strtoul(connector, nullptr, 10)) : 0;
+            qInfo() << "Hotplug event on" << devnode << "connector" << connectorId;
+            emit connectorChanged(connectorId);
+        }
+    }
+
+    udev_device_unref(dev);
+}
+
+bool WebOSKmsHotplug::disableOutput(int drmFd, bool atomic, const QKmsOutput &output, const QVector<QKmsPlane> &planes)
+{
+#if QT_CONFIG(drm_atomic)
+    if (atomic) {
+        drmModeAtomicReq *request = drmModeAtomicAlloc();
+        if (!request)
+            return false;
+
+        for (const QKmsPlane &plane : planes) {
+            drmModeAtomicAddProperty(request, plane.id, plane.framebufferPropertyId, 0);
+            drmModeAtomicAddProperty(request, plane.id, plane.crtcPropertyId, 0);
+        }
+        if (output.crtcIdPropertyId)
+            drmModeAtomicAddProperty(request, output.connector_id, output.crtcIdPropertyId, 0);
+        if (output.modeIdPropertyId)
+            drmModeAtomicAddProperty(request, output.crtc_id, output.modeIdPropertyId, 0);
+        if (output.activePropertyId)
+            drmModeAtomicAddProperty(request, output.crtc_id, output.activePropertyId, 0);
+
+        // Blocking, but it only waits for this CRTC
+        const int ret = drmModeAtomicCommit(drmFd, request, DRM_MODE_ATOMIC_ALLOW_MODESET, nullptr);
+        drmModeAtomicFree(request);
+        WebOSKmsCallStats::count(WebOSKmsCallStats::AtomicCommit);
+        if (ret) {
+            qErrnoWarning(errno, "Hotplug: Failed to disable crtc %u", output.crtc_id);
+            return false;
+        }
+        return true;
+    }
+#else
+    Q_UNUSED(atomic);
+    Q_UNUSED(planes);
+#endif
+
+    WebOSKmsCallStats::count(WebOSKmsCallStats::LegacyModeset);
+    if (drmModeSetCrtc(drmFd, output.crtc_id, 0, 0, 0, nullptr, 0, nullptr)) {
+        qErrnoWarning(errno, "Hotplug: Failed to disable crtc %u", output.crtc_id);
+        return false;
+    }
+    return true;
+}
+
+QVector<QPointer<QWindow>> WebOSKmsHotplug::releaseWindows(QPlatformScreen *screen)
+{
+    QVector<QPointer<QWindow>> released;
+
+    const QWindowList windows = QGuiApplication::allWindows();
+    for (QWindow *window : windows) {
+        // Child windows go with their parent
+        if (!window->isTopLevel() || !window->handle() || window->screen() != screen->screen())
+            continue;
+
+        qInfo() << "Hotplug: Releasing window" << window << "of screen" << screen->name();
+        if (window->isVisible())
+            released.append(window);
+        // A threaded render loop stops rendering a window once it is hidden,
+        // and releases its resources when the platform window is destroyed
+        window->setVisible(false);
+        window->destroy();
+    }
+
+    return released;
+}
+
+void WebOSKmsHotplug::restoreWindows(const QVector<QPointer<QWindow>> &windows)
+{
+    // Nowhere to show them until a screen is added
+    if (QGuiApplication::screens().isEmpty())
+        return;
+
+    for (const QPointer<QWindow> &window : windows) {
+        if (!window || window->isVisible())
+            continue;
+
+        qInfo() << "Hotplug: Showing window" << window.data() << "on screen" << window->screen();
+        window->setVisible(true);
+    }
+}
@@ -0,0 +1,72 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+#ifndef WEBOSKMSHOTPLUG_H
+#define WEBOSKMSHOTPLUG_H
+
+#include <QPointer>
+#include <QVector>
+#include <QWindow>
+#include <QtDeviceDiscoverySupport/private/qdevicediscovery_p.h>
+
+#include <sys/types.h>
+
+struct udev;
+struct udev_monitor;
+struct QKmsOutput;
+struct QKmsPlane;
+class QPlatformScreen;
+class QSocketNotifier;
+
+// Connector hotplug uevents of one DRM device. Devices that are added or
+// removed are reported through QDeviceDiscovery as usual.
+class WebOSKmsHotplug : public QDeviceDiscovery
+{
+    Q_OBJECT
+public:
+    // nullptr if udev cannot be monitored
+    static WebOSKmsHotplug *create(const QString &devicePath, QObject *parent = nullptr);
+    ~WebOSKmsHotplug() override;
+
+    QStringList scanConnectedDevices() override;
+
+    // Turns off the CRTC of a connector that went away, along with
+    // the planes it was scanning out
+    static bool disableOutput(int drmFd, bool atomic, const QKmsOutput &output, const QVector<QKmsPlane> &planes);
+    // Stops rendering to a screen that goes away and releases the surfaces
+    // of its windows, before the screen is deleted. Returns the windows
+    // that were shown. GUI thread only.
+    static QVector<QPointer<QWindow>> releaseWindows(QPlatformScreen *screen);
+    // Shows them again once the screen is deleted, on the screen Qt has
+    // moved them to
+    static void restoreWindows(const QVector<QPointer<QWindow>> &windows);
+
+signals:
+    // connectorId is 0 if the kernel does not tell which one changed
+    void connectorChanged(uint32_t connectorId);
+
+private:
+    WebOSKmsHotplug(struct udev *udev, struct udev_monitor *monitor, dev_t devnum, QObject *parent);
+    void handleUDevNotification();
+
+    struct udev *m_udev;
+    struct udev_monitor *m_monitor;
+    dev_t m_devnum;
+    QSocketNotifier *m_notifier;
+};
+
+#endif
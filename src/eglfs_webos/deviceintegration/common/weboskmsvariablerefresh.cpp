@@ -0,0 +1,169 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+#include <QDebug>
+
+#include <string.h>
+#include <time.h>
+
+#include "weboskmsatomicstate.h"
+#include "weboskmsvariablerefresh.h"
+
+// Frames of steady cadence before VRR is turned on in auto mode
+static const int s_steadyFramesToEnable = 8;
+
+static bool findProperty(int drmFd, uint32_t objectId, uint32_t objectType, const char *name,
+                         uint32_t *propertyId, uint64_t *value)
+{
+    drmModeObjectPropertiesPtr objProps = drmModeObjectGetProperties(drmFd, objectId, objectType);
+    if (!objProps)
+        return false;
+
+    bool found = false;
+    for (uint32_t i = 0; i < objProps->count_props && !found; i++) {
+        drmModePropertyPtr prop = drmModeGetProperty(drmFd, objProps->props[i]);
+        if (!prop)
+            continue;
+
+        if (!strcmp(prop->name, name)) {
+            *propertyId = prop->prop_id;
+            *value = objProps->prop_values[i];
+            found = true;
+        }
+        drmModeFreeProperty(prop);
+    }
+
+    drmModeFreeObjectProperties(objProps);
+    return found;
+}
+
+WebOSKmsVariableRefresh::Mode WebOSKmsVariableRefresh::modeFromString(const QString &mode, Mode fallback)
+{
+    if (mode == QLatin1String("off"))
+        return Off;
+    if (mode == QLatin1String("auto"))
+        return Auto;
+    if (mode == QLatin1String("on"))
+        return On;
+
+    if (!mode.isEmpty())
+        qWarning() << "Invalid vrr mode" << mode;
+    return fallback;
+}
+
+const char *WebOSKmsVariableRefresh::modeName(Mode mode)
+{
+    switch (mode) {
+    case Auto:
+        return "auto";
+    case On:
+        return "on";
+    default:
+        return "off";
+    }
+}
+
+void WebOSKmsVariableRefresh::initialize(int drmFd, uint32_t connectorId, uint32_t crtcId)
+{
+    uint32_t capableId = 0;
+    uint64_t capable = 0;
+    uint64_t enabled = 0;
+
+    m_crtcId = crtcId;
+    m_capable = findProperty(drmFd, connectorId, DRM_MODE_OBJECT_CONNECTOR, "vrr_capable", &capableId, &capable)
+        && capable
+        && findProperty(drmFd, crtcId, DRM_MODE_OBJECT_CRTC, "VRR_ENABLED", &m_enabledPropertyId, &enabled);
+
+    qInfo() << "Connector" << connectorId << "crtc" << crtcId << (m_capable ? "supports" : "does not support")
+            << "variable refresh rate, mode" << modeName(mode());
+}
+
+void WebOSKmsVariableRefresh::frameSubmitted(qint64 nsecs)
+{
+    if (!m_capable || mode() != Auto)
+        return;
+
+    QMutexLocker lock(&m_mutex);
+
+    const qint64 interval = nsecs - m_lastFrame;
+    m_lastFrame = nsecs;
+
+    // Starts over after a pause in the content
+    if (interval <= 0 || interval > 200000000) {
+        m_averageInterval = 0;
+        m_averageDeviation = 0;
+        m_steadyFrames = 0;
+        return;
+    }
+
+    if (!m_averageInterval)
+        m_averageInterval = interval;
+
+    m_averageDeviation = (m_averageDeviation * 7 + qAbs(interval - m_averageInterval)) / 8;
+    m_averageInterval = (m_averageInterval * 7 + interval) / 8;
+
+    // Within 10% of the average
+    if (m_averageDeviation * 10 < m_averageInterval)
+        m_steadyFrames = qMin(m_steadyFrames + 1, s_steadyFramesToEnable);
+    else
+        m_steadyFrames = 0;
+}
+
+void WebOSKmsVariableRefresh::frameSubmitted()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    frameSubmitted(qint64(ts.tv_sec) * 1000000000 + ts.tv_nsec);
+}
+
+bool WebOSKmsVariableRefresh::cadenceWantsVrrLocked(qint64 refreshInterval) const
+{
+    // Hysteresis around the refresh rate so that it does not toggle
+    if (m_active)
+        return m_steadyFrames > 0 && m_averageInterval * 20 > refreshInterval * 21;
+
+    return m_steadyFrames >= s_steadyFramesToEnable && m_averageInterval * 10 > refreshInterval * 11;
+}
+
+bool WebOSKmsVariableRefresh::addProperties(WebOSKmsAtomicState *state, drmModeAtomicReq *request, qint64 refreshInterval)
+{
+    if (!m_capable)
+        return false;
+
+    QMutexLocker lock(&m_mutex);
+
+    bool active = false;
+    switch (mode()) {
+    case On:
+        active = true;
+        break;
+    case Auto:
+        active = cadenceWantsVrrLocked(refreshInterval);
+        break;
+    default:
+        break;
+    }
+
+    if (active != m_active) {
+        qInfo() << "Variable refresh rate" << (active ? "on" : "off") << "for crtc" << m_crtcId
+                << "mode" << modeName(mode());
+        m_active = active;
+    }
+
+    state->add(request, m_crtcId, m_enabledPropertyId, active ? 1 : 0);
+    return active;
+}
@@ -0,0 +1,76 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+#ifndef WEBOSKMSVARIABLEREFRESH_H
+#define WEBOSKMSVARIABLEREFRESH_H
+
+#include <QAtomicInt>
+#include <QMutex>
+#include <QString>
+
+#include <xf86drmMode.h>
+
+class WebOSKmsAtomicState;
+
+// Variable refresh rate of a CRTC. In auto mode it is turned on while the
+// submitted frames come at a steady cadence slower than the refresh rate,
+// e.g. 24, 48 or 50 fps content on a 60 Hz panel, so that every frame is
+// shown for the same time instead of following a 3:2 pulldown.
+class WebOSKmsVariableRefresh
+{
+public:
+    enum Mode {
+        Off = 0,
+        Auto = 1,
+        On = 2
+    };
+
+    static Mode modeFromString(const QString &mode, Mode fallback = Off);
+    static const char *modeName(Mode mode);
+
+    // Looks up vrr_capable of the connector and VRR_ENABLED of the CRTC
+    void initialize(int drmFd, uint32_t connectorId, uint32_t crtcId);
+    bool isCapable() const { return m_capable; }
+
+    // Safe from any thread
+    void setMode(Mode mode) { m_mode.storeRelease(mode); }
+    Mode mode() const { return Mode(m_mode.loadAcquire()); }
+
+    // Feeds the cadence of new content, from any thread.
+    // Times are CLOCK_MONOTONIC in nanoseconds.
+    void frameSubmitted(qint64 nsecs);
+    void frameSubmitted();
+    // Adds VRR_ENABLED to a request and returns whether it is on
+    bool addProperties(WebOSKmsAtomicState *state, drmModeAtomicReq *request, qint64 refreshInterval);
+
+private:
+    bool cadenceWantsVrrLocked(qint64 refreshInterval) const;
+
+    bool m_capable = false;
+    uint32_t m_crtcId = 0;
+    uint32_t m_enabledPropertyId = 0;
+    QAtomicInt m_mode { Off };
+
+    QMutex m_mutex;
+    qint64 m_lastFrame = 0;
+    qint64 m_averageInterval = 0;
+    qint64 m_averageDeviation = 0;
+    int m_steadyFrames = 0;
+    bool m_active = false;
+};
+
+#endif
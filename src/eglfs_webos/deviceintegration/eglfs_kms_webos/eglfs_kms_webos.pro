@@ -21,6 +21,8 @@ PLUGIN_CLASS_NAME = WebOSEglFSKmsGbmIntegrationPlugin
 
 load(qt_plugin)
 
+include($$PWD/../common/common.pri)
+
 QT += eglfs_kms_gbm_support-private eglfsdeviceintegration-private eglfs_kms_support-private kms_support-private devicediscovery_support-private
 
 equals(QT_MAJOR_VERSION, 5) {
@@ -39,6 +41,19 @@ DEFINES += QT_EGL_NO_X11
 
 plane_composition {
     DEFINES += PLANE_COMPOSITION
+
+    SOURCES += $$PWD/weboskmsdmabuf.cpp \
+               $$PWD/weboskmsframebuffercache.cpp \
+               $$PWD/weboskmsgemregistry.cpp \
+               $$PWD/weboskmsoverlaycommitthread.cpp \
+               $$PWD/weboskmsreleasequeue.cpp
+    HEADERS += $$PWD/weboskmsbufferqueue.h \
+               $$PWD/weboskmsdmabuf.h \
+               $$PWD/weboskmsframebuffercache.h \
+               $$PWD/weboskmsgemregistry.h \
+               $$PWD/weboskmsmailbox.h \
+               $$PWD/weboskmsoverlaycommitthread.h \
+               $$PWD/weboskmsreleasequeue.h
 }
 
 egl_protected_content {
@@ -47,10 +62,18 @@ egl_protected_content {
 
 SOURCES += $$PWD/weboseglfskmsgbmmain.cpp \
            $$PWD/weboseglfskmsgbmintegration.cpp \
-           $$PWD/weboseglfskmsgbmwindow.cpp
+           $$PWD/weboseglfskmsgbmwindow.cpp \
+           $$PWD/weboskmscapture.cpp \
+           $$PWD/weboskmsframetimeline.cpp \
+           $$PWD/weboskmspresentation.cpp \
+           $$PWD/weboskmsvirtualvblank.cpp
 
 HEADERS += $$PWD/weboseglfskmsgbmintegration.h \
-           $$PWD/weboseglfskmsgbmwindow.h
+           $$PWD/weboseglfskmsgbmwindow.h \
+           $$PWD/weboskmscapture.h \
+           $$PWD/weboskmsframetimeline.h \
+           $$PWD/weboskmspresentation.h \
+           $$PWD/weboskmsvirtualvblank.h
 
 OTHER_FILES += $$PWD/eglfs_kms_webos.json
 
@@ -14,16 +14,21 @@
 //
 // SPDX-License-Identifier: Apache-2.0
 
-#include <QFile>
-#include <QJsonDocument>
-#include <QJsonArray>
+#include <QGuiApplication>
 #include <QScreen>
 #include <QWindow>
 #include <QRegularExpression>
+#include <QtMath>
 
 #include <QtDeviceDiscoverySupport/private/qdevicediscovery_p.h>
 #include <qpa/qplatformwindow.h>
+#include <qpa/qwindowsysteminterface.h>
 
+#include <drm_fourcc.h>
+#include <errno.h>
+
+#include "weboseglfsconfig.h"
+#include "weboskmscallstats.h"
 #include "weboseglfskmsgbmintegration.h"
 #include "weboseglfskmsgbmwindow.h"
 
@@ -41,71 +46,35 @@
 #include <QtEglFSDeviceIntegration/private/qeglfshooks_p.h>
 #endif
 
-static QMutex s_frameBufferMutex;
-
 #if (QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)) || (defined(HAS_PAGEFLIPPED))
 static void(*page_flip_notifier)(void* key, unsigned int sequence, unsigned int tv_sec, unsigned int tv_usec) = nullptr;
 #else
 static void(*page_flip_notifier)(void* key) = nullptr;
 #endif
 
-WebOSKmsScreenConfig::WebOSKmsScreenConfig(QJsonObject config)
-    : QKmsScreenConfig()
-    , m_configJson(config)
-{
-}
-
 void WebOSKmsScreenConfig::loadConfig()
 {
-    if (m_configJson.isEmpty()) {
+    const WebOSEglFSDeviceConfig *config = WebOSEglFSConfig::instance().device();
+    if (!config) {
         qWarning() << "No config set";
         return;
     }
 
-    m_hwCursor = m_configJson.value(QLatin1String("hwcursor")).toBool(m_hwCursor);
-    m_devicePath = m_configJson.value(QLatin1String("device")).toString();
-
-    const QJsonArray outputs = m_configJson.value(QLatin1String("outputs")).toArray();
-    m_outputSettings.clear();
-    for (int i = 0; i < outputs.size(); i++) {
-        const QVariantMap outputSettings = outputs.at(i).toObject().toVariantMap();
-        if (outputSettings.contains(QStringLiteral("name"))) {
-            const QString name = outputSettings.value(QStringLiteral("name")).toString();
-            if (m_outputSettings.contains(name))
-                qWarning() << "Output" << name << "is duplicated";
-            m_outputSettings.insert(name, outputSettings);
-        }
-    }
+    if (config->hasHwCursor)
+        m_hwCursor = config->hwCursor;
+    m_devicePath = config->device;
+    m_outputSettings = config->outputSettings();
 }
 
 WebOSEglFSKmsGbmIntegration::WebOSEglFSKmsGbmIntegration()
     : QEglFSKmsGbmIntegration()
 {
-    static QByteArray json = qgetenv("QT_QPA_EGLFS_CONFIG");
     m_protected = qgetenv("WEBOS_COMPOSITOR_PROTECTED_CONTENT").toInt() == 1;
-
-    if (!json.isEmpty()) {
-        QFile file(QString::fromUtf8(json));
-        if (file.open(QFile::ReadOnly)) {
-            QJsonDocument doc = QJsonDocument::fromJson(file.readAll());
-            if (doc.isArray()) {
-                m_configJson = doc.array().at(0).toObject();
-                qInfo() << "Using config file" << json;
-            } else {
-                qWarning() << "Invalid config file" << json << "- no top-level JSON object";
-            }
-            file.close();
-        } else {
-            qWarning() << "Could not open config file" << json << "for reading";
-        }
-    } else {
-        qWarning("No config file given");
-    }
 }
 
 QKmsScreenConfig *WebOSEglFSKmsGbmIntegration::createScreenConfig()
 {
-    QKmsScreenConfig *screenConfig = new WebOSKmsScreenConfig(m_configJson);
+    QKmsScreenConfig *screenConfig = new WebOSKmsScreenConfig;
     screenConfig->loadConfig();
 
     return screenConfig;
@@ -128,13 +97,53 @@ void WebOSEglFSKmsGbmIntegration::screenInit()
 #ifdef PLANE_COMPOSITION
     static_cast<WebOSEglFSKmsGbmDevice *>(m_device)->addPlaneProperties();
 #endif
+
+    if (!screenConfig()->headless()) {
+        static_cast<WebOSEglFSKmsGbmDevice *>(m_device)->createVirtualScreens();
+        static_cast<WebOSEglFSKmsGbmDevice *>(m_device)->startHotplug();
+    }
 }
 
 QFunctionPointer WebOSEglFSKmsGbmIntegration::platformFunction(const QByteArray &function) const
 {
+    if (function == "addPresentationListener")
+        return QFunctionPointer(addPresentationListener);
+    if (function == "setVariableRefreshMode")
+        return QFunctionPointer(setVariableRefreshMode);
+    if (function == "removePresentationListener")
+        return QFunctionPointer(removePresentationListener);
+    if (function == "setCursorPlaneImage")
+        return QFunctionPointer(setCursorPlaneImage);
+    if (function == "setCursorPlanePosition")
+        return QFunctionPointer(setCursorPlanePosition);
+    if (function == "setCursorPlaneVisible")
+        return QFunctionPointer(setCursorPlaneVisible);
+    if (function == "captureScreen")
+        return QFunctionPointer(captureScreen);
+    if (function == "releaseScreenCapture")
+        return QFunctionPointer(releaseScreenCapture);
+    if (function == "readScreenCapture")
+        return QFunctionPointer(readScreenCapture);
+    if (function == "screenReleaseFence")
+        return QFunctionPointer(screenReleaseFence);
+
 #ifdef PLANE_COMPOSITION
     if (function == "setOverlayBufferObject")
         return QFunctionPointer(setOverlayBufferObject);
+    if (function == "releaseOverlayBuffer")
+        return QFunctionPointer(releaseOverlayBuffer);
+    if (function == "layerNeedsComposition")
+        return QFunctionPointer(layerNeedsComposition);
+    if (function == "setLayerSource")
+        return QFunctionPointer(setLayerSource);
+    if (function == "setLayerQueueMode")
+        return QFunctionPointer(setLayerQueueMode);
+    if (function == "queueLayerBuffer")
+        return QFunctionPointer(queueLayerBuffer);
+    if (function == "layerQueueStatistics")
+        return QFunctionPointer(layerQueueStatistics);
+    if (function == "setLayerDmaBuf")
+        return QFunctionPointer(setLayerDmaBuf);
 #endif
 
     return nullptr;
@@ -145,6 +154,33 @@ void *WebOSEglFSKmsGbmIntegration::nativeResourceForIntegration(const QByteArray
     if (name == QByteArrayLiteral("gbm_device") && m_device)
         return (void *) static_cast<QEglFSKmsGbmDevice *>(m_device)->gbmDevice();
 
+    if (name == QByteArrayLiteral("frame_timeline")) {
+        // Snapshot of every screen, valid until the next request
+        m_frameTimelineDump.clear();
+        for (QScreen *screen : QGuiApplication::screens()) {
+            if (auto *gbmScreen = static_cast<WebOSEglFSKmsGbmScreen *>(screen->handle()))
+                gbmScreen->frameTimeline()->dump(&m_frameTimelineDump, gbmScreen->name().toUtf8());
+        }
+        return &m_frameTimelineDump;
+    }
+
+    if (name == QByteArrayLiteral("kms_call_stats")) {
+        // Cumulative since start up, valid until the next request
+        m_callStatsDump.clear();
+        WebOSKmsCallStats::dump(&m_callStatsDump);
+        return &m_callStatsDump;
+    }
+
+    if (name == QByteArrayLiteral("flip_cost")) {
+        // Cumulative per screen, valid until the next request
+        m_flipCostDump.clear();
+        for (QScreen *screen : QGuiApplication::screens()) {
+            if (auto *gbmScreen = static_cast<WebOSEglFSKmsGbmScreen *>(screen->handle()))
+                gbmScreen->flipCost()->dump(&m_flipCostDump, gbmScreen->name().toUtf8());
+        }
+        return &m_flipCostDump;
+    }
+
 #if !defined(EMULATOR)
     if (name == QByteArrayLiteral("dri_address_of_page_flip_notifier") && m_device)
         // return pointer to function "page_flip_notifier"
@@ -162,19 +198,143 @@ void *WebOSEglFSKmsGbmIntegration::nativeResourceForIntegration(const QByteArray
     return QEglFSKmsIntegration::nativeResourceForIntegration(name);
 }
 
-#ifdef IM_ENABLE
+#if defined(IM_ENABLE) || defined(PLANE_COMPOSITION)
 void *WebOSEglFSKmsGbmIntegration::nativeResourceForScreen(const QByteArray &resource, QScreen *screen)
 {
     QByteArray lowerCaseResource = resource.toLower();
 
+#ifdef PLANE_COMPOSITION
+    if (lowerCaseResource == "overlay_fb_cache_stats" && screen && screen->handle()) {
+        auto *gbmScreen = static_cast<WebOSEglFSKmsGbmScreen *>(screen->handle());
+        return (void *)gbmScreen->framebufferCacheStatistics();
+    }
+    if (lowerCaseResource == "overlay_release_stats" && screen && screen->handle()) {
+        auto *gbmScreen = static_cast<WebOSEglFSKmsGbmScreen *>(screen->handle());
+        return (void *)gbmScreen->releaseQueueStatistics();
+    }
+    if (lowerCaseResource == "layer_formats" && screen && screen->handle()) {
+        auto *gbmScreen = static_cast<WebOSEglFSKmsGbmScreen *>(screen->handle());
+        return (void *)gbmScreen->layerFormats();
+    }
+#endif
+    if (lowerCaseResource == "atomic_property_stats" && screen && screen->handle()) {
+        auto *gbmScreen = static_cast<WebOSEglFSKmsGbmScreen *>(screen->handle());
+        return (void *)gbmScreen->atomicStateStatistics();
+    }
+
+#ifdef IM_ENABLE
     void *input_interface = QStarfishInputManager::instance()->nativeResourceForScreen(lowerCaseResource, screen);
     if (input_interface)
         return input_interface;
+#endif
 
     return QEglFSKmsIntegration::nativeResourceForScreen(resource, screen);
 }
 #endif
 
+int WebOSEglFSKmsGbmIntegration::addPresentationListener(const QScreen *screen, WebOSKmsPresentation::Callback callback, void *data)
+{
+    if (!screen || !screen->handle())
+        return 0;
+
+    auto *gbmScreen = static_cast<WebOSEglFSKmsGbmScreen *>(screen->handle());
+    return gbmScreen->presentation()->addListener(callback, data);
+}
+
+bool WebOSEglFSKmsGbmIntegration::removePresentationListener(const QScreen *screen, int id)
+{
+    if (!screen || !screen->handle())
+        return false;
+
+    auto *gbmScreen = static_cast<WebOSEglFSKmsGbmScreen *>(screen->handle());
+    return gbmScreen->presentation()->removeListener(id);
+}
+
+bool WebOSEglFSKmsGbmIntegration::setVariableRefreshMode(const QScreen *screen, int mode)
+{
+    if (!screen || !screen->handle())
+        return false;
+
+    if (mode < WebOSKmsVariableRefresh::Off || mode > WebOSKmsVariableRefresh::On)
+        return false;
+
+    auto *gbmScreen = static_cast<WebOSEglFSKmsGbmScreen *>(screen->handle());
+    return gbmScreen->setVariableRefreshMode(WebOSKmsVariableRefresh::Mode(mode));
+}
+
+bool WebOSEglFSKmsGbmIntegration::setCursorPlaneImage(const QScreen *screen, const QImage &image, const QPoint &hotspot)
+{
+    if (!screen || !screen->handle())
+        return false;
+
+    auto *gbmScreen = static_cast<WebOSEglFSKmsGbmScreen *>(screen->handle());
+    WebOSKmsCursorPlane *cursorPlane = gbmScreen->cursorPlane();
+    return cursorPlane && cursorPlane->setImage(image, hotspot);
+}
+
+bool WebOSEglFSKmsGbmIntegration::setCursorPlanePosition(const QScreen *screen, const QPoint &position)
+{
+    if (!screen || !screen->handle())
+        return false;
+
+    auto *gbmScreen = static_cast<WebOSEglFSKmsGbmScreen *>(screen->handle());
+    WebOSKmsCursorPlane *cursorPlane = gbmScreen->cursorPlane();
+    if (!cursorPlane)
+        return false;
+
+    cursorPlane->setPosition(position);
+    return true;
+}
+
+bool WebOSEglFSKmsGbmIntegration::setCursorPlaneVisible(const QScreen *screen, bool visible)
+{
+    if (!screen || !screen->handle())
+        return false;
+
+    auto *gbmScreen = static_cast<WebOSEglFSKmsGbmScreen *>(screen->handle());
+    WebOSKmsCursorPlane *cursorPlane = gbmScreen->cursorPlane();
+    if (!cursorPlane)
+        return false;
+
+    cursorPlane->setVisible(visible);
+    return true;
+}
+
+WebOSKmsCapture *WebOSEglFSKmsGbmIntegration::captureScreen(const QScreen *screen)
+{
+    if (!screen || !screen->handle())
+        return nullptr;
+
+    auto *gbmScreen = static_cast<WebOSEglFSKmsGbmScreen *>(screen->handle());
+    return gbmScreen->capture();
+}
+
+void WebOSEglFSKmsGbmIntegration::releaseScreenCapture(const QScreen *screen, WebOSKmsCapture *capture)
+{
+    if (!screen || !screen->handle() || !capture)
+        return;
+
+    auto *gbmScreen = static_cast<WebOSEglFSKmsGbmScreen *>(screen->handle());
+    gbmScreen->releaseCapture(capture);
+}
+
+bool WebOSEglFSKmsGbmIntegration::readScreenCapture(const WebOSKmsCapture *capture, int index, QImage *image)
+{
+    if (!capture || !image || index < 0 || index >= capture->bufferCount)
+        return false;
+
+    return WebOSKmsCaptureExport::read(capture->buffers[index], image);
+}
+
+int WebOSEglFSKmsGbmIntegration::screenReleaseFence(const QScreen *screen)
+{
+    if (!screen || !screen->handle())
+        return -1;
+
+    auto *gbmScreen = static_cast<WebOSEglFSKmsGbmScreen *>(screen->handle());
+    return gbmScreen->releaseFence();
+}
+
 QEglFSWindow *WebOSEglFSKmsGbmIntegration::createWindow(QWindow *window) const
 {
     return new WebOSEglFSKmsGbmWindow(window, this);
@@ -187,10 +347,18 @@ QKmsDevice *WebOSEglFSKmsGbmIntegration::createDevice()
         qDebug() << "GBM: Using DRM device" << path << "specified in config file";
     } else {
         QDeviceDiscovery *d = QDeviceDiscovery::create(QDeviceDiscovery::Device_VideoMask);
-        const QStringList devices = d->scanConnectedDevices();
+        QStringList devices = d->scanConnectedDevices();
         qDebug() << "Found the following video devices:" << devices;
         d->deleteLater();
 
+        // Virtual outputs only need something to render with
+        if (devices.isEmpty() && WebOSEglFSConfig::instance().hasVirtualOutputs()) {
+            d = QDeviceDiscovery::create(QDeviceDiscovery::Device_DRM_RenderNode);
+            devices = d->scanConnectedDevices();
+            qDebug() << "Found the following render nodes:" << devices;
+            d->deleteLater();
+        }
+
         if (Q_UNLIKELY(devices.isEmpty()))
             qFatal("Could not find DRM device!");
 
@@ -210,155 +378,600 @@ void WebOSEglFSKmsGbmIntegration::setOverlayBufferObject(const QScreen *screen,
     auto *gbmScreen = static_cast<WebOSEglFSKmsGbmScreen *>(screen->handle());
     gbmScreen->setOverlayBufferObject(bo, rect, zpos);
 }
+
+void WebOSEglFSKmsGbmIntegration::releaseOverlayBuffer(const QScreen *screen, int dmaBufFd)
+{
+    if (!screen || !screen->handle())
+        return;
+
+    auto *gbmScreen = static_cast<WebOSEglFSKmsGbmScreen *>(screen->handle());
+    gbmScreen->releaseOverlayBuffer(dmaBufFd);
+}
+
+bool WebOSEglFSKmsGbmIntegration::layerNeedsComposition(const QScreen *screen, int id)
+{
+    if (!screen || !screen->handle())
+        return true;
+
+    auto *gbmScreen = static_cast<WebOSEglFSKmsGbmScreen *>(screen->handle());
+    return gbmScreen->layerNeedsComposition(id);
+}
+
+bool WebOSEglFSKmsGbmIntegration::setLayerSource(const QScreen *screen, int id, uint32_t x, uint32_t y, uint32_t width, uint32_t height)
+{
+    if (!screen || !screen->handle())
+        return false;
+
+    WebOSKmsSourceRect source;
+    source.x = x;
+    source.y = y;
+    source.width = width;
+    source.height = height;
+
+    auto *gbmScreen = static_cast<WebOSEglFSKmsGbmScreen *>(screen->handle());
+    return gbmScreen->setLayerSource(id, source);
+}
+
+bool WebOSEglFSKmsGbmIntegration::setLayerQueueMode(const QScreen *screen, int id, int mode)
+{
+    if (!screen || !screen->handle())
+        return false;
+
+    if (mode != WebOSEglFSKmsGbmScreen::MailboxMode && mode != WebOSEglFSKmsGbmScreen::FifoMode)
+        return false;
+
+    auto *gbmScreen = static_cast<WebOSEglFSKmsGbmScreen *>(screen->handle());
+    return gbmScreen->setLayerQueueMode(id, WebOSEglFSKmsGbmScreen::LayerQueueMode(mode));
+}
+
+bool WebOSEglFSKmsGbmIntegration::queueLayerBuffer(const QScreen *screen, int id, void *bo, qint64 target)
+{
+    if (!screen || !screen->handle())
+        return false;
+
+    auto *gbmScreen = static_cast<WebOSEglFSKmsGbmScreen *>(screen->handle());
+    return gbmScreen->queueLayerBuffer(id, bo, target);
+}
+
+bool WebOSEglFSKmsGbmIntegration::layerQueueStatistics(const QScreen *screen, int id, WebOSKmsBufferQueueStatistics *statistics)
+{
+    if (!screen || !screen->handle() || !statistics)
+        return false;
+
+    auto *gbmScreen = static_cast<WebOSEglFSKmsGbmScreen *>(screen->handle());
+    return gbmScreen->layerQueueStatistics(id, statistics);
+}
+
+bool WebOSEglFSKmsGbmIntegration::setLayerDmaBuf(const QScreen *screen, int id, const WebOSKmsDmaBufDescriptor *descriptor, qint64 target)
+{
+    if (!screen || !screen->handle() || !descriptor)
+        return false;
+
+    auto *gbmScreen = static_cast<WebOSEglFSKmsGbmScreen *>(screen->handle());
+    return gbmScreen->setLayerDmaBuf(id, *descriptor, target);
+}
 #endif
 
 #ifdef CURSOR_OPENGL
 #include <qstarfishimcursor.h>
+#endif
 
 void WebOSEglFSKmsGbmIntegration::waitForVSync(QPlatformSurface *surface) const
 {
-    if (auto *window = static_cast<QPlatformWindow *>(surface)) {
-        if (auto screen = window->screen()) {
-            if (auto cursor = static_cast<QStarfishIMCursor *>(screen->cursor())) {
+    auto *window = static_cast<QPlatformWindow *>(surface);
+    auto *screen = window ? static_cast<WebOSEglFSKmsGbmScreen *>(window->screen()) : nullptr;
+
+#ifdef CURSOR_OPENGL
+    if (screen) {
+        // The cursor plane moves the pointer without rendering
+        WebOSKmsCursorPlane *cursorPlane = screen->cursorPlane();
+        if (!cursorPlane || !cursorPlane->isActive()) {
+            if (auto cursor = static_cast<QStarfishIMCursor *>(screen->cursor()))
                 cursor->paint();
-            }
         }
     }
+#endif
+
+    if (screen)
+        screen->createRenderFence();
+
+    // Waited for in flip(), after eglSwapBuffers()
+    if (screen && screen->pipelinedFlip())
+        return;
 
     QEglFSKmsIntegration::waitForVSync(surface);
 }
-#endif // CURSOR_OPENGL
 
 QPlatformScreen * WebOSEglFSKmsGbmDevice::createScreen(const QKmsOutput &output)
 {
-    QEglFSKmsGbmScreen *screen = new WebOSEglFSKmsGbmScreen(this, output, false);
+    WebOSEglFSKmsGbmScreen *screen = new WebOSEglFSKmsGbmScreen(this, output, false);
 
 #ifdef PLANE_COMPOSITION
     assignPlanes(screen->output());
+    screen->initializeLayers();
 #endif
+    screen->initializeFence();
     createGlobalCursor(screen);
 
+    m_connectorScreens.insert(output.connector_id, screen);
     return screen;
 }
 
-#ifdef PLANE_COMPOSITION
-void WebOSEglFSKmsGbmDevice::addPlaneProperties()
+void WebOSEglFSKmsGbmDevice::startHotplug()
 {
-    for (QKmsPlane &plane : m_planes) {
-        drmModeObjectPropertiesPtr objProps = drmModeObjectGetProperties(m_dri_fd, plane.id, DRM_MODE_OBJECT_PLANE);
-        if (!objProps) {
-            qDebug("Failed to query plane %d object properties, ignoring", plane.id);
-            continue;
-        }
-
-        WebOSKmsPlane &webosPlane = m_webosPlanes[plane.id];
-        enumerateProperties(objProps, [&webosPlane, &plane](drmModePropertyPtr prop, quint64 value) {
-            if (!strcasecmp(prop->name, "blend_op")) {
-                webosPlane.blendPropertyId = prop->prop_id;
-            }
-#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
-#ifdef PROTECTED_CONTENT
-            else if (!strcasecmp(prop->name, "fb_translation_mode")) {
-                webosPlane.fbTranslationModeId = prop->prop_id;
-                for (int i = 0; i < prop->count_enums; i++) {
-                    if (strcmp(prop->enums[i].name, "sec"))
-                        continue;
-                    webosPlane.secureMode = prop->enums[i].value;
-                }
-            }
-#endif
-#endif
-        });
-
-        drmModeFreeObjectProperties(objProps);
-    }
-}
+    m_hotplug.reset(WebOSKmsHotplug::create(devicePath()));
+    if (!m_hotplug)
+        return;
 
-static inline void assignPlane(QKmsOutput *output, QKmsPlane *plane)
-{
-     plane->activeCrtcId = output->crtc_id;
-     output->eglfs_plane = plane;
-     qDebug() << "assign main plane" << plane->id << "to" << output->name;
+    QObject::connect(m_hotplug.data(), &WebOSKmsHotplug::connectorChanged, m_hotplug.data(),
+                     [this](uint32_t connectorId) { updateConnectors(connectorId); });
 }
 
-void WebOSEglFSKmsGbmDevice::assignPlanes(const QKmsOutput &output)
+void WebOSEglFSKmsGbmDevice::updateConnectors(uint32_t connectorId)
 {
-    auto userConfig = m_screenConfig->outputSettings();
-    QVariantMap userConnectorConfig = userConfig.value(output.name);
-
-    qInfo() << "Try assignPlanes" << userConnectorConfig.value(QStringLiteral("useMultiPlanes")).toBool() << userConnectorConfig;
-
-    if (!userConnectorConfig.value(QStringLiteral("useMultiPlanes")).toBool())
+    drmModeResPtr resources = drmModeGetResources(m_dri_fd);
+    if (!resources) {
+        qErrnoWarning(errno, "drmModeGetResources failed");
         return;
-
-    // Unset main plane which is assigned from QPA
-    if (output.eglfs_plane) {
-        QKmsOutput *op = const_cast<QKmsOutput *>(&output);
-        op->eglfs_plane->activeCrtcId = 0;
-        op->eglfs_plane = 0;
     }
 
-    for (QKmsPlane &plane : m_planes) {
-        if (!(plane.possibleCrtcs & (1 << output.crtc_index)))
+    for (int i = 0; i < resources->count_connectors; i++) {
+        const uint32_t id = resources->connectors[i];
+        if (connectorId && id != connectorId)
             continue;
 
-        if (plane.activeCrtcId)
+        // The kernel has updated the state before it sent the event
+        drmModeConnectorPtr connector = drmModeGetConnectorCurrent(m_dri_fd, id);
+        if (!connector)
             continue;
 
-        if (!output.eglfs_plane && plane.type == QKmsPlane::OverlayPlane) {
-            assignPlane(const_cast<QKmsOutput *>(&output), &plane);
-            continue;
+        const bool connected = connector->connection == DRM_MODE_CONNECTED;
+        const bool known = m_connectorScreens.contains(id);
+        drmModeFreeConnector(connector);
+
+        if (connected && !known) {
+            // Only the new connector is probed, for its modes
+            connector = drmModeGetConnector(m_dri_fd, id);
+            if (connector) {
+                addConnector(resources, connector);
+                drmModeFreeConnector(connector);
+            }
+        } else if (!connected && known) {
+            removeConnector(id);
         }
+    }
 
-        if (plane.type == QKmsPlane::OverlayPlane)
-            continue;
+    drmModeFreeResources(resources);
+}
 
-        // 1:1 map from KmsOuput to WebOSKmsOutput
-        WebOSKmsOutput &webosOutput = m_webosOutputs[output.connector_id];
+void WebOSEglFSKmsGbmDevice::addConnector(drmModeResPtr resources, drmModeConnectorPtr connector)
+{
+    ScreenInfo vinfo;
+    // Records the screen through createScreen()
+    QPlatformScreen *screen = createScreenForConnector(resources, connector, &vinfo);
+    if (!screen)
+        return;
 
-        // Fully assigned except MainPlane
-        if (webosOutput.m_assignedPlanes.size() == Plane_End - 1)
-            continue;
+    // Right of the other screens unless the config places it
+    QPoint virtualPos = vinfo.virtualPos;
+    if (virtualPos.isNull()) {
+        m_connectorScreens.remove(connector->connector_id);
+        virtualPos = nextVirtualPosition();
+        m_connectorScreens.insert(connector->connector_id, screen);
+    }
 
-        for (int p = 0; p < Plane_End; p++) {
-            if (p == MainPlane)
-                continue;
-            if (webosOutput.m_assignedPlanes.contains(p))
-                continue;
+    qInfo() << "Hotplug: Adding screen for connector" << connector->connector_id << "at" << virtualPos;
+    registerScreen(screen, vinfo.isPrimary, virtualPos, virtualSiblings(screen));
+    updateVirtualSiblings();
+}
+
+void WebOSEglFSKmsGbmDevice::removeConnector(uint32_t connectorId)
+{
+    auto *screen = static_cast<WebOSEglFSKmsGbmScreen *>(m_connectorScreens.take(connectorId));
 
-            qInfo() << "assign plane" << plane.id << "for zpos" << p << output.name;
+    // The render thread may still be in flip() for a window of the screen
+    const QVector<QPointer<QWindow>> windows = WebOSKmsHotplug::releaseWindows(screen);
 
-            plane.activeCrtcId = output.crtc_id;
-            webosOutput.m_assignedPlanes[p] = plane;
-            break;
+    // No page flip event may arrive for the screen once it is gone
+    screen->waitForFlip();
+
+    // The output goes with the screen
+    const QKmsOutput output = screen->output();
+    QVector<QKmsPlane> planes;
+    for (QKmsPlane &plane : m_planes) {
+        if (plane.activeCrtcId == output.crtc_id) {
+            planes.append(plane);
+            plane.activeCrtcId = 0;
         }
     }
-}
+#ifdef PLANE_COMPOSITION
+    m_webosOutputs.remove(connectorId);
 #endif
 
-WebOSEglFSKmsGbmScreen::WebOSEglFSKmsGbmScreen(QEglFSKmsDevice *device, const QKmsOutput &output, bool headless)
-    : QEglFSKmsGbmScreen(device, output, headless)
-    , m_dpr(-1.0)
-#ifdef IM_ENABLE
-    , m_cursor(new QStarfishIMCursor(device->fd(), output.crtc_id, this))
-#endif
+    qInfo() << "Hotplug: Removing screen" << output.name << "of connector" << connectorId;
+    QWindowSystemInterface::handleScreenRemoved(screen);
+
+    WebOSKmsHotplug::disableOutput(m_dri_fd, m_has_atomic_support, output, planes);
+    m_crtc_allocator &= ~(1U << output.crtc_index);
+    updateVirtualSiblings();
+
+    // Moved to another screen by Qt
+    WebOSKmsHotplug::restoreWindows(windows);
+}
+
+QList<QPlatformScreen *> WebOSEglFSKmsGbmDevice::virtualSiblings(QPlatformScreen *screen) const
 {
-#ifdef PLANE_COMPOSITION
-    m_bufferObjects.resize(Plane_End);
-    m_nextBufferObjects.resize(Plane_End);
-    m_currentBufferObjects.resize(Plane_End);
-    m_layerAdded.resize(Plane_End);
-#endif
+    if (m_screenConfig->separateScreens())
+        return QList<QPlatformScreen *>() << screen;
+    return m_connectorScreens.values();
 }
 
-qreal WebOSEglFSKmsGbmScreen::getDevicePixelRatio()
+void WebOSEglFSKmsGbmDevice::updateVirtualSiblings()
 {
-    if (!qFuzzyCompare(m_dpr, -1.0))
-        return m_dpr;
+    for (QPlatformScreen *screen : qAsConst(m_connectorScreens))
+        static_cast<QEglFSKmsScreen *>(screen)->setVirtualSiblings(virtualSiblings(screen));
+}
 
-    QByteArray env = qgetenv("WEBOS_DEVICE_PIXEL_RATIO");
-    if (!env.isEmpty()) {
-        // Override devicePixelRatio if WEBOS_DEVICE_PIXEL_RATIO is set
+QPoint WebOSEglFSKmsGbmDevice::nextVirtualPosition() const
+{
+    QPoint pos;
+    for (QPlatformScreen *s : m_connectorScreens.values() + m_virtualScreens)
+        pos.setX(qMax(pos.x(), s->geometry().x() + s->geometry().width()));
+    return pos;
+}
+
+// WIDTHxHEIGHT[@RATE], 1080p60 if not given
+static bool parseVirtualMode(const QString &mode, QSize *size, qreal *refreshRate)
+{
+    *size = QSize(1920, 1080);
+    *refreshRate = 60;
+    if (mode.isEmpty())
+        return true;
+
+    const QByteArray str = mode.toLatin1();
+    int width = 0;
+    int height = 0;
+    double rate = 60;
+    const int n = sscanf(str.constData(), "%dx%d@%lf", &width, &height, &rate);
+    if (n < 2 || width <= 0 || height <= 0 || width > 0xffff || height > 0xffff || rate <= 0)
+        return false;
+
+    *size = QSize(width, height);
+    *refreshRate = rate;
+    return true;
+}
+
+void WebOSEglFSKmsGbmDevice::createVirtualScreens()
+{
+    const WebOSEglFSDeviceConfig *config = WebOSEglFSConfig::instance().device();
+    if (!config)
+        return;
+
+    for (const WebOSEglFSOutputConfig &outputConfig : config->outputs) {
+        if (!outputConfig.virtualOutput)
+            continue;
+
+        QSize size;
+        qreal refreshRate;
+        if (!parseVirtualMode(outputConfig.mode, &size, &refreshRate)) {
+            qWarning() << "Invalid mode" << outputConfig.mode << "for virtual output" << outputConfig.name;
+            continue;
+        }
+
+        // A mode nothing scans out, the timings give the refresh rate
+        drmModeModeInfo mode;
+        memset(&mode, 0, sizeof(mode));
+        mode.hdisplay = mode.htotal = uint16_t(size.width());
+        mode.vdisplay = mode.vtotal = uint16_t(size.height());
+        mode.clock = uint32_t(qRound64(size.width() * size.height() * refreshRate / 1000));
+        mode.vrefresh = uint32_t(qRound(refreshRate));
+        mode.type = DRM_MODE_TYPE_USERDEF;
+        qsnprintf(mode.name, sizeof(mode.name), "%dx%d", size.width(), size.height());
+
+        QKmsOutput output;
+        output.name = outputConfig.name;
+        output.modes.append(mode);
+        output.mode = 0;
+        output.preferred_mode = 0;
+        output.drm_format = DRM_FORMAT_XRGB8888;
+        output.size = size;
+
+        auto *screen = new WebOSEglFSKmsGbmScreen(this, output, false, true);
+#ifdef PLANE_COMPOSITION
+        // No planes, clients are composited into the main buffer
+        screen->initializeLayers();
+#endif
+
+        const QPoint virtualPos = nextVirtualPosition();
+        m_virtualScreens.append(screen);
+
+        qInfo() << "Adding virtual screen" << output.name << size << refreshRate << "at" << virtualPos;
+        registerScreen(screen, outputConfig.primary, virtualPos, QList<QPlatformScreen *>() << screen);
+    }
+}
+
+#ifdef PLANE_COMPOSITION
+bool operator==(const WebOSKmsLayerTestKey &a, const WebOSKmsLayerTestKey &b)
+{
+    return a.planeId == b.planeId
+        && a.format == b.format
+        && a.modifier == b.modifier
+        && a.scaleX == b.scaleX
+        && a.scaleY == b.scaleY
+        && a.secure == b.secure;
+}
+
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+size_t qHash(const WebOSKmsLayerTestKey &key, size_t seed)
+#else
+uint qHash(const WebOSKmsLayerTestKey &key, uint seed)
+#endif
+{
+    return qHash(key.planeId, seed) ^ qHash(key.format) ^ qHash(key.modifier)
+        ^ qHash(key.scaleX) ^ (qHash(key.scaleY) << 1) ^ uint(key.secure);
+}
+
+WebOSKmsSourceRect WebOSKmsSourceRect::clampedTo(uint32_t bufferWidth, uint32_t bufferHeight) const
+{
+    const quint64 maxWidth = quint64(bufferWidth) << 16;
+    const quint64 maxHeight = quint64(bufferHeight) << 16;
+
+    if (isNull() || quint64(x) + width > maxWidth || quint64(y) + height > maxHeight) {
+        WebOSKmsSourceRect whole;
+        whole.width = bufferWidth << 16;
+        whole.height = bufferHeight << 16;
+        return whole;
+    }
+
+    return *this;
+}
+
+// Crop out the dest region to avoid from overflowing the screen
+static inline QRectF overlayDestination(const QRectF &rect, const QSizeF &screenSize)
+{
+    QRectF dest = rect.intersected(QRectF(QPointF(0, 0), screenSize));
+    //HACK: limit to minimum size of destination height to avoid failure of drm atomic commit
+    dest.setHeight(qMax(dest.height(), 270.0));
+    return dest;
+}
+
+WebOSKmsGemRegistry *WebOSEglFSKmsGbmDevice::gemRegistry()
+{
+    if (!m_gemRegistry)
+        m_gemRegistry.reset(new WebOSKmsGemRegistry(fd()));
+    return m_gemRegistry.data();
+}
+
+void WebOSEglFSKmsGbmDevice::addPlaneProperties()
+{
+    // Already done while assigning planes
+    if (!m_webosPlanes.isEmpty())
+        return;
+
+    for (QKmsPlane &plane : m_planes) {
+        drmModeObjectPropertiesPtr objProps = drmModeObjectGetProperties(m_dri_fd, plane.id, DRM_MODE_OBJECT_PLANE);
+        if (!objProps) {
+            qDebug("Failed to query plane %d object properties, ignoring", plane.id);
+            continue;
+        }
+
+        WebOSKmsPlane &webosPlane = m_webosPlanes[plane.id];
+        // Planes used for video with the former fixed layout
+        webosPlane.canScale = plane.type == QKmsPlane::PrimaryPlane;
+        webosPlane.formats = WebOSKmsFormats::queryPlane(m_dri_fd, plane.id);
+
+        enumerateProperties(objProps, [&webosPlane, &plane](drmModePropertyPtr prop, quint64 value) {
+            if (!strcasecmp(prop->name, "blend_op")) {
+                webosPlane.blendPropertyId = prop->prop_id;
+            } else if (!strcmp(prop->name, "IN_FENCE_FD")) {
+                webosPlane.inFencePropertyId = prop->prop_id;
+            } else if (!strcasecmp(prop->name, "zpos")) {
+                if (prop->flags & DRM_MODE_PROP_IMMUTABLE) {
+                    webosPlane.zposMin = value;
+                    webosPlane.zposMax = value;
+                } else if (prop->count_values == 2) {
+                    webosPlane.zposMin = prop->values[0];
+                    webosPlane.zposMax = prop->values[1];
+                }
+            } else if (!strcasecmp(prop->name, "scaler_v1")
+                       || !strcasecmp(prop->name, "scaler_v2")
+                       || !strcasecmp(prop->name, "SCALING_FILTER")) {
+                webosPlane.canScale = true;
+            }
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+#ifdef PROTECTED_CONTENT
+            else if (!strcasecmp(prop->name, "fb_translation_mode")) {
+                webosPlane.fbTranslationModeId = prop->prop_id;
+                for (int i = 0; i < prop->count_enums; i++) {
+                    if (strcmp(prop->enums[i].name, "sec"))
+                        continue;
+                    webosPlane.secureMode = prop->enums[i].value;
+                }
+            }
+#endif
+#endif
+        });
+
+        drmModeFreeObjectProperties(objProps);
+    }
+}
+
+static inline void assignPlane(QKmsOutput *output, QKmsPlane *plane)
+{
+     plane->activeCrtcId = output->crtc_id;
+     output->eglfs_plane = plane;
+     qDebug() << "assign main plane" << plane->id << "to" << output->name;
+}
+
+void WebOSEglFSKmsGbmDevice::assignPlanes(const QKmsOutput &output)
+{
+    const WebOSEglFSOutputConfig *config = WebOSEglFSConfig::instance().output(output.name);
+    const bool useMultiPlanes = config && config->useMultiPlanes;
+
+    qInfo() << "Try assignPlanes" << useMultiPlanes << (config ? config->settings : QVariantMap());
+
+    if (!useMultiPlanes)
+        return;
+
+    addPlaneProperties();
+
+    // Unset main plane which is assigned from QPA
+    if (output.eglfs_plane) {
+        QKmsOutput *op = const_cast<QKmsOutput *>(&output);
+        op->eglfs_plane->activeCrtcId = 0;
+        op->eglfs_plane = 0;
+    }
+
+    // 1:1 map from KmsOuput to WebOSKmsOutput
+    WebOSKmsOutput &webosOutput = m_webosOutputs[output.connector_id];
+    QVector<QKmsPlane *> primaryPlanes;
+    QVector<QKmsPlane *> overlayPlanes;
+
+    for (QKmsPlane &plane : m_planes) {
+        if (!(plane.possibleCrtcs & (1 << output.crtc_index)))
+            continue;
+
+        if (plane.activeCrtcId)
+            continue;
+
+        if (!output.eglfs_plane && plane.type == QKmsPlane::OverlayPlane) {
+            assignPlane(const_cast<QKmsOutput *>(&output), &plane);
+            continue;
+        }
+
+        if (plane.type == QKmsPlane::PrimaryPlane)
+            primaryPlanes.append(&plane);
+        else if (plane.type == QKmsPlane::OverlayPlane)
+            overlayPlanes.append(&plane);
+    }
+
+    if (!output.eglfs_plane) {
+        qWarning() << "No main plane for" << output.name;
+        return;
+    }
+
+    // Every layer has to stay below the main plane
+    const uint64_t maxLayers = getPlane(*output.eglfs_plane).zposMax;
+
+    // Prefer the planes used for video with the former fixed layout
+    for (QKmsPlane *plane : primaryPlanes + overlayPlanes) {
+        if (uint64_t(webosOutput.layerCount()) >= maxLayers)
+            break;
+
+        qInfo() << "assign plane" << plane->id << "for layer" << webosOutput.layerCount() << output.name;
+
+        plane->activeCrtcId = output.crtc_id;
+        webosOutput.m_layerPlanes.append(*plane);
+    }
+}
+#endif
+
+// On unless WEBOS_KMS_PIPELINED_FLIP=0. Needs pageFlipped(), which retires
+// the layers of a flip while the render thread is not waiting for it.
+static bool pipelinedFlipEnabled()
+{
+#if (QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)) || (defined(HAS_PAGEFLIPPED))
+    bool ok = false;
+    const int value = qEnvironmentVariableIntValue("WEBOS_KMS_PIPELINED_FLIP", &ok);
+    return !ok || value != 0;
+#else
+    return false;
+#endif
+}
+
+WebOSEglFSKmsGbmScreen::WebOSEglFSKmsGbmScreen(QEglFSKmsDevice *device, const QKmsOutput &output, bool headless, bool virtualOutput)
+    : QEglFSKmsGbmScreen(device, output, headless)
+#ifdef PLANE_COMPOSITION
+    , m_framebufferCache(device->fd(), static_cast<WebOSEglFSKmsGbmDevice *>(device)->gemRegistry())
+    , m_releaseQueue(&m_framebufferCache)
+#endif
+    , m_dpr(-1.0)
+#ifdef IM_ENABLE
+    , m_cursor(new QStarfishIMCursor(device->fd(), output.crtc_id, this))
+#endif
+    , m_pipelinedFlip(pipelinedFlipEnabled())
+    , m_presentation(refreshRate())
+{
+    if (virtualOutput) {
+        m_virtualVblank.reset(new WebOSKmsVirtualVblank(refreshRate(), virtualVblank, this));
+    } else if (!headless && device->hasAtomicSupport()) {
+        if (const WebOSEglFSOutputConfig *config = WebOSEglFSConfig::instance().output(output.name))
+            m_variableRefresh.setMode(WebOSKmsVariableRefresh::modeFromString(config->vrr));
+        m_variableRefresh.initialize(device->fd(), output.connector_id, output.crtc_id);
+
+        if (const QKmsPlane *plane = WebOSKmsCursorPlane::findPlane(output)) {
+            m_cursorPlane.initialize(device->fd(), static_cast<QEglFSKmsGbmDevice *>(device)->gbmDevice(),
+                                     output.crtc_id, *plane, &m_commitMutex, &m_atomicState, refreshRate());
+        }
+    }
+}
+
+void WebOSEglFSKmsGbmScreen::initializeFence()
+{
+    const QKmsOutput &op = output();
+    if (!m_headless && !m_virtualVblank && device()->hasAtomicSupport() && op.eglfs_plane)
+        m_fence.initialize(device()->fd(), op.crtc_id, op.eglfs_plane->id);
+}
+
+#ifdef PLANE_COMPOSITION
+void WebOSEglFSKmsGbmScreen::initializeLayers()
+{
+    WebOSEglFSKmsGbmDevice *wd = static_cast<WebOSEglFSKmsGbmDevice *>(device());
+    const int count = wd->getOutput(output()).layerCount();
+
+    m_bufferObjects.reset(new WebOSKmsMailbox<BufferObject>[count]);
+    m_layerQueues.reset(new WebOSKmsBufferQueue<BufferObject>[count]);
+    m_layerQueueModes.fill(MailboxMode, count);
+    m_layerBusy.reset(new QAtomicInt[count]);
+    m_submittedGeometry.resize(count);
+    m_submittedSource.resize(count);
+    m_submittedFormat.resize(count);
+    m_layerFallback.resize(count);
+    m_nextBufferObjects.resize(count);
+    m_currentBufferObjects.resize(count);
+    m_fenceWaitBuffers.resize(count);
+    m_layerAdded.resize(count);
+
+    // Each layer starts on its own plane, addLayer() may bind another one
+    m_layerPlanes.resize(count);
+    for (int p = 0; p < count; p++)
+        m_layerPlanes[p] = p;
+
+    // Any plane whose zpos range takes the layer may end up with it
+    const WebOSKmsOutput &webosOutput = wd->getOutput(output());
+    m_layerFormats.resize(count);
+    for (int p = 0; p < count; p++) {
+        for (const QKmsPlane &plane : webosOutput.m_layerPlanes) {
+            const WebOSKmsPlane &wPlane = wd->getPlane(plane);
+            if (uint64_t(p) >= wPlane.zposMin && uint64_t(p) <= wPlane.zposMax)
+                WebOSKmsFormats::unite(&m_layerFormats[p], wPlane.formats);
+        }
+    }
+
+    qInfo() << "Screen" << name() << "has" << count << "layers";
+
+    m_flipTimer.start();
+
+    if (count > 0) {
+        m_framebufferCache.setReleaseQueue(&m_releaseQueue);
+        m_releaseQueue.start(QThread::LowestPriority);
+    }
+
+    if (count > 0 && device()->hasAtomicSupport()) {
+        m_overlayCommitThread.reset(new WebOSKmsOverlayCommitThread(this));
+        m_overlayCommitThread->start();
+    }
+}
+#endif
+
+qreal WebOSEglFSKmsGbmScreen::getDevicePixelRatio()
+{
+    if (!qFuzzyCompare(m_dpr, -1.0))
+        return m_dpr;
+
+    QByteArray env = qgetenv("WEBOS_DEVICE_PIXEL_RATIO");
+    if (!env.isEmpty()) {
+        // Override devicePixelRatio if WEBOS_DEVICE_PIXEL_RATIO is set
         // Valid values are:
         // 1) WEBOS_DEVICE_PIXEL_RATIO=auto
         // 2) WEBOS_DEVICE_PIXEL_RATIO=<ratio>
@@ -427,147 +1040,806 @@ QRect WebOSEglFSKmsGbmScreen::applicationWindowGeometry() const
 void WebOSEglFSKmsGbmScreen::updateFlipStatus()
 {
 #if (QT_VERSION < QT_VERSION_CHECK(6, 0, 0)) && (!defined(HAS_PAGEFLIPPED))
+    // No vblank sequence without pageFlipped
+    m_frameTimeline.record(WebOSKmsFrameTimeline::PageFlipped);
+    presentedWithoutEvent(WebOSKmsPresentation::Frame());
     if (page_flip_notifier)
             (*page_flip_notifier)(this);
 #endif
-    QEglFSKmsGbmScreen::updateFlipStatus();
+    {
+        QMutexLocker lock(&m_commitMutex);
+
+        // Kept out of the surface until the captures holding it are released
+        if (!m_flipPending && m_gbm_bo_current && m_gbm_bo_next
+            && m_capturedBuffers.contains(m_gbm_bo_current)) {
+            m_heldMainBuffers.append(m_gbm_bo_current);
+            m_gbm_bo_current = nullptr;
+        }
+
+        QEglFSKmsGbmScreen::updateFlipStatus();
+        releaseHeldMainBuffers();
+
+#ifdef PLANE_COMPOSITION
+        retirePendingLayerBuffers();
+        m_lastMainFlip = m_flipTimer.elapsed();
+#endif
+    }
 
 #ifdef PLANE_COMPOSITION
-    for (int p = 0; p < Plane_End; p++) {
-        // The main plane will be handled in QEglFSKmsGbmScreen
-        if (p == MainPlane)
+    if (m_flipCb)
+        m_flipCb();
+#endif
+}
+
+#ifdef PLANE_COMPOSITION
+static inline const void *captureKey(const WebOSEglFSKmsGbmScreen::BufferObject &bo)
+{
+    return bo.gbo ? static_cast<const void *>(bo.gbo) : static_cast<const void *>(bo.dmabuf);
+}
+
+#endif
+
+void WebOSEglFSKmsGbmScreen::releaseHeldMainBuffers()
+{
+    for (int i = m_heldMainBuffers.size() - 1; i >= 0; i--) {
+        gbm_bo *bo = m_heldMainBuffers[i];
+        if (m_capturedBuffers.contains(bo))
             continue;
-        struct BufferObject current = m_currentBufferObjects[p];
 
-        if (current.gbo && m_nextBufferObjects[p].updated) {
-            gbm_device *device = gbm_bo_get_device(current.gbo);
-            drmModeRmFB(gbm_device_get_fd(device), current.fb);
-            qDebug() << "destroy current bo" << current.gbo;
-            gbm_bo_destroy(current.gbo);
-        }
+        gbm_surface_release_buffer(m_gbm_surface, bo);
+        m_heldMainBuffers.remove(i);
+    }
+}
 
-        m_currentBufferObjects[p] = m_nextBufferObjects[p];
-        m_nextBufferObjects[p].updated = false;
+WebOSKmsCapture *WebOSEglFSKmsGbmScreen::capture()
+{
+    QScopedPointer<WebOSKmsCapture> capture(new WebOSKmsCapture);
+    QVector<const void *> keys;
+
+    QMutexLocker lock(&m_commitMutex);
+
+#ifdef PLANE_COMPOSITION
+    for (int p = 0; p < m_currentBufferObjects.size() && capture->bufferCount < WebOSKmsCapture::MaxBuffers - 1; p++) {
+        const BufferObject &bo = m_currentBufferObjects[p];
+        if (!bo.hasBuffer() || !bo.fb)
+            continue;
+
+        WebOSKmsCaptureBuffer &buffer = capture->buffers[capture->bufferCount];
+        LayerFormat format;
+        bool exported = bo.gbo
+            ? layerFormatForBufferObject(bo.gbo, &format) && WebOSKmsCaptureExport::exportBufferObject(bo.gbo, format.key.modifier, &buffer)
+            : WebOSKmsCaptureExport::exportDmaBuf(bo.dmabuf, &buffer);
+        if (!exported)
+            continue;
+
+        const QSize size = bufferSize(bo);
+        const WebOSKmsSourceRect source = bo.source.clampedTo(size.width(), size.height());
+        buffer.zpos = p;
+        buffer.source = QRectF(source.x / 65536.0, source.y / 65536.0, source.width / 65536.0, source.height / 65536.0);
+        buffer.destination = overlayDestination(bo.rect, geometry().size()).toRect();
+        capture->bufferCount++;
+        keys.append(captureKey(bo));
     }
+#endif
 
-    if (m_flipCb)
-        m_flipCb();
+    if (m_gbm_bo_current) {
+        WebOSKmsCaptureBuffer &buffer = capture->buffers[capture->bufferCount];
+        uint64_t modifier = DRM_FORMAT_MOD_LINEAR;
+#ifdef PLANE_COMPOSITION
+        // The user data of the surface buffer belongs to Qt
+        LayerFormat format;
+        if (queryLayerFormat(m_gbm_bo_current, &format))
+            modifier = format.key.modifier;
+#endif
+        if (WebOSKmsCaptureExport::exportBufferObject(m_gbm_bo_current, modifier, &buffer)) {
+#ifdef PLANE_COMPOSITION
+            WebOSEglFSKmsGbmDevice *wd = static_cast<WebOSEglFSKmsGbmDevice *>(device());
+            buffer.zpos = wd->getOutput(output()).mainZpos();
+#endif
+            buffer.source = QRectF(0, 0, buffer.width, buffer.height);
+            buffer.destination = QRect(QPoint(0, 0), geometry().size());
+            capture->bufferCount++;
+            keys.append(m_gbm_bo_current);
+        }
+    }
+
+    if (!capture->bufferCount)
+        return nullptr;
+
+    for (const void *key : keys)
+        m_capturedBuffers[key]++;
+    m_captures.insert(capture.data(), keys);
+
+    return capture.take();
+}
+
+void WebOSEglFSKmsGbmScreen::releaseCapture(WebOSKmsCapture *capture)
+{
+    for (int i = 0; i < capture->bufferCount; i++)
+        WebOSKmsCaptureExport::close(&capture->buffers[i]);
+
+    {
+        QMutexLocker lock(&m_commitMutex);
+
+        const QVector<const void *> keys = m_captures.take(capture);
+        for (const void *key : keys) {
+            auto it = m_capturedBuffers.find(key);
+            if (it != m_capturedBuffers.end() && --it.value() == 0)
+                m_capturedBuffers.erase(it);
+        }
+
+#ifdef PLANE_COMPOSITION
+        for (int i = m_heldLayerBuffers.size() - 1; i >= 0; i--) {
+            const BufferObject &bo = m_heldLayerBuffers[i];
+            if (m_capturedBuffers.contains(captureKey(bo)))
+                continue;
+
+            m_releaseQueue.release(bo.fb, bo.gbo, bo.dmabuf);
+            m_heldLayerBuffers.remove(i);
+        }
 #endif
+        // Main plane buffers go back to the surface on the render thread
+    }
+
+    delete capture;
 }
 
 #if (QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)) || (defined(HAS_PAGEFLIPPED))
 void WebOSEglFSKmsGbmScreen::pageFlipped(unsigned int sequence, unsigned int tv_sec, unsigned int tv_usec)
 {
+    const qint64 nsecs = qint64(tv_sec) * 1000000000 + qint64(tv_usec) * 1000;
+
+#ifdef PLANE_COMPOSITION
+    WebOSKmsPresentation::Frame overlayFrame;
+    {
+        QMutexLocker lock(&m_commitMutex);
+        if (m_overlayFlipEvent && m_overlayCommitState != OverlayCommitIdle) {
+            // Of an overlay-only commit, the main plane did not flip
+            m_overlayFlipEvent = false;
+            retireLayerBuffers();
+            overlayFrame = m_overlayFrame;
+            if (m_overlayCommitState == OverlayCommitQueued)
+                finishOverlayCommit();
+            else
+                m_overlayFlipped = true;
+        } else {
+            // The layers of the flip are on the screen now, the render
+            // thread may not get to updateFlipStatus() for a long time
+            retirePendingLayerBuffers();
+        }
+    }
+    if (m_overlayCommitThread)
+        m_overlayCommitThread->schedule();
+
+    if (overlayFrame.id) {
+        m_presentation.presented(overlayFrame, sequence, nsecs);
+        return;
+    }
+#endif
+
+    m_frameTimeline.recordPageFlipped(sequence, tv_sec, tv_usec);
+    m_presentation.presented(sequence, nsecs);
+
     if (page_flip_notifier)
         (*page_flip_notifier)(this, sequence, tv_sec, tv_usec);
 }
 #endif
 
+static bool currentVblank(int fd, int crtcIndex, quint32 *sequence, qint64 *nsecs)
+{
+    drmVBlank vbl;
+    memset(&vbl, 0, sizeof(vbl));
+
+    // Relative 0 only queries the last vblank
+    vbl.request.type = DRM_VBLANK_RELATIVE;
+    if (crtcIndex == 1)
+        vbl.request.type = drmVBlankSeqType(vbl.request.type | DRM_VBLANK_SECONDARY);
+    else if (crtcIndex > 1)
+        vbl.request.type = drmVBlankSeqType(vbl.request.type | ((crtcIndex << DRM_VBLANK_HIGH_CRTC_SHIFT) & DRM_VBLANK_HIGH_CRTC_MASK));
+
+    if (drmWaitVBlank(fd, &vbl))
+        return false;
+
+    *sequence = vbl.reply.sequence;
+    *nsecs = qint64(vbl.reply.tval_sec) * 1000000000 + qint64(vbl.reply.tval_usec) * 1000;
+    return true;
+}
+
+void WebOSEglFSKmsGbmScreen::presentedWithoutEvent(const WebOSKmsPresentation::Frame &frame)
+{
+    quint32 sequence = 0;
+    qint64 nsecs = 0;
+
+    if (m_virtualVblank) {
+        m_virtualVblank->lastVblank(&sequence, &nsecs);
+    } else if (!currentVblank(device()->fd(), output().crtc_index, &sequence, &nsecs)) {
+        qWarning() << "Failed to query vblank" << name() << this;
+        return;
+    }
+
+    if (frame.id)
+        m_presentation.presented(frame, sequence, nsecs);
+    else
+        m_presentation.presented(sequence, nsecs);
+}
+
 void WebOSEglFSKmsGbmScreen::flip()
 {
+    WebOSKmsFlipCost::Scope cost(&m_flipCost);
+
+    // Only one flip can be queued on the CRTC, the nonblocking commit
+    // of the next one would fail with EBUSY
+    if (m_pipelinedFlip)
+        waitForFlip();
+
+    if (m_virtualVblank) {
+        virtualFlip();
+        return;
+    }
+
+    m_frameTimeline.record(WebOSKmsFrameTimeline::FlipEntry);
+
+    quint32 layersUpdated = 0;
+    quint32 layersVisible = 0;
+#if QT_CONFIG(drm_atomic)
+    drmModeAtomicReq *request = nullptr;
+#endif
+
+    // Held until the main flip is committed
+    QMutexLocker commitLock(&m_commitMutex);
+
 #ifdef PLANE_COMPOSITION
+    // An overlay-only commit goes first, rare as it waits for the UI to idle
+    while (m_overlayCommitState != OverlayCommitIdle) {
+        if (!m_overlayCommitDone.wait(&m_commitMutex, 100)) {
+            qWarning() << "Overlay commit did not complete" << name() << this;
+            break;
+        }
+    }
+
     QKmsOutput &op(output());
     WebOSEglFSKmsGbmDevice *wd = static_cast<WebOSEglFSKmsGbmDevice *>(device());
     WebOSKmsOutput &webosOutput = wd->getOutput(op);
+#endif
 
     if (device()->hasAtomicSupport()) {
 #if QT_CONFIG(drm_atomic)
-        drmModeAtomicReq *request = device()->threadLocalAtomicRequest();
-
-        for (int p = 0; p < Plane_End; p++) {
-            // The main plane will be flipped in QEglFSKmsGbmScreen::flip
-            // Do some additional command for webos
-            if (p == MainPlane) {
-                WebOSKmsPlane &wPlane = wd->getPlane(*op.eglfs_plane);
-                drmModeAtomicAddProperty(request, op.eglfs_plane->id, op.eglfs_plane->zposPropertyId, p);
-                //Additional Properties
-                drmModeAtomicAddProperty(request, op.eglfs_plane->id, wPlane.blendPropertyId, 2);
+        request = device()->threadLocalAtomicRequest();
+        m_atomicState.begin();
+
+        m_variableRefresh.frameSubmitted(WebOSKmsPresentation::now());
+        addVariableRefreshProperties(request);
+        m_cursorPlane.addProperties(request, true);
+        m_fence.addProperties(request, true);
+
+#ifdef PLANE_COMPOSITION
+        // The main plane will be flipped in QEglFSKmsGbmScreen::flip
+        // Do some additional command for webos
+        {
+            WebOSKmsPlane &wPlane = wd->getPlane(*op.eglfs_plane);
+            m_atomicState.add(request, op.eglfs_plane->id, op.eglfs_plane->zposPropertyId, webosOutput.mainZpos());
+            //Additional Properties
+            m_atomicState.add(request, op.eglfs_plane->id, wPlane.blendPropertyId, 2);
 #if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
 #ifdef PROTECTED_CONTENT
-                static int secured = qEnvironmentVariableIntValue("QT_EGL_PROTECTED_RENDERING");
-                if (secured)
-                    drmModeAtomicAddProperty(request, op.eglfs_plane->id, wPlane.fbTranslationModeId, wPlane.secureMode);
+            static int secured = qEnvironmentVariableIntValue("QT_EGL_PROTECTED_RENDERING");
+            if (secured)
+                m_atomicState.add(request, op.eglfs_plane->id, wPlane.fbTranslationModeId, wPlane.secureMode);
 #endif
 #endif
-                continue;
-            }
+        }
 
-            if (!webosOutput.m_assignedPlanes.contains(p))
-                continue;
+        addLayerProperties(request);
+        m_lastMainFlip = m_flipTimer.elapsed();
+#endif
+#endif
+    }
+
+#ifdef PLANE_COMPOSITION
+    layerMasks(&layersUpdated, &layersVisible);
+#endif
+
+    const WebOSKmsPresentation::Frame frame = m_presentation.prepare(true, layersUpdated, layersVisible);
+    m_presentation.submitted(frame);
+
+#ifdef PLANE_COMPOSITION
+    // What the planes can scan out may change with the mode
+    if (!op.mode_set)
+        m_layerTestsInvalid.storeRelease(1);
+#endif
+
+    m_frameTimeline.record(WebOSKmsFrameTimeline::RequestBuilt);
+    QEglFSKmsGbmScreen::flip();
+    WebOSKmsCallStats::count(device()->hasAtomicSupport() ? WebOSKmsCallStats::AtomicCommit : WebOSKmsCallStats::PageFlip);
+    m_frameTimeline.record(WebOSKmsFrameTimeline::Commit);
+
+#if QT_CONFIG(drm_atomic)
+    if (device()->hasAtomicSupport()) {
+        // Qt hands a committed request over and starts a new one
+        const bool committed = device()->threadLocalAtomicRequest() != request;
 
-            QKmsPlane &plane = webosOutput.m_assignedPlanes[p];
-            WebOSKmsPlane &wPlane = wd->getPlane(plane);
+        // Values of a rejected request are not on the hardware
+        m_atomicState.end(committed);
+        m_fence.committed(device()->threadLocalAtomicRequest(), committed);
+        // No event comes for it, the next flip would report it
+        if (!committed)
+            m_presentation.cancel(frame);
+
+#ifdef PLANE_COMPOSITION
+        // Retired by the page flip event, overlay commits wait for it
+        if (committed)
+            m_layersFlipPending = true;
+        else
+            rollbackLayerBuffers();
+#else
+        Q_UNUSED(committed);
+#endif
+    }
+#endif
+}
+
+void WebOSEglFSKmsGbmScreen::virtualFlip()
+{
+    m_frameTimeline.record(WebOSKmsFrameTimeline::FlipEntry);
 
-            //In rendering thread - which access to m_bufferObjects
-            QMutexLocker lock(&m_bufferObjectMutex);
-            if (!m_bufferObjects[p].updated) {
-                lock.unlock();
+    if (!m_gbm_surface) {
+        qWarning("Cannot sync before platform init!");
+        return;
+    }
+
+    gbm_bo *bo = gbm_surface_lock_front_buffer(m_gbm_surface);
+    if (!bo) {
+        qWarning("Could not lock GBM surface front buffer for %s", qPrintable(name()));
+        return;
+    }
+
+    {
+        QMutexLocker commitLock(&m_commitMutex);
+        m_gbm_bo_next = bo;
+        m_flipPending = true;
+    }
+
+    m_presentation.submitted(m_presentation.prepare(true, 0, 0));
+    m_frameTimeline.record(WebOSKmsFrameTimeline::RequestBuilt);
+    m_virtualVblank->queueFlip();
+    m_frameTimeline.record(WebOSKmsFrameTimeline::Commit);
+}
+
+void WebOSEglFSKmsGbmScreen::virtualVblank(void *data, quint32 sequence, qint64 nsecs)
+{
+#if (QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)) || (defined(HAS_PAGEFLIPPED))
+    // As the page flip event would, on the vblank thread
+    static_cast<WebOSEglFSKmsGbmScreen *>(data)->pageFlipped(sequence, unsigned(nsecs / 1000000000),
+                                                             unsigned(nsecs % 1000000000 / 1000));
+#else
+    // Reported by updateFlipStatus() through presentedWithoutEvent()
+    Q_UNUSED(data);
+    Q_UNUSED(sequence);
+    Q_UNUSED(nsecs);
+#endif
+}
+
+void WebOSEglFSKmsGbmScreen::waitForFlip()
+{
+    if (!m_virtualVblank) {
+        QEglFSKmsGbmScreen::waitForFlip();
+        return;
+    }
+
+    if (!m_gbm_bo_next)
+        return;
+
+    m_virtualVblank->waitForFlip();
+    m_flipPending = false;
+    updateFlipStatus();
+}
+
+#if QT_CONFIG(drm_atomic)
+void WebOSEglFSKmsGbmScreen::addVariableRefreshProperties(drmModeAtomicReq *request)
+{
+    bool active = m_variableRefresh.addProperties(&m_atomicState, request, m_presentation.refreshInterval());
+    m_presentation.setVariableRefresh(active);
+}
+#endif
+
+bool WebOSEglFSKmsGbmScreen::setVariableRefreshMode(WebOSKmsVariableRefresh::Mode mode)
+{
+    if (mode != WebOSKmsVariableRefresh::Off && !m_variableRefresh.isCapable()) {
+        qWarning() << "Variable refresh rate is not supported by" << name();
+        return false;
+    }
+
+    qInfo() << "Variable refresh rate mode" << WebOSKmsVariableRefresh::modeName(mode) << name() << this;
+    m_variableRefresh.setMode(mode);
+    return true;
+}
+
+#ifdef PLANE_COMPOSITION
+#if QT_CONFIG(drm_atomic)
+void WebOSEglFSKmsGbmScreen::addLayerProperties(drmModeAtomicReq *request)
+{
+    // Buffers in FIFO mode go out at the vblank closest to their target
+    const qint64 vblank = m_presentation.predictNextVblank(WebOSKmsPresentation::now());
+    const qint64 refreshInterval = m_presentation.refreshInterval();
+
+    for (int p = 0; p < m_nextBufferObjects.size(); p++) {
+        // Never waits for the producers
+        if (const BufferObject *state = m_bufferObjects[p].consume()) {
+            if (state->updated) {
+                if (state->hasBuffer())
+                    m_layerQueues[p].countPresented();
+                addLayerBuffer(request, p, *state);
                 continue;
             }
 
-            BufferObject bo = m_bufferObjects[p];
-            m_bufferObjects[p].updated = false;
-            lock.unlock();
+            addLayerGeometry(request, p, *state);
+        }
 
-            m_nextBufferObjects[p] = bo;
+        // One buffer per layer and commit, the rest stays queued
+        if (m_nextBufferObjects[p].updated)
+            continue;
 
-            if (!bo.gbo) {
-                //clear overlay plane
-                qDebug() << op.name << "clear overlay" << "plane" << plane.id << "zpos" << p;
-                drmModeAtomicAddProperty(request, plane.id, plane.framebufferPropertyId, 0);
-                drmModeAtomicAddProperty(request, plane.id, plane.crtcPropertyId, 0);
-                continue;
+        // Still newer than anything queued, parked again if not ready
+        if (m_fenceWaitBuffers[p].hasBuffer()) {
+            BufferObject waiting = m_fenceWaitBuffers[p];
+            m_fenceWaitBuffers[p] = BufferObject();
+            if (m_nextBufferObjects[p].plane >= 0) {
+                waiting.rect = m_nextBufferObjects[p].rect;
+                waiting.source = m_nextBufferObjects[p].source;
+                waiting.plane = m_nextBufferObjects[p].plane;
             }
+            addLayerBuffer(request, p, waiting);
+            continue;
+        }
 
-            qDebug() << "render buffer object plane" << p << "bo" << bo.gbo << bo.rect;
-
-            // Can be null to mean clear overlay plane
-            bo.fb = framebufferForOverlayBufferObject(bo.gbo);
-            // Set fb to clear it on updateFlipStatus
-            m_nextBufferObjects[p].fb = bo.fb;
-
-            uint32_t sw = gbm_bo_get_width(bo.gbo);
-            uint32_t sh = gbm_bo_get_height(bo.gbo);
-
-            // Crop out the dest region to avoid from overflowing the screen
-            bo.rect = bo.rect.intersected(QRectF(QPointF(0,0), geometry().size()));
-
-            qDebug() << "overlay" << plane.id << "plane" << p << "fb" << bo.fb << "source" << sw << sh << "dest" << bo.rect << name() << this;
-
-            drmModeAtomicAddProperty(request, plane.id, plane.framebufferPropertyId, bo.fb);
-            drmModeAtomicAddProperty(request, plane.id, plane.crtcPropertyId, op.crtc_id);
-            drmModeAtomicAddProperty(request, plane.id, plane.srcXPropertyId, 0);
-            drmModeAtomicAddProperty(request, plane.id, plane.srcYPropertyId, 0);
-            drmModeAtomicAddProperty(request, plane.id, plane.srcwidthPropertyId, sw << 16);
-            drmModeAtomicAddProperty(request, plane.id, plane.srcheightPropertyId, sh << 16);
-            drmModeAtomicAddProperty(request, plane.id, plane.crtcXPropertyId, bo.rect.x());
-            drmModeAtomicAddProperty(request, plane.id, plane.crtcYPropertyId, bo.rect.y());
-            drmModeAtomicAddProperty(request, plane.id, plane.crtcwidthPropertyId, bo.rect.width());
-            //HACK: limit to minimum size of destination height to avoid failure of drm atomic commit
-            drmModeAtomicAddProperty(request, plane.id, plane.crtcheightPropertyId, qMax(bo.rect.height(), 270.0));
-            drmModeAtomicAddProperty(request, plane.id, plane.zposPropertyId, p);
-            //Additional Properties
-            drmModeAtomicAddProperty(request, plane.id, wPlane.blendPropertyId, 2);
+        BufferObject queued;
+        WebOSKmsBufferQueue<BufferObject>::List dropped;
+        bool taken = m_layerQueues[p].take(vblank, refreshInterval, &queued, &dropped);
+
+        for (const BufferObject &bo : dropped)
+            m_releaseQueue.release(0, bo.gbo, bo.dmabuf);
+
+        if (!taken)
+            continue;
+
+        // The latest geometry applies to queued buffers too
+        if (m_nextBufferObjects[p].plane >= 0) {
+            queued.rect = m_nextBufferObjects[p].rect;
+            queued.source = m_nextBufferObjects[p].source;
+            queued.plane = m_nextBufferObjects[p].plane;
+        }
+        addLayerBuffer(request, p, queued);
+    }
+}
+
+void WebOSEglFSKmsGbmScreen::addLayerGeometry(drmModeAtomicReq *request, int p, const BufferObject &bo)
+{
+    WebOSEglFSKmsGbmDevice *wd = static_cast<WebOSEglFSKmsGbmDevice *>(device());
+    WebOSKmsOutput &webosOutput = wd->getOutput(output());
+
+    // Geometry only, move the buffer which is already on the plane
+    m_nextBufferObjects[p].rect = bo.rect;
+    m_nextBufferObjects[p].source = bo.source;
+    if (!m_nextBufferObjects[p].hasBuffer() || !m_nextBufferObjects[p].fb)
+        return;
+
+    QKmsPlane &plane = webosOutput.m_layerPlanes[m_nextBufferObjects[p].plane];
+    QRectF rect = overlayDestination(bo.rect, geometry().size());
+    const QSize size = bufferSize(m_nextBufferObjects[p]);
+    WebOSKmsSourceRect source = bo.source.clampedTo(size.width(), size.height());
+    qDebug() << "move overlay" << plane.id << "plane" << p << "dest" << rect << name() << this;
+
+    m_atomicState.add(request, plane.id, plane.srcXPropertyId, source.x);
+    m_atomicState.add(request, plane.id, plane.srcYPropertyId, source.y);
+    m_atomicState.add(request, plane.id, plane.srcwidthPropertyId, source.width);
+    m_atomicState.add(request, plane.id, plane.srcheightPropertyId, source.height);
+    m_atomicState.add(request, plane.id, plane.crtcXPropertyId, rect.x());
+    m_atomicState.add(request, plane.id, plane.crtcYPropertyId, rect.y());
+    m_atomicState.add(request, plane.id, plane.crtcwidthPropertyId, rect.width());
+    m_atomicState.add(request, plane.id, plane.crtcheightPropertyId, rect.height());
+}
+
+void WebOSEglFSKmsGbmScreen::addLayerBuffer(drmModeAtomicReq *request, int p, BufferObject bo)
+{
+    QKmsOutput &op(output());
+    WebOSEglFSKmsGbmDevice *wd = static_cast<WebOSEglFSKmsGbmDevice *>(device());
+    WebOSKmsOutput &webosOutput = wd->getOutput(op);
+
+    if (bo.plane < 0 || bo.plane >= webosOutput.layerCount()) {
+        qWarning() << "No plane for layer" << p << "bo" << bo.gbo;
+        return;
+    }
+
+    QKmsPlane &plane = webosOutput.m_layerPlanes[bo.plane];
+    WebOSKmsPlane &wPlane = wd->getPlane(plane);
+
+    // Without IN_FENCE_FD the plane would scan out a buffer the producer
+    // is still writing. Polled, the commit does not wait for the producer.
+    const int acquireFence = bo.dmabuf ? bo.dmabuf->descriptor().acquireFence : -1;
+    if (acquireFence >= 0 && !wPlane.inFencePropertyId && !WebOSKmsFence::wait(acquireFence, 0)) {
+        const BufferObject &waiting = m_fenceWaitBuffers[p];
+        if (waiting.hasBuffer() && captureKey(waiting) != captureKey(bo))
+            m_releaseQueue.release(0, waiting.gbo, waiting.dmabuf);
+        m_fenceWaitBuffers[p] = bo;
+        return;
+    }
+
+    // Replaced by a newer buffer that is ready
+    const BufferObject &waiting = m_fenceWaitBuffers[p];
+    if (waiting.hasBuffer()) {
+        if (captureKey(waiting) != captureKey(bo))
+            m_releaseQueue.release(0, waiting.gbo, waiting.dmabuf);
+        m_fenceWaitBuffers[p] = BufferObject();
+    }
+
+    // Not retired yet, nothing else would release it
+    const BufferObject &superseded = m_nextBufferObjects[p];
+    if (superseded.updated && superseded.hasBuffer() && captureKey(superseded) != captureKey(bo)) {
+        qWarning() << "Layer" << p << "buffer replaced before it was retired" << name();
+        m_releaseQueue.release(superseded.fb, superseded.gbo, superseded.dmabuf);
+    }
+
+    m_nextBufferObjects[p] = bo;
+
+    if (!bo.hasBuffer()) {
+        //clear overlay plane
+        qDebug() << op.name << "clear overlay" << "plane" << plane.id << "zpos" << p;
+        // Everything is written again once the plane is back on
+        m_atomicState.forget(plane.id);
+        m_atomicState.add(request, plane.id, plane.framebufferPropertyId, 0);
+        m_atomicState.add(request, plane.id, plane.crtcPropertyId, 0);
+        return;
+    }
+
+    qDebug() << "render buffer object plane" << p << "bo" << bo.gbo << "dmabuf" << bo.dmabuf << bo.rect;
+
+    // Can be null to mean clear overlay plane
+    bo.fb = framebufferForBuffer(bo);
+    // Set fb to clear it on updateFlipStatus
+    m_nextBufferObjects[p].fb = bo.fb;
+
+    const QSize size = bufferSize(bo);
+    uint32_t sw = size.width();
+    uint32_t sh = size.height();
+    WebOSKmsSourceRect source = bo.source.clampedTo(sw, sh);
+
+    bo.rect = overlayDestination(bo.rect, geometry().size());
+
+    qDebug() << "overlay" << plane.id << "plane" << p << "fb" << bo.fb << "source" << sw << sh << "dest" << bo.rect << name() << this;
+
+    m_atomicState.add(request, plane.id, plane.framebufferPropertyId, bo.fb);
+    m_atomicState.add(request, plane.id, plane.crtcPropertyId, op.crtc_id);
+    m_atomicState.add(request, plane.id, plane.srcXPropertyId, source.x);
+    m_atomicState.add(request, plane.id, plane.srcYPropertyId, source.y);
+    m_atomicState.add(request, plane.id, plane.srcwidthPropertyId, source.width);
+    m_atomicState.add(request, plane.id, plane.srcheightPropertyId, source.height);
+    m_atomicState.add(request, plane.id, plane.crtcXPropertyId, bo.rect.x());
+    m_atomicState.add(request, plane.id, plane.crtcYPropertyId, bo.rect.y());
+    m_atomicState.add(request, plane.id, plane.crtcwidthPropertyId, bo.rect.width());
+    m_atomicState.add(request, plane.id, plane.crtcheightPropertyId, bo.rect.height());
+    m_atomicState.add(request, plane.id, plane.zposPropertyId, p);
+    //Additional Properties
+    m_atomicState.add(request, plane.id, wPlane.blendPropertyId, 2);
+
+    // Per commit, the kernel waits for it before the plane scans out
+    if (acquireFence >= 0 && wPlane.inFencePropertyId)
+        drmModeAtomicAddProperty(request, plane.id, wPlane.inFencePropertyId, acquireFence);
 
 #ifdef PROTECTED_CONTENT
-            int secured = 0;
-            gbm_perform(GBM_PERFORM_GET_SECURE_BUFFER_STATUS, bo.gbo, &secured);
-            if (secured) {
-                qDebug() << "overlay bo" << bo.gbo << "secured";
+    int secured = 0;
+    if (bo.gbo)
+        gbm_perform(GBM_PERFORM_GET_SECURE_BUFFER_STATUS, bo.gbo, &secured);
+    if (secured) {
+        qDebug() << "overlay bo" << bo.gbo << "secured";
 #if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
-                drmModeAtomicAddProperty(request, plane.id, wPlane.fbTranslationModeId, wPlane.secureMode);
+        m_atomicState.add(request, plane.id, wPlane.fbTranslationModeId, wPlane.secureMode);
 #else
-                drmModeAtomicAddProperty(request, plane.id, plane.fbTranslationModeId, plane.secureMode);
+        m_atomicState.add(request, plane.id, plane.fbTranslationModeId, plane.secureMode);
 #endif
-            }
+    }
+#endif
+}
 #endif
+
+void WebOSEglFSKmsGbmScreen::retireLayerBuffers()
+{
+    for (int p = 0; p < m_nextBufferObjects.size(); p++) {
+        struct BufferObject current = m_currentBufferObjects[p];
+
+        // Released on the worker, never blocks the flip completion
+        if (current.hasBuffer() && m_nextBufferObjects[p].updated)
+            releaseRetiredLayerBuffer(current);
+
+        // The plane is off now and can be bound to another layer
+        if (m_nextBufferObjects[p].updated && !m_nextBufferObjects[p].hasBuffer())
+            m_layerBusy[p].storeRelease(0);
+
+        m_currentBufferObjects[p] = m_nextBufferObjects[p];
+        m_nextBufferObjects[p].updated = false;
+    }
+}
+
+void WebOSEglFSKmsGbmScreen::retirePendingLayerBuffers()
+{
+    if (!m_layersFlipPending)
+        return;
+
+    retireLayerBuffers();
+    m_layersFlipPending = false;
+}
+
+void WebOSEglFSKmsGbmScreen::finishOverlayCommit()
+{
+    m_overlayCommitState = OverlayCommitIdle;
+    m_overlayFlipped = false;
+    m_overlayCommitDone.wakeAll();
+}
+
+void WebOSEglFSKmsGbmScreen::releaseRetiredLayerBuffer(const BufferObject &bo)
+{
+    if (m_capturedBuffers.contains(captureKey(bo))) {
+        m_heldLayerBuffers.append(bo);
+        return;
+    }
+
+    m_releaseQueue.release(bo.fb, bo.gbo, bo.dmabuf);
+}
+
+void WebOSEglFSKmsGbmScreen::layerMasks(quint32 *updated, quint32 *visible) const
+{
+    for (int p = 0; p < qMin(m_nextBufferObjects.size(), 32); p++) {
+        if (m_nextBufferObjects[p].updated)
+            *updated |= 1u << p;
+        if (m_nextBufferObjects[p].hasBuffer())
+            *visible |= 1u << p;
+    }
+}
+
+void WebOSEglFSKmsGbmScreen::rollbackLayerBuffers()
+{
+    for (int p = 0; p < m_nextBufferObjects.size(); p++) {
+        struct BufferObject next = m_nextBufferObjects[p];
+
+        if (next.updated && next.hasBuffer())
+            m_releaseQueue.release(next.fb, next.gbo, next.dmabuf);
+
+        m_nextBufferObjects[p] = m_currentBufferObjects[p];
+        m_nextBufferObjects[p].updated = false;
+    }
+}
+
+int WebOSEglFSKmsGbmScreen::commitOverlays()
+{
+#if QT_CONFIG(drm_atomic)
+    QMutexLocker lock(&m_commitMutex);
+
+    // Its page flip event schedules the thread again
+    if (m_overlayCommitState != OverlayCommitIdle)
+        return 0;
+
+    const qint64 now = WebOSKmsPresentation::now();
+    const qint64 vblank = m_presentation.predictNextVblank(now);
+    const qint64 refreshInterval = m_presentation.refreshInterval();
+
+    bool pending = false;
+    bool fenceWait = false;
+    qint64 wakeUp = -1;
+    for (int p = 0; p < m_nextBufferObjects.size(); p++) {
+        pending |= m_bufferObjects[p].isPending();
+
+        const BufferObject &waiting = m_fenceWaitBuffers[p];
+        if (waiting.hasBuffer()) {
+            if (WebOSKmsFence::wait(waiting.dmabuf->descriptor().acquireFence, 0))
+                pending = true;
+            else
+                fenceWait = true;
         }
+
+        qint64 target = m_layerQueues[p].nextTarget();
+        if (target < 0)
+            continue;
+
+        if (target <= vblank + refreshInterval / 2)
+            pending = true;
+        else if (wakeUp < 0 || target < wakeUp)
+            wakeUp = target;
+    }
+
+    // Would replace the layer buffers of the queued main flip before
+    // they are retired, come back once its page flip event is handled
+    if (pending && m_layersFlipPending)
+        return int(qMax(refreshInterval / 1000000, qint64(1)));
+
+    if (!pending) {
+        // Poll the acquire fence of a parked buffer again
+        if (fenceWait)
+            return 1;
+        // Already taken by the main flip, or come back one frame before a queued buffer is due
+        if (wakeUp < 0)
+            return 0;
+        return int(qMax((wakeUp - now - refreshInterval * 3 / 2) / 1000000, qint64(1)));
+    }
+
+    // Let the layers go out with the main plane while the UI is flipping
+    const qint64 idleInterval = 2000 / qMax(refreshRate(), qreal(1));
+    const qint64 sinceFlip = m_flipTimer.elapsed() - m_lastMainFlip;
+    if (sinceFlip < idleInterval)
+        return idleInterval - sinceFlip;
+
+    if (!m_overlayRequest)
+        m_overlayRequest.reset(drmModeAtomicAlloc());
+    drmModeAtomicReq *request = m_overlayRequest.data();
+    if (!request)
+        return 0;
+
+    drmModeAtomicSetCursor(request, 0);
+    m_atomicState.begin();
+    addLayerProperties(request);
+    m_cursorPlane.addProperties(request, false);
+
+    quint32 layersUpdated = 0;
+    quint32 layersVisible = 0;
+    layerMasks(&layersUpdated, &layersVisible);
+
+    // New layer content drives the refresh cadence as well
+    if (layersUpdated)
+        m_variableRefresh.frameSubmitted(now);
+    addVariableRefreshProperties(request);
+    WebOSKmsPresentation::Frame frame = m_presentation.prepare(false, layersUpdated, layersVisible);
+
+    m_frameTimeline.record(WebOSKmsFrameTimeline::RequestBuilt);
+    m_fence.addProperties(request, false);
+
+#if (QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)) || (defined(HAS_PAGEFLIPPED))
+    // Completes in pageFlipped(), a virtual vblank has no event to give
+    const bool flipEvent = !m_virtualVblank;
+#else
+    const bool flipEvent = false;
 #endif
+
+    // Committed without the lock, the main flip waits for it instead
+    m_overlayCommitState = OverlayCommitInFlight;
+    m_overlayFlipEvent = flipEvent;
+    m_overlayFrame = frame;
+    lock.unlock();
+
+    int ret = flipEvent
+        ? drmModeAtomicCommit(device()->fd(), request, DRM_MODE_ATOMIC_NONBLOCK | DRM_MODE_PAGE_FLIP_EVENT, this)
+        : drmModeAtomicCommit(device()->fd(), request, 0, nullptr);
+    WebOSKmsCallStats::count(WebOSKmsCallStats::AtomicCommit);
+
+    lock.relock();
+    m_atomicState.end(ret == 0);
+    m_fence.committed(request, ret == 0);
+    m_frameTimeline.record(WebOSKmsFrameTimeline::OverlayCommit);
+
+    if (ret) {
+        rollbackLayerBuffers();
+        m_overlayFlipEvent = false;
+        finishOverlayCommit();
+        // Another commit still queued on the CRTC, queued buffers
+        // go out after its vblank
+        if (ret == -EBUSY)
+            return int(qMax(refreshInterval / 1000000, qint64(1)));
+        qWarning() << "Failed to commit overlay planes" << ret << name() << this;
+        return 0;
+    }
+
+    if (!flipEvent) {
+        retireLayerBuffers();
+        // Latched on the last vblank when the commit returns
+        presentedWithoutEvent(frame);
+        finishOverlayCommit();
+    } else if (m_overlayFlipped) {
+        finishOverlayCommit();
+    } else {
+        m_overlayCommitState = OverlayCommitQueued;
     }
 #endif
 
-    QEglFSKmsGbmScreen::flip();
+    return 0;
 }
+#endif
 
 #ifndef PLANE_COMPOSITION
 #ifdef SECURE_RENDERING
@@ -593,44 +1865,246 @@ uint32_t WebOSEglFSKmsGbmScreen::gbmFlags()
 }
 #endif
 
-uint32_t WebOSEglFSKmsGbmScreen::framebufferForOverlayBufferObject(gbm_bo *bo)
+bool WebOSEglFSKmsGbmScreen::layerFormatForBufferObject(gbm_bo *bo, LayerFormat *format)
+{
+    // Overlay buffers are owned by the screen, nothing else sets their user
+    // data. The format and the inode never change for a bo.
+    if (const LayerFormat *cached = static_cast<const LayerFormat *>(gbm_bo_get_user_data(bo))) {
+        *format = *cached;
+        return true;
+    }
+
+    if (!queryLayerFormat(bo, format))
+        return false;
+
+    gbm_bo_set_user_data(bo, new LayerFormat(*format), [](gbm_bo *, void *data) {
+        delete static_cast<LayerFormat *>(data);
+    });
+    return true;
+}
+
+bool WebOSEglFSKmsGbmScreen::queryLayerFormat(gbm_bo *bo, LayerFormat *format)
 {
-    struct gbm_import_fd_data import_fd_data;
-    generic_buf_layout_t buf_layout;
     uint32_t alignedWidth = 0;
     uint32_t alignedHeight = 0;
-    uint32_t stride[4] = { 0 };
-    uint32_t offset[4] = { 0 };
     uint32_t ubwc_status = 0;
 
     gbm_perform(GBM_PERFORM_GET_BO_ALIGNED_WIDTH, bo, &alignedWidth);
     gbm_perform(GBM_PERFORM_GET_BO_ALIGNED_HEIGHT, bo, &alignedHeight);
     gbm_perform(GBM_PERFORM_GET_UBWC_STATUS, bo, &ubwc_status);
 
-    import_fd_data.fd = gbm_bo_get_fd(bo);
-    import_fd_data.format = gbm_bo_get_format(bo);
+    format->size = QSize(gbm_bo_get_width(bo), gbm_bo_get_height(bo));
+    format->key.format = gbm_bo_get_format(bo);
+    format->key.modifier = ubwc_status == 0 ? 0 : DRM_FORMAT_MOD_QCOM_COMPRESSED;
+    format->key.width = alignedWidth;
+    format->key.height = alignedHeight;
+#ifdef PROTECTED_CONTENT
+    int secured = 0;
+    gbm_perform(GBM_PERFORM_GET_SECURE_BUFFER_STATUS, bo, &secured);
+    format->secure = secured;
+#endif
 
-    int ret = gbm_perform(GBM_PERFORM_GET_PLANE_INFO, bo, &buf_layout);
-    if (ret == GBM_ERROR_NONE) {
-        for(int j=0; j< buf_layout.num_planes; j++) {
-            offset[j] = buf_layout.planes[j].offset;
-            stride[j] = buf_layout.planes[j].v_increment;
+    // Without the inode the framebuffer cannot be cached. The QTI gbm
+    // returns the fd of the bo itself, which is not closed.
+    return WebOSKmsFramebufferCache::keyForDmaBuf(gbm_bo_get_fd(bo), format->key.format, format->key.modifier,
+                                                  alignedWidth, alignedHeight, &format->key);
+}
+
+bool WebOSEglFSKmsGbmScreen::layerFormatForDmaBuf(const WebOSKmsDmaBuf *dmabuf, LayerFormat *format)
+{
+    const WebOSKmsDmaBufDescriptor &desc = dmabuf->descriptor();
+
+    format->size = QSize(desc.width, desc.height);
+    format->key.format = desc.format;
+    format->key.modifier = desc.modifier;
+    format->key.width = desc.width;
+    format->key.height = desc.height;
+
+    // Any plane may differ between buffers sharing the first dma-buf
+    for (int i = 0; i < desc.planeCount; i++) {
+        if (!WebOSKmsFramebufferCache::setKeyPlane(&format->key, i, desc.fds[i], desc.offsets[i], desc.pitches[i]))
+            return false;
+    }
+    return true;
+}
+
+bool WebOSEglFSKmsGbmScreen::layerFormatForBuffer(const BufferObject &bo, LayerFormat *format)
+{
+    if (bo.dmabuf)
+        return layerFormatForDmaBuf(bo.dmabuf, format);
+    return bo.gbo && layerFormatForBufferObject(bo.gbo, format);
+}
+
+QSize WebOSEglFSKmsGbmScreen::bufferSize(const BufferObject &bo)
+{
+    if (bo.dmabuf)
+        return QSize(bo.dmabuf->descriptor().width, bo.dmabuf->descriptor().height);
+    if (bo.gbo)
+        return QSize(gbm_bo_get_width(bo.gbo), gbm_bo_get_height(bo.gbo));
+    return QSize();
+}
+
+void WebOSEglFSKmsGbmScreen::destroyBuffer(const BufferObject &bo)
+{
+    if (bo.gbo)
+        gbm_bo_destroy(bo.gbo);
+    delete bo.dmabuf;
+}
+
+bool WebOSEglFSKmsGbmScreen::testLayer(const QKmsPlane &plane, uint32_t fb, const WebOSKmsSourceRect &source, const QRectF &dest, uint32_t zpos, bool secure)
+{
+#if QT_CONFIG(drm_atomic)
+    WebOSEglFSKmsGbmDevice *wd = static_cast<WebOSEglFSKmsGbmDevice *>(device());
+    WebOSKmsPlane &wPlane = wd->getPlane(plane);
+
+    drmModeAtomicReq *request = drmModeAtomicAlloc();
+    if (!request)
+        return true;
+
+    drmModeAtomicAddProperty(request, plane.id, plane.framebufferPropertyId, fb);
+    drmModeAtomicAddProperty(request, plane.id, plane.crtcPropertyId, output().crtc_id);
+    drmModeAtomicAddProperty(request, plane.id, plane.srcXPropertyId, source.x);
+    drmModeAtomicAddProperty(request, plane.id, plane.srcYPropertyId, source.y);
+    drmModeAtomicAddProperty(request, plane.id, plane.srcwidthPropertyId, source.width);
+    drmModeAtomicAddProperty(request, plane.id, plane.srcheightPropertyId, source.height);
+    drmModeAtomicAddProperty(request, plane.id, plane.crtcXPropertyId, dest.x());
+    drmModeAtomicAddProperty(request, plane.id, plane.crtcYPropertyId, dest.y());
+    drmModeAtomicAddProperty(request, plane.id, plane.crtcwidthPropertyId, dest.width());
+    drmModeAtomicAddProperty(request, plane.id, plane.crtcheightPropertyId, dest.height());
+    drmModeAtomicAddProperty(request, plane.id, plane.zposPropertyId, zpos);
+    if (wPlane.blendPropertyId)
+        drmModeAtomicAddProperty(request, plane.id, wPlane.blendPropertyId, 2);
+#ifdef PROTECTED_CONTENT
+    // As addLayerBuffer() commits a secure buffer
+    if (secure) {
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+        drmModeAtomicAddProperty(request, plane.id, wPlane.fbTranslationModeId, wPlane.secureMode);
+#else
+        drmModeAtomicAddProperty(request, plane.id, plane.fbTranslationModeId, plane.secureMode);
+#endif
+    }
+#else
+    Q_UNUSED(secure);
+#endif
+
+    int ret = drmModeAtomicCommit(device()->fd(), request, DRM_MODE_ATOMIC_TEST_ONLY, nullptr);
+    drmModeAtomicFree(request);
+    WebOSKmsCallStats::count(WebOSKmsCallStats::AtomicTestCommit);
+
+    return ret == 0;
+#else
+    Q_UNUSED(plane);
+    Q_UNUSED(fb);
+    Q_UNUSED(source);
+    Q_UNUSED(dest);
+    Q_UNUSED(zpos);
+    Q_UNUSED(secure);
+    return true;
+#endif
+}
+
+bool WebOSEglFSKmsGbmScreen::validateLayerLocked(uint32_t zpos, int planeIndex, const LayerFormat &format, const QRectF &rect,
+                                                 const WebOSKmsSourceRect &source, const BufferObject *bo)
+{
+    if (!device()->hasAtomicSupport() || !format.key.format || format.size.isEmpty())
+        return true;
+
+    WebOSEglFSKmsGbmDevice *wd = static_cast<WebOSEglFSKmsGbmDevice *>(device());
+    WebOSKmsOutput &webosOutput = wd->getOutput(output());
+
+    if (planeIndex < 0 || planeIndex >= webosOutput.layerCount())
+        return false;
+
+    // Nothing on the screen to test
+    QRectF dest = overlayDestination(rect, geometry().size());
+    if (dest.width() <= 0)
+        return true;
+
+    const QKmsPlane &plane = webosOutput.m_layerPlanes[planeIndex];
+    const WebOSKmsSourceRect src = source.clampedTo(format.size.width(), format.size.height());
+
+    // Coarse enough for a video being zoomed to test only a few times
+    WebOSKmsLayerTestKey key;
+    key.planeId = plane.id;
+    key.format = format.key.format;
+    key.modifier = format.key.modifier;
+    key.scaleX = uint32_t(qCeil(src.width / 65536.0 / dest.width() * 8));
+    key.scaleY = uint32_t(qCeil(src.height / 65536.0 / dest.height() * 8));
+    key.secure = format.secure;
+
+    if (m_layerTestsInvalid.fetchAndStoreAcquire(0))
+        m_layerTestResults.clear();
+
+    auto it = m_layerTestResults.find(key);
+    if (it != m_layerTestResults.end()) {
+        it->lastUsed = ++m_layerTestCounter;
+        return it->supported;
+    }
+
+    // Imported here once, flip() finds it in the cache
+    uint32_t fb = bo ? framebufferForBuffer(*bo) : m_framebufferCache.acquire(format.key);
+    if (!fb)
+        return true;
+
+    bool supported = testLayer(plane, fb, src, dest, zpos, format.secure);
+    m_framebufferCache.release(fb);
+
+    qInfo() << "Layer config plane" << plane.id << "format" << key.format << "modifier" << key.modifier
+            << "scale" << key.scaleX << key.scaleY << "secure" << key.secure
+            << (supported ? "is supported" : "needs GPU composition");
+
+    if (m_layerTestResults.size() >= LayerTestCapacity) {
+        auto victim = m_layerTestResults.begin();
+        for (auto it = m_layerTestResults.begin(); it != m_layerTestResults.end(); ++it) {
+            if (it->lastUsed < victim->lastUsed)
+                victim = it;
         }
+        m_layerTestResults.erase(victim);
+    }
+
+    LayerTestResult result;
+    result.supported = supported;
+    result.lastUsed = ++m_layerTestCounter;
+    m_layerTestResults.insert(key, result);
+    return supported;
+}
+
+uint32_t WebOSEglFSKmsGbmScreen::framebufferForOverlayBufferObject(gbm_bo *bo)
+{
+    struct gbm_import_fd_data import_fd_data;
+    generic_buf_layout_t buf_layout;
+
+    LayerFormat format;
+    bool cacheable = layerFormatForBufferObject(bo, &format);
+    if (cacheable) {
+        uint32_t fb = m_framebufferCache.acquire(format.key);
+        if (fb)
+            return fb;
     }
 
-    qDebug() << bo << gbm_bo_get_fd(bo) << alignedWidth << alignedHeight << "format" << import_fd_data.format << "NV12" << GBM_FORMAT_NV12 << ubwc_status;
+    const uint32_t alignedWidth = format.key.width;
+    const uint32_t alignedHeight = format.key.height;
+    const uint64_t modifier = format.key.modifier;
 
-    // The gem_handle should not be closed by another screen
-    // Cover mirroring case when same gem handle is used across the screens
-    QMutexLocker lock(&s_frameBufferMutex);
+    // Owned by the bo on the QTI gbm
+    import_fd_data.fd = gbm_bo_get_fd(bo);
+    import_fd_data.format = format.key.format;
 
-    uint32_t gem_handle = 0;
-    ret = drmPrimeFDToHandle(device()->fd(), import_fd_data.fd, &gem_handle);
-    if (ret) {
-        qWarning() << "Failed to drmPrimeFDToHandle" << device()->fd() << import_fd_data.fd;
+    int ret = gbm_perform(GBM_PERFORM_GET_PLANE_INFO, bo, &buf_layout);
+    if (ret != GBM_ERROR_NONE) {
+        qWarning() << "Failed to get plane info" << bo;
         return 0;
     }
 
+    qDebug() << bo << import_fd_data.fd << alignedWidth << alignedHeight << "format" << import_fd_data.format << "NV12" << GBM_FORMAT_NV12 << modifier;
+
+    // Shared with mirrored screens showing the same buffer
+    WebOSKmsGemRegistry *registry = static_cast<WebOSEglFSKmsGbmDevice *>(device())->gemRegistry();
+    WebOSKmsGemRegistry::Reference reference;
+    if (!registry->acquire(import_fd_data.fd, &reference))
+        return 0;
+    const uint32_t gem_handle = reference.handle;
+
     struct drm_mode_fb_cmd2 cmd2 {};
     cmd2.width = alignedWidth;
     cmd2.height = alignedHeight;
@@ -641,7 +2115,7 @@ uint32_t WebOSEglFSKmsGbmScreen::framebufferForOverlayBufferObject(gbm_bo *bo)
         cmd2.handles[i] = gem_handle;
         cmd2.pitches[i] = buf_layout.planes[0].v_increment;
         cmd2.offsets[i] = 0;
-        cmd2.modifier[i] = ubwc_status == 0 ? 0 : DRM_FORMAT_MOD_QCOM_COMPRESSED;
+        cmd2.modifier[i] = modifier;
     }
 
     // In ubwc case, the offsets[0] is non-zero.
@@ -652,91 +2126,444 @@ uint32_t WebOSEglFSKmsGbmScreen::framebufferForOverlayBufferObject(gbm_bo *bo)
         cmd2.offsets[1] = cmd2.pitches[0] * cmd2.height;
     }
 
+    WebOSKmsCallStats::count(WebOSKmsCallStats::AddFramebuffer);
     if ((ret = drmIoctl(device()->fd(), DRM_IOCTL_MODE_ADDFB2, &cmd2))) {
         qWarning() << "Failed to DRM_IOCTL_MODE_ADDFB2" << bo << gem_handle;
+        registry->release(reference);
         return 0;
     }
 
     uint32_t fb = cmd2.fb_id;
 
-    struct drm_gem_close gem_close = {};
-    gem_close.handle = gem_handle;
-    if (drmIoctl(device()->fd(), DRM_IOCTL_GEM_CLOSE, &gem_close)) {
-        qWarning() << "Failed to DRM_IOCTL_GEM_CLOSE" << bo << gem_handle;
+    // The handle stays open until the framebuffer is removed
+    registry->attach(fb, &reference, 1);
+
+    if (cacheable)
+        m_framebufferCache.insert(format.key, fb);
+
+    return fb;
+}
+
+uint32_t WebOSEglFSKmsGbmScreen::framebufferForDmaBuf(const WebOSKmsDmaBuf *dmabuf)
+{
+    LayerFormat format;
+    bool cacheable = layerFormatForDmaBuf(dmabuf, &format);
+    if (cacheable) {
+        uint32_t fb = m_framebufferCache.acquire(format.key);
+        if (fb)
+            return fb;
+    }
+
+    const WebOSKmsDmaBufDescriptor &desc = dmabuf->descriptor();
+
+    struct drm_mode_fb_cmd2 cmd2 {};
+    cmd2.width = desc.width;
+    cmd2.height = desc.height;
+    cmd2.pixel_format = desc.format;
+    if (desc.modifier != DRM_FORMAT_MOD_INVALID)
+        cmd2.flags = DRM_MODE_FB_MODIFIERS;
+
+    // Shared with mirrored screens showing the same buffer
+    WebOSKmsGemRegistry *registry = static_cast<WebOSEglFSKmsGbmDevice *>(device())->gemRegistry();
+    WebOSKmsGemRegistry::Reference references[4];
+    int referenceCount = 0;
+
+    int ret = 0;
+    for (int i = 0; i < desc.planeCount; i++) {
+        if (!registry->acquire(desc.fds[i], &references[i])) {
+            ret = -1;
+            break;
+        }
+        referenceCount++;
+        cmd2.handles[i] = references[i].handle;
+        cmd2.pitches[i] = desc.pitches[i];
+        cmd2.offsets[i] = desc.offsets[i];
+        if (cmd2.flags & DRM_MODE_FB_MODIFIERS)
+            cmd2.modifier[i] = desc.modifier;
+    }
+
+    qDebug() << "dmabuf" << dmabuf << desc.width << desc.height << "format" << desc.format << "modifier" << desc.modifier << "planes" << desc.planeCount;
+
+    if (!ret) {
+        WebOSKmsCallStats::count(WebOSKmsCallStats::AddFramebuffer);
+        if ((ret = drmIoctl(device()->fd(), DRM_IOCTL_MODE_ADDFB2, &cmd2)))
+            qWarning() << "Failed to DRM_IOCTL_MODE_ADDFB2 dmabuf" << dmabuf << cmd2.handles[0];
+    }
+
+    if (ret) {
+        for (int i = 0; i < referenceCount; i++)
+            registry->release(references[i]);
         return 0;
     }
 
-    return fb;
+    // The handles stay open until the framebuffer is removed
+    registry->attach(cmd2.fb_id, references, referenceCount);
+
+    if (cacheable)
+        m_framebufferCache.insert(format.key, cmd2.fb_id);
+
+    return cmd2.fb_id;
 }
 
-#if QT_VERSION < QT_VERSION_CHECK(6, 0, 0)
-void WebOSEglFSKmsGbmScreen::setOverlayBufferObject(void *bo, QRectF rect, uint32_t zpos)
+uint32_t WebOSEglFSKmsGbmScreen::framebufferForBuffer(const BufferObject &bo)
 {
-    QKmsOutput &op(output());
-    WebOSEglFSKmsGbmDevice *wd = static_cast<WebOSEglFSKmsGbmDevice *>(device());
-    WebOSKmsOutput &webosOutput = wd->getOutput(op);
+    if (bo.dmabuf)
+        return framebufferForDmaBuf(bo.dmabuf);
+    return bo.gbo ? framebufferForOverlayBufferObject(bo.gbo) : 0;
+}
 
-    if (!webosOutput.m_assignedPlanes.contains(zpos)) {
-        qWarning() << "WebOSEglFSKmsGbmScreen::setOverlayBufferObject - no plane for" << zpos << "bo" << bo;
-        gbm_bo_destroy((gbm_bo *)bo);
+void WebOSEglFSKmsGbmScreen::submitBufferObject(uint32_t zpos, const BufferObject &bo)
+{
+    QMutexLocker lock(&m_submitMutex);
+
+    m_submittedGeometry[zpos] = bo.rect;
+
+    BufferObject state = bo;
+    state.plane = m_layerPlanes[zpos];
+    state.source = m_submittedSource[zpos];
+
+    BufferObject superseded;
+    bool replaced = m_bufferObjects[zpos].publish(state, &superseded);
+
+    if (m_overlayCommitThread)
+        m_overlayCommitThread->schedule();
+
+    if (!replaced || !superseded.updated)
+        return;
+
+    if (bo.updated) {
+        // Replaced before the render thread picked it up
+        qDebug() << "destroy old bo" << superseded.gbo << "dmabuf" << superseded.dmabuf;
+        if (superseded.hasBuffer()) {
+            m_layerQueues[zpos].countDropped();
+            destroyBuffer(superseded);
+        }
         return;
     }
 
-    qDebug() << "QEglFSKmsGbmScreen::setOverlayPlaneFramebuffer:" << bo << name() << rect << zpos;
+    // Geometry only, keep the pending buffer with the new geometry.
+    // What comes back is the geometry-only state published above.
+    BufferObject carried = superseded;
+    carried.rect = bo.rect;
+    carried.source = state.source;
+    BufferObject dropped;
+    m_bufferObjects[zpos].publish(carried, &dropped);
+}
+
+bool WebOSEglFSKmsGbmScreen::acceptLayerBuffer(uint32_t zpos, const BufferObject &bo)
+{
+    bool supported = true;
+    const QRectF &rect = bo.rect;
+
+    LayerFormat format;
+    layerFormatForBuffer(bo, &format);
+
+    {
+        QMutexLocker lock(&m_submitMutex);
+
+        const LayerFormat &last = m_submittedFormat[zpos];
+        bool unchanged = last.key.format == format.key.format && last.key.modifier == format.key.modifier
+            && last.size == format.size && m_submittedGeometry[zpos] == rect;
+
+        // Only a new geometry or buffer format is tested
+        if (unchanged)
+            supported = !m_layerFallback[zpos];
+        else
+            supported = validateLayerLocked(zpos, m_layerPlanes[zpos], format, rect, m_submittedSource[zpos], &bo);
+
+        m_submittedFormat[zpos] = format;
+        m_layerFallback[zpos] = !supported;
+    }
+
+    if (!supported) {
+        qDebug() << "Layer" << zpos << "needs GPU composition, drop bo" << bo.gbo << "dmabuf" << bo.dmabuf;
+        destroyBuffer(bo);
+    }
+
+    return supported;
+}
+
+bool WebOSEglFSKmsGbmScreen::submitLayerBuffer(uint32_t zpos, const BufferObject &bo)
+{
+    m_frameTimeline.record(WebOSKmsFrameTimeline::Submit, zpos);
 
-    // In GUI thread
-    QMutexLocker lock(&m_bufferObjectMutex);
+    bool supported = !bo.hasBuffer() || acceptLayerBuffer(zpos, bo);
 
-    if (m_bufferObjects[zpos].updated) {
-        gbm_bo *old_bo = m_bufferObjects[zpos].gbo;
-        qDebug() << "destroy old bo" << old_bo;
-        gbm_bo_destroy(old_bo);
+    // Without a buffer the plane is turned off
+    submitBufferObject(zpos, supported ? bo : BufferObject(nullptr, bo.rect, true));
+    return supported;
+}
+
+bool WebOSEglFSKmsGbmScreen::layerNeedsComposition(int zpos)
+{
+    QMutexLocker lock(&m_submitMutex);
+
+    if (zpos < 0 || zpos >= m_layerFallback.size())
+        return true;
+
+    return m_layerFallback[zpos];
+}
+
+bool WebOSEglFSKmsGbmScreen::setLayerQueueMode(int zpos, LayerQueueMode mode)
+{
+    {
+        QMutexLocker lock(&m_submitMutex);
+
+        if (zpos < 0 || zpos >= m_layerQueueModes.size())
+            return false;
+
+        if (m_layerQueueModes[zpos] == mode)
+            return true;
+
+        m_layerQueueModes[zpos] = mode;
+    }
+
+    qInfo() << "Layer" << zpos << "queue mode" << mode << name() << this;
+
+    // Queued buffers are not presented in mailbox mode
+    WebOSKmsBufferQueue<BufferObject>::List dropped;
+    m_layerQueues[zpos].clear(&dropped);
+    for (const BufferObject &bo : dropped)
+        m_releaseQueue.release(0, bo.gbo, bo.dmabuf);
+
+    return true;
+}
+
+bool WebOSEglFSKmsGbmScreen::queueLayerBuffer(int zpos, void *bo, qint64 target)
+{
+    if (zpos < 0 || zpos >= m_layerQueueModes.size() || !bo)
+        return false;
+
+    return enqueueLayerBuffer(zpos, BufferObject((gbm_bo *)bo, QRectF(), true), target);
+}
+
+bool WebOSEglFSKmsGbmScreen::setLayerDmaBuf(int zpos, const WebOSKmsDmaBufDescriptor &descriptor, qint64 target)
+{
+    if (zpos < 0 || zpos >= m_layerQueueModes.size())
+        return false;
+
+    BufferObject bo;
+    bo.dmabuf = WebOSKmsDmaBuf::create(descriptor);
+    bo.updated = true;
+    if (!bo.dmabuf)
+        return false;
+
+    return enqueueLayerBuffer(zpos, bo, target);
+}
+
+bool WebOSEglFSKmsGbmScreen::enqueueLayerBuffer(uint32_t zpos, BufferObject bo, qint64 target)
+{
+    LayerQueueMode mode;
+    {
+        QMutexLocker lock(&m_submitMutex);
+        bo.rect = m_submittedGeometry[zpos];
+        mode = m_layerQueueModes[zpos];
+    }
+
+    // Invalid destination rect
+    if (bo.rect.isEmpty()) {
+        destroyBuffer(bo);
+        return false;
+    }
+
+    if (mode == MailboxMode)
+        return submitLayerBuffer(zpos, bo);
+
+    m_frameTimeline.record(WebOSKmsFrameTimeline::Submit, zpos);
+
+    if (!acceptLayerBuffer(zpos, bo)) {
+        submitBufferObject(zpos, BufferObject(nullptr, bo.rect, true));
+        return false;
+    }
+
+    {
+        QMutexLocker lock(&m_submitMutex);
+        bo.plane = m_layerPlanes[zpos];
+        bo.source = m_submittedSource[zpos];
+    }
+
+    BufferObject dropped;
+    if (m_layerQueues[zpos].push(bo, target, &dropped)) {
+        qDebug() << "Layer" << zpos << "queue is full, drop bo" << dropped.gbo << "dmabuf" << dropped.dmabuf;
+        m_releaseQueue.release(0, dropped.gbo, dropped.dmabuf);
+    }
+
+    if (m_overlayCommitThread)
+        m_overlayCommitThread->schedule();
+
+    return true;
+}
+
+bool WebOSEglFSKmsGbmScreen::layerQueueStatistics(int zpos, WebOSKmsBufferQueueStatistics *statistics) const
+{
+    if (zpos < 0 || zpos >= m_layerQueueModes.size())
+        return false;
+
+    *statistics = m_layerQueues[zpos].statistics();
+    return true;
+}
+
+bool WebOSEglFSKmsGbmScreen::setLayerSource(int zpos, const WebOSKmsSourceRect &source)
+{
+    QRectF rect;
+    {
+        QMutexLocker lock(&m_submitMutex);
+
+        if (zpos < 0 || zpos >= m_submittedSource.size())
+            return false;
+
+        const LayerFormat &format = m_submittedFormat[zpos];
+        if (!source.isNull() && !format.size.isEmpty()
+            && source.clampedTo(format.size.width(), format.size.height()) != source) {
+            qWarning() << "setLayerSource plane" << zpos << "source is out of the buffer" << format.size;
+            return false;
+        }
+
+        rect = m_submittedGeometry[zpos];
+
+        // Keep the last source if the plane cannot scale to the new one
+        if (!validateLayerLocked(zpos, m_layerPlanes[zpos], format, rect, source, nullptr)) {
+            qInfo() << "setLayerSource plane" << zpos << "source" << source.x << source.y << source.width << source.height
+                    << "is not supported" << name() << this;
+            return false;
+        }
+
+        m_submittedSource[zpos] = source;
+    }
+
+    qDebug() << "setLayerSource plane" << zpos << "source" << source.x << source.y << source.width << source.height << name() << this;
+
+    // Applied to the buffer on the plane like a new geometry
+    submitBufferObject(zpos, BufferObject(nullptr, rect, false));
+    return true;
+}
+
+#if QT_VERSION < QT_VERSION_CHECK(6, 0, 0)
+bool WebOSEglFSKmsGbmScreen::setOverlayBufferObject(void *bo, QRectF rect, uint32_t zpos)
+{
+    if (zpos >= uint32_t(m_nextBufferObjects.size())) {
+        qWarning() << "WebOSEglFSKmsGbmScreen::setOverlayBufferObject - no plane for" << zpos << "bo" << bo;
+        gbm_bo_destroy((gbm_bo *)bo);
+        return false;
     }
 
-    m_bufferObjects[zpos] = BufferObject((gbm_bo *)bo, rect, true);
+    qDebug() << "QEglFSKmsGbmScreen::setOverlayPlaneFramebuffer:" << bo << name() << rect << zpos;
+
+    return submitLayerBuffer(zpos, BufferObject((gbm_bo *)bo, rect, true));
 }
 #else
-void WebOSEglFSKmsGbmScreen::setOverlayBufferObject(void *bo, QRectF rect, uint32_t zpos)
+bool WebOSEglFSKmsGbmScreen::setOverlayBufferObject(void *bo, QRectF rect, uint32_t zpos)
 {
     qDebug() << "WebOSEglFSKmsGbmScreen::setOverlayPlaneFramebuffer:" << bo << name() << rect << zpos;
 
+    if (zpos >= uint32_t(m_nextBufferObjects.size())) {
+        qWarning() << "WebOSEglFSKmsGbmScreen::setOverlayBufferObject - no plane for" << zpos << "bo" << bo;
+        return false;
+    }
+
     // Invalid destination rect
     if (bo != nullptr && rect.isEmpty())
-        return;
-
-    clearBufferObject(zpos);
+        return false;
 
-    // In GUI thread
-    QMutexLocker lock(&m_bufferObjectMutex);
-    m_bufferObjects[zpos] = BufferObject((gbm_bo *)bo, rect, true);
+    return submitLayerBuffer(zpos, BufferObject((gbm_bo *)bo, rect, true));
 }
 
-int WebOSEglFSKmsGbmScreen::addLayer(void *gbm_bo, const QRectF &geometry)
+int WebOSEglFSKmsGbmScreen::findLayerPlane(int zpos, const LayerFormat &format, const QRectF &geometry)
 {
-    QKmsOutput &op(output());
     WebOSEglFSKmsGbmDevice *wd = static_cast<WebOSEglFSKmsGbmDevice *>(device());
-    WebOSKmsOutput &webosOutput = wd->getOutput(op);
+    WebOSKmsOutput &webosOutput = wd->getOutput(output());
+
+    QVector<bool> taken(webosOutput.layerCount());
+    for (int p = 0; p < m_layerPlanes.size(); p++) {
+        if (p != zpos && (m_layerAdded[p] || m_layerBusy[p].loadAcquire()))
+            taken[m_layerPlanes[p]] = true;
+    }
+
+    const bool needsScaling = format.key.format && geometry.size() != QSizeF(format.size);
 
-    for (int p = 0; p < Plane_End; p++) {
-        if (!webosOutput.m_assignedPlanes.contains(p))
+    int best = -1;
+    int bestScore = -1;
+    for (int i = 0; i < webosOutput.layerCount(); i++) {
+        if (taken[i])
             continue;
 
-        if (m_layerAdded[p])
+        const QKmsPlane &plane = webosOutput.m_layerPlanes[i];
+        const WebOSKmsPlane &wPlane = wd->getPlane(plane);
+
+        if (uint64_t(zpos) < wPlane.zposMin || uint64_t(zpos) > wPlane.zposMax)
+            continue;
+
+        if (format.key.format && !wPlane.formats.isEmpty()
+            && !WebOSKmsFormats::supports(wPlane.formats, format.key.format, format.key.modifier))
             continue;
 
-        qInfo() << "addLayer plane" << p << "bo" << gbm_bo << "dest" << geometry << name() << this;
+        int score = 0;
+        if (needsScaling && wPlane.canScale)
+            score += 2;
+        // Keep the binding stable if nothing else matters
+        if (i == m_layerPlanes[zpos])
+            score += 1;
+
+        if (score > bestScore) {
+            best = i;
+            bestScore = score;
+        }
+    }
+
+    return best;
+}
+
+int WebOSEglFSKmsGbmScreen::addLayer(void *gbm_bo, const QRectF &geometry)
+{
+    int zpos = -1;
+
+    LayerFormat format;
+    const BufferObject layerBuffer((struct gbm_bo *)gbm_bo, geometry, true);
+    if (gbm_bo)
+        layerFormatForBufferObject((struct gbm_bo *)gbm_bo, &format);
+
+    {
+        QMutexLocker lock(&m_submitMutex);
+
+        for (int p = 0; p < m_layerPlanes.size(); p++) {
+            // Still turning off the plane of a removed layer
+            if (m_layerAdded[p] || m_layerBusy[p].loadAcquire())
+                continue;
+
+            int plane = findLayerPlane(p, format, geometry);
+            if (plane < 0)
+                continue;
+
+            // A new layer shows the whole buffer
+            if (!validateLayerLocked(p, plane, format, geometry, WebOSKmsSourceRect(), gbm_bo ? &layerBuffer : nullptr))
+                continue;
+
+            zpos = p;
+            m_layerPlanes[p] = plane;
+            m_submittedFormat[p] = format;
+            m_submittedGeometry[p] = geometry;
+            m_submittedSource[p] = WebOSKmsSourceRect();
+            m_layerFallback[p] = false;
+            m_layerBusy[p].storeRelease(1);
+            m_layerAdded[p] = true;
+            break;
+        }
+    }
 
-        m_layerAdded[p] = true;
-        setOverlayBufferObject(gbm_bo, geometry, p);
-        return p;
+    if (zpos < 0) {
+        qInfo() << "addLayer no plane available for bo" << gbm_bo << "dest" << geometry << "- use GPU composition" << name() << this;
+        return -1;
     }
 
-    return -1;
+    qInfo() << "addLayer plane" << zpos << "bo" << gbm_bo << "dest" << geometry << name() << this;
+
+    setOverlayBufferObject(gbm_bo, geometry, zpos);
+    return zpos;
 }
 
 void WebOSEglFSKmsGbmScreen::setLayerBuffer(int zpos, void *bo)
 {
-    if (!m_layerAdded[zpos]) {
+    if (zpos < 0 || zpos >= m_layerAdded.size() || !m_layerAdded[zpos]) {
         qWarning() << "The layer" << zpos << "is not added yet.";
         return;
     }
@@ -744,50 +2571,71 @@ void WebOSEglFSKmsGbmScreen::setLayerBuffer(int zpos, void *bo)
     qDebug() << "WebOSEglFSKmsGbmScreen::setLayerBuffer plane" << zpos << "bo" << bo << name() << this;
 
     // Use previous geometry rect
-    setOverlayBufferObject((gbm_bo *)bo,  m_bufferObjects[zpos].rect, zpos);
+    QRectF rect;
+    {
+        QMutexLocker lock(&m_submitMutex);
+        rect = m_submittedGeometry[zpos];
+    }
+    setOverlayBufferObject((gbm_bo *)bo, rect, zpos);
 }
 
 void WebOSEglFSKmsGbmScreen::setLayerGeometry(int zpos, const QRectF &geometry)
 {
+    if (zpos < 0 || zpos >= m_layerAdded.size()) {
+        qWarning() << "No layer" << zpos;
+        return;
+    }
+
     if (!m_layerAdded[zpos])
         qWarning() << "The layer" << zpos << "is not added yet.";
 
     qDebug() << "WebOSEglFSKmsGbmScreen::setLayerGeometry" << geometry << "plane" << zpos << name() << this;
 
-    // In GUI thread
-    QMutexLocker lock(&m_bufferObjectMutex);
+    bool supported;
+    {
+        QMutexLocker lock(&m_submitMutex);
+        supported = validateLayerLocked(zpos, m_layerPlanes[zpos], m_submittedFormat[zpos], geometry,
+                                        m_submittedSource[zpos], nullptr);
+        m_layerFallback[zpos] = !supported;
+    }
+
+    if (!supported) {
+        // Turn the plane off, the layer is composited until a geometry fits again
+        qInfo() << "setLayerGeometry" << geometry << "plane" << zpos << "needs GPU composition" << name() << this;
+        submitBufferObject(zpos, BufferObject(nullptr, geometry, true));
+        return;
+    }
 
-    m_bufferObjects[zpos].rect = geometry;
+    submitBufferObject(zpos, BufferObject(nullptr, geometry, false));
 }
 
 bool WebOSEglFSKmsGbmScreen::removeLayer(int zpos)
 {
-    if (!m_layerAdded[zpos]) {
+    if (zpos < 0 || zpos >= m_layerAdded.size() || !m_layerAdded[zpos]) {
         qWarning() << "The layer" << zpos << "is not added yet.";
         return false;
     }
 
     m_layerAdded[zpos] = false;
 
+    {
+        QMutexLocker lock(&m_submitMutex);
+        m_submittedFormat[zpos] = LayerFormat();
+        m_submittedSource[zpos] = WebOSKmsSourceRect();
+        m_layerFallback[zpos] = false;
+    }
+
+    WebOSKmsBufferQueue<BufferObject>::List dropped;
+    m_layerQueues[zpos].clear(&dropped);
+    for (const BufferObject &bo : dropped)
+        m_releaseQueue.release(0, bo.gbo, bo.dmabuf);
+
     qInfo() << "removeLayer plane" << zpos << name() << this;
 
     // Use previous geometry rect
     setOverlayBufferObject(nullptr, QRectF(), zpos);
     return true;
 }
-
-void WebOSEglFSKmsGbmScreen::clearBufferObject(uint32_t zpos)
-{
-    // In GUI thread
-    QMutexLocker lock(&m_bufferObjectMutex);
-
-    if (m_bufferObjects[zpos].updated) {
-        gbm_bo *old_bo = m_bufferObjects[zpos].gbo;
-        m_bufferObjects[zpos].gbo = nullptr;
-        qDebug() << "destroy old bo" << old_bo;
-        gbm_bo_destroy(old_bo);
-    }
-}
 #endif
 
 #endif //PLANE_COMPOSITION
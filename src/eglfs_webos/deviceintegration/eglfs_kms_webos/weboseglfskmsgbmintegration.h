@@ -18,21 +18,41 @@
 #define WEBOSEGLFSKMSGBMINTEGRATION_H
 
 #include <QMap>
-#include <QJsonObject>
 #include <private/qeglfskmsgbmintegration_p.h>
 #include <private/qeglfskmsgbmdevice_p.h>
 #include <private/qeglfskmsgbmscreen_p.h>
 #include <private/qeglfskmsdevice_p.h>
 #include <qpa/qplatformscreen_p.h>
 
+#include "weboskmsatomicstate.h"
+#include "weboskmscapture.h"
+#include "weboskmscursorplane.h"
+#include "weboskmsfence.h"
+#include "weboskmsflipcost.h"
+#include "weboskmsformats.h"
+#include "weboskmsframetimeline.h"
+#include "weboskmshotplug.h"
+#include "weboskmspresentation.h"
+#include "weboskmsvariablerefresh.h"
+#include "weboskmsvirtualvblank.h"
+
+#ifdef PLANE_COMPOSITION
+#include "weboskmsbufferqueue.h"
+#include "weboskmsdmabuf.h"
+#include "weboskmsframebuffercache.h"
+#include "weboskmsgemregistry.h"
+#include "weboskmsmailbox.h"
+#include "weboskmsoverlaycommitthread.h"
+#include "weboskmsreleasequeue.h"
+
+#include <QElapsedTimer>
+#include <QWaitCondition>
+#endif
+
 class WebOSKmsScreenConfig : public QKmsScreenConfig
 {
 public:
-    WebOSKmsScreenConfig(QJsonObject);
     void loadConfig() override;
-
-private:
-    QJsonObject m_configJson;
 };
 
 class WebOSEglFSKmsGbmIntegration : public QEglFSKmsGbmIntegration
@@ -43,13 +63,22 @@ public:
 
     void screenInit() override;
     QSurfaceFormat surfaceFormatFor(const QSurfaceFormat &inputFormat) const override;
-#ifdef CURSOR_OPENGL
     void waitForVSync(QPlatformSurface *surface) const override;
-#endif
 
     QFunctionPointer platformFunction(const QByteArray &function) const override;
+
+    static int addPresentationListener(const QScreen *screen, WebOSKmsPresentation::Callback callback, void *data);
+    static bool removePresentationListener(const QScreen *screen, int id);
+    static bool setVariableRefreshMode(const QScreen *screen, int mode);
+    static bool setCursorPlaneImage(const QScreen *screen, const QImage &image, const QPoint &hotspot);
+    static bool setCursorPlanePosition(const QScreen *screen, const QPoint &position);
+    static bool setCursorPlaneVisible(const QScreen *screen, bool visible);
+    static WebOSKmsCapture *captureScreen(const QScreen *screen);
+    static void releaseScreenCapture(const QScreen *screen, WebOSKmsCapture *capture);
+    static bool readScreenCapture(const WebOSKmsCapture *capture, int index, QImage *image);
+    static int screenReleaseFence(const QScreen *screen);
     void *nativeResourceForIntegration(const QByteArray &name) override;
-#ifdef IM_ENABLE
+#if defined(IM_ENABLE) || defined(PLANE_COMPOSITION)
     void *nativeResourceForScreen(const QByteArray &resource, QScreen *screen) override;
 #endif
 
@@ -58,24 +87,33 @@ public:
 
 #ifdef PLANE_COMPOSITION
     static void setOverlayBufferObject(const QScreen *screen, void *bo, QRectF rect, uint32_t zpos);
+    static void releaseOverlayBuffer(const QScreen *screen, int dmaBufFd);
+    static bool layerNeedsComposition(const QScreen *screen, int id);
+    static bool setLayerSource(const QScreen *screen, int id, uint32_t x, uint32_t y, uint32_t width, uint32_t height);
+    static bool setLayerQueueMode(const QScreen *screen, int id, int mode);
+    static bool queueLayerBuffer(const QScreen *screen, int id, void *bo, qint64 target);
+    static bool layerQueueStatistics(const QScreen *screen, int id, WebOSKmsBufferQueueStatistics *statistics);
+    static bool setLayerDmaBuf(const QScreen *screen, int id, const WebOSKmsDmaBufDescriptor *descriptor, qint64 target);
 #endif
     bool isProtected() const { return m_protected; }
 private:
-    QJsonObject m_configJson;
     bool m_protected = false;
+    QByteArray m_frameTimelineDump;
+    QByteArray m_callStatsDump;
+    QByteArray m_flipCostDump;
 };
 
 #ifdef PLANE_COMPOSITION
-enum PlaneOrder {
-    VideoPlane = 0,
-    FullscreenPlane = 1,
-    MainPlane = 2,
-    Plane_End = 3
-};
-
 // Hold additional properties
 struct WebOSKmsPlane {
     uint32_t blendPropertyId = 0;
+    uint32_t inFencePropertyId = 0;
+    // Parsed once at startup
+    WebOSKmsFormatList formats;
+    // Range of the zpos property, unbounded if the plane has none
+    uint64_t zposMin = 0;
+    uint64_t zposMax = UINT64_MAX;
+    bool canScale = false;
 #if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
 #ifdef PROTECTED_CONTENT
     uint32_t secureMode = 0;
@@ -84,10 +122,49 @@ struct WebOSKmsPlane {
 #endif
 };
 
+// Source rectangle of a layer in 16.16 fixed point, null for the whole buffer
+struct WebOSKmsSourceRect {
+    uint32_t x = 0;
+    uint32_t y = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+
+    bool isNull() const { return !width || !height; }
+    bool operator==(const WebOSKmsSourceRect &o) const { return x == o.x && y == o.y && width == o.width && height == o.height; }
+    bool operator!=(const WebOSKmsSourceRect &o) const { return !(*this == o); }
+
+    // The rectangle to scan out of a buffer, the whole buffer if it does not fit
+    WebOSKmsSourceRect clampedTo(uint32_t bufferWidth, uint32_t bufferHeight) const;
+};
+
+// A layer configuration checked with a TEST_ONLY commit
+struct WebOSKmsLayerTestKey {
+    uint32_t planeId = 0;
+    uint32_t format = 0;
+    uint64_t modifier = 0;
+    // Source to destination ratio in 1/8 steps, rounded up
+    uint32_t scaleX = 0;
+    uint32_t scaleY = 0;
+    // Scanned out with fb_translation_mode set
+    bool secure = false;
+};
+
+bool operator==(const WebOSKmsLayerTestKey &a, const WebOSKmsLayerTestKey &b);
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+size_t qHash(const WebOSKmsLayerTestKey &key, size_t seed = 0);
+#else
+uint qHash(const WebOSKmsLayerTestKey &key, uint seed = 0);
+#endif
+
 // Hold additional planes
 struct WebOSKmsOutput {
-    // z-pos, plane
-    QMap<uint32_t, QKmsPlane> m_assignedPlanes;
+    // Planes which can be handed out to layers
+    QVector<QKmsPlane> m_layerPlanes;
+
+    int layerCount() const { return m_layerPlanes.size(); }
+    // The main plane stays above all the layers, at least where
+    // it used to be with the fixed video/fullscreen/main layout
+    uint32_t mainZpos() const { return qMax(layerCount(), 2); }
 };
 #endif
 
@@ -101,6 +178,11 @@ public:
 
     QPlatformScreen *createScreen(const QKmsOutput &output) override;
 
+    // Screens of the virtual outputs in the config
+    void createVirtualScreens();
+    // Adds and removes screens as connectors come and go
+    void startHotplug();
+
 #ifdef PLANE_COMPOSITION
     void addPlaneProperties();
     void assignPlanes(const QKmsOutput &output);
@@ -108,12 +190,30 @@ public:
     WebOSKmsOutput &getOutput(const QKmsOutput &output) { return m_webosOutputs[output.connector_id]; }
     WebOSKmsPlane &getPlane(const QKmsPlane &plane) { return m_webosPlanes[plane.id]; }
 
+    // Created with the first screen, the device fd is open by then
+    WebOSKmsGemRegistry *gemRegistry();
+
 private:
+    QScopedPointer<WebOSKmsGemRegistry> m_gemRegistry;
     // plane_id, WebOSKmsPlane - for additional property
     QMap<uint32_t, WebOSKmsPlane> m_webosPlanes;
     // connector_id, WebOSKmsOutput
     QMap<uint32_t, WebOSKmsOutput> m_webosOutputs;
 #endif
+
+private:
+    void updateConnectors(uint32_t connectorId);
+    void addConnector(drmModeResPtr resources, drmModeConnectorPtr connector);
+    void removeConnector(uint32_t connectorId);
+    QList<QPlatformScreen *> virtualSiblings(QPlatformScreen *screen) const;
+    void updateVirtualSiblings();
+    // Right of all the screens
+    QPoint nextVirtualPosition() const;
+
+    // connector_id, screen
+    QMap<uint32_t, QPlatformScreen *> m_connectorScreens;
+    QList<QPlatformScreen *> m_virtualScreens;
+    QScopedPointer<WebOSKmsHotplug> m_hotplug;
 };
 
 #if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0) && defined(PLANE_COMPOSITION)
@@ -123,15 +223,40 @@ class WebOSEglFSKmsGbmScreen : public QEglFSKmsGbmScreen
 #endif
 {
 public:
-    WebOSEglFSKmsGbmScreen(QEglFSKmsDevice *device, const QKmsOutput &output, bool headless);
+    // A virtual output has no connector, it flips at a simulated vblank
+    WebOSEglFSKmsGbmScreen(QEglFSKmsDevice *device, const QKmsOutput &output, bool headless, bool virtualOutput = false);
 
     QDpi logicalDpi() const override;
     qreal getDevicePixelRatio();
     qreal getDevicePixelRatio() const;
     QRect applicationWindowGeometry() const;
 
+    // flip() waits for the previous flip instead of waitForVSync(), so
+    // the next frame is rendered while the previous one is queued
+    bool pipelinedFlip() const { return m_pipelinedFlip; }
+    // Once the main plane is known
+    void initializeFence();
+    // Render thread, before eglSwapBuffers()
+    void createRenderFence() { m_fence.createRenderFence(); }
+    // Signals once the buffers replaced by the latest commit have left
+    // the screen, -1 if unknown. The caller owns the fd.
+    int releaseFence() { return m_fence.releaseFence(); }
+    WebOSKmsFrameTimeline *frameTimeline() { return &m_frameTimeline; }
+    const WebOSKmsFlipCost *flipCost() const { return &m_flipCost; }
+    WebOSKmsPresentation *presentation() { return &m_presentation; }
+    const WebOSKmsAtomicState::Statistics *atomicStateStatistics() const { return m_atomicState.statistics(); }
+    // False if the screen cannot do variable refresh
+    bool setVariableRefreshMode(WebOSKmsVariableRefresh::Mode mode);
+    // Null if the CRTC has no cursor plane
+    WebOSKmsCursorPlane *cursorPlane() { return m_cursorPlane.isInitialized() ? &m_cursorPlane : nullptr; }
+
+    // Exports the buffers on screen, nullptr if there are none
+    WebOSKmsCapture *capture();
+    void releaseCapture(WebOSKmsCapture *capture);
+
     void updateFlipStatus() override;
     void flip() override;
+    void waitForFlip() override;
 #if (QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)) || (defined(HAS_PAGEFLIPPED))
     void pageFlipped(unsigned int sequence, unsigned int tv_sec, unsigned int tv_usec) override;
 #endif
@@ -150,45 +275,223 @@ public:
     uint32_t gbmFlags() override;
 #endif
 
-    void setOverlayBufferObject(void *bo, QRectF rect, uint32_t zpos);
+    bool setOverlayBufferObject(void *bo, QRectF rect, uint32_t zpos);
 
     struct BufferObject {
         BufferObject() {}
         BufferObject(gbm_bo *b, QRectF r, bool u) : gbo(b), rect(r), updated(u) {}
         gbm_bo *gbo = nullptr;
+        // Set instead of gbo for buffers imported as dma-buf
+        WebOSKmsDmaBuf *dmabuf = nullptr;
         uint32_t fb = 0;
         QRectF rect;
+        WebOSKmsSourceRect source;
         bool updated = false;
+        // Index in WebOSKmsOutput::m_layerPlanes
+        int plane = -1;
+
+        bool hasBuffer() const { return gbo || dmabuf; }
     };
 
+    void initializeLayers();
+
 #if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
     int addLayer(void *gbm_bo, const QRectF &geometry) override;
     void setLayerBuffer(int id, void *gbm_bo) override;
     void setLayerGeometry(int id, const QRectF &geometry) override;
     void setLayerAlpha(int id, qreal alpha) override {}
     bool removeLayer(int id) override;
+    // Called on the render thread after each main flip. Completions of
+    // overlay-only commits are reported to presentation listeners.
     void addFlipListener(void (*callback)()) override { m_flipCb = callback; }
-
-    void clearBufferObject(uint32_t zpos);
 #endif
 
+    // Called from the overlay commit thread, returns how long
+    // to wait before trying again while the UI is flipping
+    // or the CRTC is busy
+    int commitOverlays();
+
+    void releaseOverlayBuffer(int dmaBufFd) { m_framebufferCache.invalidate(dmaBufFd); }
+    // The layer cannot be scanned out and has to be composited on the GPU
+    bool layerNeedsComposition(int zpos);
+    // What the planes a layer can be bound to scan out, indexed by zpos.
+    // Fixed once the layers are initialized.
+    const QVector<WebOSKmsFormatList> *layerFormats() const { return &m_layerFormats; }
+    // Crop or zoom into the buffers of a layer, false if the plane cannot scale it
+    bool setLayerSource(int zpos, const WebOSKmsSourceRect &source);
+
+    enum LayerQueueMode {
+        // The latest buffer replaces a pending one, lowest latency
+        MailboxMode = 0,
+        // Buffers are presented in order at their target time
+        FifoMode = 1
+    };
+    bool setLayerQueueMode(int zpos, LayerQueueMode mode);
+    // Target is a CLOCK_MONOTONIC time in nanoseconds, 0 for the next vblank
+    bool queueLayerBuffer(int zpos, void *bo, qint64 target);
+    // Same as queueLayerBuffer without a gbm_bo, the target is ignored in mailbox mode
+    bool setLayerDmaBuf(int zpos, const WebOSKmsDmaBufDescriptor &descriptor, qint64 target);
+    bool layerQueueStatistics(int zpos, WebOSKmsBufferQueueStatistics *statistics) const;
+    const WebOSKmsFramebufferCache::Statistics *framebufferCacheStatistics() const { return m_framebufferCache.statistics(); }
+    const WebOSKmsReleaseQueue::Statistics *releaseQueueStatistics() const { return m_releaseQueue.statistics(); }
+
 private:
+    struct LayerFormat {
+        WebOSKmsFramebufferCache::Key key;
+        QSize size;
+        bool secure = false;
+    };
+
+    static QSize bufferSize(const BufferObject &bo);
+    static void destroyBuffer(const BufferObject &bo);
+    // Kept as user data of the bo, which must be an overlay buffer
+    static bool layerFormatForBufferObject(gbm_bo *bo, LayerFormat *format);
+    static bool queryLayerFormat(gbm_bo *bo, LayerFormat *format);
+    bool layerFormatForDmaBuf(const WebOSKmsDmaBuf *dmabuf, LayerFormat *format);
+    bool layerFormatForBuffer(const BufferObject &bo, LayerFormat *format);
+    bool submitLayerBuffer(uint32_t zpos, const BufferObject &bo);
+    bool acceptLayerBuffer(uint32_t zpos, const BufferObject &bo);
+    bool enqueueLayerBuffer(uint32_t zpos, BufferObject bo, qint64 target);
+    bool validateLayerLocked(uint32_t zpos, int planeIndex, const LayerFormat &format, const QRectF &rect,
+                             const WebOSKmsSourceRect &source, const BufferObject *bo);
+    bool testLayer(const QKmsPlane &plane, uint32_t fb, const WebOSKmsSourceRect &source, const QRectF &dest, uint32_t zpos, bool secure);
+
     uint32_t framebufferForOverlayBufferObject(gbm_bo *bo);
+    uint32_t framebufferForDmaBuf(const WebOSKmsDmaBuf *dmabuf);
+    uint32_t framebufferForBuffer(const BufferObject &bo);
+#if QT_CONFIG(drm_atomic)
+    void addLayerProperties(drmModeAtomicReq *request);
+    void addLayerGeometry(drmModeAtomicReq *request, int p, const BufferObject &bo);
+    void addLayerBuffer(drmModeAtomicReq *request, int p, BufferObject bo);
+#endif
+    void retireLayerBuffers();
+    void retirePendingLayerBuffers();
+    void finishOverlayCommit();
+    void releaseRetiredLayerBuffer(const BufferObject &bo);
+    void layerMasks(quint32 *updated, quint32 *visible) const;
+    void rollbackLayerBuffers();
+    void submitBufferObject(uint32_t zpos, const BufferObject &bo);
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+    int findLayerPlane(int zpos, const LayerFormat &format, const QRectF &geometry);
+#endif
+
+    WebOSKmsFramebufferCache m_framebufferCache;
+    // Declared after the cache which it releases into
+    WebOSKmsReleaseQueue m_releaseQueue;
 
-    QMutex m_bufferObjectMutex;
+    // Serializes producers only, flip() never takes it
+    QMutex m_submitMutex;
+    // Last geometry submitted per zpos, guarded by m_submitMutex
+    QVector<QRectF> m_submittedGeometry;
+    QVector<WebOSKmsSourceRect> m_submittedSource;
+    QVector<LayerQueueMode> m_layerQueueModes;
+    // Plane bound to each zpos, guarded by m_submitMutex
+    QVector<int> m_layerPlanes;
+    QVector<WebOSKmsFormatList> m_layerFormats;
+    // Set while a zpos holds its plane, cleared by the render
+    // thread once the plane has been turned off
+    QScopedArrayPointer<QAtomicInt> m_layerBusy;
+    // Last buffer format and GPU fallback per zpos, guarded by m_submitMutex
+    QVector<LayerFormat> m_submittedFormat;
+    QVector<bool> m_layerFallback;
+    enum { LayerTestCapacity = 64 };
+    struct LayerTestResult {
+        bool supported = false;
+        quint64 lastUsed = 0;
+    };
+    // Verdicts of TEST_ONLY commits, guarded by m_submitMutex.
+    // The least recently used are dropped past the capacity.
+    QHash<WebOSKmsLayerTestKey, LayerTestResult> m_layerTestResults;
+    quint64 m_layerTestCounter = 0;
+    // Set by a modeset, the results are dropped on the next validation
+    QAtomicInt m_layerTestsInvalid { 0 };
+
+    // Layer states from producers to the render thread
+    QScopedArrayPointer<WebOSKmsMailbox<BufferObject>> m_bufferObjects;
+    // Buffers of layers in FIFO mode
+    QScopedArrayPointer<WebOSKmsBufferQueue<BufferObject>> m_layerQueues;
+    // Guarded by m_commitMutex
+#if QT_CONFIG(drm_atomic)
+    struct AtomicRequestDeleter {
+        static void cleanup(drmModeAtomicReq *request) { if (request) drmModeAtomicFree(request); }
+    };
+    // Reused by every overlay-only commit
+    QScopedPointer<drmModeAtomicReq, AtomicRequestDeleter> m_overlayRequest;
+#endif
 
-    QVector<struct BufferObject> m_bufferObjects;
     QVector<struct BufferObject> m_nextBufferObjects;
     QVector<struct BufferObject> m_currentBufferObjects;
+    // m_nextBufferObjects went out with a main flip which has not completed
+    bool m_layersFlipPending = false;
+    // An overlay-only commit in progress. The CRTC takes one commit at a
+    // time, so the main flip waits for m_overlayCommitDone.
+    enum OverlayCommitState {
+        OverlayCommitIdle,
+        // drmModeAtomicCommit() has not returned yet
+        OverlayCommitInFlight,
+        // Committed, waits for its page flip event
+        OverlayCommitQueued
+    };
+    OverlayCommitState m_overlayCommitState = OverlayCommitIdle;
+    // Completes with a page flip event rather than a blocking commit
+    bool m_overlayFlipEvent = false;
+    // The event came before drmModeAtomicCommit() returned
+    bool m_overlayFlipped = false;
+    WebOSKmsPresentation::Frame m_overlayFrame;
+    QWaitCondition m_overlayCommitDone;
+    // Layer buffers whose acquire fence had not signalled yet, on planes
+    // without IN_FENCE_FD. They go out with a later commit.
+    QVector<struct BufferObject> m_fenceWaitBuffers;
+    // Retired layer buffers still held by a capture
+    QVector<struct BufferObject> m_heldLayerBuffers;
+    QElapsedTimer m_flipTimer;
+    qint64 m_lastMainFlip = 0;
 
     void (*m_flipCb)() = nullptr;
     QVector<bool> m_layerAdded;
 #endif //PLANE_COMPOSITION
 private:
+    void presentedWithoutEvent(const WebOSKmsPresentation::Frame &frame);
+    void releaseHeldMainBuffers();
+    void virtualFlip();
+    static void virtualVblank(void *data, quint32 sequence, qint64 nsecs);
+#if QT_CONFIG(drm_atomic)
+    void addVariableRefreshProperties(drmModeAtomicReq *request);
+#endif
+
     qreal m_dpr;
 #ifdef IM_ENABLE
     QScopedPointer<QPlatformCursor> m_cursor;
 #endif
+
+    // Written from every thread taking part in a frame
+    WebOSKmsFrameTimeline m_frameTimeline;
+    WebOSKmsFlipCost m_flipCost;
+    bool m_pipelinedFlip;
+    WebOSKmsPresentation m_presentation;
+    // Serializes the main flip with overlay and cursor only commits,
+    // which makes them a single consumer of the pending layer states
+    QMutex m_commitMutex;
+    // Plane properties written by this screen, guarded by m_commitMutex
+    WebOSKmsAtomicState m_atomicState;
+    // Used by the main flip and overlay commits, guarded by m_commitMutex
+    WebOSKmsFence m_fence;
+    WebOSKmsVariableRefresh m_variableRefresh;
+    // Declared after the state its commit thread uses
+    WebOSKmsCursorPlane m_cursorPlane;
+    // Buffers exported by each capture and how many captures hold
+    // each buffer, guarded by m_commitMutex
+    QHash<WebOSKmsCapture *, QVector<const void *>> m_captures;
+    QHash<const void *, int> m_capturedBuffers;
+    // Main plane buffers off screen but still held by a capture
+    QVector<gbm_bo *> m_heldMainBuffers;
+    // Virtual outputs only, stopped before the state its callback uses
+    QScopedPointer<WebOSKmsVirtualVblank> m_virtualVblank;
+
+#ifdef PLANE_COMPOSITION
+    // Declared last to stop before the state above goes away
+    QScopedPointer<WebOSKmsOverlayCommitThread> m_overlayCommitThread;
+#endif
 };
 
 #endif
@@ -0,0 +1,157 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef WEBOSKMSBUFFERQUEUE_H
+#define WEBOSKMSBUFFERQUEUE_H
+
+#include <QMutex>
+#include <QVarLengthArray>
+
+struct WebOSKmsBufferQueueStatistics {
+    quint64 queued = 0;
+    quint64 presented = 0;
+    quint64 dropped = 0;
+    // Vblanks a buffer stayed on the screen for in place of a late one
+    quint64 repeated = 0;
+    // Buffers taken after the vblank they were due at
+    quint64 late = 0;
+};
+
+// Small FIFO of buffers of a layer, each with the time it should be
+// presented at. The consumer takes the newest buffer due at the vblank
+// it commits for, so 24/25/50 fps content keeps its cadence on a faster
+// panel. A buffer which was due together with a newer one is dropped.
+template <typename T>
+class WebOSKmsBufferQueue
+{
+public:
+    enum { Capacity = 4 };
+
+    typedef WebOSKmsBufferQueueStatistics Statistics;
+    typedef QVarLengthArray<T, Capacity + 1> List;
+
+    WebOSKmsBufferQueue() = default;
+    WebOSKmsBufferQueue(const WebOSKmsBufferQueue &) = delete;
+    WebOSKmsBufferQueue &operator=(const WebOSKmsBufferQueue &) = delete;
+
+    // Producer side. A target of 0 means as soon as possible. Returns
+    // true and fills dropped if the oldest buffer had to make room.
+    bool push(const T &value, qint64 target, T *dropped)
+    {
+        QMutexLocker lock(&m_mutex);
+
+        bool full = m_count == Capacity;
+        if (full) {
+            *dropped = m_entries[m_head].value;
+            m_head = (m_head + 1) % Capacity;
+            m_count--;
+            m_statistics.dropped++;
+        }
+
+        Entry &entry = m_entries[(m_head + m_count) % Capacity];
+        entry.value = value;
+        entry.target = target;
+        m_count++;
+        m_statistics.queued++;
+        return full;
+    }
+
+    // Consumer side. Takes the newest buffer due at the vblank, which is
+    // the one closest to its target, and hands older due ones to dropped.
+    bool take(qint64 vblank, qint64 refreshInterval, T *value, List *dropped)
+    {
+        QMutexLocker lock(&m_mutex);
+
+        int due = 0;
+        while (due < m_count && m_entries[(m_head + due) % Capacity].target <= vblank + refreshInterval / 2)
+            due++;
+
+        if (due == 0)
+            return false;
+
+        for (int i = 0; i < due - 1; i++) {
+            dropped->append(m_entries[m_head].value);
+            m_head = (m_head + 1) % Capacity;
+            m_count--;
+            m_statistics.dropped++;
+        }
+
+        const Entry &entry = m_entries[m_head];
+        *value = entry.value;
+
+        // Too late, the previous buffer stayed on the screen for longer
+        if (entry.target > 0 && entry.target < vblank - refreshInterval / 2) {
+            m_statistics.late++;
+            m_statistics.repeated += quint64((vblank - entry.target + refreshInterval / 2) / qMax(refreshInterval, qint64(1)));
+        }
+
+        m_head = (m_head + 1) % Capacity;
+        m_count--;
+        m_statistics.presented++;
+        return true;
+    }
+
+    // Target of the oldest buffer or -1 if empty
+    qint64 nextTarget() const
+    {
+        QMutexLocker lock(&m_mutex);
+        return m_count > 0 ? m_entries[m_head].target : -1;
+    }
+
+    void clear(List *dropped)
+    {
+        QMutexLocker lock(&m_mutex);
+
+        while (m_count > 0) {
+            dropped->append(m_entries[m_head].value);
+            m_head = (m_head + 1) % Capacity;
+            m_count--;
+        }
+    }
+
+    // For buffers replaced in mailbox mode
+    void countDropped()
+    {
+        QMutexLocker lock(&m_mutex);
+        m_statistics.dropped++;
+    }
+
+    void countPresented()
+    {
+        QMutexLocker lock(&m_mutex);
+        m_statistics.presented++;
+    }
+
+    Statistics statistics() const
+    {
+        QMutexLocker lock(&m_mutex);
+        return m_statistics;
+    }
+
+private:
+    struct Entry {
+        T value;
+        qint64 target = 0;
+    };
+
+    mutable QMutex m_mutex;
+    Entry m_entries[Capacity];
+    int m_head = 0;
+    int m_count = 0;
+    Statistics m_statistics;
+};
+
+#endif
@@ -0,0 +1,171 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+#include <QDebug>
+#include <QImage>
+
+#include <drm_fourcc.h>
+#include <fcntl.h>
+#include <gbm.h>
+#include <linux/dma-buf.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "weboskmscapture.h"
+#include "weboskmsdmabuf.h"
+
+bool WebOSKmsCaptureExport::exportBufferObject(gbm_bo *bo, uint64_t modifier, WebOSKmsCaptureBuffer *buffer)
+{
+#ifdef PLANE_COMPOSITION
+    // Owned by the bo on the QTI gbm
+    const int fd = gbm_bo_get_fd(bo);
+    if (fd < 0)
+        return false;
+
+    buffer->fds[0] = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+    if (buffer->fds[0] < 0) {
+        qWarning() << "Failed to duplicate the fd of bo" << bo;
+        return false;
+    }
+#else
+    // A new fd on every call elsewhere, closed with the buffer
+    buffer->fds[0] = gbm_bo_get_fd(bo);
+    if (buffer->fds[0] < 0) {
+        qWarning() << "Failed to export bo" << bo;
+        return false;
+    }
+#endif
+
+    buffer->width = gbm_bo_get_width(bo);
+    buffer->height = gbm_bo_get_height(bo);
+    buffer->format = gbm_bo_get_format(bo);
+    buffer->modifier = modifier;
+    buffer->planeCount = 1;
+    buffer->offsets[0] = 0;
+    buffer->pitches[0] = gbm_bo_get_stride(bo);
+    return true;
+}
+
+bool WebOSKmsCaptureExport::exportDmaBuf(const WebOSKmsDmaBuf *dmabuf, WebOSKmsCaptureBuffer *buffer)
+{
+    const WebOSKmsDmaBufDescriptor &desc = dmabuf->descriptor();
+
+    buffer->width = desc.width;
+    buffer->height = desc.height;
+    buffer->format = desc.format;
+    buffer->modifier = desc.modifier;
+    buffer->planeCount = desc.planeCount;
+
+    for (int i = 0; i < desc.planeCount; i++) {
+        int j = 0;
+        while (j < i && desc.fds[j] != desc.fds[i])
+            j++;
+
+        // Duplicate a shared fd only once
+        buffer->fds[i] = j < i ? buffer->fds[j] : fcntl(desc.fds[i], F_DUPFD_CLOEXEC, 0);
+        buffer->offsets[i] = desc.offsets[i];
+        buffer->pitches[i] = desc.pitches[i];
+
+        if (buffer->fds[i] < 0) {
+            qWarning() << "Failed to duplicate dma-buf fd" << desc.fds[i] << "of plane" << i;
+            buffer->planeCount = i;
+            close(buffer);
+            return false;
+        }
+    }
+    return true;
+}
+
+void WebOSKmsCaptureExport::close(WebOSKmsCaptureBuffer *buffer)
+{
+    for (int i = 0; i < buffer->planeCount; i++) {
+        int j = 0;
+        while (j < i && buffer->fds[j] != buffer->fds[i])
+            j++;
+
+        if (j == i && buffer->fds[i] >= 0)
+            ::close(buffer->fds[i]);
+    }
+
+    for (int i = 0; i < 4; i++)
+        buffer->fds[i] = -1;
+    buffer->planeCount = 0;
+}
+
+static QImage::Format imageFormat(uint32_t format)
+{
+    // Byte orders of little endian DRM formats
+    switch (format) {
+    case DRM_FORMAT_XRGB8888:
+        return QImage::Format_RGB32;
+    case DRM_FORMAT_ARGB8888:
+        return QImage::Format_ARGB32_Premultiplied;
+    case DRM_FORMAT_XBGR8888:
+        return QImage::Format_RGBX8888;
+    case DRM_FORMAT_ABGR8888:
+        return QImage::Format_RGBA8888_Premultiplied;
+    case DRM_FORMAT_XRGB2101010:
+        return QImage::Format_RGB30;
+    case DRM_FORMAT_XBGR2101010:
+        return QImage::Format_BGR30;
+    case DRM_FORMAT_ARGB2101010:
+        return QImage::Format_A2RGB30_Premultiplied;
+    case DRM_FORMAT_ABGR2101010:
+        return QImage::Format_A2BGR30_Premultiplied;
+    case DRM_FORMAT_RGB565:
+        return QImage::Format_RGB16;
+    default:
+        return QImage::Format_Invalid;
+    }
+}
+
+bool WebOSKmsCaptureExport::read(const WebOSKmsCaptureBuffer &buffer, QImage *image)
+{
+    const QImage::Format format = imageFormat(buffer.format);
+    if (format == QImage::Format_Invalid || buffer.planeCount != 1) {
+        qWarning() << "Cannot read back format" << buffer.format << "with" << buffer.planeCount << "planes";
+        return false;
+    }
+
+    // Tiled or compressed layouts are only known to the GPU
+    if (buffer.modifier != DRM_FORMAT_MOD_LINEAR && buffer.modifier != DRM_FORMAT_MOD_INVALID) {
+        qWarning() << "Cannot read back modifier" << buffer.modifier;
+        return false;
+    }
+
+    const size_t size = size_t(buffer.offsets[0]) + size_t(buffer.pitches[0]) * buffer.height;
+    void *data = mmap(nullptr, size, PROT_READ, MAP_SHARED, buffer.fds[0], 0);
+    if (data == MAP_FAILED) {
+        qWarning() << "Failed to map capture buffer" << buffer.fds[0];
+        return false;
+    }
+
+    struct dma_buf_sync sync = { DMA_BUF_SYNC_START | DMA_BUF_SYNC_READ };
+    ioctl(buffer.fds[0], DMA_BUF_IOCTL_SYNC, &sync);
+
+    // Qt converts with the SIMD routines of the CPU
+    QImage mapped(static_cast<const uchar *>(data) + buffer.offsets[0], buffer.width, buffer.height,
+                  buffer.pitches[0], format);
+    *image = mapped.convertToFormat(QImage::Format_RGB888);
+
+    sync.flags = DMA_BUF_SYNC_END | DMA_BUF_SYNC_READ;
+    ioctl(buffer.fds[0], DMA_BUF_IOCTL_SYNC, &sync);
+    munmap(data, size);
+
+    return !image->isNull();
+}
@@ -0,0 +1,71 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+#ifndef WEBOSKMSCAPTURE_H
+#define WEBOSKMSCAPTURE_H
+
+#include <QRect>
+#include <QRectF>
+
+#include <stdint.h>
+
+class QImage;
+class WebOSKmsDmaBuf;
+struct gbm_bo;
+
+// A buffer on screen at the time of a capture. Planes may share an fd.
+// The fds belong to the capture and are closed when it is released.
+struct WebOSKmsCaptureBuffer {
+    // Layer zpos, the main plane is above all layers
+    int zpos = 0;
+    // Part of the buffer that is shown, in buffer pixels
+    QRectF source;
+    // Where it is shown, in screen pixels
+    QRect destination;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    // DRM fourcc and modifier
+    uint32_t format = 0;
+    uint64_t modifier = 0;
+    int planeCount = 0;
+    int fds[4] = { -1, -1, -1, -1 };
+    uint32_t offsets[4] = {};
+    uint32_t pitches[4] = {};
+};
+
+// The buffers on screen, from the bottom to the top. They are not reused
+// by the renderer or handed back to producers until the capture is
+// released, so a consumer has to release it within a frame or two.
+struct WebOSKmsCapture {
+    enum { MaxBuffers = 8 };
+
+    int bufferCount = 0;
+    WebOSKmsCaptureBuffer buffers[MaxBuffers];
+};
+
+class WebOSKmsCaptureExport
+{
+public:
+    static bool exportBufferObject(gbm_bo *bo, uint64_t modifier, WebOSKmsCaptureBuffer *buffer);
+    static bool exportDmaBuf(const WebOSKmsDmaBuf *dmabuf, WebOSKmsCaptureBuffer *buffer);
+    static void close(WebOSKmsCaptureBuffer *buffer);
+
+    // Copies a linear RGB buffer into a packed RGB888 image
+    static bool read(const WebOSKmsCaptureBuffer &buffer, QImage *image);
+};
+
+#endif
@@ -0,0 +1,89 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+#include <QDebug>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "weboskmsdmabuf.h"
+
+WebOSKmsDmaBuf *WebOSKmsDmaBuf::create(const WebOSKmsDmaBufDescriptor &descriptor)
+{
+    if (!descriptor.width || !descriptor.height || !descriptor.format
+        || descriptor.planeCount < 1 || descriptor.planeCount > 4) {
+        qWarning() << "Invalid dma-buf" << descriptor.width << descriptor.height
+                   << "format" << descriptor.format << "planes" << descriptor.planeCount;
+        return nullptr;
+    }
+
+    WebOSKmsDmaBuf *dmabuf = new WebOSKmsDmaBuf;
+    dmabuf->m_descriptor = descriptor;
+    // Released by the producer if this fails, only duplicates get closed
+    dmabuf->m_descriptor.release = nullptr;
+    dmabuf->m_descriptor.acquireFence = -1;
+    for (int i = 0; i < 4; i++)
+        dmabuf->m_descriptor.fds[i] = -1;
+
+    for (int i = 0; i < descriptor.planeCount; i++) {
+        int j = 0;
+        while (j < i && descriptor.fds[j] != descriptor.fds[i])
+            j++;
+
+        // Duplicate a shared fd only once
+        int fd = j < i ? dmabuf->m_descriptor.fds[j] : fcntl(descriptor.fds[i], F_DUPFD_CLOEXEC, 0);
+        if (fd < 0) {
+            qWarning() << "Failed to duplicate dma-buf fd" << descriptor.fds[i] << "of plane" << i;
+            delete dmabuf;
+            return nullptr;
+        }
+        dmabuf->m_descriptor.fds[i] = fd;
+    }
+
+    if (descriptor.acquireFence >= 0) {
+        dmabuf->m_descriptor.acquireFence = fcntl(descriptor.acquireFence, F_DUPFD_CLOEXEC, 0);
+        if (dmabuf->m_descriptor.acquireFence < 0) {
+            qWarning() << "Failed to duplicate acquire fence" << descriptor.acquireFence;
+            delete dmabuf;
+            return nullptr;
+        }
+    }
+
+    dmabuf->m_descriptor.release = descriptor.release;
+    return dmabuf;
+}
+
+WebOSKmsDmaBuf::~WebOSKmsDmaBuf()
+{
+    for (int i = 0; i < m_descriptor.planeCount; i++) {
+        int fd = m_descriptor.fds[i];
+        if (fd < 0)
+            continue;
+
+        close(fd);
+        for (int j = i; j < m_descriptor.planeCount; j++) {
+            if (m_descriptor.fds[j] == fd)
+                m_descriptor.fds[j] = -1;
+        }
+    }
+
+    if (m_descriptor.acquireFence >= 0)
+        close(m_descriptor.acquireFence);
+
+    if (m_descriptor.release)
+        m_descriptor.release(m_descriptor.releaseData);
+}
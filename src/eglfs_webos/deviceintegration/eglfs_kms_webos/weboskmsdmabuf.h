@@ -0,0 +1,62 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+#ifndef WEBOSKMSDMABUF_H
+#define WEBOSKMSDMABUF_H
+
+#include <stdint.h>
+
+// A dma-buf handed to an overlay layer without a gbm_bo.
+// Planes may share an fd. The fds stay owned by the producer.
+struct WebOSKmsDmaBufDescriptor {
+    uint32_t width = 0;
+    uint32_t height = 0;
+    // DRM fourcc and modifier, DRM_FORMAT_MOD_INVALID for implicit
+    uint32_t format = 0;
+    uint64_t modifier = 0;
+    int planeCount = 0;
+    int fds[4] = { -1, -1, -1, -1 };
+    uint32_t offsets[4] = {};
+    uint32_t pitches[4] = {};
+    // Signals once the producer is done writing, -1 if it already is
+    int acquireFence = -1;
+    // Called from any thread once the buffer has left the screen
+    void (*release)(void *data) = nullptr;
+    void *releaseData = nullptr;
+};
+
+// The layer's own reference to a dma-buf, the fds are duplicated
+// so that the producer can close its copies right away.
+class WebOSKmsDmaBuf
+{
+public:
+    // Returns nullptr if the descriptor is invalid
+    static WebOSKmsDmaBuf *create(const WebOSKmsDmaBufDescriptor &descriptor);
+    ~WebOSKmsDmaBuf();
+
+    WebOSKmsDmaBuf(const WebOSKmsDmaBuf &) = delete;
+    WebOSKmsDmaBuf &operator=(const WebOSKmsDmaBuf &) = delete;
+
+    const WebOSKmsDmaBufDescriptor &descriptor() const { return m_descriptor; }
+
+private:
+    WebOSKmsDmaBuf() = default;
+
+    WebOSKmsDmaBufDescriptor m_descriptor;
+};
+
+#endif
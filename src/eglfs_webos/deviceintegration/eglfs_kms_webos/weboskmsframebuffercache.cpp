@@ -0,0 +1,264 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include <QDebug>
+
+#include <algorithm>
+
+#include <sys/stat.h>
+#include <xf86drmMode.h>
+
+#include "weboskmscallstats.h"
+#include "weboskmsframebuffercache.h"
+#include "weboskmsgemregistry.h"
+#include "weboskmsreleasequeue.h"
+
+bool operator==(const WebOSKmsFramebufferCache::Key &a, const WebOSKmsFramebufferCache::Key &b)
+{
+    for (int i = 0; i < 4; i++) {
+        if (a.inodes[i] != b.inodes[i] || a.offsets[i] != b.offsets[i] || a.pitches[i] != b.pitches[i])
+            return false;
+    }
+
+    return a.format == b.format
+        && a.modifier == b.modifier
+        && a.width == b.width
+        && a.height == b.height;
+}
+
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+size_t qHash(const WebOSKmsFramebufferCache::Key &key, size_t seed)
+#else
+uint qHash(const WebOSKmsFramebufferCache::Key &key, uint seed)
+#endif
+{
+    auto hash = qHash(quint64(key.inodes[0]), seed) ^ qHash(key.format) ^ qHash(key.modifier)
+        ^ qHash(key.width) ^ (qHash(key.height) << 1);
+    for (int i = 0; i < 4; i++)
+        hash ^= (qHash(quint64(key.inodes[i])) + qHash(key.offsets[i]) + qHash(key.pitches[i])) << (i + 2);
+    return hash;
+}
+
+WebOSKmsFramebufferCache::WebOSKmsFramebufferCache(int drmFd, WebOSKmsGemRegistry *registry, int capacity)
+    : m_drmFd(drmFd)
+    , m_registry(registry)
+    , m_capacity(qMax(capacity, 1))
+{
+}
+
+WebOSKmsFramebufferCache::~WebOSKmsFramebufferCache()
+{
+    qInfo() << "Overlay framebuffer cache hits" << m_statistics.hits.loadRelaxed()
+            << "misses" << m_statistics.misses.loadRelaxed() << "evictions" << m_statistics.evictions.loadRelaxed();
+    clear();
+}
+
+int WebOSKmsFramebufferCache::defaultCapacity()
+{
+    bool ok = false;
+    int capacity = qEnvironmentVariableIntValue("WEBOS_OVERLAY_FB_CACHE_SIZE", &ok);
+    return ok && capacity > 0 ? capacity : 32;
+}
+
+bool WebOSKmsFramebufferCache::keyForDmaBuf(int dmaBufFd, uint32_t format, uint64_t modifier,
+                                            uint32_t width, uint32_t height, Key *key)
+{
+    key->format = format;
+    key->modifier = modifier;
+    key->width = width;
+    key->height = height;
+    return setKeyPlane(key, 0, dmaBufFd, key->offsets[0], key->pitches[0]);
+}
+
+bool WebOSKmsFramebufferCache::setKeyPlane(Key *key, int plane, int dmaBufFd, uint32_t offset, uint32_t pitch)
+{
+    // The inode identifies a dma-buf for its lifetime and a framebuffer
+    // holds a reference to it, so it cannot be recycled while cached.
+    struct stat st;
+    if (plane < 0 || plane >= 4 || dmaBufFd < 0 || fstat(dmaBufFd, &st)) {
+        qWarning() << "Failed to stat dma-buf" << dmaBufFd << "of plane" << plane;
+        return false;
+    }
+
+    key->inodes[plane] = st.st_ino;
+    key->offsets[plane] = offset;
+    key->pitches[plane] = pitch;
+    return true;
+}
+
+uint32_t WebOSKmsFramebufferCache::acquire(const Key &key)
+{
+    QMutexLocker lock(&m_mutex);
+
+    auto it = m_entries.find(key);
+    if (it == m_entries.end() || it->stale) {
+        m_statistics.misses.fetchAndAddRelaxed(1);
+        return 0;
+    }
+
+    it->lastUsed = ++m_useCounter;
+    it->pins++;
+    m_statistics.hits.fetchAndAddRelaxed(1);
+    return it->fb;
+}
+
+void WebOSKmsFramebufferCache::insert(const Key &key, uint32_t fb)
+{
+    QVarLengthArray<uint32_t, 4> removed;
+
+    {
+        QMutexLocker lock(&m_mutex);
+
+        auto it = m_entries.find(key);
+        if (it != m_entries.end()) {
+            // A stale entry for the same buffer is still on the screen
+            if (it->pins > 0)
+                qWarning() << "Overlay framebuffer" << it->fb << "is replaced while in use";
+            else
+                removed.append(it->fb);
+            m_entries.erase(it);
+        }
+
+        Entry entry;
+        entry.fb = fb;
+        entry.lastUsed = ++m_useCounter;
+        entry.pins = 1;
+        m_entries.insert(key, entry);
+
+        evictLocked(&removed);
+    }
+
+    // Not cached anymore, so the worker removes them through release().
+    // Queued outside the lock as a full queue releases synchronously.
+    for (uint32_t removedFb : removed) {
+        if (m_releaseQueue)
+            m_releaseQueue->release(removedFb, nullptr);
+        else
+            removeFramebuffer(removedFb);
+    }
+}
+
+void WebOSKmsFramebufferCache::release(uint32_t fb)
+{
+    if (!fb)
+        return;
+
+    {
+        QMutexLocker lock(&m_mutex);
+
+        for (auto it = m_entries.begin(); it != m_entries.end(); ++it) {
+            if (it->fb != fb)
+                continue;
+
+            if (it->pins > 0)
+                it->pins--;
+
+            if (it->pins > 0 || !it->stale)
+                return;
+
+            m_entries.erase(it);
+            break;
+        }
+    }
+
+    // Stale or not cached anymore (replaced while pinned),
+    // removed outside the lock as RmFB may take a while
+    removeFramebuffer(fb);
+}
+
+void WebOSKmsFramebufferCache::invalidate(int dmaBufFd)
+{
+    struct stat st;
+    if (dmaBufFd < 0 || fstat(dmaBufFd, &st))
+        return;
+
+    QVarLengthArray<uint32_t, 4> removed;
+
+    {
+        QMutexLocker lock(&m_mutex);
+
+        auto it = m_entries.begin();
+        while (it != m_entries.end()) {
+            const Key &key = it.key();
+            if (std::find(key.inodes, key.inodes + 4, st.st_ino) == key.inodes + 4) {
+                ++it;
+                continue;
+            }
+
+            if (it->pins > 0) {
+                // Removed once it leaves the screen
+                it->stale = true;
+                ++it;
+                continue;
+            }
+
+            qDebug() << "Drop overlay framebuffer" << it->fb << "for released dma-buf" << dmaBufFd;
+            removed.append(it->fb);
+            it = m_entries.erase(it);
+        }
+    }
+
+    for (uint32_t fb : removed)
+        removeFramebuffer(fb);
+}
+
+void WebOSKmsFramebufferCache::clear()
+{
+    QVarLengthArray<uint32_t, 32> removed;
+
+    {
+        QMutexLocker lock(&m_mutex);
+
+        for (const Entry &entry : m_entries)
+            removed.append(entry.fb);
+        m_entries.clear();
+    }
+
+    for (uint32_t fb : removed)
+        removeFramebuffer(fb);
+}
+
+void WebOSKmsFramebufferCache::removeFramebuffer(uint32_t fb)
+{
+    if (m_registry) {
+        m_registry->removeFramebuffer(fb);
+    } else {
+        drmModeRmFB(m_drmFd, fb);
+        WebOSKmsCallStats::count(WebOSKmsCallStats::RemoveFramebuffer);
+    }
+}
+
+void WebOSKmsFramebufferCache::evictLocked(QVarLengthArray<uint32_t, 4> *removed)
+{
+    while (m_entries.size() > m_capacity) {
+        auto victim = m_entries.end();
+        for (auto it = m_entries.begin(); it != m_entries.end(); ++it) {
+            if (it->pins > 0)
+                continue;
+            if (victim == m_entries.end() || it->lastUsed < victim->lastUsed)
+                victim = it;
+        }
+
+        // Everything is on the screen
+        if (victim == m_entries.end())
+            return;
+
+        qDebug() << "Evict overlay framebuffer" << victim->fb;
+        removed->append(victim->fb);
+        m_entries.erase(victim);
+        m_statistics.evictions.fetchAndAddRelaxed(1);
+    }
+}
@@ -0,0 +1,112 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef WEBOSKMSFRAMEBUFFERCACHE_H
+#define WEBOSKMSFRAMEBUFFERCACHE_H
+
+#include <QAtomicInteger>
+#include <QHash>
+#include <QMutex>
+#include <QVarLengthArray>
+
+#include <sys/types.h>
+
+class WebOSKmsGemRegistry;
+class WebOSKmsReleaseQueue;
+
+// Keeps KMS framebuffers of overlay buffers alive across flips.
+// Video decoders cycle through a small pool of dma-bufs, so the same
+// buffer is imported again and again. An entry is keyed by the identity
+// of the underlying dma-buf and is removed either by LRU eviction or
+// when the producer tells that the buffer is gone.
+class WebOSKmsFramebufferCache
+{
+public:
+    struct Key {
+        // Per plane, planes sharing a dma-buf have the same inode
+        ino_t inodes[4] = {};
+        uint32_t format = 0;
+        uint64_t modifier = 0;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        // Buffers suballocated from one dma-buf differ by offset
+        uint32_t offsets[4] = {};
+        uint32_t pitches[4] = {};
+    };
+
+    // Written by the render thread, read from any
+    struct Statistics {
+        QAtomicInteger<quint64> hits;
+        QAtomicInteger<quint64> misses;
+        QAtomicInteger<quint64> evictions;
+    };
+
+    // Framebuffers are removed through the registry if there is one
+    explicit WebOSKmsFramebufferCache(int drmFd, WebOSKmsGemRegistry *registry = nullptr, int capacity = defaultCapacity());
+    ~WebOSKmsFramebufferCache();
+
+    static int defaultCapacity();
+    // Framebuffers dropped by insert() are removed on the worker of the
+    // queue instead of the calling thread
+    void setReleaseQueue(WebOSKmsReleaseQueue *queue) { m_releaseQueue = queue; }
+    static bool keyForDmaBuf(int dmaBufFd, uint32_t format, uint64_t modifier,
+                             uint32_t width, uint32_t height, Key *key);
+    // Sets the plane of a multi-planar buffer
+    static bool setKeyPlane(Key *key, int plane, int dmaBufFd, uint32_t offset, uint32_t pitch);
+
+    // Returns the cached framebuffer for the key or 0 on miss.
+    // A returned framebuffer is pinned until release() is called.
+    uint32_t acquire(const Key &key);
+    // Adds a newly created framebuffer which is pinned as well.
+    void insert(const Key &key, uint32_t fb);
+    void release(uint32_t fb);
+
+    // The dma-buf is no longer used by the producer
+    void invalidate(int dmaBufFd);
+    void clear();
+
+    const Statistics *statistics() const { return &m_statistics; }
+
+private:
+    struct Entry {
+        uint32_t fb = 0;
+        quint64 lastUsed = 0;
+        int pins = 0;
+        bool stale = false;
+    };
+
+    void removeFramebuffer(uint32_t fb);
+    void evictLocked(QVarLengthArray<uint32_t, 4> *removed);
+
+    int m_drmFd = -1;
+    WebOSKmsGemRegistry *m_registry = nullptr;
+    WebOSKmsReleaseQueue *m_releaseQueue = nullptr;
+    int m_capacity = 0;
+    quint64 m_useCounter = 0;
+
+    QMutex m_mutex;
+    QHash<Key, Entry> m_entries;
+    Statistics m_statistics;
+};
+
+bool operator==(const WebOSKmsFramebufferCache::Key &a, const WebOSKmsFramebufferCache::Key &b);
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+size_t qHash(const WebOSKmsFramebufferCache::Key &key, size_t seed = 0);
+#else
+uint qHash(const WebOSKmsFramebufferCache::Key &key, uint seed = 0);
+#endif
+
+#endif
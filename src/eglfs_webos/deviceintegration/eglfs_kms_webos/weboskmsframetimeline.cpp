@@ -0,0 +1,82 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include <time.h>
+
+#include "weboskmsframetimeline.h"
+
+static const char *eventName(quint8 type)
+{
+    switch (type) {
+    case WebOSKmsFrameTimeline::Submit: return "submit";
+    case WebOSKmsFrameTimeline::FlipEntry: return "flip";
+    case WebOSKmsFrameTimeline::RequestBuilt: return "request";
+    case WebOSKmsFrameTimeline::Commit: return "commit";
+    case WebOSKmsFrameTimeline::OverlayCommit: return "overlay_commit";
+    case WebOSKmsFrameTimeline::PageFlipped: return "page_flipped";
+    }
+    return "unknown";
+}
+
+void WebOSKmsFrameTimeline::record(EventType type, int layer)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    Event event;
+    event.nsecs = qint64(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+    event.sequence = quint32(m_sequence.loadAcquire());
+    event.layer = layer;
+    event.type = type;
+    store(event);
+}
+
+void WebOSKmsFrameTimeline::recordPageFlipped(unsigned int sequence, unsigned int tv_sec, unsigned int tv_usec)
+{
+    m_sequence.storeRelease(int(sequence));
+
+    Event event;
+    event.nsecs = qint64(tv_sec) * 1000000000 + qint64(tv_usec) * 1000;
+    event.sequence = sequence;
+    event.type = PageFlipped;
+    store(event);
+}
+
+void WebOSKmsFrameTimeline::store(const Event &event)
+{
+    int index = m_next.fetchAndAddRelaxed(1) & (Capacity - 1);
+    m_events[index] = event;
+    m_events[index].valid = true;
+}
+
+void WebOSKmsFrameTimeline::dump(QByteArray *out, const QByteArray &title) const
+{
+    // Writers keep going, an event may be torn while it is being replaced
+    const int next = m_next.loadAcquire();
+
+    out->append("# ").append(title).append("\n# sequence event layer time_us\n");
+
+    for (int i = 0; i < Capacity; i++) {
+        const Event &event = m_events[(next + i) & (Capacity - 1)];
+        if (!event.valid)
+            continue;
+
+        out->append(QByteArray::number(event.sequence)).append(' ')
+            .append(eventName(event.type)).append(' ')
+            .append(QByteArray::number(event.layer)).append(' ')
+            .append(QByteArray::number(event.nsecs / 1000)).append('\n');
+    }
+}
@@ -0,0 +1,68 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef WEBOSKMSFRAMETIMELINE_H
+#define WEBOSKMSFRAMETIMELINE_H
+
+#include <QAtomicInt>
+#include <QByteArray>
+
+// Fixed size record of the display events of a screen. Recording is
+// lock-free and never allocates, so it can stay enabled on the flip
+// path. Events are tagged with the last vblank sequence seen, which
+// groups them by the frame they were aiming at.
+class WebOSKmsFrameTimeline
+{
+public:
+    enum EventType : quint8 {
+        Submit,
+        FlipEntry,
+        RequestBuilt,
+        Commit,
+        OverlayCommit,
+        PageFlipped
+    };
+
+    WebOSKmsFrameTimeline() = default;
+    WebOSKmsFrameTimeline(const WebOSKmsFrameTimeline &) = delete;
+    WebOSKmsFrameTimeline &operator=(const WebOSKmsFrameTimeline &) = delete;
+
+    // Timestamped with CLOCK_MONOTONIC, the clock of page flip events
+    void record(EventType type, int layer = -1);
+    void recordPageFlipped(unsigned int sequence, unsigned int tv_sec, unsigned int tv_usec);
+
+    // One line per event, oldest first
+    void dump(QByteArray *out, const QByteArray &title) const;
+
+private:
+    enum { Capacity = 512 };
+
+    struct Event {
+        qint64 nsecs = 0;
+        quint32 sequence = 0;
+        qint16 layer = -1;
+        quint8 type = 0;
+        bool valid = false;
+    };
+
+    void store(const Event &event);
+
+    Event m_events[Capacity];
+    QAtomicInt m_next { 0 };
+    QAtomicInt m_sequence { 0 };
+};
+
+#endif
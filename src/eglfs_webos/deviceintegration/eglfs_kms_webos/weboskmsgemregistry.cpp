@@ -0,0 +1,119 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+#include <QDebug>
+
+#include <sys/stat.h>
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+
+#include "weboskmscallstats.h"
+#include "weboskmsgemregistry.h"
+
+WebOSKmsGemRegistry::WebOSKmsGemRegistry(int drmFd)
+    : m_drmFd(drmFd)
+{
+}
+
+WebOSKmsGemRegistry::~WebOSKmsGemRegistry()
+{
+    for (FramebufferShard &shard : m_framebufferShards) {
+        if (!shard.framebuffers.isEmpty())
+            qWarning() << "Framebuffers left in the GEM registry" << shard.framebuffers.keys();
+    }
+}
+
+bool WebOSKmsGemRegistry::acquire(int dmaBufFd, Reference *reference)
+{
+    struct stat st;
+    if (dmaBufFd < 0 || fstat(dmaBufFd, &st)) {
+        qWarning() << "Failed to stat dma-buf" << dmaBufFd;
+        return false;
+    }
+
+    HandleShard &shard = handleShard(st.st_ino);
+    QMutexLocker lock(&shard.mutex);
+
+    Handle &entry = shard.handles[st.st_ino];
+    if (!entry.refs) {
+        WebOSKmsCallStats::count(WebOSKmsCallStats::PrimeImport);
+        if (drmPrimeFDToHandle(m_drmFd, dmaBufFd, &entry.handle)) {
+            qWarning() << "Failed to drmPrimeFDToHandle" << m_drmFd << dmaBufFd;
+            shard.handles.remove(st.st_ino);
+            return false;
+        }
+    }
+
+    entry.refs++;
+    reference->handle = entry.handle;
+    reference->inode = st.st_ino;
+    return true;
+}
+
+void WebOSKmsGemRegistry::release(const Reference &reference)
+{
+    HandleShard &shard = handleShard(reference.inode);
+    QMutexLocker lock(&shard.mutex);
+
+    auto it = shard.handles.find(reference.inode);
+    if (it == shard.handles.end() || it->handle != reference.handle) {
+        qWarning() << "Release of unknown GEM handle" << reference.handle;
+        return;
+    }
+
+    if (--it->refs > 0)
+        return;
+
+    // Closed under the lock so that nobody picks it up meanwhile
+    struct drm_gem_close gem_close = {};
+    gem_close.handle = it->handle;
+    WebOSKmsCallStats::count(WebOSKmsCallStats::GemClose);
+    if (drmIoctl(m_drmFd, DRM_IOCTL_GEM_CLOSE, &gem_close))
+        qWarning() << "Failed to DRM_IOCTL_GEM_CLOSE" << it->handle;
+
+    shard.handles.erase(it);
+}
+
+void WebOSKmsGemRegistry::attach(uint32_t fb, const Reference *references, int count)
+{
+    FramebufferShard &shard = framebufferShard(fb);
+    QMutexLocker lock(&shard.mutex);
+
+    auto &list = shard.framebuffers[fb];
+    list.append(references, count);
+}
+
+void WebOSKmsGemRegistry::removeFramebuffer(uint32_t fb)
+{
+    // Taken out first, the id can be reused as soon as it is removed
+    QVarLengthArray<Reference, 4> references;
+    {
+        FramebufferShard &shard = framebufferShard(fb);
+        QMutexLocker lock(&shard.mutex);
+        auto it = shard.framebuffers.find(fb);
+        if (it != shard.framebuffers.end()) {
+            references = *it;
+            shard.framebuffers.erase(it);
+        }
+    }
+
+    drmModeRmFB(m_drmFd, fb);
+    WebOSKmsCallStats::count(WebOSKmsCallStats::RemoveFramebuffer);
+
+    for (const Reference &reference : references)
+        release(reference);
+}
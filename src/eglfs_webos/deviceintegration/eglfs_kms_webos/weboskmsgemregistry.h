@@ -0,0 +1,80 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+#ifndef WEBOSKMSGEMREGISTRY_H
+#define WEBOSKMSGEMREGISTRY_H
+
+#include <QHash>
+#include <QMutex>
+#include <QVarLengthArray>
+
+#include <sys/types.h>
+
+// GEM handles of the dma-bufs imported on one DRM device.
+// A dma-buf gets the same handle on every import through the same fd, so
+// closing it for one screen would break a mirrored screen using the same
+// buffer. Handles are reference counted instead and closed when the last
+// framebuffer made from them is removed. The tables are split in shards
+// by dma-buf and framebuffer, so screens importing different buffers do
+// not wait for each other.
+class WebOSKmsGemRegistry
+{
+public:
+    struct Reference {
+        uint32_t handle = 0;
+        ino_t inode = 0;
+    };
+
+    explicit WebOSKmsGemRegistry(int drmFd);
+    ~WebOSKmsGemRegistry();
+
+    // Takes a reference to the handle of the dma-buf, imported only if
+    // it is not known yet. Returns false if it cannot be imported.
+    bool acquire(int dmaBufFd, Reference *reference);
+    void release(const Reference &reference);
+
+    // The framebuffer holds the references until it is removed
+    void attach(uint32_t fb, const Reference *references, int count);
+    void removeFramebuffer(uint32_t fb);
+
+private:
+    enum { ShardCount = 16 };
+
+    struct Handle {
+        uint32_t handle = 0;
+        int refs = 0;
+    };
+
+    struct HandleShard {
+        QMutex mutex;
+        QHash<ino_t, Handle> handles;
+    };
+
+    struct FramebufferShard {
+        QMutex mutex;
+        QHash<uint32_t, QVarLengthArray<Reference, 4>> framebuffers;
+    };
+
+    HandleShard &handleShard(ino_t inode) { return m_handleShards[inode % ShardCount]; }
+    FramebufferShard &framebufferShard(uint32_t fb) { return m_framebufferShards[fb % ShardCount]; }
+
+    int m_drmFd = -1;
+    HandleShard m_handleShards[ShardCount];
+    FramebufferShard m_framebufferShards[ShardCount];
+};
+
+#endif
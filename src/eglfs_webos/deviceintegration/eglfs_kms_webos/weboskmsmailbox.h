@@ -0,0 +1,77 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef WEBOSKMSMAILBOX_H
+#define WEBOSKMSMAILBOX_H
+
+#include <QAtomicInt>
+
+// Lock-free triple buffer between a single producer and a single consumer.
+// The producer always writes into its own back slot and swaps it with the
+// shared middle slot. The consumer takes the middle slot only when it holds
+// a state that has not been consumed yet, so it never waits for the producer.
+template <typename T>
+class WebOSKmsMailbox
+{
+public:
+    WebOSKmsMailbox() = default;
+    WebOSKmsMailbox(const WebOSKmsMailbox &) = delete;
+    WebOSKmsMailbox &operator=(const WebOSKmsMailbox &) = delete;
+
+    // Producer side. Returns true and fills superseded if the previously
+    // published state was not consumed, handing its ownership back.
+    bool publish(const T &state, T *superseded)
+    {
+        m_slots[m_back] = state;
+        int old = m_middle.fetchAndStoreAcquireRelease(m_back | Dirty);
+        m_back = old & IndexMask;
+
+        if (!(old & Dirty))
+            return false;
+
+        *superseded = m_slots[m_back];
+        return true;
+    }
+
+    // True if a published state has not been consumed yet
+    bool isPending() const
+    {
+        return m_middle.loadAcquire() & Dirty;
+    }
+
+    // Consumer side. Returns the latest published state or nullptr if
+    // nothing has been published since the last call. The returned
+    // pointer stays valid until the next call.
+    const T *consume()
+    {
+        if (!(m_middle.loadAcquire() & Dirty))
+            return nullptr;
+
+        int old = m_middle.fetchAndStoreAcquireRelease(m_front);
+        m_front = old & IndexMask;
+        return &m_slots[m_front];
+    }
+
+private:
+    enum { IndexMask = 0x3, Dirty = 0x4 };
+
+    T m_slots[3];
+    int m_back = 0;
+    int m_front = 1;
+    QAtomicInt m_middle { 2 };
+};
+
+#endif
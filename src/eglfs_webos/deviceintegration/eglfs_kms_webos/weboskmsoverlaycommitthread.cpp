@@ -0,0 +1,68 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include "weboskmsoverlaycommitthread.h"
+#include "weboseglfskmsgbmintegration.h"
+
+WebOSKmsOverlayCommitThread::WebOSKmsOverlayCommitThread(WebOSEglFSKmsGbmScreen *screen)
+    : m_screen(screen)
+{
+    setObjectName(QStringLiteral("WebOSKmsOverlayCommit"));
+}
+
+WebOSKmsOverlayCommitThread::~WebOSKmsOverlayCommitThread()
+{
+    stop();
+    wait();
+}
+
+void WebOSKmsOverlayCommitThread::schedule()
+{
+    QMutexLocker lock(&m_mutex);
+    m_pending = true;
+    m_condition.wakeOne();
+}
+
+void WebOSKmsOverlayCommitThread::stop()
+{
+    QMutexLocker lock(&m_mutex);
+    m_stopped = true;
+    m_condition.wakeOne();
+}
+
+void WebOSKmsOverlayCommitThread::run()
+{
+    QMutexLocker lock(&m_mutex);
+
+    while (!m_stopped) {
+        if (!m_pending) {
+            m_condition.wait(&m_mutex);
+            continue;
+        }
+
+        m_pending = false;
+
+        lock.unlock();
+        int delay = m_screen->commitOverlays();
+        lock.relock();
+
+        // The UI is flipping, check again whether it took the layers
+        if (delay > 0) {
+            m_pending = true;
+            m_condition.wait(&m_mutex, delay);
+        }
+    }
+}
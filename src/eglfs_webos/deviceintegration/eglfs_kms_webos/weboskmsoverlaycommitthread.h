@@ -0,0 +1,51 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef WEBOSKMSOVERLAYCOMMITTHREAD_H
+#define WEBOSKMSOVERLAYCOMMITTHREAD_H
+
+#include <QMutex>
+#include <QThread>
+#include <QWaitCondition>
+
+class WebOSEglFSKmsGbmScreen;
+
+// Commits overlay layers on their own while the main plane has no new
+// frame, e.g. a video playing on top of a static UI. While the UI keeps
+// flipping, the layers go out with the main plane instead.
+class WebOSKmsOverlayCommitThread : public QThread
+{
+public:
+    explicit WebOSKmsOverlayCommitThread(WebOSEglFSKmsGbmScreen *screen);
+    ~WebOSKmsOverlayCommitThread() override;
+
+    // A producer has published a new layer state
+    void schedule();
+    void stop();
+
+protected:
+    void run() override;
+
+private:
+    WebOSEglFSKmsGbmScreen *m_screen = nullptr;
+
+    QMutex m_mutex;
+    QWaitCondition m_condition;
+    bool m_pending = false;
+    bool m_stopped = false;
+};
+
+#endif
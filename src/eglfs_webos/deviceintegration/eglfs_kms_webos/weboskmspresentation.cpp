@@ -0,0 +1,181 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include <time.h>
+
+#include "weboskmspresentation.h"
+
+WebOSKmsPresentation::WebOSKmsPresentation(qreal refreshRate)
+    : m_refreshInterval(qint64(1000000000 / qMax(refreshRate, qreal(1))))
+{
+}
+
+qint64 WebOSKmsPresentation::now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return qint64(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+int WebOSKmsPresentation::addListener(Callback callback, void *data)
+{
+    if (!callback)
+        return 0;
+
+    QMutexLocker lock(&m_mutex);
+
+    Listener listener;
+    listener.id = m_nextListenerId++;
+    listener.callback = callback;
+    listener.data = data;
+    m_listeners.append(listener);
+    return listener.id;
+}
+
+bool WebOSKmsPresentation::removeListener(int id)
+{
+    QMutexLocker lock(&m_mutex);
+
+    for (int i = 0; i < m_listeners.size(); i++) {
+        if (m_listeners[i].id == id) {
+            m_listeners.remove(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+WebOSKmsPresentation::Frame WebOSKmsPresentation::prepare(bool mainUpdated, quint32 layersUpdated, quint32 layersVisible)
+{
+    QMutexLocker lock(&m_mutex);
+
+    Frame frame;
+    frame.id = m_nextFrame++;
+    frame.mainUpdated = mainUpdated;
+    frame.layersUpdated = layersUpdated;
+    frame.layersVisible = layersVisible;
+
+    // The earliest vblank after now
+    if (m_lastVblank > 0) {
+        qint64 elapsed = qMax(now() - m_lastVblank, qint64(0));
+        frame.targetSequence = m_lastSequence + (m_variableRefresh ? 1 : quint32(elapsed / m_refreshInterval) + 1);
+        frame.predicted = true;
+    }
+
+    return frame;
+}
+
+void WebOSKmsPresentation::submitted(const Frame &frame)
+{
+    QMutexLocker lock(&m_mutex);
+    m_pending = frame;
+    m_hasPending = true;
+}
+
+void WebOSKmsPresentation::cancel(const Frame &frame)
+{
+    QMutexLocker lock(&m_mutex);
+    if (m_hasPending && m_pending.id == frame.id)
+        m_hasPending = false;
+}
+
+void WebOSKmsPresentation::presented(quint32 sequence, qint64 nsecs)
+{
+    Frame frame;
+    {
+        QMutexLocker lock(&m_mutex);
+        if (m_hasPending)
+            frame = m_pending;
+        else
+            frame.mainUpdated = true;
+        m_hasPending = false;
+    }
+
+    presented(frame, sequence, nsecs);
+}
+
+void WebOSKmsPresentation::presented(const Frame &frame, quint32 sequence, qint64 nsecs)
+{
+    Feedback feedback;
+    QVector<Listener> listeners;
+    {
+        QMutexLocker lock(&m_mutex);
+        updateTimingLocked(sequence, nsecs);
+
+        feedback.frame = frame.id;
+        feedback.sequence = sequence;
+        feedback.presented = nsecs;
+        feedback.refreshInterval = m_refreshInterval;
+        feedback.nextVblank = predictNextVblankLocked(nsecs);
+        feedback.targetSequence = frame.predicted ? frame.targetSequence : sequence;
+        // Wraps around together with the vblank counter
+        feedback.missed = frame.predicted && qint32(sequence - frame.targetSequence) > 0;
+        feedback.mainUpdated = frame.mainUpdated;
+        feedback.layersUpdated = frame.layersUpdated;
+        feedback.layersVisible = frame.layersVisible;
+
+        // Shared, a listener may remove itself from its callback
+        listeners = m_listeners;
+    }
+
+    for (const Listener &listener : listeners)
+        listener.callback(listener.data, &feedback);
+}
+
+qint64 WebOSKmsPresentation::refreshInterval() const
+{
+    QMutexLocker lock(&m_mutex);
+    return m_refreshInterval;
+}
+
+qint64 WebOSKmsPresentation::predictNextVblank(qint64 now) const
+{
+    QMutexLocker lock(&m_mutex);
+    return predictNextVblankLocked(now);
+}
+
+void WebOSKmsPresentation::setVariableRefresh(bool active)
+{
+    QMutexLocker lock(&m_mutex);
+    m_variableRefresh = active;
+}
+
+void WebOSKmsPresentation::updateTimingLocked(quint32 sequence, qint64 nsecs)
+{
+    const quint32 vblanks = sequence - m_lastSequence;
+
+    // Average over consecutive page flips, which tolerates skipped vblanks.
+    // Variable refresh stretches vblanks, keep the nominal interval then.
+    if (!m_variableRefresh && m_lastVblank > 0 && vblanks > 0 && vblanks < 1000 && nsecs > m_lastVblank) {
+        qint64 interval = (nsecs - m_lastVblank) / vblanks;
+        m_refreshInterval = (m_refreshInterval * 7 + interval) / 8;
+    }
+
+    m_lastSequence = sequence;
+    m_lastVblank = nsecs;
+}
+
+qint64 WebOSKmsPresentation::predictNextVblankLocked(qint64 now) const
+{
+    if (m_lastVblank <= 0)
+        return now + m_refreshInterval;
+
+    if (m_variableRefresh)
+        return qMax(now, m_lastVblank + m_refreshInterval);
+
+    qint64 elapsed = qMax(now - m_lastVblank, qint64(0));
+    return m_lastVblank + (elapsed / m_refreshInterval + 1) * m_refreshInterval;
+}
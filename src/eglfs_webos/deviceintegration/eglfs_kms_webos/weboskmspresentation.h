@@ -0,0 +1,111 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef WEBOSKMSPRESENTATION_H
+#define WEBOSKMSPRESENTATION_H
+
+#include <QMutex>
+#include <QVector>
+
+// Presentation feedback of a screen in the spirit of wp_presentation.
+// Every committed frame is reported to all listeners once it reaches the
+// screen, together with the measured refresh interval and a prediction
+// of the next vblank so that rendering can be scheduled just in time.
+// Times are CLOCK_MONOTONIC in nanoseconds.
+class WebOSKmsPresentation
+{
+public:
+    struct Feedback {
+        quint64 frame = 0;
+        quint32 sequence = 0;
+        qint64 presented = 0;
+        qint64 refreshInterval = 0;
+        qint64 nextVblank = 0;
+        // The vblank the frame was committed for
+        quint32 targetSequence = 0;
+        bool missed = false;
+        bool mainUpdated = false;
+        // Bit n stands for the layer at zpos n
+        quint32 layersUpdated = 0;
+        quint32 layersVisible = 0;
+    };
+
+    struct Frame {
+        quint64 id = 0;
+        quint32 targetSequence = 0;
+        bool predicted = false;
+        bool mainUpdated = false;
+        quint32 layersUpdated = 0;
+        quint32 layersVisible = 0;
+    };
+
+    // Called on a display thread (DRM events, rendering or overlay
+    // commit), so it must not block
+    typedef void (*Callback)(void *data, const Feedback *feedback);
+
+    explicit WebOSKmsPresentation(qreal refreshRate);
+
+    int addListener(Callback callback, void *data);
+    // Listeners are called outside the lock, so a callback which has
+    // already started on another thread may still be running when this
+    // returns. The data must stay valid until such a call is done.
+    bool removeListener(int id);
+
+    // Describes a frame about to be committed now
+    Frame prepare(bool mainUpdated, quint32 layersUpdated, quint32 layersVisible);
+    // The frame completes with the next page flip event. Submitted
+    // before the commit, as the event may come before it returns.
+    void submitted(const Frame &frame);
+    // The commit of a submitted frame failed
+    void cancel(const Frame &frame);
+    void presented(quint32 sequence, qint64 nsecs);
+    // For commits without a page flip event
+    void presented(const Frame &frame, quint32 sequence, qint64 nsecs);
+
+    qint64 refreshInterval() const;
+    qint64 predictNextVblank(qint64 now) const;
+
+    // With variable refresh the next vblank follows the next commit, no
+    // earlier than the nominal refresh interval after the last one
+    void setVariableRefresh(bool active);
+
+    static qint64 now();
+
+private:
+    struct Listener {
+        int id = 0;
+        Callback callback = nullptr;
+        void *data = nullptr;
+    };
+
+    void updateTimingLocked(quint32 sequence, qint64 nsecs);
+    qint64 predictNextVblankLocked(qint64 now) const;
+
+    mutable QMutex m_mutex;
+    QVector<Listener> m_listeners;
+    int m_nextListenerId = 1;
+
+    quint64 m_nextFrame = 1;
+    Frame m_pending;
+    bool m_hasPending = false;
+
+    quint32 m_lastSequence = 0;
+    qint64 m_lastVblank = 0;
+    qint64 m_refreshInterval = 0;
+    bool m_variableRefresh = false;
+};
+
+#endif
@@ -0,0 +1,122 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include <QDebug>
+
+#include <gbm.h>
+
+#include "weboskmsdmabuf.h"
+#include "weboskmsframebuffercache.h"
+#include "weboskmsreleasequeue.h"
+
+WebOSKmsReleaseQueue::WebOSKmsReleaseQueue(WebOSKmsFramebufferCache *cache, int capacity)
+    : m_cache(cache)
+    , m_entries(qMax(capacity, 1))
+{
+    setObjectName(QStringLiteral("WebOSKmsRelease"));
+}
+
+WebOSKmsReleaseQueue::~WebOSKmsReleaseQueue()
+{
+    {
+        QMutexLocker lock(&m_mutex);
+        m_stopped = true;
+        m_condition.wakeOne();
+    }
+    wait();
+
+    // Whatever is left when the worker is gone
+    while (m_count > 0) {
+        releaseEntry(m_entries[m_head]);
+        m_head = (m_head + 1) % m_entries.size();
+        m_count--;
+        m_statistics.released.fetchAndAddRelaxed(1);
+    }
+
+    qInfo() << "Overlay release queue queued" << m_statistics.queued.loadRelaxed()
+            << "released" << m_statistics.released.loadRelaxed()
+            << "synchronous" << m_statistics.synchronous.loadRelaxed() << "peak" << m_statistics.peak.loadRelaxed();
+}
+
+int WebOSKmsReleaseQueue::defaultCapacity()
+{
+    bool ok = false;
+    int capacity = qEnvironmentVariableIntValue("WEBOS_OVERLAY_RELEASE_QUEUE_SIZE", &ok);
+    return ok && capacity > 0 ? capacity : 16;
+}
+
+void WebOSKmsReleaseQueue::release(uint32_t fb, gbm_bo *bo, WebOSKmsDmaBuf *dmabuf)
+{
+    Entry entry;
+    entry.fb = fb;
+    entry.bo = bo;
+    entry.dmabuf = dmabuf;
+
+    {
+        QMutexLocker lock(&m_mutex);
+
+        if (isRunning() && m_count < m_entries.size()) {
+            m_entries[(m_head + m_count) % m_entries.size()] = entry;
+            m_count++;
+            m_statistics.queued.fetchAndAddRelaxed(1);
+            if (m_count > m_statistics.peak.loadRelaxed())
+                m_statistics.peak.storeRelaxed(m_count);
+            m_condition.wakeOne();
+            return;
+        }
+
+        m_statistics.synchronous.fetchAndAddRelaxed(1);
+    }
+
+    releaseEntry(entry);
+}
+
+void WebOSKmsReleaseQueue::run()
+{
+    QMutexLocker lock(&m_mutex);
+
+    while (!m_stopped) {
+        if (m_count == 0) {
+            m_condition.wait(&m_mutex);
+            continue;
+        }
+
+        Entry entry = m_entries[m_head];
+        m_head = (m_head + 1) % m_entries.size();
+        m_count--;
+
+        lock.unlock();
+        releaseEntry(entry);
+        lock.relock();
+
+        m_statistics.released.fetchAndAddRelaxed(1);
+    }
+}
+
+void WebOSKmsReleaseQueue::releaseEntry(const Entry &entry)
+{
+    // The framebuffer stays in the cache for the next use of the buffer
+    if (entry.fb)
+        m_cache->release(entry.fb);
+
+    if (entry.bo) {
+        qDebug() << "destroy bo" << entry.bo;
+        gbm_bo_destroy(entry.bo);
+    }
+
+    // Hands the buffer back to the producer
+    delete entry.dmabuf;
+}
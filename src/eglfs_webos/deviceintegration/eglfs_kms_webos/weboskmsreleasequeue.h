@@ -0,0 +1,80 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef WEBOSKMSRELEASEQUEUE_H
+#define WEBOSKMSRELEASEQUEUE_H
+
+#include <QAtomicInteger>
+#include <QMutex>
+#include <QThread>
+#include <QVector>
+#include <QWaitCondition>
+
+struct gbm_bo;
+class WebOSKmsDmaBuf;
+class WebOSKmsFramebufferCache;
+
+// Releases overlay framebuffers and buffer objects on a low priority
+// thread. RmFB may block until the scanout has dropped the buffer, which
+// must not delay the page flip completion. If the worker falls behind,
+// entries beyond the capacity are released by the caller.
+class WebOSKmsReleaseQueue : public QThread
+{
+public:
+    // Written under the queue mutex, read from any thread
+    struct Statistics {
+        QAtomicInteger<quint64> queued;
+        QAtomicInteger<quint64> released;
+        QAtomicInteger<quint64> synchronous;
+        QAtomicInt peak;
+    };
+
+    explicit WebOSKmsReleaseQueue(WebOSKmsFramebufferCache *cache, int capacity = defaultCapacity());
+    ~WebOSKmsReleaseQueue() override;
+
+    static int defaultCapacity();
+
+    // Any can be null
+    void release(uint32_t fb, gbm_bo *bo, WebOSKmsDmaBuf *dmabuf = nullptr);
+
+    const Statistics *statistics() const { return &m_statistics; }
+
+protected:
+    void run() override;
+
+private:
+    struct Entry {
+        uint32_t fb = 0;
+        gbm_bo *bo = nullptr;
+        WebOSKmsDmaBuf *dmabuf = nullptr;
+    };
+
+    void releaseEntry(const Entry &entry);
+
+    WebOSKmsFramebufferCache *m_cache = nullptr;
+
+    QMutex m_mutex;
+    QWaitCondition m_condition;
+    // Fixed size ring, nothing is allocated while queueing
+    QVector<Entry> m_entries;
+    int m_head = 0;
+    int m_count = 0;
+    bool m_stopped = false;
+
+    Statistics m_statistics;
+};
+
+#endif
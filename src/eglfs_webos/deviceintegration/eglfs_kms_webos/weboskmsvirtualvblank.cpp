@@ -0,0 +1,113 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+#include <errno.h>
+#include <time.h>
+
+#include <QThread>
+
+#include "weboskmspresentation.h"
+#include "weboskmsvirtualvblank.h"
+
+class WebOSKmsVirtualVblank::Thread : public QThread
+{
+public:
+    explicit Thread(WebOSKmsVirtualVblank *vblank)
+        : m_vblank(vblank)
+    {
+        setObjectName(QStringLiteral("WebOSKmsVirtualVblank"));
+    }
+
+protected:
+    void run() override { m_vblank->run(); }
+
+private:
+    WebOSKmsVirtualVblank *m_vblank;
+};
+
+static void sleepUntil(qint64 nsecs)
+{
+    struct timespec ts;
+    ts.tv_sec = nsecs / 1000000000;
+    ts.tv_nsec = nsecs % 1000000000;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR) {
+    }
+}
+
+WebOSKmsVirtualVblank::WebOSKmsVirtualVblank(qreal refreshRate, Callback callback, void *data)
+    : m_interval(qint64(1000000000 / qMax(refreshRate, qreal(1))))
+    , m_epoch(WebOSKmsPresentation::now())
+    , m_callback(callback)
+    , m_data(data)
+    , m_thread(new Thread(this))
+{
+    m_thread->start(QThread::TimeCriticalPriority);
+}
+
+WebOSKmsVirtualVblank::~WebOSKmsVirtualVblank()
+{
+    {
+        QMutexLocker lock(&m_mutex);
+        m_stop = true;
+        m_queued.wakeAll();
+    }
+    m_thread->wait();
+}
+
+void WebOSKmsVirtualVblank::queueFlip()
+{
+    QMutexLocker lock(&m_mutex);
+    m_flipPending = true;
+    m_queued.wakeAll();
+}
+
+void WebOSKmsVirtualVblank::waitForFlip()
+{
+    QMutexLocker lock(&m_mutex);
+    while (m_flipPending && !m_stop)
+        m_completed.wait(&m_mutex);
+}
+
+void WebOSKmsVirtualVblank::lastVblank(quint32 *sequence, qint64 *nsecs) const
+{
+    const qint64 ticks = (WebOSKmsPresentation::now() - m_epoch) / m_interval;
+    *sequence = quint32(ticks);
+    *nsecs = m_epoch + ticks * m_interval;
+}
+
+void WebOSKmsVirtualVblank::run()
+{
+    QMutexLocker lock(&m_mutex);
+    while (!m_stop) {
+        if (!m_flipPending) {
+            m_queued.wait(&m_mutex);
+            continue;
+        }
+
+        // The first tick after the commit, as the hardware would latch it
+        const qint64 ticks = (WebOSKmsPresentation::now() - m_epoch) / m_interval + 1;
+        const qint64 vblank = m_epoch + ticks * m_interval;
+
+        lock.unlock();
+        sleepUntil(vblank);
+        m_callback(m_data, quint32(ticks), vblank);
+        lock.relock();
+
+        m_flipPending = false;
+        m_completed.wakeAll();
+    }
+}
@@ -0,0 +1,62 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+#ifndef WEBOSKMSVIRTUALVBLANK_H
+#define WEBOSKMSVIRTUALVBLANK_H
+
+#include <QMutex>
+#include <QScopedPointer>
+#include <QWaitCondition>
+
+// Vblank of a virtual output, ticking at a fixed rate on CLOCK_MONOTONIC.
+// A queued flip completes at the next tick on the vblank thread, where
+// the callback plays the part of the page flip event.
+class WebOSKmsVirtualVblank
+{
+public:
+    typedef void (*Callback)(void *data, quint32 sequence, qint64 nsecs);
+
+    WebOSKmsVirtualVblank(qreal refreshRate, Callback callback, void *data);
+    ~WebOSKmsVirtualVblank();
+    WebOSKmsVirtualVblank(const WebOSKmsVirtualVblank &) = delete;
+    WebOSKmsVirtualVblank &operator=(const WebOSKmsVirtualVblank &) = delete;
+
+    void queueFlip();
+    // Blocks until the queued flip, if any, has completed
+    void waitForFlip();
+    // The last tick, also without a flip
+    void lastVblank(quint32 *sequence, qint64 *nsecs) const;
+
+private:
+    class Thread;
+
+    void run();
+
+    const qint64 m_interval;
+    const qint64 m_epoch;
+    Callback m_callback;
+    void *m_data;
+
+    mutable QMutex m_mutex;
+    QWaitCondition m_queued;
+    QWaitCondition m_completed;
+    bool m_flipPending = false;
+    bool m_stop = false;
+    QScopedPointer<Thread> m_thread;
+};
+
+#endif
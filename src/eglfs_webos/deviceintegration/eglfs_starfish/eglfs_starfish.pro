@@ -21,6 +21,8 @@ PLUGIN_CLASS_NAME = EglFSStarfishIntegrationPlugin
 
 load(qt_plugin)
 
+include($$PWD/../common/common.pri)
+
 QT += eglfs_kms_gbm_support-private eglfsdeviceintegration-private eglfs_kms_support-private kms_support-private devicediscovery_support-private
 
 # CONFIG += inputmanager to use libim through qpa-starfish-input
@@ -14,9 +14,8 @@
 //
 // SPDX-License-Identifier: Apache-2.0
 
-#include <QFile>
-#include <QJsonDocument>
-#include <QJsonArray>
+#include <errno.h>
+
 #include <QScreen>
 #include <QWindow>
 #include <QtCore/QLoggingCategory>
@@ -26,11 +25,14 @@
 #include <QtDeviceDiscoverySupport/private/qdevicediscovery_p.h>
 #include <QtEglFSDeviceIntegration/private/qeglfshooks_p.h>
 #include <qpa/qplatformwindow.h>
+#include <qpa/qwindowsysteminterface.h>
 
 #include <private/qguiapplication_p.h>
 
 #include "eglfsstarfishintegration.h"
 #include "eglfsstarfishwindow.h"
+#include "weboseglfsconfig.h"
+#include "weboskmscallstats.h"
 
 #ifdef MULTIINPUT_SUPPORT
 #include "qstarfishinputmanager.h"
@@ -46,8 +48,6 @@
 
 #define ARRAY_LENGTH(a) (sizeof (a) / sizeof (a)[0])
 
-static QMutex s_frameBufferMutex;
-
 Q_LOGGING_CATEGORY(qLcStarfishDebug, "qt.qpa.eglfs.starfish")
 
 enum OutputConfiguration {
@@ -111,6 +111,72 @@ static void setScreenRegionDirectly(QScreen *screen, QRect region)
 #endif
 }
 
+static bool setVariableRefreshMode(const QScreen *screen, int mode)
+{
+    if (!screen || !screen->handle())
+        return false;
+
+    if (mode < WebOSKmsVariableRefresh::Off || mode > WebOSKmsVariableRefresh::On)
+        return false;
+
+    EglFSStarfishScreen *platformScreen = static_cast<EglFSStarfishScreen *>(screen->handle());
+    return platformScreen->setVariableRefreshMode(WebOSKmsVariableRefresh::Mode(mode));
+}
+
+static bool setCursorPlaneImage(const QScreen *screen, const QImage &image, const QPoint &hotspot)
+{
+    if (!screen || !screen->handle())
+        return false;
+
+    EglFSStarfishScreen *platformScreen = static_cast<EglFSStarfishScreen *>(screen->handle());
+    WebOSKmsCursorPlane *cursorPlane = platformScreen->cursorPlane();
+    return cursorPlane && cursorPlane->setImage(image, hotspot);
+}
+
+static bool setCursorPlanePosition(const QScreen *screen, const QPoint &position)
+{
+    if (!screen || !screen->handle())
+        return false;
+
+    EglFSStarfishScreen *platformScreen = static_cast<EglFSStarfishScreen *>(screen->handle());
+    WebOSKmsCursorPlane *cursorPlane = platformScreen->cursorPlane();
+    if (!cursorPlane)
+        return false;
+
+    cursorPlane->setPosition(position);
+    return true;
+}
+
+static bool setCursorPlaneVisible(const QScreen *screen, bool visible)
+{
+    if (!screen || !screen->handle())
+        return false;
+
+    EglFSStarfishScreen *platformScreen = static_cast<EglFSStarfishScreen *>(screen->handle());
+    WebOSKmsCursorPlane *cursorPlane = platformScreen->cursorPlane();
+    if (!cursorPlane)
+        return false;
+
+    cursorPlane->setVisible(visible);
+    return true;
+}
+
+static bool setScreenRefreshRateDirectly(QScreen *screen, qreal rate)
+{
+    if (!screen) {
+        qWarning() << "[QPA:EGL:INTERFACE] null screen";
+        return false;
+    }
+
+    EglFSStarfishScreen* platformScreen = static_cast<EglFSStarfishScreen*>(screen->handle());
+    if (!platformScreen) {
+        qWarning() << "[QPA:EGL:INTERFACE] null egl_screen";
+        return false;
+    }
+
+    return platformScreen->requestRefreshRate(rate);
+}
+
 struct OrderedScreen
 {
     OrderedScreen() : screen(nullptr) { }
@@ -210,34 +276,19 @@ static QByteArray nameForConnector(const drmModeConnectorPtr connector)
     return connectorName;
 }
 
-EglFSStarfishScreenConfig::EglFSStarfishScreenConfig(QJsonObject config)
-    : QKmsScreenConfig()
-    , m_configJson(config)
-{
-}
-
 void EglFSStarfishScreenConfig::loadConfig()
 {
-    if (m_configJson.isEmpty()) {
+    const WebOSEglFSDeviceConfig *config = WebOSEglFSConfig::instance().device();
+    if (!config) {
         qWarning() << "No config set";
         return;
     }
 
-    m_hwCursor = m_configJson.value(QLatin1String("hwcursor")).toBool(m_hwCursor);
-    m_devicePath = m_configJson.value(QLatin1String("device")).toString();
-    m_connector = m_configJson.value(QLatin1String("connector")).toObject().toVariantMap();
-
-    const QJsonArray outputs = m_configJson.value(QLatin1String("outputs")).toArray();
-    m_outputSettings.clear();
-    for (int i = 0; i < outputs.size(); i++) {
-        const QVariantMap outputSettings = outputs.at(i).toObject().toVariantMap();
-        if (outputSettings.contains(QStringLiteral("name"))) {
-            const QString name = outputSettings.value(QStringLiteral("name")).toString();
-            if (m_outputSettings.contains(name))
-                qWarning() << "Output" << name << "is duplicated";
-            m_outputSettings.insert(name, outputSettings);
-        }
-    }
+    if (config->hasHwCursor)
+        m_hwCursor = config->hwCursor;
+    m_devicePath = config->device;
+    m_connector = config->connector;
+    m_outputSettings = config->outputSettings();
     qCDebug(qLcStarfishDebug) << "loadConfig: m_outputSettings:"
                               << m_outputSettings;
 }
@@ -267,30 +318,11 @@ EglFSStarfishIntegration::EglFSStarfishIntegration()
     : QEglFSKmsGbmIntegration()
     , d_ptr(new EglFSStarfishIntegrationPrivate(this))
 {
-    static QByteArray json = qgetenv("QT_QPA_EGLFS_CONFIG");
-
-    if (!json.isEmpty()) {
-        QFile file(QString::fromUtf8(json));
-        if (file.open(QFile::ReadOnly)) {
-            QJsonDocument doc = QJsonDocument::fromJson(file.readAll());
-            if (doc.isArray()) {
-                m_configJson = doc.array().at(0).toObject();
-                qInfo() << "Using config file" << json;
-            } else {
-                qWarning() << "Invalid config file" << json << "- no top-level JSON object";
-            }
-            file.close();
-        } else {
-            qWarning() << "Could not open config file" << json << "for reading";
-        }
-    } else {
-        qWarning("No config file given");
-    }
 }
 
 QKmsScreenConfig *EglFSStarfishIntegration::createScreenConfig()
 {
-    QKmsScreenConfig *screenConfig = new EglFSStarfishScreenConfig(m_configJson);
+    QKmsScreenConfig *screenConfig = new EglFSStarfishScreenConfig;
     screenConfig->loadConfig();
 
     return screenConfig;
@@ -303,6 +335,7 @@ void EglFSStarfishIntegration::screenInit()
         qFatal("Expect EglFSStarfishDevice");
 
     device->createStarfishScreens();
+    device->startHotplug();
 
     QList<QScreen*> screens = QGuiApplication::screens();
     for (QList<QScreen*>::iterator i = screens.begin(); i != screens.end(); ++i) {
@@ -334,6 +367,14 @@ QFunctionPointer EglFSStarfishIntegration::platformFunction(const QByteArray &fu
 {
     if (function == "snapshot-boot-done")
         return QFunctionPointer(onSnapshotBootDone);
+    if (function == "setVariableRefreshMode")
+        return QFunctionPointer(setVariableRefreshMode);
+    if (function == "setCursorPlaneImage")
+        return QFunctionPointer(setCursorPlaneImage);
+    if (function == "setCursorPlanePosition")
+        return QFunctionPointer(setCursorPlanePosition);
+    if (function == "setCursorPlaneVisible")
+        return QFunctionPointer(setCursorPlaneVisible);
 
     return nullptr;
 }
@@ -349,6 +390,23 @@ void *EglFSStarfishIntegration::nativeResourceForIntegration(const QByteArray &n
         return (void*)&page_flip_notifier;
 #endif
 
+    if (name == QByteArrayLiteral("kms_call_stats")) {
+        // Cumulative since start up, valid until the next request
+        m_callStatsDump.clear();
+        WebOSKmsCallStats::dump(&m_callStatsDump);
+        return &m_callStatsDump;
+    }
+
+    if (name == QByteArrayLiteral("flip_cost")) {
+        // Cumulative per screen, valid until the next request
+        m_flipCostDump.clear();
+        for (QScreen *screen : QGuiApplication::screens()) {
+            if (auto *starfishScreen = static_cast<EglFSStarfishScreen *>(screen->handle()))
+                starfishScreen->flipCost()->dump(&m_flipCostDump, starfishScreen->name().toUtf8());
+        }
+        return &m_flipCostDump;
+    }
+
     QByteArray lowerCaseResource = name.toLower();
 
     void *input_interface = QStarfishInputManager::instance()->nativeResourceForIntegration(lowerCaseResource);
@@ -401,6 +459,18 @@ void *EglFSStarfishIntegration::nativeResourceForScreen(const QByteArray &resour
 {
     QByteArray lowerCaseResource = resource.toLower();
 
+    if (lowerCaseResource == "atomic_property_stats" && screen && screen->handle()) {
+        auto *starfishScreen = static_cast<EglFSStarfishScreen *>(screen->handle());
+        return (void *)starfishScreen->atomicStateStatistics();
+    }
+    if (lowerCaseResource == "layer_formats" && screen && screen->handle()) {
+        auto *starfishScreen = static_cast<EglFSStarfishScreen *>(screen->handle());
+        return (void *)starfishScreen->layerFormats();
+    }
+
+    if (lowerCaseResource == "setscreenrefreshratedirectly")
+        return (void*)setScreenRefreshRateDirectly;
+
     void *input_interface = QStarfishInputManager::instance()->nativeResourceForScreen(lowerCaseResource, screen);
     if (input_interface)
         return input_interface;
@@ -417,16 +487,28 @@ void *EglFSStarfishIntegration::nativeResourceForScreen(const QByteArray &resour
 
 void EglFSStarfishIntegration::waitForVSync(QPlatformSurface *surface) const
 {
+    auto *window = static_cast<QPlatformWindow *>(surface);
+    auto *screen = window ? static_cast<EglFSStarfishScreen *>(window->screen()) : nullptr;
+
 #ifdef CURSOR_OPENGL
     //starfish_im_cursor_cursorNeedUpdate = false;
-    if (auto *window = static_cast<QPlatformWindow *>(surface)) {
-        if (auto screen = window->screen()) {
-            if (auto cursor = static_cast<QStarfishIMCursor *>(screen->cursor())) {
+    if (screen) {
+        // The cursor plane moves the pointer without rendering
+        WebOSKmsCursorPlane *cursorPlane = screen->cursorPlane();
+        if (!cursorPlane || !cursorPlane->isActive()) {
+            if (auto cursor = static_cast<QStarfishIMCursor *>(screen->cursor()))
                 cursor->paint();
-            }
         }
     }
 #endif
+
+    if (screen)
+        screen->createRenderFence();
+
+    // Waited for in flip(), after eglSwapBuffers()
+    if (screen && screen->pipelinedFlip())
+        return;
+
     QElapsedTimer timer;
     timer.start();
 
@@ -440,103 +522,143 @@ void EglFSStarfishIntegration::waitForVSync(QPlatformSurface *surface) const
     //system("echo \'[surface-manager] eglSwapBuffers\' >> /dev/lg/logm0");
 }
 
-static inline uint32_t *
-formats_ptr(struct drm_format_modifier_blob *blob)
+const WebOSKmsFormatList &EglFSStarfishDevice::planeFormats(uint32_t planeId)
 {
-    return (uint32_t *)(((char *)blob) + blob->formats_offset);
-}
+    // Every plane at once, they do not change at runtime
+    if (m_planeFormats.isEmpty()) {
+        for (const QKmsPlane &plane : m_planes)
+            m_planeFormats.insert(plane.id, WebOSKmsFormats::queryPlane(m_dri_fd, plane.id));
+    }
 
-static inline struct drm_format_modifier *
-modifiers_ptr(struct drm_format_modifier_blob *blob)
-{
-    return (struct drm_format_modifier *)
-        (((char *)blob) + blob->modifiers_offset);
+    return m_planeFormats[planeId];
 }
 
 QVector<uint64_t> EglFSStarfishDevice::getGbmModifiersFromPlane(const QKmsOutput &output)
 {
-    QVector<uint64_t> modifiers;
+    const QVector<uint64_t> modifiers = WebOSKmsFormats::modifiers(planeFormats(output.eglfs_plane->id), output.drm_format);
 
-    drmModePlaneResPtr planeResources = drmModeGetPlaneResources(m_dri_fd);
-    if (!planeResources)
-        return modifiers;
+    const uint32_t f = output.drm_format;
+    for (uint64_t modifier : modifiers) {
+        qInfo("Found modifier(0x%llx) for format(%c%c%c%c)\n",
+                (unsigned long long)modifier,
+                (f>>0)&0xff, (f>>8)&0xff, (f>>16)&0xff, (f>>24)&0xff);
+    }
 
-    const unsigned int countPlanes = planeResources->count_planes;
-    qCDebug(qLcStarfishDebug, "Found %u planes", countPlanes);
+    return modifiers;
+}
 
-    drmModePlanePtr plane = nullptr;
-    bool found = false;
+EglFSStarfishDevice::CrtcCommit *EglFSStarfishDevice::crtcCommit(uint32_t crtcId)
+{
+    QSharedPointer<CrtcCommit> &commit = m_crtcCommits[crtcId];
+    if (!commit)
+        commit.reset(new CrtcCommit);
+    return commit.data();
+}
 
-    for (unsigned int planeIdx = 0; planeIdx < countPlanes; ++planeIdx) {
-        plane = drmModeGetPlane(m_dri_fd, planeResources->planes[planeIdx]);
-        if (!plane) {
-            qCDebug(qLcStarfishDebug, "Failed to query plane %u, ignoring", planeIdx);
-            continue;
-        }
-        if (plane->plane_id != output.eglfs_plane->id) {
-            drmModeFreePlane(plane);
-            continue;
-        } else {
-            found = true;
-            break;
-        }
-    }
+QPlatformScreen * EglFSStarfishDevice::createScreen(const QKmsOutput &output)
+{
+    QVector<uint64_t> modifiers = getGbmModifiersFromPlane(output);
+    EglFSStarfishScreen *screen = new EglFSStarfishScreen(this, output, false, modifiers);
+    screen->setPlaneFormats(planeFormats(output.eglfs_plane->id));
 
-    if (!found) {
-        qCDebug(qLcStarfishDebug, "No matching plane found having id %d", output.eglfs_plane->id);
-        drmModeFreePlaneResources(planeResources);
-        return modifiers;
-    }
+#ifndef IM_ENABLE
+    createGlobalCursor(screen);
+#endif
 
-    drmModePropertyBlobRes *blob = planePropertyBlob(plane, QByteArrayLiteral("IN_FORMATS"));
-    if (!blob) {
-        drmModeFreePlane(plane);
-        return modifiers;
-    }
+    return screen;
+}
 
-    struct drm_format_modifier_blob *fmt_mod_blob = static_cast<struct drm_format_modifier_blob *>(blob->data);
-    uint32_t *blob_formats = formats_ptr(fmt_mod_blob);
-    struct drm_format_modifier *blob_modifiers = modifiers_ptr(fmt_mod_blob);
+void EglFSStarfishDevice::startHotplug()
+{
+    m_hotplug.reset(WebOSKmsHotplug::create(devicePath()));
+    if (!m_hotplug)
+        return;
 
-    for (int i = 0; i < fmt_mod_blob->count_formats; i++) {
-        uint32_t _f = blob_formats[i];
+    QObject::connect(m_hotplug.data(), &WebOSKmsHotplug::connectorChanged, m_hotplug.data(),
+                     [this](uint32_t connectorId) { updateConnectors(connectorId); });
+}
 
-        if (output.drm_format != _f)
-            continue;
+void EglFSStarfishDevice::updateConnectors(uint32_t connectorId)
+{
+    drmModeResPtr resources = drmModeGetResources(m_dri_fd);
+    if (!resources) {
+        qErrnoWarning(errno, "drmModeGetResources failed");
+        return;
+    }
 
-        for (int j = 0; j < fmt_mod_blob->count_modifiers; j++) {
-            struct drm_format_modifier *mod = &blob_modifiers[j];
+    for (int i = 0; i < resources->count_connectors; i++) {
+        const uint32_t id = resources->connectors[i];
+        // The panel keeps its screens for the lifetime of the process
+        if (id == m_panelConnectorId || (connectorId && id != connectorId))
+            continue;
 
-            if ((i < mod->offset) || (i > mod->offset + 63))
-                continue;
-            if (!(mod->formats & (1UL << (i - mod->offset))))
-                continue;
+        // The kernel has updated the state before it sent the event
+        drmModeConnectorPtr connector = drmModeGetConnectorCurrent(m_dri_fd, id);
+        if (!connector)
+            continue;
 
-            modifiers.append(mod->modifier);
+        const bool connected = connector->connection == DRM_MODE_CONNECTED;
+        const bool known = m_connectorScreens.contains(id);
+        drmModeFreeConnector(connector);
 
-            qInfo("Found modifier(0x%llx) for format(%c%c%c%c)\n",
-                    mod->modifier,
-                    (_f>>0)&0xff, (_f>>8)&0xff, (_f>>16)&0xff, (_f>>24)&0xff);
+        if (connected && !known) {
+            // Only the new connector is probed, for its modes
+            connector = drmModeGetConnector(m_dri_fd, id);
+            if (connector) {
+                addConnector(resources, connector);
+                drmModeFreeConnector(connector);
+            }
+        } else if (!connected && known) {
+            removeConnector(id);
         }
     }
 
-    drmModeFreePropertyBlob(blob);
-    drmModeFreePlane(plane);
-    drmModeFreePlaneResources(planeResources);
+    drmModeFreeResources(resources);
+}
 
-    return modifiers;
+void EglFSStarfishDevice::addConnector(drmModeResPtr resources, drmModeConnectorPtr connector)
+{
+    ScreenInfo vinfo;
+    QPlatformScreen *screen = createScreenForConnector(resources, connector, &vinfo);
+    if (!screen)
+        return;
+
+    m_connectorScreens.insert(connector->connector_id, screen);
+
+    // Not one of the panel screens, which are shown one at a time
+    qInfo() << "Hotplug: Adding screen" << screen->name() << "for connector" << connector->connector_id;
+    registerScreen(screen, vinfo.isPrimary, vinfo.virtualPos, QList<QPlatformScreen *>() << screen);
+    static_cast<EglFSStarfishScreen *>(screen)->setVisible(true);
 }
 
-QPlatformScreen * EglFSStarfishDevice::createScreen(const QKmsOutput &output)
+void EglFSStarfishDevice::removeConnector(uint32_t connectorId)
 {
-    QVector<uint64_t> modifiers = getGbmModifiersFromPlane(output);
-    EglFSStarfishScreen *screen = new EglFSStarfishScreen(this, output, false, modifiers);
+    auto *screen = static_cast<EglFSStarfishScreen *>(m_connectorScreens.take(connectorId));
 
-#ifndef IM_ENABLE
-    createGlobalCursor(screen);
-#endif
+    // The render thread may still be in flip() for a window of the screen
+    const QVector<QPointer<QWindow>> windows = WebOSKmsHotplug::releaseWindows(screen);
 
-    return screen;
+    // No page flip event may arrive for the screen once it is gone
+    screen->waitForFlip();
+
+    // The output goes with the screen
+    const QKmsOutput output = screen->output();
+    QVector<QKmsPlane> planes;
+    for (QKmsPlane &plane : m_planes) {
+        if (plane.activeCrtcId == output.crtc_id) {
+            planes.append(plane);
+            plane.activeCrtcId = 0;
+        }
+    }
+
+    qInfo() << "Hotplug: Removing screen" << output.name << "of connector" << connectorId;
+    QWindowSystemInterface::handleScreenRemoved(screen);
+
+    WebOSKmsHotplug::disableOutput(m_dri_fd, m_has_atomic_support, output, planes);
+    m_crtc_allocator &= ~(1U << output.crtc_index);
+
+    // Moved to another screen by Qt
+    WebOSKmsHotplug::restoreWindows(windows);
 }
 
 // from luna-surfacemanager
@@ -567,11 +689,8 @@ static bool parseGeometryString(const QString& string, QRect &geometry, int &rot
 
 bool EglFSStarfishDevice::getSizeForPlane(const QString& connectorNameForPlane, QSize &size)
 {
-    auto userConfig = m_screenConfig->outputSettings();
-    QVariantMap userConnectorConfig = userConfig.value(connectorNameForPlane);
-
-    const QByteArray geometryString = userConnectorConfig.value(QStringLiteral("geometry"), QStringLiteral(""))
-        .toByteArray();
+    const WebOSEglFSOutputConfig *config = WebOSEglFSConfig::instance().output(connectorNameForPlane);
+    const QByteArray geometryString = config ? config->geometry.toUtf8() : QByteArray();
     if (geometryString.isEmpty()) {
         qCDebug(qLcStarfishDebug) << "No \"geometry\" is available for" << connectorNameForPlane;
         return false;
@@ -671,6 +790,7 @@ void EglFSStarfishDevice::createStarfishScreens()
     //  }
     // ]
     const QByteArray connectorName = nameForConnector(connector);
+    m_panelConnectorId = connector->connector_id;
 
     const int crtcIdx = crtcForConnector(resources, connector);
     if (crtcIdx < 0) {
@@ -811,8 +931,7 @@ void EglFSStarfishDevice::createStarfishScreens()
 
     QString connectorNameForSecondary(screenNames.at(1).split('/').last()); // fb1
     ScreenInfo secondaryInfo;
-    auto userConfig = m_screenConfig->outputSettings();
-    if (userConfig.contains(connectorNameForSecondary)) {
+    if (WebOSEglFSConfig::instance().output(connectorNameForSecondary)) {
         QPlatformScreen *secondaryScreen = createStarfishScreenForConnector(resources, connector, &secondaryInfo,
                                                                             connectorNameForSecondary,
                                                                             crtc, selected_mode,
@@ -844,16 +963,14 @@ QPlatformScreen *EglFSStarfishDevice::createStarfishScreenForConnector(drmModeRe
 {
     Q_ASSERT(vinfo);
 
-    auto userConfig = m_screenConfig->outputSettings();
-    QVariantMap userConnectorConfig = userConfig.value(connectorName);
+    const WebOSEglFSOutputConfig *config = WebOSEglFSConfig::instance().output(connectorName);
 
     *vinfo = ScreenInfo();
     vinfo->virtualIndex = INT_MAX;
-    if (userConnectorConfig.value(QStringLiteral("primary")).toBool())
+    if (config && config->primary)
         vinfo->isPrimary = true;
 
-    const QByteArray formatStr = userConnectorConfig.value(QStringLiteral("format"), QString())
-        .toByteArray().toLower();
+    const QByteArray formatStr = config ? config->format.toUtf8().toLower() : QByteArray();
     uint32_t drmFormat;
     bool drmFormatExplicit = true;
     if (formatStr.isEmpty()) {
@@ -993,21 +1110,179 @@ QPlatformScreen *EglFSStarfishDevice::createStarfishScreenForConnector(drmModeRe
     return createScreen(output);
 }
 
+// On unless WEBOS_KMS_PIPELINED_FLIP=0
+static bool pipelinedFlipEnabled()
+{
+    bool ok = false;
+    const int value = qEnvironmentVariableIntValue("WEBOS_KMS_PIPELINED_FLIP", &ok);
+    return !ok || value != 0;
+}
+
 EglFSStarfishScreen::EglFSStarfishScreen(QEglFSKmsDevice *device, const QKmsOutput &output, bool headless, QVector<uint64_t> modifiers)
     : QEglFSKmsGbmScreen(device, output, headless)
 #ifdef IM_ENABLE
     , m_cursor(new QStarfishIMCursor(device->fd(), output.crtc_id, this))
 #endif
     , m_dpr(-1.0)
+    , m_pipelinedFlip(pipelinedFlipEnabled())
     , m_modifiers(modifiers)
+    , m_crtcCommit(static_cast<EglFSStarfishDevice *>(device)->crtcCommit(output.crtc_id))
+    , m_commitMutex(&m_crtcCommit->mutex)
 {
 #ifdef SNAPSHOT_BOOT
     m_snapshotOperator = new QStarfishSnapshotOperator(this);
 #endif
+
+    // VRR_ENABLED is per CRTC, so the screen of the primary plane owns it
+    if (!headless && device->hasAtomicSupport()
+        && output.eglfs_plane && output.eglfs_plane->type == QKmsPlane::PrimaryPlane) {
+        if (const WebOSEglFSOutputConfig *config = WebOSEglFSConfig::instance().output(output.name))
+            m_variableRefresh.setMode(WebOSKmsVariableRefresh::modeFromString(config->vrr));
+        m_variableRefresh.initialize(device->fd(), output.connector_id, output.crtc_id);
+
+        if (const QKmsPlane *plane = WebOSKmsCursorPlane::findPlane(output)) {
+            m_cursorPlane.initialize(device->fd(), static_cast<QEglFSKmsGbmDevice *>(device)->gbmDevice(),
+                                     output.crtc_id, *plane, m_commitMutex, &m_atomicState, refreshRate());
+            if (m_cursorPlane.isInitialized()) {
+                QMutexLocker lock(m_commitMutex);
+                m_crtcCommit->cursorPlane = &m_cursorPlane;
+            }
+        }
+    }
+
+    if (!headless && device->hasAtomicSupport() && output.eglfs_plane)
+        m_fence.initialize(device->fd(), output.crtc_id, output.eglfs_plane->id);
+}
+
+bool EglFSStarfishScreen::setVariableRefreshMode(WebOSKmsVariableRefresh::Mode mode)
+{
+    if (mode != WebOSKmsVariableRefresh::Off && !m_variableRefresh.isCapable()) {
+        qWarning() << "Variable refresh rate is not supported by" << name();
+        return false;
+    }
+
+    qInfo() << "Variable refresh rate mode" << WebOSKmsVariableRefresh::modeName(mode) << name() << this;
+    m_variableRefresh.setMode(mode);
+    return true;
+}
+
+static qreal modeRefreshRate(const drmModeModeInfo &mode)
+{
+    if (!mode.htotal || !mode.vtotal)
+        return mode.vrefresh;
+
+    qreal rate = mode.clock * 1000.0 / (mode.htotal * mode.vtotal);
+    if (mode.flags & DRM_MODE_FLAG_INTERLACE)
+        rate *= 2;
+    if (mode.flags & DRM_MODE_FLAG_DBLSCAN)
+        rate /= 2;
+    if (mode.vscan > 1)
+        rate /= mode.vscan;
+    return rate;
+}
+
+bool EglFSStarfishScreen::requestRefreshRate(qreal rate)
+{
+    QKmsOutput &op(output());
+
+    // The CRTC mode is shared, the screen of the primary plane owns it
+    if (m_headless || !device()->hasAtomicSupport() || !op.modeIdPropertyId
+        || !op.eglfs_plane || op.eglfs_plane->type != QKmsPlane::PrimaryPlane) {
+        qWarning() << "Refresh rate cannot be switched on" << name();
+        return false;
+    }
+
+    // op.mode is written by flip() on the render thread
+    QMutexLocker lock(&m_modeMutex);
+
+    if (rate <= 0 || op.mode < 0 || op.mode >= op.modes.size())
+        return false;
+
+    // Only the resolution in use, which the driver can switch to without a
+    // full modeset and which keeps the geometry of every screen on the CRTC.
+    // Then the closest multiple of the content rate, then the lowest
+    // multiple so that no refresh is wasted.
+    const drmModeModeInfo &current = op.modes.at(op.mode);
+    int selected = -1;
+    qreal selectedError = 0;
+    int selectedMultiple = 0;
+
+    for (int i = 0; i < op.modes.size(); i++) {
+        const drmModeModeInfo &m = op.modes.at(i);
+        const qreal refresh = modeRefreshRate(m);
+        const int multiple = qRound(refresh / rate);
+        if (multiple < 1)
+            continue;
+
+        // 0.5% tolerates 24 Hz modes for 23.976 Hz content
+        const qreal error = qAbs(refresh / (rate * multiple) - 1);
+        if (error > 0.005)
+            continue;
+
+        const bool sameSize = m.hdisplay == current.hdisplay && m.vdisplay == current.vdisplay
+            && (m.flags & DRM_MODE_FLAG_INTERLACE) == (current.flags & DRM_MODE_FLAG_INTERLACE);
+        if (!sameSize)
+            continue;
+
+        bool better = selected < 0;
+        if (!better && qAbs(error - selectedError) > 0.0001)
+            better = error < selectedError;
+        else if (!better)
+            better = multiple < selectedMultiple;
+
+        if (better) {
+            selected = i;
+            selectedError = error;
+            selectedMultiple = multiple;
+        }
+    }
+
+    if (selected < 0) {
+        qWarning() << "No mode of the current resolution fits refresh rate" << rate << "on" << name();
+        return false;
+    }
+
+    if (selected == m_pendingMode)
+        return true;
+
+    if (m_pendingModeBlob) {
+        drmModeDestroyPropertyBlob(device()->fd(), m_pendingModeBlob);
+        m_pendingModeBlob = 0;
+    }
+    m_pendingMode = -1;
+
+    // Cancels a switch that has not been applied yet
+    if (selected == op.mode)
+        return true;
+
+    // Built here so that flip() only has to reference it
+    uint32_t blob = 0;
+    if (drmModeCreatePropertyBlob(device()->fd(), &op.modes[selected], sizeof(drmModeModeInfo), &blob) != 0) {
+        qWarning() << "Failed to create mode blob for mode" << selected << "on" << name();
+        return false;
+    }
+
+    const drmModeModeInfo &m = op.modes.at(selected);
+    qInfo() << "Switching" << name() << "to mode" << selected << ":" << m.hdisplay << "x" << m.vdisplay
+            << '@' << modeRefreshRate(m) << "hz for content at" << rate << "hz";
+
+    m_pendingMode = selected;
+    m_pendingModeBlob = blob;
+    return true;
 }
 
 EglFSStarfishScreen::~EglFSStarfishScreen()
 {
+    {
+        QMutexLocker lock(m_commitMutex);
+        if (m_crtcCommit->cursorPlane == &m_cursorPlane)
+            m_crtcCommit->cursorPlane = nullptr;
+        m_crtcCommit->planeDisables.removeAll(this);
+    }
+
+    if (m_pendingModeBlob)
+        drmModeDestroyPropertyBlob(device()->fd(), m_pendingModeBlob);
+
 #ifdef SNAPSHOT_BOOT
     delete m_snapshotOperator;
 #endif
@@ -1152,13 +1427,30 @@ void EglFSStarfishScreen::pageFlipped(unsigned int sequence, unsigned int tv_sec
     // system("echo \'[surface-manager] got pageFlipped(vsync)\' >> /dev/kmsg");
     // system("echo \'[surface-manager] got pageFlipped(vsync)\' >> /dev/lg/logm0");
 
+    {
+        // The CRTC may be free for the plane of a hidden screen now
+        QMutexLocker commitLock(m_commitMutex);
+        const QVector<EglFSStarfishScreen *> screens = m_crtcCommit->planeDisables;
+        for (EglFSStarfishScreen *screen : screens)
+            screen->commitPlaneDisable(false);
+    }
+
     if (page_flip_notifier)
         (*page_flip_notifier)(this, sequence, tv_sec, tv_usec);
 }
 
 void EglFSStarfishScreen::flip()
 {
+    WebOSKmsFlipCost::Scope cost(&m_flipCost);
+
     if (!m_visible) {
+        // The plane is still on while another commit was queued, now the
+        // render thread may wait for the CRTC
+        QMutexLocker commitLock(m_commitMutex);
+        if (m_planeDisablePending)
+            commitPlaneDisable(true);
+        commitLock.unlock();
+
         updateFlipStatus();
         return;
     }
@@ -1178,6 +1470,11 @@ void EglFSStarfishScreen::flip()
         return;
     }
 
+    // Only one flip can be queued on the CRTC, the nonblocking commit
+    // of the next one would fail with EBUSY
+    if (m_pipelinedFlip)
+        waitForFlip();
+
     m_gbm_bo_next = gbm_surface_lock_front_buffer(m_gbm_surface);
     if (!m_gbm_bo_next) {
         qWarning("Could not lock GBM surface front buffer!");
@@ -1188,6 +1485,12 @@ void EglFSStarfishScreen::flip()
 
     FrameBuffer *fb = framebufferForBufferObject(m_gbm_bo_next);
     QKmsOutput &op(output());
+    // Held until the flip is committed
+    QMutexLocker commitLock(m_commitMutex);
+#if QT_CONFIG(drm_atomic)
+    int switchMode = -1;
+    uint32_t switchModeBlob = 0;
+#endif
 
     if (!fb) {
         qWarning("FrameBuffer not available. Cannot flip");
@@ -1202,6 +1505,27 @@ void EglFSStarfishScreen::flip()
 #if QT_CONFIG(drm_atomic)
         drmModeAtomicReq *request = device()->threadLocalAtomicRequest();
         if (request) {
+            m_atomicState.begin();
+
+            // A requested mode switch goes out together with this frame
+            {
+                QMutexLocker lock(&m_modeMutex);
+                switchMode = m_pendingMode;
+                switchModeBlob = m_pendingModeBlob;
+                m_pendingMode = -1;
+                m_pendingModeBlob = 0;
+            }
+            if (switchMode >= 0)
+                drmModeAtomicAddProperty(request, op.crtc_id, op.modeIdPropertyId, switchModeBlob);
+
+            m_variableRefresh.frameSubmitted();
+            m_variableRefresh.addProperties(&m_atomicState, request, qint64(1000000000 / qMax(refreshRate(), qreal(1))));
+            m_cursorPlane.addProperties(request, true);
+            // The pointer of another screen of the CRTC may still be queued
+            if (m_crtcCommit->cursorPlane && m_crtcCommit->cursorPlane != &m_cursorPlane)
+                m_crtcCommit->cursorPlane->waitForCommit();
+            m_fence.addProperties(request, true);
+
             int int_geometryX = geometry().x();
             int int_geometryY = geometry().y();
             int int_geometryWidth = geometry().width();
@@ -1225,8 +1549,9 @@ void EglFSStarfishScreen::flip()
             if (isPrimaryPlane) {
                 // gbm surface for primary plane always has 1920x1080 and it should be mapped to
                 // CRTC 3840x2160 for 4K
-                crtc_w = op.modes[op.mode].hdisplay;
-                crtc_h = op.modes[op.mode].vdisplay;
+                const drmModeModeInfo &mode = op.modes[switchMode >= 0 ? switchMode : op.mode];
+                crtc_w = mode.hdisplay;
+                crtc_h = mode.vdisplay;
             }
 
             qCDebug(qLcStarfishDebug, "[flip] %s (plane %u): %ux%u -> %ux%u+%u+%u",
@@ -1234,16 +1559,16 @@ void EglFSStarfishScreen::flip()
                     w, h, crtc_w, crtc_h, crtc_x, crtc_y);
             if(op.eglfs_plane)
             {
-                drmModeAtomicAddProperty(request, op.eglfs_plane->id, op.eglfs_plane->framebufferPropertyId, fb->fb);
-                drmModeAtomicAddProperty(request, op.eglfs_plane->id, op.eglfs_plane->crtcPropertyId, op.crtc_id);
-                drmModeAtomicAddProperty(request, op.eglfs_plane->id, op.eglfs_plane->srcwidthPropertyId, w << 16);
-                drmModeAtomicAddProperty(request, op.eglfs_plane->id, op.eglfs_plane->srcXPropertyId, 0);
-                drmModeAtomicAddProperty(request, op.eglfs_plane->id, op.eglfs_plane->srcYPropertyId, 0);
-                drmModeAtomicAddProperty(request, op.eglfs_plane->id, op.eglfs_plane->srcheightPropertyId, h << 16);
-                drmModeAtomicAddProperty(request, op.eglfs_plane->id, op.eglfs_plane->crtcXPropertyId, crtc_x);
-                drmModeAtomicAddProperty(request, op.eglfs_plane->id, op.eglfs_plane->crtcYPropertyId, crtc_y);
-                drmModeAtomicAddProperty(request, op.eglfs_plane->id, op.eglfs_plane->crtcwidthPropertyId, crtc_w);
-                drmModeAtomicAddProperty(request, op.eglfs_plane->id, op.eglfs_plane->crtcheightPropertyId, crtc_h);
+                m_atomicState.add(request, op.eglfs_plane->id, op.eglfs_plane->framebufferPropertyId, fb->fb);
+                m_atomicState.add(request, op.eglfs_plane->id, op.eglfs_plane->crtcPropertyId, op.crtc_id);
+                m_atomicState.add(request, op.eglfs_plane->id, op.eglfs_plane->srcwidthPropertyId, w << 16);
+                m_atomicState.add(request, op.eglfs_plane->id, op.eglfs_plane->srcXPropertyId, 0);
+                m_atomicState.add(request, op.eglfs_plane->id, op.eglfs_plane->srcYPropertyId, 0);
+                m_atomicState.add(request, op.eglfs_plane->id, op.eglfs_plane->srcheightPropertyId, h << 16);
+                m_atomicState.add(request, op.eglfs_plane->id, op.eglfs_plane->crtcXPropertyId, crtc_x);
+                m_atomicState.add(request, op.eglfs_plane->id, op.eglfs_plane->crtcYPropertyId, crtc_y);
+                m_atomicState.add(request, op.eglfs_plane->id, op.eglfs_plane->crtcwidthPropertyId, crtc_w);
+                m_atomicState.add(request, op.eglfs_plane->id, op.eglfs_plane->crtcheightPropertyId, crtc_h);
             }
         }
 #endif // QT_CONFIG(drm_atomic)
@@ -1251,8 +1576,30 @@ void EglFSStarfishScreen::flip()
         qFatal("DRM atomic support is mandatory. Set QT_QPA_EGLFS_KMS_ATOMIC=1");
     }
 #if QT_CONFIG(drm_atomic)
-    if (!device()->threadLocalAtomicCommit(this))
-        goto Error;
+    {
+        bool committed = device()->threadLocalAtomicCommit(this);
+        WebOSKmsCallStats::count(WebOSKmsCallStats::AtomicCommit);
+        m_atomicState.end(committed);
+        m_fence.committed(device()->threadLocalAtomicRequest(), committed);
+
+        if (switchMode >= 0) {
+            if (committed) {
+                QMutexLocker lock(&m_modeMutex);
+                if (op.mode_blob_id)
+                    drmModeDestroyPropertyBlob(device()->fd(), op.mode_blob_id);
+                op.mode = switchMode;
+                op.mode_blob_id = switchModeBlob;
+                lock.unlock();
+                QWindowSystemInterface::handleScreenRefreshRateChange(screen(), refreshRate());
+            } else {
+                qWarning() << "Failed to switch" << name() << "to mode" << switchMode;
+                drmModeDestroyPropertyBlob(device()->fd(), switchModeBlob);
+            }
+        }
+
+        if (!committed)
+            goto Error;
+    }
 #endif
     // system("echo \'[surface-manager] flip: done(threadLocalAtomicCommit)\' >> /dev/kmsg");
     // system("echo \'[surface-manager] flip: done(threadLocalAtomicCommit)\' >> /dev/lg/logm0");
@@ -1298,6 +1645,7 @@ QEglFSKmsGbmScreen::FrameBuffer *EglFSStarfishScreen::framebufferForBufferObject
         ? drmModeAddFB2WithModifiers(device()->fd(), width, height, pixelFormat, handles, strides, offsets, modifiers, &fb->fb, DRM_MODE_FB_MODIFIERS)
         : drmModeAddFB2(device()->fd(), width, height, pixelFormat, handles, strides, offsets, &fb->fb, 0);
 
+    WebOSKmsCallStats::count(WebOSKmsCallStats::AddFramebuffer);
     if (ret) {
         qWarning("Failed to create KMS FB!");
         return nullptr;
@@ -1322,51 +1670,77 @@ void EglFSStarfishScreen::setVisible(bool visible)
     if (!device()->hasAtomicSupport())
         qFatal("DRM atomic support is mandatory. Set QT_QPA_EGLFS_KMS_ATOMIC=1");
 
-    if (!m_visible) {
-#if QT_CONFIG(drm_atomic)
-        qCDebug(qLcStarfishDebug, "setVisible: Turn off for invisible plane %u", output().forced_plane_id);
-
-        if (m_gbm_bo_next) {
-            qCDebug(qLcStarfishDebug, "setVisible: Release bo not to wait in waitForFlip()");
-            gbm_surface_release_buffer(m_gbm_surface, m_gbm_bo_next);
-            m_gbm_bo_next = nullptr;
+    {
+        QMutexLocker commitLock(m_commitMutex);
+        if (m_visible) {
+            // Shown again before the plane went off, flip() turns it on
+            m_planeDisablePending = false;
+            m_crtcCommit->planeDisables.removeAll(this);
+        } else {
+            qCDebug(qLcStarfishDebug, "setVisible: Turn off for invisible plane %u", output().forced_plane_id);
+            // Never blocks the GUI thread. With a flip still queued on the
+            // CRTC, its page flip event or the next flip() of this screen
+            // turns the plane off.
+            m_planeDisablePending = true;
+            commitPlaneDisable(false);
         }
+    }
 
-        // TODO: device()->threadLocalAtomicRequest() if possible
-        drmModeAtomicReq *request = drmModeAtomicAlloc();
-        if (!request) {
-            qWarning("setVisible: Fail to drmModeAtomicAlloc");
-            return;
-        }
+    foreach(EglFSStarfishWindow *w, m_windows) {
+        QEvent ev(QEvent::Type(QEvent::User + (visible ? 1 : 2)));
+        QGuiApplication::sendEvent(w->window(), &ev);
+    }
+}
+
+bool EglFSStarfishScreen::commitPlaneDisable(bool blocking)
+{
+    if (!m_planeDisablePending)
+        return true;
 
-        if (!op.eglfs_plane)
-            qFatal("op.eglfs_plane should not be nullptr");
+#if QT_CONFIG(drm_atomic)
+    QKmsOutput &op(output());
+    if (!op.eglfs_plane)
+        qFatal("op.eglfs_plane should not be nullptr");
 
-        drmModeAtomicAddProperty(request, op.eglfs_plane->id, op.eglfs_plane->framebufferPropertyId, 0);
-        drmModeAtomicAddProperty(request, op.eglfs_plane->id, op.eglfs_plane->crtcPropertyId, 0);
-        drmModeAtomicAddProperty(request, op.eglfs_plane->id, op.eglfs_plane->srcwidthPropertyId, 0);
-        drmModeAtomicAddProperty(request, op.eglfs_plane->id, op.eglfs_plane->srcXPropertyId, 0);
-        drmModeAtomicAddProperty(request, op.eglfs_plane->id, op.eglfs_plane->srcYPropertyId, 0);
-        drmModeAtomicAddProperty(request, op.eglfs_plane->id, op.eglfs_plane->srcheightPropertyId, 0);
-        drmModeAtomicAddProperty(request, op.eglfs_plane->id, op.eglfs_plane->crtcXPropertyId, 0);
-        drmModeAtomicAddProperty(request, op.eglfs_plane->id, op.eglfs_plane->crtcYPropertyId, 0);
-        drmModeAtomicAddProperty(request, op.eglfs_plane->id, op.eglfs_plane->crtcwidthPropertyId, 0);
-        drmModeAtomicAddProperty(request, op.eglfs_plane->id, op.eglfs_plane->crtcheightPropertyId, 0);
+    drmModeAtomicReq *request = drmModeAtomicAlloc();
+    if (!request) {
+        qWarning("setVisible: Fail to drmModeAtomicAlloc");
+        return false;
+    }
 
-        uint32_t flags = 0;
-        int ret = drmModeAtomicCommit(device()->fd(), request, flags, nullptr);
+    drmModeAtomicAddProperty(request, op.eglfs_plane->id, op.eglfs_plane->framebufferPropertyId, 0);
+    drmModeAtomicAddProperty(request, op.eglfs_plane->id, op.eglfs_plane->crtcPropertyId, 0);
+    drmModeAtomicAddProperty(request, op.eglfs_plane->id, op.eglfs_plane->srcwidthPropertyId, 0);
+    drmModeAtomicAddProperty(request, op.eglfs_plane->id, op.eglfs_plane->srcXPropertyId, 0);
+    drmModeAtomicAddProperty(request, op.eglfs_plane->id, op.eglfs_plane->srcYPropertyId, 0);
+    drmModeAtomicAddProperty(request, op.eglfs_plane->id, op.eglfs_plane->srcheightPropertyId, 0);
+    drmModeAtomicAddProperty(request, op.eglfs_plane->id, op.eglfs_plane->crtcXPropertyId, 0);
+    drmModeAtomicAddProperty(request, op.eglfs_plane->id, op.eglfs_plane->crtcYPropertyId, 0);
+    drmModeAtomicAddProperty(request, op.eglfs_plane->id, op.eglfs_plane->crtcwidthPropertyId, 0);
+    drmModeAtomicAddProperty(request, op.eglfs_plane->id, op.eglfs_plane->crtcheightPropertyId, 0);
+
+    int ret = drmModeAtomicCommit(device()->fd(), request, blocking ? 0 : DRM_MODE_ATOMIC_NONBLOCK, nullptr);
+    WebOSKmsCallStats::count(WebOSKmsCallStats::AtomicCommit);
+    drmModeAtomicFree(request);
+
+    if (ret == -EBUSY) {
+        if (!m_crtcCommit->planeDisables.contains(this))
+            m_crtcCommit->planeDisables.append(this);
+        return false;
+    }
 
-        if (ret)
-            qWarning("setVisible: Failed to commit atomic request (code=%d)", ret);
+    if (ret)
+        qWarning("setVisible: Failed to commit atomic request (code=%d)", ret);
 
-        drmModeAtomicFree(request);
+    // Written behind the back of flip()
+    m_atomicState.invalidate();
+#else
+    Q_UNUSED(blocking);
 #endif // QT_CONFIG(drm_atomic)
-    }
 
-    foreach(EglFSStarfishWindow *w, m_windows) {
-        QEvent ev(QEvent::Type(QEvent::User + (visible ? 1 : 2)));
-        QGuiApplication::sendEvent(w->window(), &ev);
-    }
+    m_planeDisablePending = false;
+    m_crtcCommit->planeDisables.removeAll(this);
+    return true;
 }
 
 void EglFSStarfishIntegration::updateScreenVisibleDirectly(EglFSStarfishScreen *screen, bool visible, const QString& policy)
@@ -18,8 +18,11 @@
 #define EGLFSSTARFISHINTEGRATION_H
 
 
-#include <QJsonObject>
+#include <QHash>
 #include <QMap>
+#include <QMutex>
+#include <QSharedPointer>
+#include <QVector>
 #include <QtEglSupport/private/qeglplatformcontext_p.h>
 #include <private/qeglfscontext_p.h>
 #include <private/qeglfskmsdevice_p.h>
@@ -30,6 +33,14 @@
 
 #include <StarfishServiceIntegration/qstarfishpowerdbridge.h>
 
+#include "weboskmsatomicstate.h"
+#include "weboskmscursorplane.h"
+#include "weboskmsfence.h"
+#include "weboskmsflipcost.h"
+#include "weboskmsformats.h"
+#include "weboskmshotplug.h"
+#include "weboskmsvariablerefresh.h"
+
 class EglFSStarfishScreen;
 class EglFSStarfishWindow;
 class QStarfishSnapshotOperator;
@@ -38,12 +49,10 @@ class QStarfishSnapshotOperator;
 class EglFSStarfishScreenConfig : public QKmsScreenConfig
 {
 public:
-    EglFSStarfishScreenConfig(QJsonObject);
     void loadConfig() override;
 
     QVariantMap connector() const { return m_connector; }
 private:
-    QJsonObject m_configJson;
     QVariantMap m_connector;
 };
 
@@ -89,8 +98,9 @@ private:
     class EglFSStarfishIntegrationPrivate* d_ptr;
     Q_DECLARE_PRIVATE(EglFSStarfishIntegration);
 
-    QJsonObject m_configJson;
     QList<EglFSStarfishScreen*> m_screens;
+    QByteArray m_callStatsDump;
+    QByteArray m_flipCostDump;
 };
 
 class EglFSStarfishDevice : public QEglFSKmsGbmDevice
@@ -115,7 +125,37 @@ public:
     bool getSizeForPlane(const QString& connectorNameForPlane, QSize &size);
 
     QVector<uint64_t> getGbmModifiersFromPlane(const QKmsOutput &output);
+    // IN_FORMATS of a plane, parsed for all planes on first use
+    const WebOSKmsFormatList &planeFormats(uint32_t planeId);
     drmModePropertyBlobPtr planePropertyBlob(drmModePlanePtr plane, const QByteArray &name);
+
+    // Adds and removes screens as connectors other than the panel come and go
+    void startHotplug();
+
+    // Shared by the screens of a CRTC, which commit one at a time
+    struct CrtcCommit {
+        QMutex mutex;
+        // Of the screen on the primary plane, guarded by mutex
+        WebOSKmsCursorPlane *cursorPlane = nullptr;
+        // Hidden screens whose plane is not off yet, guarded by mutex.
+        // Tried again on the page flip events of the CRTC.
+        QVector<EglFSStarfishScreen *> planeDisables;
+    };
+    CrtcCommit *crtcCommit(uint32_t crtcId);
+
+private:
+    void updateConnectors(uint32_t connectorId);
+    void addConnector(drmModeResPtr resources, drmModeConnectorPtr connector);
+    void removeConnector(uint32_t connectorId);
+
+    uint32_t m_panelConnectorId = 0;
+    // connector_id, screen
+    QMap<uint32_t, QPlatformScreen *> m_connectorScreens;
+    QScopedPointer<WebOSKmsHotplug> m_hotplug;
+    // plane_id, formats
+    QHash<uint32_t, WebOSKmsFormatList> m_planeFormats;
+    // crtc_id, commit serialization
+    QHash<uint32_t, QSharedPointer<CrtcCommit>> m_crtcCommits;
 };
 
 class EglFSStarfishScreen : public QEglFSKmsGbmScreen
@@ -155,6 +195,9 @@ public:
     void removePlatformWindow(EglFSStarfishWindow *window);
 
     void setVisible(bool visible);
+    // Turns the plane of a hidden screen off, with the commit mutex held.
+    // False while another commit is still queued on the CRTC.
+    bool commitPlaneDisable(bool blocking);
 
     void setX(int value) { m_position.setX(value); }
     void setY(int value) { m_position.setY(value); }
@@ -170,6 +213,24 @@ public:
     bool hasSnapshotDone() const;
     bool isSnapshotMaking() const;
 
+    const WebOSKmsAtomicState::Statistics *atomicStateStatistics() const { return m_atomicState.statistics(); }
+    const WebOSKmsFlipCost *flipCost() const { return &m_flipCost; }
+    // flip() waits for the previous flip instead of waitForVSync(), so
+    // the next frame is rendered while the previous one is queued
+    bool pipelinedFlip() const { return m_pipelinedFlip; }
+    // A single layer, the plane of the screen
+    void setPlaneFormats(const WebOSKmsFormatList &formats) { m_layerFormats = QVector<WebOSKmsFormatList>() << formats; }
+    const QVector<WebOSKmsFormatList> *layerFormats() const { return &m_layerFormats; }
+    // Render thread, before eglSwapBuffers()
+    void createRenderFence() { m_fence.createRenderFence(); }
+    // False if the screen cannot do variable refresh
+    bool setVariableRefreshMode(WebOSKmsVariableRefresh::Mode mode);
+    // Switches to the mode that fits content of the given frame rate.
+    // The switch is applied by the next flip().
+    bool requestRefreshRate(qreal rate);
+    // Null if the screen does not own a cursor plane
+    WebOSKmsCursorPlane *cursorPlane() { return m_cursorPlane.isInitialized() ? &m_cursorPlane : nullptr; }
+
 private:
     qreal m_dpr;
 #ifdef IM_ENABLE
@@ -177,9 +238,29 @@ private:
 #endif
     QPoint m_position;
     bool m_visible = false;
+    // Hidden but the plane is still on, guarded by m_commitMutex
+    bool m_planeDisablePending = false;
+    bool m_pipelinedFlip;
     QVector<uint64_t> m_modifiers;
+    QVector<WebOSKmsFormatList> m_layerFormats;
     QMap<QString,bool> m_visiblePolicies;
     QList<EglFSStarfishWindow*> m_windows;
+    // Serializes flip() with cursor only commits and with the other
+    // screens of the CRTC, owned by the device
+    EglFSStarfishDevice::CrtcCommit *m_crtcCommit;
+    QMutex *m_commitMutex;
+    // Plane properties written by flip(), guarded by m_commitMutex
+    WebOSKmsAtomicState m_atomicState;
+    WebOSKmsFlipCost m_flipCost;
+    // Used by flip(), guarded by m_commitMutex
+    WebOSKmsFence m_fence;
+    WebOSKmsVariableRefresh m_variableRefresh;
+    // Declared after the state its commit thread uses
+    WebOSKmsCursorPlane m_cursorPlane;
+    // Mode switch waiting for the next flip()
+    QMutex m_modeMutex;
+    int m_pendingMode = -1;
+    uint32_t m_pendingModeBlob = 0;
 #ifdef SNAPSHOT_BOOT
     QStarfishSnapshotOperator *m_snapshotOperator = nullptr;
 #endif
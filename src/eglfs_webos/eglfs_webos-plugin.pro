@@ -40,6 +40,8 @@ SOURCES += $$PWD/weboseglfsmain.cpp \
 
 HEADERS += $$PWD/weboseglfsintegration.h
 
+include($$PWD/deviceintegration/common/config.pri)
+
 OTHER_FILES += $$PWD/eglfs_webos.json
 
 emulator {
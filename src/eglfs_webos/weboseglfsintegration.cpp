@@ -16,9 +16,6 @@
 
 #include <QScreen>
 #include <QGuiApplication>
-#include <QJsonArray>
-#include <QJsonObject>
-#include <QFile>
 
 #include <QtGui/private/qguiapplication_p.h>
 #include <QtGui/private/qhighdpiscaling_p.h>
@@ -27,6 +24,7 @@
 #include "webosdevicediscovery_udev_sorted_p.h"
 #endif
 
+#include "weboseglfsconfig.h"
 #include "weboseglfsintegration.h"
 
 #if defined(EMULATOR)
@@ -82,25 +80,8 @@ void WebOSOutputMapping::removeDevice(const QString &deviceNode)
 WebOSEglFSIntegration::WebOSEglFSIntegration()
     : QEglFSIntegration()
 {
-    static QByteArray json = qgetenv("QT_QPA_EGLFS_CONFIG");
-
-    if (!json.isEmpty()) {
-        QFile file(QString::fromUtf8(json));
-        if (file.open(QFile::ReadOnly)) {
-            QJsonDocument doc = QJsonDocument::fromJson(file.readAll());
-            if (doc.isArray()) {
-                m_configJson = doc;
-                qInfo() << "Using config file" << json;
-            } else {
-                qWarning() << "Invalid config file" << json << "- no top-level JSON object";
-            }
-            file.close();
-        } else {
-            qWarning() << "Could not open config file" << json << "for reading";
-        }
-    } else {
-        qWarning("No config file given");
-    }
+    // Parsed before the device integration asks for it
+    WebOSEglFSConfig::instance();
 
 #if QT_CONFIG(evdev)
     bool ok = false;
@@ -163,26 +144,10 @@ void WebOSEglFSIntegration::createInputHandlers()
     // HACK: implement virtual touch for emulator.
     QOutputMapping::set(&m_mappingHelper);
 
-    if (!m_configJson.isEmpty()) {
-        for (int i = 0; i < m_configJson.array().size(); i++) {
-            const QJsonObject object = m_configJson.array().at(i).toObject();
-            const QJsonArray outputs = object.value(QLatin1String("outputs")).toArray();
-            for (int j = 0; j < outputs.size(); j++) {
-                const QJsonObject output = outputs.at(j).toObject();
-                if (!m_useFixedAssociationForTouch) {
-                    QString touchDevice = output.value(QLatin1String("touchDevice")).toString();
-                    if (!touchDevice.isEmpty())
-                        m_useFixedAssociationForTouch = true;
-                }
-
-                const QVariantMap outputSettings = outputs.at(j).toObject().toVariantMap();
-                if (outputSettings.contains(QStringLiteral("name"))) {
-                    const QString name = outputSettings.value(QStringLiteral("name")).toString();
-                    if (m_outputSettings.contains(name))
-                        qWarning() << "Output" << name << "is duplicated";
-                    m_outputSettings.insert(name, outputSettings);
-                }
-            }
+    for (const WebOSEglFSDeviceConfig &device : WebOSEglFSConfig::instance().devices()) {
+        for (const WebOSEglFSOutputConfig &output : device.outputs) {
+            if (!output.touchDevice.isEmpty())
+                m_useFixedAssociationForTouch = true;
         }
     }
 
@@ -237,34 +202,15 @@ void WebOSEglFSIntegration::createInputHandlers()
     QOutputMapping::set(&m_mappingHelper);
     QString env;
 
-    if (!m_configJson.isEmpty()) {
-        for (int i = 0; i < m_configJson.array().size(); i++) {
-            const QJsonObject object = m_configJson.array().at(i).toObject();
-            const QJsonArray outputs = object.value(QLatin1String("outputs")).toArray();
-            for (int j = 0; j < outputs.size(); j++) {
-                const QJsonObject output = outputs.at(j).toObject();
-                if (!m_useFixedAssociationForTouch) {
-                    QString touchDevice = output.value(QLatin1String("touchDevice")).toString();
-                    if (!touchDevice.isEmpty())
-                        m_useFixedAssociationForTouch = true;
-                }
-                if (!m_useFixedAssociationForKeyboard) {
-                    QString keyboardDevice = output.value(QLatin1String("keyboardDevice")).toString();
-                    if (!keyboardDevice.isEmpty()) {
-                        if (m_disableKbdOutputMapping)
-                            qWarning() << "Unset QT_QPA_EVDEV_DISABLE_KBD_OUTPUT_MAPPING to use fixed keyboard mapping";
-                        else
-                            m_useFixedAssociationForKeyboard = true;
-                    }
-                }
-
-                const QVariantMap outputSettings = outputs.at(j).toObject().toVariantMap();
-                if (outputSettings.contains(QStringLiteral("name"))) {
-                    const QString name = outputSettings.value(QStringLiteral("name")).toString();
-                    if (m_outputSettings.contains(name))
-                        qWarning() << "Output" << name << "is duplicated";
-                    m_outputSettings.insert(name, outputSettings);
-                }
+    for (const WebOSEglFSDeviceConfig &device : WebOSEglFSConfig::instance().devices()) {
+        for (const WebOSEglFSOutputConfig &output : device.outputs) {
+            if (!output.touchDevice.isEmpty())
+                m_useFixedAssociationForTouch = true;
+            if (!m_useFixedAssociationForKeyboard && !output.keyboardDevice.isEmpty()) {
+                if (m_disableKbdOutputMapping)
+                    qWarning() << "Unset QT_QPA_EVDEV_DISABLE_KBD_OUTPUT_MAPPING to use fixed keyboard mapping";
+                else
+                    m_useFixedAssociationForKeyboard = true;
             }
         }
     }
@@ -416,10 +362,11 @@ void WebOSEglFSIntegration::prepareFixedOutputMapping(const QStringList &devices
         if (!screen)
             continue;
 
-        if (!m_outputSettings.contains(screen->name()))
+        const WebOSEglFSOutputConfig *output = WebOSEglFSConfig::instance().output(screen->name());
+        if (!output)
             continue;
 
-        QString devName = m_outputSettings.value(screen->name()).value(deviceType).toString();
+        const QString &devName = deviceType == QLatin1String("keyboardDevice") ? output->keyboardDevice : output->touchDevice;
 
         foreach (QString device, devices) {
             if (devName != device)
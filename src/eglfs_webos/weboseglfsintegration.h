@@ -17,8 +17,6 @@
 #ifndef WEBOS_EGLFS_INTEGRATION_H
 #define WEBOS_EGLFS_INTEGRATION_H
 
-#include <QJsonDocument>
-
 #include <qpa/qplatformfontdatabase.h>
 #include <qpa/qplatformservices.h>
 #include <QtFbSupport/private/qfbvthandler_p.h>
@@ -100,11 +98,9 @@ private:
     WebOSOutputMapping m_mappingHelper;
 #endif
 
-    QJsonDocument m_configJson;
     bool m_disableKbdOutputMapping = false;
     bool m_useFixedAssociationForTouch = false;
     bool m_useFixedAssociationForKeyboard = false;
-    QMap<QString, QVariantMap> m_outputSettings;
 #if defined(EMULATOR)
     QEmulatorKeyboardManager* m_emulatorKeyboardManager;
     QEmulatorMouseManager* m_emulatorMouseManager;
@@ -0,0 +1,31 @@
+# Copyright (c) 2024 LG Electronics, Inc.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+# http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# SPDX-License-Identifier: Apache-2.0
+
+CONFIG += testcase no_testcase_installs
+TARGET = tst_eglfs_kms_webos
+
+QT += testlib gui gui-private
+
+include($$PWD/../../fakedrm/fakedrm.pri)
+
+# Plugins of this build, found ahead of the installed ones
+DEFINES += WEBOS_PLUGIN_DIR=\\\"$$MODULE_BASE_OUTDIR/plugins\\\"
+
+plane_composition {
+    DEFINES += PLANE_COMPOSITION
+}
+
+SOURCES += $$PWD/tst_eglfs_kms_webos.cpp
@@ -0,0 +1,273 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+#include <QDir>
+#include <QFile>
+#include <QGuiApplication>
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+#include <QScreen>
+#include <QTemporaryDir>
+#include <QWindow>
+#include <QtTest>
+#include <qpa/qplatformnativeinterface.h>
+
+#include <errno.h>
+#include <gbm.h>
+
+#include "fakedrm.h"
+
+// Runs the eglfs_kms_webos integration end to end on the simulated
+// device of libfakedrm: mode set, page flips, failed commits and, with
+// plane composition, overlay layers.
+
+static QTemporaryDir *runtimeDir = nullptr;
+
+class tst_EglFSKmsWebOS : public QObject
+{
+    Q_OBJECT
+
+public:
+    static void initMain();
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+    void screen();
+    void flip();
+    void failedCommit();
+    void callStats();
+#ifdef PLANE_COMPOSITION
+    void overlay();
+#endif
+
+private:
+    void render(int frames);
+    static bool findPlane(uint32_t width, uint32_t height, FakeDrmPlaneState *state = nullptr);
+
+    QWindow *m_window = nullptr;
+    QOpenGLContext *m_context = nullptr;
+    int m_frame = 0;
+};
+
+void tst_EglFSKmsWebOS::initMain()
+{
+    FakeDrmConfig config;
+    fakedrm_default_config(&config);
+    config.overlayPlanes = 4;
+    fakedrm_configure(&config);
+
+    // Outlives the application, the plugin keeps its config cache there
+    runtimeDir = new QTemporaryDir;
+
+    const QString configPath = runtimeDir->filePath(QStringLiteral("eglfs_config.json"));
+    QFile file(configPath);
+    if (!file.open(QIODevice::WriteOnly))
+        qFatal("Cannot write %s", qPrintable(configPath));
+
+#ifdef PLANE_COMPOSITION
+    const QByteArray multiPlanes = "true";
+#else
+    const QByteArray multiPlanes = "false";
+#endif
+    file.write("[{\"device\": \"" + QByteArray(fakedrm_device_path()) + "\", \"hwcursor\": false, "
+               "\"outputs\": [{\"name\": \"HDMI1\", \"primary\": true, \"useMultiPlanes\": " + multiPlanes + "}]}]");
+    file.close();
+
+    qputenv("QT_QPA_PLATFORM", "eglfs_webos");
+    qputenv("QT_QPA_EGLFS_INTEGRATION", "eglfs_kms_webos");
+    qputenv("QT_QPA_EGLFS_KMS_ATOMIC", "1");
+    qputenv("QT_QPA_EGLFS_DISABLE_INPUT", "1");
+    qputenv("QT_QPA_EGLFS_HIDECURSOR", "1");
+    qputenv("QT_QPA_EGLFS_CONFIG", QFile::encodeName(configPath));
+    qputenv("XDG_RUNTIME_DIR", QFile::encodeName(runtimeDir->path()));
+
+    if (QDir(QStringLiteral(WEBOS_PLUGIN_DIR)).exists()) {
+        QByteArray pluginPath(WEBOS_PLUGIN_DIR);
+        if (qEnvironmentVariableIsSet("QT_PLUGIN_PATH"))
+            pluginPath += ':' + qgetenv("QT_PLUGIN_PATH");
+        qputenv("QT_PLUGIN_PATH", pluginPath);
+    }
+}
+
+void tst_EglFSKmsWebOS::initTestCase()
+{
+    QCOMPARE(QGuiApplication::platformName(), QStringLiteral("eglfs_webos"));
+
+    m_window = new QWindow;
+    m_window->setSurfaceType(QSurface::OpenGLSurface);
+    m_window->showFullScreen();
+    QVERIFY(QTest::qWaitForWindowExposed(m_window));
+
+    m_context = new QOpenGLContext;
+    m_context->setFormat(m_window->requestedFormat());
+    QVERIFY(m_context->create());
+    QVERIFY(m_context->makeCurrent(m_window));
+}
+
+void tst_EglFSKmsWebOS::cleanupTestCase()
+{
+    delete m_context;
+    m_context = nullptr;
+    delete m_window;
+    m_window = nullptr;
+}
+
+void tst_EglFSKmsWebOS::render(int frames)
+{
+    for (int i = 0; i < frames; i++) {
+        QVERIFY(m_context->makeCurrent(m_window));
+        const float shade = (m_frame++ % 16) / 16.0f;
+        m_context->functions()->glClearColor(shade, shade, shade, 1.0f);
+        m_context->functions()->glClear(GL_COLOR_BUFFER_BIT);
+        m_context->swapBuffers(m_window);
+    }
+}
+
+bool tst_EglFSKmsWebOS::findPlane(uint32_t width, uint32_t height, FakeDrmPlaneState *state)
+{
+    const int count = fakedrm_plane_count();
+    for (int i = 0; i < count; i++) {
+        FakeDrmPlaneState plane;
+        if (!fakedrm_plane_state(i, &plane))
+            continue;
+        if (plane.fbId && plane.crtcId && plane.crtcWidth == width && plane.crtcHeight == height) {
+            if (state)
+                *state = plane;
+            return true;
+        }
+    }
+    return false;
+}
+
+void tst_EglFSKmsWebOS::screen()
+{
+    QScreen *screen = QGuiApplication::primaryScreen();
+    QVERIFY(screen);
+    QCOMPARE(screen->name(), QStringLiteral("HDMI1"));
+    QCOMPARE(screen->size(), QSize(1920, 1080));
+    QVERIFY(qAbs(screen->refreshRate() - 60) < 1);
+}
+
+void tst_EglFSKmsWebOS::flip()
+{
+    render(1);
+    // The first frame sets the mode
+    QTRY_COMPARE(fakedrm_crtc_refresh(0), 60000);
+
+    fakedrm_reset_stats();
+    const uint64_t sequence = fakedrm_crtc_sequence(0);
+
+    render(30);
+
+    FakeDrmStats stats;
+    fakedrm_stats(&stats);
+    QVERIFY(stats.atomicCommits >= 30);
+    QCOMPARE(stats.rejectedCommits, uint64_t(0));
+    QVERIFY(stats.flipEvents >= 29);
+    QCOMPARE(stats.swapBuffers, uint64_t(30));
+    // One frame per vblank at most
+    QVERIFY(fakedrm_crtc_sequence(0) - sequence >= 29);
+    // Triple buffering at most, each buffer added once
+    QVERIFY(stats.framebuffers <= 3);
+    QVERIFY(stats.framebuffersAdded <= 3);
+
+    FakeDrmPlaneState plane;
+    QVERIFY(findPlane(1920, 1080, &plane));
+    QCOMPARE(plane.crtcX, 0);
+    QCOMPARE(plane.crtcY, 0);
+}
+
+void tst_EglFSKmsWebOS::failedCommit()
+{
+    render(2);
+    fakedrm_reset_stats();
+    fakedrm_fail_commits(1, EINVAL);
+
+    // Rendering goes on with the next frame
+    render(10);
+
+    FakeDrmStats stats;
+    fakedrm_stats(&stats);
+    QCOMPARE(stats.rejectedCommits, uint64_t(1));
+    QVERIFY(stats.atomicCommits >= 9);
+    QVERIFY(findPlane(1920, 1080));
+}
+
+void tst_EglFSKmsWebOS::callStats()
+{
+    render(5);
+
+    QPlatformNativeInterface *native = QGuiApplication::platformNativeInterface();
+    QVERIFY(native);
+    auto *callStats = static_cast<QByteArray *>(native->nativeResourceForIntegration("kms_call_stats"));
+    QVERIFY(callStats);
+    QVERIFY(!callStats->isEmpty());
+
+    auto *flipCost = static_cast<QByteArray *>(native->nativeResourceForIntegration("flip_cost"));
+    QVERIFY(flipCost);
+    QVERIFY(flipCost->contains("HDMI1"));
+}
+
+#ifdef PLANE_COMPOSITION
+void tst_EglFSKmsWebOS::overlay()
+{
+    typedef void (*SetOverlayBufferObject)(const QScreen *, void *, QRectF, uint32_t);
+    auto setOverlayBufferObject = reinterpret_cast<SetOverlayBufferObject>(
+        QGuiApplication::platformFunction("setOverlayBufferObject"));
+    QVERIFY(setOverlayBufferObject);
+
+    auto *device = static_cast<gbm_device *>(
+        QGuiApplication::platformNativeInterface()->nativeResourceForIntegration("gbm_device"));
+    QVERIFY(device);
+
+    // The plugin owns the buffer object from here on
+    gbm_bo *bo = gbm_bo_create(device, 640, 360, GBM_FORMAT_XRGB8888, GBM_BO_USE_SCANOUT | GBM_BO_USE_RENDERING);
+    QVERIFY(bo);
+
+    fakedrm_reset_stats();
+    setOverlayBufferObject(QGuiApplication::primaryScreen(), bo, QRectF(100, 50, 640, 360), 0);
+
+    FakeDrmPlaneState plane;
+    for (int i = 0; i < 60 && !findPlane(640, 360, &plane); i++)
+        render(1);
+    QVERIFY(findPlane(640, 360, &plane));
+    QCOMPARE(plane.crtcX, 100);
+    QCOMPARE(plane.crtcY, 50);
+
+    // Stays below the main plane
+    FakeDrmPlaneState main;
+    QVERIFY(findPlane(1920, 1080, &main));
+    QVERIFY(plane.zpos < main.zpos);
+
+    FakeDrmStats stats;
+    fakedrm_stats(&stats);
+    QVERIFY(stats.framebuffersAdded >= 1);
+    QCOMPARE(stats.rejectedCommits, uint64_t(0));
+
+    // Hiding the layer frees the plane
+    setOverlayBufferObject(QGuiApplication::primaryScreen(), nullptr, QRectF(), 0);
+    for (int i = 0; i < 60 && findPlane(640, 360); i++)
+        render(1);
+    QVERIFY(!findPlane(640, 360));
+    QVERIFY(findPlane(1920, 1080));
+}
+#endif
+
+QTEST_MAIN(tst_EglFSKmsWebOS)
+
+#include "tst_eglfs_kms_webos.moc"
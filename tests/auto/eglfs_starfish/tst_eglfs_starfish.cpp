@@ -0,0 +1,280 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+#include <QDir>
+#include <QFile>
+#include <QGuiApplication>
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+#include <QScreen>
+#include <QTemporaryDir>
+#include <QWindow>
+#include <QtTest>
+#include <qpa/qplatformnativeinterface.h>
+
+#include <errno.h>
+#include <xf86drmMode.h>
+
+#include "fakedrm.h"
+
+// Runs the eglfs_starfish integration end to end on the simulated device
+// of libfakedrm. fb0 scans out from the primary plane and fb1 from an
+// overlay plane, one of them is visible at a time.
+
+static QTemporaryDir *runtimeDir = nullptr;
+
+typedef void (*SetScreenVisibleDirectly)(QScreen *, bool, QString);
+
+class tst_EglFSStarfish : public QObject
+{
+    Q_OBJECT
+
+public:
+    static void initMain();
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+    void screens();
+    void flip();
+    void visibility();
+    void failedCommit();
+    void callStats();
+
+private:
+    void render(int index, int frames);
+    void show(int index);
+    static bool findPlane(uint32_t type, FakeDrmPlaneState *state = nullptr);
+
+    QScreen *m_screens[2] = {};
+    QWindow *m_windows[2] = {};
+    QOpenGLContext *m_context = nullptr;
+    SetScreenVisibleDirectly m_setScreenVisible = nullptr;
+    int m_frame = 0;
+};
+
+void tst_EglFSStarfish::initMain()
+{
+    FakeDrmConfig config;
+    fakedrm_default_config(&config);
+    config.overlayPlanes = 2;
+    fakedrm_configure(&config);
+
+    // Outlives the application, the plugin keeps its config cache there
+    runtimeDir = new QTemporaryDir;
+
+    const QString configPath = runtimeDir->filePath(QStringLiteral("eglfs_config.json"));
+    QFile file(configPath);
+    if (!file.open(QIODevice::WriteOnly))
+        qFatal("Cannot write %s", qPrintable(configPath));
+
+    file.write("[{\"device\": \"" + QByteArray(fakedrm_device_path()) + "\", \"hwcursor\": false, \"outputs\": ["
+               "{\"name\": \"fb0\", \"primary\": true, \"geometry\": \"1920x1080+0+0r0s1\"}, "
+               "{\"name\": \"fb1\", \"geometry\": \"1920x1080+0+0r0s1\"}]}]");
+    file.close();
+
+    qputenv("QT_QPA_PLATFORM", "eglfs_webos");
+    qputenv("QT_QPA_EGLFS_INTEGRATION", "eglfs_starfish");
+    qputenv("QT_QPA_EGLFS_KMS_ATOMIC", "1");
+    qputenv("QT_QPA_EGLFS_DISABLE_INPUT", "1");
+    qputenv("QT_QPA_EGLFS_HIDECURSOR", "1");
+    qputenv("QT_QPA_EGLFS_FB", "/dev/fb0:/dev/fb1");
+    qputenv("QT_QPA_EGLFS_CONFIG", QFile::encodeName(configPath));
+    qputenv("XDG_RUNTIME_DIR", QFile::encodeName(runtimeDir->path()));
+
+    if (QDir(QStringLiteral(WEBOS_PLUGIN_DIR)).exists()) {
+        QByteArray pluginPath(WEBOS_PLUGIN_DIR);
+        if (qEnvironmentVariableIsSet("QT_PLUGIN_PATH"))
+            pluginPath += ':' + qgetenv("QT_PLUGIN_PATH");
+        qputenv("QT_PLUGIN_PATH", pluginPath);
+    }
+}
+
+void tst_EglFSStarfish::initTestCase()
+{
+    QCOMPARE(QGuiApplication::platformName(), QStringLiteral("eglfs_webos"));
+
+    for (QScreen *screen : QGuiApplication::screens()) {
+        if (screen->name() == QStringLiteral("fb0"))
+            m_screens[0] = screen;
+        else if (screen->name() == QStringLiteral("fb1"))
+            m_screens[1] = screen;
+    }
+    QVERIFY(m_screens[0]);
+    QVERIFY(m_screens[1]);
+
+    m_setScreenVisible = reinterpret_cast<SetScreenVisibleDirectly>(
+        QGuiApplication::platformNativeInterface()->nativeResourceForIntegration("setScreenVisibleDirectly"));
+    QVERIFY(m_setScreenVisible);
+
+    for (int i = 0; i < 2; i++) {
+        m_windows[i] = new QWindow(m_screens[i]);
+        m_windows[i]->setSurfaceType(QSurface::OpenGLSurface);
+        m_windows[i]->showFullScreen();
+        QVERIFY(QTest::qWaitForWindowExposed(m_windows[i]));
+    }
+
+    m_context = new QOpenGLContext;
+    m_context->setFormat(m_windows[0]->requestedFormat());
+    QVERIFY(m_context->create());
+}
+
+void tst_EglFSStarfish::cleanupTestCase()
+{
+    delete m_context;
+    m_context = nullptr;
+    for (QWindow *&window : m_windows) {
+        delete window;
+        window = nullptr;
+    }
+}
+
+void tst_EglFSStarfish::render(int index, int frames)
+{
+    for (int i = 0; i < frames; i++) {
+        QVERIFY(m_context->makeCurrent(m_windows[index]));
+        const float shade = (m_frame++ % 16) / 16.0f;
+        m_context->functions()->glClearColor(shade, shade, shade, 1.0f);
+        m_context->functions()->glClear(GL_COLOR_BUFFER_BIT);
+        m_context->swapBuffers(m_windows[index]);
+    }
+}
+
+void tst_EglFSStarfish::show(int index)
+{
+    // The application policy keeps the other one off
+    m_setScreenVisible(m_screens[index], true, QStringLiteral("application"));
+}
+
+bool tst_EglFSStarfish::findPlane(uint32_t type, FakeDrmPlaneState *state)
+{
+    const int count = fakedrm_plane_count();
+    for (int i = 0; i < count; i++) {
+        FakeDrmPlaneState plane;
+        if (!fakedrm_plane_state(i, &plane) || plane.type != type)
+            continue;
+        if (plane.fbId && plane.crtcId) {
+            if (state)
+                *state = plane;
+            return true;
+        }
+    }
+    return false;
+}
+
+void tst_EglFSStarfish::screens()
+{
+    for (QScreen *screen : m_screens) {
+        QCOMPARE(screen->size(), QSize(1920, 1080));
+        QVERIFY(qAbs(screen->refreshRate() - 60) < 1);
+    }
+    QCOMPARE(QGuiApplication::primaryScreen(), m_screens[0]);
+}
+
+void tst_EglFSStarfish::flip()
+{
+    show(0);
+    render(0, 1);
+    // The first frame sets the mode
+    QTRY_COMPARE(fakedrm_crtc_refresh(0), 60000);
+
+    fakedrm_reset_stats();
+    const uint64_t sequence = fakedrm_crtc_sequence(0);
+
+    render(0, 30);
+
+    FakeDrmStats stats;
+    fakedrm_stats(&stats);
+    QVERIFY(stats.atomicCommits >= 30);
+    QCOMPARE(stats.rejectedCommits, uint64_t(0));
+    QVERIFY(stats.flipEvents >= 29);
+    QCOMPARE(stats.swapBuffers, uint64_t(30));
+    // One frame per vblank at most
+    QVERIFY(fakedrm_crtc_sequence(0) - sequence >= 29);
+    QVERIFY(stats.framebuffersAdded <= 3);
+
+    FakeDrmPlaneState plane;
+    QVERIFY(findPlane(DRM_PLANE_TYPE_PRIMARY, &plane));
+    QCOMPARE(plane.crtcWidth, uint32_t(1920));
+    QCOMPARE(plane.crtcHeight, uint32_t(1080));
+    QVERIFY(!findPlane(DRM_PLANE_TYPE_OVERLAY));
+}
+
+void tst_EglFSStarfish::visibility()
+{
+    show(0);
+    render(0, 2);
+    QVERIFY(findPlane(DRM_PLANE_TYPE_PRIMARY));
+
+    // fb1 takes over, fb0 is turned off right away
+    show(1);
+    QTRY_VERIFY(!findPlane(DRM_PLANE_TYPE_PRIMARY));
+    render(1, 5);
+    QVERIFY(findPlane(DRM_PLANE_TYPE_OVERLAY));
+
+    // Frames of a hidden screen do not reach the device
+    fakedrm_reset_stats();
+    render(0, 5);
+    FakeDrmStats stats;
+    fakedrm_stats(&stats);
+    QCOMPARE(stats.atomicCommits, uint64_t(0));
+
+    show(0);
+    QTRY_VERIFY(!findPlane(DRM_PLANE_TYPE_OVERLAY));
+    render(0, 5);
+    QVERIFY(findPlane(DRM_PLANE_TYPE_PRIMARY));
+
+    fakedrm_stats(&stats);
+    QCOMPARE(stats.rejectedCommits, uint64_t(0));
+}
+
+void tst_EglFSStarfish::failedCommit()
+{
+    show(0);
+    render(0, 2);
+    fakedrm_reset_stats();
+    fakedrm_fail_commits(1, EINVAL);
+
+    // Rendering goes on with the next frame
+    render(0, 10);
+
+    FakeDrmStats stats;
+    fakedrm_stats(&stats);
+    QCOMPARE(stats.rejectedCommits, uint64_t(1));
+    QVERIFY(stats.atomicCommits >= 9);
+    QVERIFY(findPlane(DRM_PLANE_TYPE_PRIMARY));
+}
+
+void tst_EglFSStarfish::callStats()
+{
+    show(0);
+    render(0, 5);
+
+    QPlatformNativeInterface *native = QGuiApplication::platformNativeInterface();
+    auto *callStats = static_cast<QByteArray *>(native->nativeResourceForIntegration("kms_call_stats"));
+    QVERIFY(callStats);
+    QVERIFY(!callStats->isEmpty());
+
+    auto *flipCost = static_cast<QByteArray *>(native->nativeResourceForIntegration("flip_cost"));
+    QVERIFY(flipCost);
+    QVERIFY(flipCost->contains("fb0"));
+    QVERIFY(flipCost->contains("fb1"));
+}
+
+QTEST_MAIN(tst_EglFSStarfish)
+
+#include "tst_eglfs_starfish.moc"
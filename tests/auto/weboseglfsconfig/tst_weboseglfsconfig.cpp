@@ -0,0 +1,328 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+
+#include <QDir>
+#include <QFile>
+#include <QSaveFile>
+#include <QTemporaryDir>
+#include <QtTest>
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "weboseglfsconfig.h"
+
+// Where a WebOSEglFSConfig is loaded from as the JSON file and its cache
+// in the runtime directory change. Each object reads the environment
+// again, instance() is left alone.
+
+static const QByteArray configJson =
+    "[{\"device\": \"/dev/dri/card0\", \"hwcursor\": false, \"outputs\": ["
+    "{\"name\": \"HDMI1\", \"primary\": true, \"useMultiPlanes\": true, \"vrr\": \"auto\", \"transform\": \"rotate90\"}, "
+    "{\"name\": \"VIRTUAL1\", \"virtual\": true, \"mode\": \"1280x720@60\"}]}]";
+
+static QStringList messages;
+
+static void collectMessage(QtMsgType type, const QMessageLogContext &context, const QString &message)
+{
+    Q_UNUSED(type);
+    Q_UNUSED(context);
+    messages.append(message);
+}
+
+class tst_WebOSEglFSConfig : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanup();
+    void noConfig();
+    void parse();
+    void cached();
+    void changedInPlace();
+    void touched();
+    void replaced();
+    void corruptCache();
+    void invalidJson();
+    void noRuntimeDir();
+
+private:
+    enum Source { None, Json, Cache };
+
+    Source load(WebOSEglFSConfig *config);
+    void writeConfig(const QByteArray &json);
+    // Sets the modification time, which changes the change time as well
+    void setModified(const struct timespec &time);
+    struct timespec modified() const;
+    QString cachePath() const;
+    QByteArray cache() const;
+
+    QTemporaryDir *m_runtimeDir = nullptr;
+    QTemporaryDir *m_configDir = nullptr;
+    QString m_configPath;
+};
+
+void tst_WebOSEglFSConfig::init()
+{
+    m_runtimeDir = new QTemporaryDir;
+    m_configDir = new QTemporaryDir;
+    QVERIFY(m_runtimeDir->isValid() && m_configDir->isValid());
+    m_configPath = m_configDir->filePath(QStringLiteral("eglfs_config.json"));
+
+    qputenv("XDG_RUNTIME_DIR", QFile::encodeName(m_runtimeDir->path()));
+    qputenv("QT_QPA_EGLFS_CONFIG", QFile::encodeName(m_configPath));
+}
+
+void tst_WebOSEglFSConfig::cleanup()
+{
+    delete m_runtimeDir;
+    m_runtimeDir = nullptr;
+    delete m_configDir;
+    m_configDir = nullptr;
+}
+
+tst_WebOSEglFSConfig::Source tst_WebOSEglFSConfig::load(WebOSEglFSConfig *config)
+{
+    messages.clear();
+    QtMessageHandler previous = qInstallMessageHandler(collectMessage);
+    *config = WebOSEglFSConfig();
+    qInstallMessageHandler(previous);
+
+    for (const QString &message : qAsConst(messages)) {
+        if (message.startsWith(QLatin1String("Using config file")))
+            return message.contains(QLatin1String(" from cache ")) ? Cache : Json;
+    }
+    return None;
+}
+
+void tst_WebOSEglFSConfig::writeConfig(const QByteArray &json)
+{
+    // In place, the inode stays the same
+    QFile file(m_configPath);
+    QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Truncate));
+    QCOMPARE(file.write(json), qint64(json.size()));
+}
+
+void tst_WebOSEglFSConfig::setModified(const struct timespec &time)
+{
+    const struct timespec times[2] = { time, time };
+    QCOMPARE(utimensat(AT_FDCWD, QFile::encodeName(m_configPath).constData(), times, 0), 0);
+}
+
+struct timespec tst_WebOSEglFSConfig::modified() const
+{
+    struct stat st;
+    memset(&st, 0, sizeof st);
+    stat(QFile::encodeName(m_configPath).constData(), &st);
+    return st.st_mtim;
+}
+
+QString tst_WebOSEglFSConfig::cachePath() const
+{
+    const QStringList caches = QDir(m_runtimeDir->path()).entryList({ QStringLiteral("qt-eglfs-config-*.cache") }, QDir::Files);
+    return caches.size() == 1 ? m_runtimeDir->filePath(caches.first()) : QString();
+}
+
+QByteArray tst_WebOSEglFSConfig::cache() const
+{
+    QFile file(cachePath());
+    return file.open(QIODevice::ReadOnly) ? file.readAll() : QByteArray();
+}
+
+void tst_WebOSEglFSConfig::noConfig()
+{
+    qunsetenv("QT_QPA_EGLFS_CONFIG");
+
+    WebOSEglFSConfig config;
+    QCOMPARE(load(&config), None);
+    QVERIFY(config.isEmpty());
+    QVERIFY(!config.device());
+    QVERIFY(messages.contains(QStringLiteral("No config file given")));
+}
+
+void tst_WebOSEglFSConfig::parse()
+{
+    writeConfig(configJson);
+
+    WebOSEglFSConfig config;
+    QCOMPARE(load(&config), Json);
+
+    QCOMPARE(config.devices().size(), 1);
+    const WebOSEglFSDeviceConfig *device = config.device();
+    QVERIFY(device);
+    QCOMPARE(device->device, QStringLiteral("/dev/dri/card0"));
+    QVERIFY(device->hasHwCursor);
+    QVERIFY(!device->hwCursor);
+    QCOMPARE(device->outputs.size(), 2);
+
+    const WebOSEglFSOutputConfig *hdmi = config.output(QStringLiteral("HDMI1"));
+    QVERIFY(hdmi);
+    QVERIFY(hdmi->primary);
+    QVERIFY(hdmi->useMultiPlanes);
+    QCOMPARE(hdmi->vrr, QStringLiteral("auto"));
+    QCOMPARE(hdmi->settings, (QVariantMap { { QStringLiteral("transform"), QStringLiteral("rotate90") } }));
+
+    const WebOSEglFSOutputConfig *virtualOutput = config.output(QStringLiteral("VIRTUAL1"));
+    QVERIFY(virtualOutput);
+    QVERIFY(virtualOutput->virtualOutput);
+    QCOMPARE(virtualOutput->mode, QStringLiteral("1280x720@60"));
+    QVERIFY(config.hasVirtualOutputs());
+    QVERIFY(!config.output(QStringLiteral("HDMI2")));
+
+    // Every key comes back for QKmsScreenConfig
+    const QVariantMap settings = device->outputSettings().value(QStringLiteral("HDMI1"));
+    QCOMPARE(settings.value(QStringLiteral("name")).toString(), QStringLiteral("HDMI1"));
+    QCOMPARE(settings.value(QStringLiteral("primary")).toBool(), true);
+    QCOMPARE(settings.value(QStringLiteral("transform")).toString(), QStringLiteral("rotate90"));
+
+    // Keyed by the path of the config file
+    QVERIFY(QFileInfo(cachePath()).fileName().contains(QRegularExpression(QStringLiteral("^qt-eglfs-config-[0-9a-f]{16}\\.cache$"))));
+}
+
+void tst_WebOSEglFSConfig::cached()
+{
+    writeConfig(configJson);
+
+    WebOSEglFSConfig parsed;
+    QCOMPARE(load(&parsed), Json);
+    const QByteArray written = cache();
+    QVERIFY(!written.isEmpty());
+
+    WebOSEglFSConfig cached;
+    QCOMPARE(load(&cached), Cache);
+    QCOMPARE(cached.devices().size(), parsed.devices().size());
+    QCOMPARE(cached.device()->outputSettings(), parsed.device()->outputSettings());
+    QVERIFY(cached.output(QStringLiteral("VIRTUAL1")));
+    QVERIFY(cached.hasVirtualOutputs());
+
+    // Left as it is
+    QCOMPARE(cache(), written);
+}
+
+void tst_WebOSEglFSConfig::changedInPlace()
+{
+    writeConfig(configJson);
+    const struct timespec time = modified();
+
+    WebOSEglFSConfig config;
+    QCOMPARE(load(&config), Json);
+
+    // Same size and modification time, only the change time tells
+    QByteArray json = configJson;
+    json.replace("HDMI1", "HDMI2");
+    writeConfig(json);
+    setModified(time);
+
+    QCOMPARE(load(&config), Json);
+    QVERIFY(!config.output(QStringLiteral("HDMI1")));
+    QVERIFY(config.output(QStringLiteral("HDMI2")));
+}
+
+void tst_WebOSEglFSConfig::touched()
+{
+    writeConfig(configJson);
+
+    WebOSEglFSConfig config;
+    QCOMPARE(load(&config), Json);
+    const QByteArray written = cache();
+
+    // Same content, found by its hash, and the stamp is updated
+    struct timespec time = modified();
+    time.tv_sec += 60;
+    setModified(time);
+
+    QCOMPARE(load(&config), Cache);
+    QVERIFY(config.output(QStringLiteral("HDMI1")));
+    QVERIFY(cache() != written);
+
+    QCOMPARE(load(&config), Cache);
+    QVERIFY(config.output(QStringLiteral("HDMI1")));
+}
+
+void tst_WebOSEglFSConfig::replaced()
+{
+    writeConfig(configJson);
+    const struct timespec time = modified();
+
+    WebOSEglFSConfig config;
+    QCOMPARE(load(&config), Json);
+
+    // Renamed over the old one with the same size and time
+    QByteArray json = configJson;
+    json.replace("HDMI1", "HDMI2");
+    QSaveFile file(m_configPath);
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    file.write(json);
+    QVERIFY(file.commit());
+    setModified(time);
+
+    QCOMPARE(load(&config), Json);
+    QVERIFY(config.output(QStringLiteral("HDMI2")));
+}
+
+void tst_WebOSEglFSConfig::corruptCache()
+{
+    writeConfig(configJson);
+
+    WebOSEglFSConfig config;
+    QCOMPARE(load(&config), Json);
+
+    // Stamp and hash intact, the model is cut short
+    QByteArray broken = cache();
+    QVERIFY(broken.size() > 80);
+    broken.chop(broken.size() - 80);
+    QFile file(cachePath());
+    QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Truncate));
+    file.write(broken);
+    file.close();
+
+    QCOMPARE(load(&config), Json);
+    QCOMPARE(config.device()->outputs.size(), 2);
+
+    // Written again
+    QCOMPARE(load(&config), Cache);
+    QCOMPARE(config.device()->outputs.size(), 2);
+}
+
+void tst_WebOSEglFSConfig::invalidJson()
+{
+    writeConfig("{\"device\": \"/dev/dri/card0\"}");
+
+    WebOSEglFSConfig config;
+    QCOMPARE(load(&config), None);
+    QVERIFY(config.isEmpty());
+    QVERIFY(cachePath().isEmpty());
+}
+
+void tst_WebOSEglFSConfig::noRuntimeDir()
+{
+    qunsetenv("XDG_RUNTIME_DIR");
+    writeConfig(configJson);
+
+    WebOSEglFSConfig config;
+    QCOMPARE(load(&config), Json);
+    QCOMPARE(load(&config), Json);
+    QVERIFY(config.output(QStringLiteral("HDMI1")));
+    QVERIFY(QDir(m_runtimeDir->path()).isEmpty());
+}
+
+QTEST_MAIN(tst_WebOSEglFSConfig)
+
+#include "tst_weboseglfsconfig.moc"
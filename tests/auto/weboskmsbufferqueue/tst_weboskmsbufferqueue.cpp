@@ -0,0 +1,195 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+
+#include <QtTest>
+
+#include "weboskmsbufferqueue.h"
+
+typedef WebOSKmsBufferQueue<int> Queue;
+
+// Times in milliseconds, which the queue does not care about
+static const qint64 refresh = 16;
+
+class tst_WebOSKmsBufferQueue : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void empty();
+    void asSoonAsPossible();
+    void notDueYet();
+    void newestDue();
+    void full();
+    void late();
+    void clear();
+    void cadence();
+};
+
+void tst_WebOSKmsBufferQueue::empty()
+{
+    Queue queue;
+    Queue::List dropped;
+    int value = -1;
+
+    QCOMPARE(queue.nextTarget(), qint64(-1));
+    QVERIFY(!queue.take(1000, refresh, &value, &dropped));
+    QCOMPARE(value, -1);
+    QVERIFY(dropped.isEmpty());
+}
+
+void tst_WebOSKmsBufferQueue::asSoonAsPossible()
+{
+    Queue queue;
+    Queue::List dropped;
+    int value = -1;
+
+    QVERIFY(!queue.push(1, 0, &value));
+    QCOMPARE(queue.nextTarget(), qint64(0));
+    QVERIFY(queue.take(1000, refresh, &value, &dropped));
+    QCOMPARE(value, 1);
+    QVERIFY(dropped.isEmpty());
+
+    // Never late
+    const Queue::Statistics stats = queue.statistics();
+    QCOMPARE(stats.queued, quint64(1));
+    QCOMPARE(stats.presented, quint64(1));
+    QCOMPARE(stats.late, quint64(0));
+    QCOMPARE(stats.repeated, quint64(0));
+}
+
+void tst_WebOSKmsBufferQueue::notDueYet()
+{
+    Queue queue;
+    Queue::List dropped;
+    int value = -1;
+
+    queue.push(1, 100, &value);
+
+    // Due within half a refresh interval of the vblank
+    QVERIFY(!queue.take(91, refresh, &value, &dropped));
+    QCOMPARE(queue.nextTarget(), qint64(100));
+    QVERIFY(queue.take(92, refresh, &value, &dropped));
+    QCOMPARE(value, 1);
+    QCOMPARE(queue.nextTarget(), qint64(-1));
+}
+
+void tst_WebOSKmsBufferQueue::newestDue()
+{
+    Queue queue;
+    Queue::List dropped;
+    int value = -1;
+
+    queue.push(1, 100, &value);
+    queue.push(2, 110, &value);
+    queue.push(3, 300, &value);
+
+    QVERIFY(queue.take(110, refresh, &value, &dropped));
+    QCOMPARE(value, 2);
+    QCOMPARE(dropped.size(), 1);
+    QCOMPARE(dropped.at(0), 1);
+    QCOMPARE(queue.nextTarget(), qint64(300));
+
+    const Queue::Statistics stats = queue.statistics();
+    QCOMPARE(stats.queued, quint64(3));
+    QCOMPARE(stats.presented, quint64(1));
+    QCOMPARE(stats.dropped, quint64(1));
+}
+
+void tst_WebOSKmsBufferQueue::full()
+{
+    Queue queue;
+    int dropped = -1;
+
+    for (int i = 1; i <= Queue::Capacity; i++)
+        QVERIFY(!queue.push(i, i * 100, &dropped));
+    QCOMPARE(dropped, -1);
+
+    // The oldest one makes room
+    QVERIFY(queue.push(Queue::Capacity + 1, 1000, &dropped));
+    QCOMPARE(dropped, 1);
+    QCOMPARE(queue.nextTarget(), qint64(200));
+
+    const Queue::Statistics stats = queue.statistics();
+    QCOMPARE(stats.queued, quint64(Queue::Capacity + 1));
+    QCOMPARE(stats.dropped, quint64(1));
+}
+
+void tst_WebOSKmsBufferQueue::late()
+{
+    Queue queue;
+    Queue::List dropped;
+    int value = -1;
+
+    queue.push(1, 100, &value);
+    QVERIFY(queue.take(150, refresh, &value, &dropped));
+    QCOMPARE(value, 1);
+
+    // Due three vblanks earlier
+    const Queue::Statistics stats = queue.statistics();
+    QCOMPARE(stats.late, quint64(1));
+    QCOMPARE(stats.repeated, quint64(3));
+}
+
+void tst_WebOSKmsBufferQueue::clear()
+{
+    Queue queue;
+    Queue::List dropped;
+    int value = -1;
+
+    for (int i = 1; i <= 3; i++)
+        queue.push(i, i * 100, &value);
+
+    queue.clear(&dropped);
+    QCOMPARE(dropped.size(), 3);
+    for (int i = 0; i < 3; i++)
+        QCOMPARE(dropped.at(i), i + 1);
+    QCOMPARE(queue.nextTarget(), qint64(-1));
+    QVERIFY(!queue.take(1000, refresh, &value, &dropped));
+}
+
+void tst_WebOSKmsBufferQueue::cadence()
+{
+    // 25 fps on a 50 Hz panel, queued ahead of time
+    const qint64 interval = 20;
+    Queue queue;
+    int value = -1;
+    for (int i = 0; i < Queue::Capacity; i++)
+        queue.push(i, 1000 + i * 2 * interval, &value);
+
+    // Every frame is shown for two vblanks
+    QVector<int> shown;
+    Queue::List dropped;
+    for (qint64 vblank = 1000; vblank < 1000 + 2 * interval * Queue::Capacity; vblank += interval) {
+        if (queue.take(vblank, interval, &value, &dropped))
+            shown.append(value);
+        else
+            shown.append(-1);
+    }
+
+    QCOMPARE(shown, (QVector<int> { 0, -1, 1, -1, 2, -1, 3, -1 }));
+    QVERIFY(dropped.isEmpty());
+
+    const Queue::Statistics stats = queue.statistics();
+    QCOMPARE(stats.presented, quint64(Queue::Capacity));
+    QCOMPARE(stats.dropped, quint64(0));
+    QCOMPARE(stats.late, quint64(0));
+}
+
+QTEST_MAIN(tst_WebOSKmsBufferQueue)
+
+#include "tst_weboskmsbufferqueue.moc"
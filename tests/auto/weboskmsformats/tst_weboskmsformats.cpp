@@ -0,0 +1,155 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+
+#include <QtTest>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <drm_fourcc.h>
+#include <xf86drmMode.h>
+
+#include "fakedrm.h"
+#include "weboskmsformats.h"
+
+// IN_FORMATS of the planes of the simulated device and the lookups on it
+
+static WebOSKmsFormatModifier entry(uint32_t format, uint64_t modifier)
+{
+    WebOSKmsFormatModifier result;
+    result.format = format;
+    result.modifier = modifier;
+    return result;
+}
+
+class tst_WebOSKmsFormats : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+    void queryPlane();
+    void unknownPlane();
+    void modifiers();
+    void supports();
+    void implicitModifier();
+    void unite();
+
+private:
+    uint32_t findPlane(uint32_t type) const;
+
+    int m_drmFd = -1;
+};
+
+void tst_WebOSKmsFormats::initTestCase()
+{
+    m_drmFd = open(fakedrm_device_path(), O_RDWR | O_CLOEXEC);
+    QVERIFY(m_drmFd >= 0);
+}
+
+void tst_WebOSKmsFormats::cleanupTestCase()
+{
+    close(m_drmFd);
+}
+
+uint32_t tst_WebOSKmsFormats::findPlane(uint32_t type) const
+{
+    FakeDrmPlaneState state;
+    for (int i = 0; i < fakedrm_plane_count(); i++) {
+        if (fakedrm_plane_state(i, &state) && state.type == type)
+            return state.id;
+    }
+    return 0;
+}
+
+void tst_WebOSKmsFormats::queryPlane()
+{
+    const uint32_t primary = findPlane(DRM_PLANE_TYPE_PRIMARY);
+    const uint32_t overlay = findPlane(DRM_PLANE_TYPE_OVERLAY);
+    const uint32_t cursor = findPlane(DRM_PLANE_TYPE_CURSOR);
+    QVERIFY(primary && overlay && cursor);
+
+    // Every format of the blob is listed with its modifier
+    const WebOSKmsFormatList primaryFormats = WebOSKmsFormats::queryPlane(m_drmFd, primary);
+    QCOMPARE(primaryFormats.size(), 7);
+    for (const WebOSKmsFormatModifier &format : primaryFormats)
+        QCOMPARE(format.modifier, uint64_t(DRM_FORMAT_MOD_LINEAR));
+    QVERIFY(primaryFormats.contains(entry(DRM_FORMAT_XRGB8888, DRM_FORMAT_MOD_LINEAR)));
+    QVERIFY(primaryFormats.contains(entry(DRM_FORMAT_ARGB2101010, DRM_FORMAT_MOD_LINEAR)));
+    QVERIFY(!primaryFormats.contains(entry(DRM_FORMAT_NV12, DRM_FORMAT_MOD_LINEAR)));
+
+    const WebOSKmsFormatList overlayFormats = WebOSKmsFormats::queryPlane(m_drmFd, overlay);
+    QCOMPARE(overlayFormats.size(), 8);
+    QVERIFY(overlayFormats.contains(entry(DRM_FORMAT_NV12, DRM_FORMAT_MOD_LINEAR)));
+
+    const WebOSKmsFormatList cursorFormats = WebOSKmsFormats::queryPlane(m_drmFd, cursor);
+    QCOMPARE(cursorFormats, (WebOSKmsFormatList { entry(DRM_FORMAT_ARGB8888, DRM_FORMAT_MOD_LINEAR) }));
+}
+
+void tst_WebOSKmsFormats::unknownPlane()
+{
+    QTest::ignoreMessage(QtWarningMsg, "Failed to query formats of plane 4096");
+    QVERIFY(WebOSKmsFormats::queryPlane(m_drmFd, 4096).isEmpty());
+}
+
+void tst_WebOSKmsFormats::modifiers()
+{
+    const WebOSKmsFormatList formats = WebOSKmsFormats::queryPlane(m_drmFd, findPlane(DRM_PLANE_TYPE_OVERLAY));
+    QCOMPARE(WebOSKmsFormats::modifiers(formats, DRM_FORMAT_NV12), (QVector<uint64_t> { DRM_FORMAT_MOD_LINEAR }));
+    QVERIFY(WebOSKmsFormats::modifiers(formats, DRM_FORMAT_YUYV).isEmpty());
+}
+
+void tst_WebOSKmsFormats::supports()
+{
+    const WebOSKmsFormatList formats = WebOSKmsFormats::queryPlane(m_drmFd, findPlane(DRM_PLANE_TYPE_PRIMARY));
+
+    QVERIFY(WebOSKmsFormats::supports(formats, DRM_FORMAT_XRGB8888, DRM_FORMAT_MOD_LINEAR));
+    // A buffer of implicit layout goes anywhere its format does
+    QVERIFY(WebOSKmsFormats::supports(formats, DRM_FORMAT_XRGB8888, DRM_FORMAT_MOD_INVALID));
+    QVERIFY(!WebOSKmsFormats::supports(formats, DRM_FORMAT_XRGB8888, I915_FORMAT_MOD_X_TILED));
+    QVERIFY(!WebOSKmsFormats::supports(formats, DRM_FORMAT_NV12, DRM_FORMAT_MOD_LINEAR));
+    QVERIFY(!WebOSKmsFormats::supports(formats, DRM_FORMAT_NV12, DRM_FORMAT_MOD_INVALID));
+}
+
+void tst_WebOSKmsFormats::implicitModifier()
+{
+    // As listed for planes without IN_FORMATS
+    const WebOSKmsFormatList formats { entry(DRM_FORMAT_XRGB8888, DRM_FORMAT_MOD_INVALID) };
+
+    QVERIFY(WebOSKmsFormats::modifiers(formats, DRM_FORMAT_XRGB8888).isEmpty());
+    QVERIFY(WebOSKmsFormats::supports(formats, DRM_FORMAT_XRGB8888, I915_FORMAT_MOD_X_TILED));
+    QVERIFY(WebOSKmsFormats::supports(formats, DRM_FORMAT_XRGB8888, DRM_FORMAT_MOD_LINEAR));
+    QVERIFY(!WebOSKmsFormats::supports(formats, DRM_FORMAT_ARGB8888, DRM_FORMAT_MOD_LINEAR));
+}
+
+void tst_WebOSKmsFormats::unite()
+{
+    WebOSKmsFormatList formats { entry(DRM_FORMAT_XRGB8888, DRM_FORMAT_MOD_LINEAR) };
+    WebOSKmsFormats::unite(&formats, { entry(DRM_FORMAT_XRGB8888, DRM_FORMAT_MOD_LINEAR),
+                                       entry(DRM_FORMAT_XRGB8888, I915_FORMAT_MOD_X_TILED),
+                                       entry(DRM_FORMAT_NV12, DRM_FORMAT_MOD_LINEAR) });
+
+    QCOMPARE(formats, (WebOSKmsFormatList { entry(DRM_FORMAT_XRGB8888, DRM_FORMAT_MOD_LINEAR),
+                                            entry(DRM_FORMAT_XRGB8888, I915_FORMAT_MOD_X_TILED),
+                                            entry(DRM_FORMAT_NV12, DRM_FORMAT_MOD_LINEAR) }));
+}
+
+QTEST_MAIN(tst_WebOSKmsFormats)
+
+#include "tst_weboskmsformats.moc"
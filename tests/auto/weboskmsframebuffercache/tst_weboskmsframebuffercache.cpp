@@ -0,0 +1,329 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+
+#include <QtTest>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <drm_fourcc.h>
+#include <gbm.h>
+#include <xf86drmMode.h>
+
+#include "fakedrm.h"
+#include "weboskmsframebuffercache.h"
+
+// LRU eviction, pinning and invalidation of the overlay framebuffer
+// cache, on framebuffers and dma-bufs of the simulated device
+
+class tst_WebOSKmsFramebufferCache : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+    void cleanup();
+    void defaultCapacity();
+    void keys();
+    void hitAndMiss();
+    void leastRecentlyUsed();
+    void pinned();
+    void invalidate();
+    void invalidatePinned();
+    void replace();
+    void clear();
+
+private:
+    struct Buffer {
+        gbm_bo *bo = nullptr;
+        // Stands for the dma-buf of a video frame
+        int fd = -1;
+        uint32_t fb = 0;
+        WebOSKmsFramebufferCache::Key key;
+    };
+
+    Buffer createBuffer();
+    static quint64 framebuffers();
+
+    int m_drmFd = -1;
+    gbm_device *m_gbm = nullptr;
+    QVector<Buffer> m_buffers;
+};
+
+void tst_WebOSKmsFramebufferCache::initTestCase()
+{
+    m_drmFd = open(fakedrm_device_path(), O_RDWR | O_CLOEXEC);
+    QVERIFY(m_drmFd >= 0);
+    m_gbm = gbm_create_device(m_drmFd);
+    QVERIFY(m_gbm);
+}
+
+void tst_WebOSKmsFramebufferCache::cleanupTestCase()
+{
+    gbm_device_destroy(m_gbm);
+    close(m_drmFd);
+}
+
+void tst_WebOSKmsFramebufferCache::cleanup()
+{
+    // The caches of the tests are gone, so are their framebuffers
+    QCOMPARE(framebuffers(), quint64(0));
+
+    for (const Buffer &buffer : m_buffers) {
+        close(buffer.fd);
+        gbm_bo_destroy(buffer.bo);
+    }
+    m_buffers.clear();
+}
+
+tst_WebOSKmsFramebufferCache::Buffer tst_WebOSKmsFramebufferCache::createBuffer()
+{
+    Buffer buffer;
+    buffer.bo = gbm_bo_create(m_gbm, 64, 64, DRM_FORMAT_XRGB8888, GBM_BO_USE_SCANOUT);
+    if (!buffer.bo)
+        qFatal("Failed to create a buffer object");
+    buffer.fd = gbm_bo_get_fd_for_plane(buffer.bo, 0);
+
+    const uint32_t handles[4] = { gbm_bo_get_handle(buffer.bo).u32 };
+    const uint32_t pitches[4] = { gbm_bo_get_stride(buffer.bo) };
+    const uint32_t offsets[4] = {};
+    if (drmModeAddFB2(m_drmFd, 64, 64, DRM_FORMAT_XRGB8888, handles, pitches, offsets, &buffer.fb, 0))
+        qFatal("Failed to add a framebuffer");
+
+    if (!WebOSKmsFramebufferCache::keyForDmaBuf(buffer.fd, DRM_FORMAT_XRGB8888, DRM_FORMAT_MOD_LINEAR, 64, 64, &buffer.key)
+        || !WebOSKmsFramebufferCache::setKeyPlane(&buffer.key, 0, buffer.fd, 0, pitches[0]))
+        qFatal("Failed to make a key");
+
+    m_buffers.append(buffer);
+    return buffer;
+}
+
+quint64 tst_WebOSKmsFramebufferCache::framebuffers()
+{
+    FakeDrmStats stats;
+    fakedrm_stats(&stats);
+    return stats.framebuffers;
+}
+
+void tst_WebOSKmsFramebufferCache::defaultCapacity()
+{
+    qputenv("WEBOS_OVERLAY_FB_CACHE_SIZE", "5");
+    QCOMPARE(WebOSKmsFramebufferCache::defaultCapacity(), 5);
+    qputenv("WEBOS_OVERLAY_FB_CACHE_SIZE", "0");
+    QCOMPARE(WebOSKmsFramebufferCache::defaultCapacity(), 32);
+    qunsetenv("WEBOS_OVERLAY_FB_CACHE_SIZE");
+    QCOMPARE(WebOSKmsFramebufferCache::defaultCapacity(), 32);
+}
+
+void tst_WebOSKmsFramebufferCache::keys()
+{
+    const Buffer a = createBuffer();
+    const Buffer b = createBuffer();
+    QVERIFY(!(a.key == b.key));
+
+    // Another fd of the same dma-buf
+    const int fd = fcntl(a.fd, F_DUPFD_CLOEXEC, 0);
+    QVERIFY(fd >= 0);
+    WebOSKmsFramebufferCache::Key key;
+    QVERIFY(WebOSKmsFramebufferCache::keyForDmaBuf(fd, DRM_FORMAT_XRGB8888, DRM_FORMAT_MOD_LINEAR, 64, 64, &key));
+    QVERIFY(WebOSKmsFramebufferCache::setKeyPlane(&key, 0, fd, 0, a.key.pitches[0]));
+    close(fd);
+    QVERIFY(key == a.key);
+    QCOMPARE(qHash(key), qHash(a.key));
+
+    // Suballocated from the same dma-buf
+    key.offsets[0] = 4096;
+    QVERIFY(!(key == a.key));
+
+    QTest::ignoreMessage(QtWarningMsg, QRegularExpression(QStringLiteral("Failed to stat dma-buf \\d+ of plane 4")));
+    QVERIFY(!WebOSKmsFramebufferCache::setKeyPlane(&key, 4, a.fd, 0, 0));
+    QTest::ignoreMessage(QtWarningMsg, "Failed to stat dma-buf -1 of plane 0");
+    QVERIFY(!WebOSKmsFramebufferCache::setKeyPlane(&key, 0, -1, 0, 0));
+
+    for (const Buffer &buffer : { a, b })
+        drmModeRmFB(m_drmFd, buffer.fb);
+}
+
+void tst_WebOSKmsFramebufferCache::hitAndMiss()
+{
+    const Buffer a = createBuffer();
+    WebOSKmsFramebufferCache cache(m_drmFd, nullptr, 4);
+
+    QCOMPARE(cache.acquire(a.key), uint32_t(0));
+    cache.insert(a.key, a.fb);
+    cache.release(a.fb);
+    QCOMPARE(framebuffers(), quint64(1));
+
+    QCOMPARE(cache.acquire(a.key), a.fb);
+    cache.release(a.fb);
+    QCOMPARE(cache.acquire(a.key), a.fb);
+    cache.release(a.fb);
+
+    QCOMPARE(cache.statistics()->hits.loadRelaxed(), quint64(2));
+    QCOMPARE(cache.statistics()->misses.loadRelaxed(), quint64(1));
+    QCOMPARE(cache.statistics()->evictions.loadRelaxed(), quint64(0));
+}
+
+void tst_WebOSKmsFramebufferCache::leastRecentlyUsed()
+{
+    const Buffer a = createBuffer();
+    const Buffer b = createBuffer();
+    const Buffer c = createBuffer();
+    WebOSKmsFramebufferCache cache(m_drmFd, nullptr, 2);
+
+    cache.insert(a.key, a.fb);
+    cache.release(a.fb);
+    cache.insert(b.key, b.fb);
+    cache.release(b.fb);
+
+    // a is used after b, so b goes first
+    QCOMPARE(cache.acquire(a.key), a.fb);
+    cache.release(a.fb);
+    cache.insert(c.key, c.fb);
+    cache.release(c.fb);
+
+    QCOMPARE(cache.statistics()->evictions.loadRelaxed(), quint64(1));
+    QCOMPARE(framebuffers(), quint64(2));
+    QCOMPARE(cache.acquire(b.key), uint32_t(0));
+    QCOMPARE(cache.acquire(a.key), a.fb);
+    QCOMPARE(cache.acquire(c.key), c.fb);
+    cache.release(a.fb);
+    cache.release(c.fb);
+}
+
+void tst_WebOSKmsFramebufferCache::pinned()
+{
+    const Buffer a = createBuffer();
+    const Buffer b = createBuffer();
+    const Buffer c = createBuffer();
+    WebOSKmsFramebufferCache cache(m_drmFd, nullptr, 1);
+
+    // Both on the screen, over capacity for now
+    cache.insert(a.key, a.fb);
+    cache.insert(b.key, b.fb);
+    QCOMPARE(cache.statistics()->evictions.loadRelaxed(), quint64(0));
+    QCOMPARE(framebuffers(), quint64(3));
+
+    // Unpinned, but only evicted by the next insert
+    cache.release(a.fb);
+    QCOMPARE(framebuffers(), quint64(3));
+
+    cache.insert(c.key, c.fb);
+    QCOMPARE(cache.statistics()->evictions.loadRelaxed(), quint64(1));
+    QCOMPARE(framebuffers(), quint64(2));
+    QCOMPARE(cache.acquire(a.key), uint32_t(0));
+
+    cache.release(b.fb);
+    cache.release(c.fb);
+}
+
+void tst_WebOSKmsFramebufferCache::invalidate()
+{
+    const Buffer a = createBuffer();
+    const Buffer b = createBuffer();
+    WebOSKmsFramebufferCache cache(m_drmFd, nullptr, 4);
+
+    cache.insert(a.key, a.fb);
+    cache.release(a.fb);
+    cache.insert(b.key, b.fb);
+    cache.release(b.fb);
+
+    cache.invalidate(a.fd);
+    QCOMPARE(framebuffers(), quint64(1));
+    QCOMPARE(cache.acquire(a.key), uint32_t(0));
+    QCOMPARE(cache.acquire(b.key), b.fb);
+    cache.release(b.fb);
+
+    // Not cached
+    const Buffer c = createBuffer();
+    cache.invalidate(c.fd);
+    QCOMPARE(framebuffers(), quint64(2));
+    drmModeRmFB(m_drmFd, c.fb);
+}
+
+void tst_WebOSKmsFramebufferCache::invalidatePinned()
+{
+    const Buffer a = createBuffer();
+    WebOSKmsFramebufferCache cache(m_drmFd, nullptr, 4);
+
+    // Still on the screen when the producer lets it go
+    cache.insert(a.key, a.fb);
+    QCOMPARE(cache.acquire(a.key), a.fb);
+    cache.invalidate(a.fd);
+    QCOMPARE(framebuffers(), quint64(1));
+    QCOMPARE(cache.acquire(a.key), uint32_t(0));
+
+    // Removed with the last pin
+    cache.release(a.fb);
+    QCOMPARE(framebuffers(), quint64(1));
+    cache.release(a.fb);
+    QCOMPARE(framebuffers(), quint64(0));
+}
+
+void tst_WebOSKmsFramebufferCache::replace()
+{
+    const Buffer a = createBuffer();
+    const uint32_t handles[4] = { gbm_bo_get_handle(a.bo).u32 };
+    const uint32_t pitches[4] = { a.key.pitches[0] };
+    const uint32_t offsets[4] = {};
+    uint32_t fb = 0;
+    QVERIFY(!drmModeAddFB2(m_drmFd, 64, 64, DRM_FORMAT_XRGB8888, handles, pitches, offsets, &fb, 0));
+
+    WebOSKmsFramebufferCache cache(m_drmFd, nullptr, 4);
+
+    // The old one goes right away when it is not on the screen
+    cache.insert(a.key, a.fb);
+    cache.release(a.fb);
+    cache.insert(a.key, fb);
+    QCOMPARE(framebuffers(), quint64(1));
+    QCOMPARE(cache.acquire(a.key), fb);
+    cache.release(fb);
+
+    // Otherwise once it leaves the screen
+    uint32_t other = 0;
+    QVERIFY(!drmModeAddFB2(m_drmFd, 64, 64, DRM_FORMAT_XRGB8888, handles, pitches, offsets, &other, 0));
+    QTest::ignoreMessage(QtWarningMsg, QRegularExpression(QStringLiteral("is replaced while in use")));
+    cache.insert(a.key, other);
+    QCOMPARE(framebuffers(), quint64(2));
+    cache.release(fb);
+    QCOMPARE(framebuffers(), quint64(1));
+    QCOMPARE(cache.acquire(a.key), other);
+    cache.release(other);
+    cache.release(other);
+}
+
+void tst_WebOSKmsFramebufferCache::clear()
+{
+    const Buffer a = createBuffer();
+    const Buffer b = createBuffer();
+    WebOSKmsFramebufferCache cache(m_drmFd, nullptr, 4);
+
+    cache.insert(a.key, a.fb);
+    cache.insert(b.key, b.fb);
+    cache.release(b.fb);
+
+    cache.clear();
+    QCOMPARE(framebuffers(), quint64(0));
+    QCOMPARE(cache.acquire(a.key), uint32_t(0));
+    QCOMPARE(cache.acquire(b.key), uint32_t(0));
+}
+
+QTEST_MAIN(tst_WebOSKmsFramebufferCache)
+
+#include "tst_weboskmsframebuffercache.moc"
@@ -0,0 +1,144 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+
+#include <QAtomicInt>
+#include <QThread>
+#include <QtTest>
+
+#include "weboskmsmailbox.h"
+
+class tst_WebOSKmsMailbox : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void empty();
+    void publishConsume();
+    void supersede();
+    void consumedStaysValid();
+    void threads();
+};
+
+void tst_WebOSKmsMailbox::empty()
+{
+    WebOSKmsMailbox<int> mailbox;
+    QVERIFY(!mailbox.isPending());
+    QVERIFY(!mailbox.consume());
+}
+
+void tst_WebOSKmsMailbox::publishConsume()
+{
+    WebOSKmsMailbox<int> mailbox;
+    int superseded = -1;
+
+    QVERIFY(!mailbox.publish(1, &superseded));
+    QCOMPARE(superseded, -1);
+    QVERIFY(mailbox.isPending());
+
+    const int *state = mailbox.consume();
+    QVERIFY(state);
+    QCOMPARE(*state, 1);
+    QVERIFY(!mailbox.isPending());
+
+    // Consumed once only
+    QVERIFY(!mailbox.consume());
+}
+
+void tst_WebOSKmsMailbox::supersede()
+{
+    WebOSKmsMailbox<int> mailbox;
+    int superseded = -1;
+
+    QVERIFY(!mailbox.publish(1, &superseded));
+    QVERIFY(mailbox.publish(2, &superseded));
+    QCOMPARE(superseded, 1);
+    QVERIFY(mailbox.publish(3, &superseded));
+    QCOMPARE(superseded, 2);
+
+    const int *state = mailbox.consume();
+    QVERIFY(state);
+    QCOMPARE(*state, 3);
+
+    // Not superseded once consumed
+    superseded = -1;
+    QVERIFY(!mailbox.publish(4, &superseded));
+    QCOMPARE(superseded, -1);
+}
+
+void tst_WebOSKmsMailbox::consumedStaysValid()
+{
+    WebOSKmsMailbox<int> mailbox;
+    int superseded = -1;
+
+    mailbox.publish(1, &superseded);
+    const int *state = mailbox.consume();
+    QVERIFY(state);
+
+    // The producer cycles through the other two slots meanwhile
+    for (int i = 2; i < 10; i++)
+        mailbox.publish(i, &superseded);
+    QCOMPARE(*state, 1);
+
+    state = mailbox.consume();
+    QVERIFY(state);
+    QCOMPARE(*state, 9);
+}
+
+void tst_WebOSKmsMailbox::threads()
+{
+    const int count = 100000;
+    WebOSKmsMailbox<int> mailbox;
+    QAtomicInt done;
+    int superseded = 0;
+
+    QThread *producer = QThread::create([&] {
+        int value = 0;
+        for (int i = 1; i <= count; i++) {
+            if (mailbox.publish(i, &value))
+                superseded++;
+        }
+        done.storeRelease(1);
+    });
+    producer->start();
+
+    // Every value is either consumed or handed back, in order
+    int consumed = 0;
+    int last = 0;
+    bool ordered = true;
+    for (;;) {
+        const bool finished = done.loadAcquire();
+        if (const int *state = mailbox.consume()) {
+            ordered = ordered && *state > last;
+            last = *state;
+            consumed++;
+        } else if (finished) {
+            break;
+        }
+    }
+
+    QVERIFY(producer->wait());
+    delete producer;
+
+    QVERIFY(ordered);
+    QCOMPARE(last, count);
+    QCOMPARE(consumed + superseded, count);
+}
+
+QTEST_MAIN(tst_WebOSKmsMailbox)
+
+#include "tst_weboskmsmailbox.moc"
@@ -0,0 +1,286 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+
+#include <QtTest>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <xf86drmMode.h>
+
+#include "fakedrm.h"
+#include "weboskmsatomicstate.h"
+#include "weboskmsvariablerefresh.h"
+
+// The cadence detector of the auto mode, fed with frame times directly,
+// on a connector of the simulated device
+
+static const qint64 refresh60 = 16666667;
+static const qint64 fps24 = 41666667;
+
+class tst_WebOSKmsVariableRefresh : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanup();
+    void modeFromString_data();
+    void modeFromString();
+    void notCapable();
+    void off();
+    void on();
+    void steadyCadence();
+    void fullRate();
+    void jitter();
+    void pause();
+    void hysteresis();
+    void written();
+
+private:
+    void initialize(WebOSKmsVariableRefresh *vrr, bool capable);
+    // Frames at the interval, right after a pause
+    void feed(WebOSKmsVariableRefresh *vrr, int frames, qint64 interval);
+    bool addProperties(WebOSKmsVariableRefresh *vrr, qint64 refreshInterval, int *written = nullptr);
+
+    int m_drmFd = -1;
+    qint64 m_time = 0;
+    WebOSKmsAtomicState m_state;
+};
+
+void tst_WebOSKmsVariableRefresh::init()
+{
+    m_drmFd = open(fakedrm_device_path(), O_RDWR | O_CLOEXEC);
+    QVERIFY(m_drmFd >= 0);
+    m_time = 1000000000;
+    m_state.invalidate();
+}
+
+void tst_WebOSKmsVariableRefresh::cleanup()
+{
+    close(m_drmFd);
+}
+
+void tst_WebOSKmsVariableRefresh::initialize(WebOSKmsVariableRefresh *vrr, bool capable)
+{
+    FakeDrmConfig config;
+    fakedrm_default_config(&config);
+    config.vrrCapable = capable;
+    fakedrm_configure(&config);
+
+    drmModeResPtr resources = drmModeGetResources(m_drmFd);
+    QVERIFY(resources && resources->count_connectors > 0 && resources->count_crtcs > 0);
+    vrr->initialize(m_drmFd, resources->connectors[0], resources->crtcs[0]);
+    drmModeFreeResources(resources);
+
+    QCOMPARE(vrr->isCapable(), capable);
+}
+
+void tst_WebOSKmsVariableRefresh::feed(WebOSKmsVariableRefresh *vrr, int frames, qint64 interval)
+{
+    m_time += 1000000000;
+    vrr->frameSubmitted(m_time);
+    for (int i = 0; i < frames; i++) {
+        m_time += interval;
+        vrr->frameSubmitted(m_time);
+    }
+}
+
+bool tst_WebOSKmsVariableRefresh::addProperties(WebOSKmsVariableRefresh *vrr, qint64 refreshInterval, int *written)
+{
+    drmModeAtomicReq *request = drmModeAtomicAlloc();
+    m_state.begin();
+    const bool active = vrr->addProperties(&m_state, request, refreshInterval);
+    m_state.end(true);
+    if (written)
+        *written = drmModeAtomicGetCursor(request);
+    drmModeAtomicFree(request);
+    return active;
+}
+
+void tst_WebOSKmsVariableRefresh::modeFromString_data()
+{
+    QTest::addColumn<QString>("string");
+    QTest::addColumn<int>("mode");
+
+    QTest::newRow("off") << QStringLiteral("off") << int(WebOSKmsVariableRefresh::Off);
+    QTest::newRow("auto") << QStringLiteral("auto") << int(WebOSKmsVariableRefresh::Auto);
+    QTest::newRow("on") << QStringLiteral("on") << int(WebOSKmsVariableRefresh::On);
+    QTest::newRow("empty") << QString() << int(WebOSKmsVariableRefresh::Auto);
+}
+
+void tst_WebOSKmsVariableRefresh::modeFromString()
+{
+    QFETCH(QString, string);
+    QFETCH(int, mode);
+
+    QCOMPARE(int(WebOSKmsVariableRefresh::modeFromString(string, WebOSKmsVariableRefresh::Auto)), mode);
+    const char *name = WebOSKmsVariableRefresh::modeName(WebOSKmsVariableRefresh::Mode(mode));
+    QCOMPARE(int(WebOSKmsVariableRefresh::modeFromString(QLatin1String(name))), mode);
+
+    QTest::ignoreMessage(QtWarningMsg, "Invalid vrr mode \"fast\"");
+    QCOMPARE(int(WebOSKmsVariableRefresh::modeFromString(QStringLiteral("fast"), WebOSKmsVariableRefresh::On)),
+             int(WebOSKmsVariableRefresh::On));
+}
+
+void tst_WebOSKmsVariableRefresh::notCapable()
+{
+    WebOSKmsVariableRefresh vrr;
+    initialize(&vrr, false);
+    vrr.setMode(WebOSKmsVariableRefresh::On);
+
+    int written = -1;
+    QVERIFY(!addProperties(&vrr, refresh60, &written));
+    QCOMPARE(written, 0);
+}
+
+void tst_WebOSKmsVariableRefresh::off()
+{
+    WebOSKmsVariableRefresh vrr;
+    initialize(&vrr, true);
+    QCOMPARE(int(vrr.mode()), int(WebOSKmsVariableRefresh::Off));
+
+    feed(&vrr, 16, fps24);
+    QVERIFY(!addProperties(&vrr, refresh60));
+}
+
+void tst_WebOSKmsVariableRefresh::on()
+{
+    WebOSKmsVariableRefresh vrr;
+    initialize(&vrr, true);
+    vrr.setMode(WebOSKmsVariableRefresh::On);
+
+    // Whatever the content does
+    QVERIFY(addProperties(&vrr, refresh60));
+    feed(&vrr, 16, refresh60);
+    QVERIFY(addProperties(&vrr, refresh60));
+}
+
+void tst_WebOSKmsVariableRefresh::steadyCadence()
+{
+    WebOSKmsVariableRefresh vrr;
+    initialize(&vrr, true);
+    vrr.setMode(WebOSKmsVariableRefresh::Auto);
+
+    // 24 fps content on a 60 Hz panel turns it on after 8 frames
+    feed(&vrr, 7, fps24);
+    QVERIFY(!addProperties(&vrr, refresh60));
+    m_time += fps24;
+    vrr.frameSubmitted(m_time);
+    QVERIFY(addProperties(&vrr, refresh60));
+
+    // As do 50 fps
+    feed(&vrr, 8, 20000000);
+    QVERIFY(addProperties(&vrr, refresh60));
+}
+
+void tst_WebOSKmsVariableRefresh::fullRate()
+{
+    WebOSKmsVariableRefresh vrr;
+    initialize(&vrr, true);
+    vrr.setMode(WebOSKmsVariableRefresh::Auto);
+
+    feed(&vrr, 32, refresh60);
+    QVERIFY(!addProperties(&vrr, refresh60));
+
+    // Within 10% of the refresh rate
+    feed(&vrr, 32, 18000000);
+    QVERIFY(!addProperties(&vrr, refresh60));
+}
+
+void tst_WebOSKmsVariableRefresh::jitter()
+{
+    WebOSKmsVariableRefresh vrr;
+    initialize(&vrr, true);
+    vrr.setMode(WebOSKmsVariableRefresh::Auto);
+
+    feed(&vrr, 8, fps24);
+    QVERIFY(addProperties(&vrr, refresh60));
+
+    // One frame far off the average is enough to turn it off
+    m_time += 10000000;
+    vrr.frameSubmitted(m_time);
+    QVERIFY(!addProperties(&vrr, refresh60));
+
+    // Irregular frames keep it off
+    for (int i = 0; i < 32; i++) {
+        m_time += i % 2 ? 20000000 : 60000000;
+        vrr.frameSubmitted(m_time);
+    }
+    QVERIFY(!addProperties(&vrr, refresh60));
+}
+
+void tst_WebOSKmsVariableRefresh::pause()
+{
+    WebOSKmsVariableRefresh vrr;
+    initialize(&vrr, true);
+    vrr.setMode(WebOSKmsVariableRefresh::Auto);
+
+    feed(&vrr, 8, fps24);
+    QVERIFY(addProperties(&vrr, refresh60));
+
+    // Starts over after a pause
+    m_time += 500000000;
+    vrr.frameSubmitted(m_time);
+    QVERIFY(!addProperties(&vrr, refresh60));
+}
+
+void tst_WebOSKmsVariableRefresh::hysteresis()
+{
+    WebOSKmsVariableRefresh vrr;
+    initialize(&vrr, true);
+    vrr.setMode(WebOSKmsVariableRefresh::Auto);
+
+    // Below 10% slower than the refresh rate it is not turned on
+    const qint64 interval = 17900000;
+    feed(&vrr, 16, interval);
+    QVERIFY(!addProperties(&vrr, refresh60));
+
+    // but above 5% it stays on
+    vrr.setMode(WebOSKmsVariableRefresh::On);
+    QVERIFY(addProperties(&vrr, refresh60));
+    vrr.setMode(WebOSKmsVariableRefresh::Auto);
+    QVERIFY(addProperties(&vrr, refresh60));
+
+    feed(&vrr, 16, refresh60);
+    QVERIFY(!addProperties(&vrr, refresh60));
+}
+
+void tst_WebOSKmsVariableRefresh::written()
+{
+    WebOSKmsVariableRefresh vrr;
+    initialize(&vrr, true);
+    vrr.setMode(WebOSKmsVariableRefresh::Auto);
+
+    // VRR_ENABLED is only written when it changes
+    int written = -1;
+    QVERIFY(!addProperties(&vrr, refresh60, &written));
+    QCOMPARE(written, 1);
+    QVERIFY(!addProperties(&vrr, refresh60, &written));
+    QCOMPARE(written, 0);
+
+    feed(&vrr, 8, fps24);
+    QVERIFY(addProperties(&vrr, refresh60, &written));
+    QCOMPARE(written, 1);
+    QVERIFY(addProperties(&vrr, refresh60, &written));
+    QCOMPARE(written, 0);
+}
+
+QTEST_MAIN(tst_WebOSKmsVariableRefresh)
+
+#include "tst_weboskmsvariablerefresh.moc"
@@ -0,0 +1,597 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <drm_fourcc.h>
+
+#include "fakedrm_p.h"
+
+// The libdrm entry points the plugins and Qt use. drmMode* calls return
+// -errno like libdrm does, the drm* ones -1 with errno set.
+
+struct _drmModeAtomicReq {
+    std::vector<FakeDrmDevice::AtomicItem> items;
+    int cursor = 0;
+};
+
+static FakeDrmDevice &device()
+{
+    return FakeDrmDevice::instance();
+}
+
+static int modeResult(int ret)
+{
+    if (ret < 0)
+        errno = -ret;
+    return ret;
+}
+
+static int ioctlResult(int ret)
+{
+    if (ret < 0) {
+        errno = -ret;
+        return -1;
+    }
+    return 0;
+}
+
+extern "C" {
+
+void fakedrm_default_config(FakeDrmConfig *config)
+{
+    *config = FakeDrmDevice::defaultConfig();
+}
+
+void fakedrm_configure(const FakeDrmConfig *config)
+{
+    device().configure(*config);
+}
+
+const char *fakedrm_device_path(void)
+{
+    return device().devicePath();
+}
+
+void fakedrm_stats(FakeDrmStats *stats)
+{
+    *stats = device().stats();
+}
+
+void fakedrm_reset_stats(void)
+{
+    device().resetStats();
+}
+
+void fakedrm_fail_commits(int count, int error)
+{
+    device().failCommits(count, error);
+}
+
+int fakedrm_plane_count(void)
+{
+    return device().planeCount();
+}
+
+int fakedrm_plane_state(int index, FakeDrmPlaneState *state)
+{
+    return device().planeState(index, state) ? 1 : 0;
+}
+
+int fakedrm_crtc_refresh(int crtcIndex)
+{
+    return device().crtcRefresh(crtcIndex);
+}
+
+uint64_t fakedrm_crtc_sequence(int crtcIndex)
+{
+    return device().crtcSequence(crtcIndex);
+}
+
+int drmAvailable(void)
+{
+    return 1;
+}
+
+drmVersionPtr drmGetVersion(int fd)
+{
+    (void)fd;
+    device().countIoctl();
+    drmVersionPtr version = static_cast<drmVersionPtr>(calloc(1, sizeof(drmVersion)));
+    version->version_major = 1;
+    version->name = strdup("fakedrm");
+    version->name_len = strlen(version->name);
+    version->date = strdup("20240101");
+    version->date_len = strlen(version->date);
+    version->desc = strdup("Simulated DRM device");
+    version->desc_len = strlen(version->desc);
+    return version;
+}
+
+void drmFreeVersion(drmVersionPtr version)
+{
+    if (!version)
+        return;
+    free(version->name);
+    free(version->date);
+    free(version->desc);
+    free(version);
+}
+
+int drmSetMaster(int fd)
+{
+    (void)fd;
+    return device().countIoctl();
+}
+
+int drmDropMaster(int fd)
+{
+    (void)fd;
+    return device().countIoctl();
+}
+
+int drmIsMaster(int fd)
+{
+    (void)fd;
+    return 1;
+}
+
+int drmSetClientCap(int fd, uint64_t capability, uint64_t value)
+{
+    (void)fd;
+    return ioctlResult(device().setClientCap(capability, value));
+}
+
+int drmGetCap(int fd, uint64_t capability, uint64_t *value)
+{
+    (void)fd;
+    return ioctlResult(device().getCap(capability, value));
+}
+
+int drmIoctl(int fd, unsigned long request, void *arg)
+{
+    switch (request) {
+    case DRM_IOCTL_GEM_CLOSE:
+        return ioctlResult(device().closeHandle(static_cast<drm_gem_close *>(arg)->handle));
+    case DRM_IOCTL_PRIME_FD_TO_HANDLE: {
+        drm_prime_handle *prime = static_cast<drm_prime_handle *>(arg);
+        return ioctlResult(device().primeFdToHandle(prime->fd, &prime->handle));
+    }
+    case DRM_IOCTL_PRIME_HANDLE_TO_FD: {
+        drm_prime_handle *prime = static_cast<drm_prime_handle *>(arg);
+        int primeFd = -1;
+        const int ret = device().primeHandleToFd(prime->handle, &primeFd);
+        prime->fd = primeFd;
+        return ioctlResult(ret);
+    }
+    case DRM_IOCTL_MODE_ADDFB2:
+        return ioctlResult(device().addFramebuffer(static_cast<drm_mode_fb_cmd2 *>(arg)));
+    case DRM_IOCTL_MODE_RMFB:
+        return ioctlResult(device().removeFramebuffer(*static_cast<unsigned int *>(arg)));
+    case DRM_IOCTL_MODE_ATOMIC: {
+        const drm_mode_atomic *atomic = static_cast<const drm_mode_atomic *>(arg);
+        const uint32_t *objects = reinterpret_cast<const uint32_t *>(uintptr_t(atomic->objs_ptr));
+        const uint32_t *counts = reinterpret_cast<const uint32_t *>(uintptr_t(atomic->count_props_ptr));
+        const uint32_t *properties = reinterpret_cast<const uint32_t *>(uintptr_t(atomic->props_ptr));
+        const uint64_t *values = reinterpret_cast<const uint64_t *>(uintptr_t(atomic->prop_values_ptr));
+        std::vector<FakeDrmDevice::AtomicItem> items;
+        for (uint32_t i = 0, k = 0; i < atomic->count_objs; ++i) {
+            for (uint32_t j = 0; j < counts[i]; ++j, ++k)
+                items.push_back({ objects[i], properties[k], values[k] });
+        }
+        return ioctlResult(device().atomicCommit(fd, items, atomic->flags,
+                                                 reinterpret_cast<void *>(uintptr_t(atomic->user_data))));
+    }
+    default:
+        device().countIoctl();
+        errno = EINVAL;
+        return -1;
+    }
+}
+
+drmModeResPtr drmModeGetResources(int fd)
+{
+    (void)fd;
+    return device().getResources();
+}
+
+void drmModeFreeResources(drmModeResPtr ptr)
+{
+    if (!ptr)
+        return;
+    free(ptr->fbs);
+    free(ptr->crtcs);
+    free(ptr->connectors);
+    free(ptr->encoders);
+    free(ptr);
+}
+
+drmModeConnectorPtr drmModeGetConnector(int fd, uint32_t connectorId)
+{
+    (void)fd;
+    return device().getConnector(connectorId);
+}
+
+drmModeConnectorPtr drmModeGetConnectorCurrent(int fd, uint32_t connectorId)
+{
+    (void)fd;
+    return device().getConnector(connectorId);
+}
+
+void drmModeFreeConnector(drmModeConnectorPtr ptr)
+{
+    if (!ptr)
+        return;
+    free(ptr->modes);
+    free(ptr->props);
+    free(ptr->prop_values);
+    free(ptr->encoders);
+    free(ptr);
+}
+
+void drmModeFreeModeInfo(drmModeModeInfoPtr ptr)
+{
+    free(ptr);
+}
+
+drmModeEncoderPtr drmModeGetEncoder(int fd, uint32_t encoderId)
+{
+    (void)fd;
+    return device().getEncoder(encoderId);
+}
+
+void drmModeFreeEncoder(drmModeEncoderPtr ptr)
+{
+    free(ptr);
+}
+
+drmModeCrtcPtr drmModeGetCrtc(int fd, uint32_t crtcId)
+{
+    (void)fd;
+    return device().getCrtc(crtcId);
+}
+
+void drmModeFreeCrtc(drmModeCrtcPtr ptr)
+{
+    free(ptr);
+}
+
+drmModePlaneResPtr drmModeGetPlaneResources(int fd)
+{
+    (void)fd;
+    return device().getPlaneResources();
+}
+
+void drmModeFreePlaneResources(drmModePlaneResPtr ptr)
+{
+    if (!ptr)
+        return;
+    free(ptr->planes);
+    free(ptr);
+}
+
+drmModePlanePtr drmModeGetPlane(int fd, uint32_t planeId)
+{
+    (void)fd;
+    return device().getPlane(planeId);
+}
+
+void drmModeFreePlane(drmModePlanePtr ptr)
+{
+    if (!ptr)
+        return;
+    free(ptr->formats);
+    free(ptr);
+}
+
+drmModeObjectPropertiesPtr drmModeObjectGetProperties(int fd, uint32_t objectId, uint32_t objectType)
+{
+    (void)fd;
+    return device().getObjectProperties(objectId, objectType);
+}
+
+void drmModeFreeObjectProperties(drmModeObjectPropertiesPtr ptr)
+{
+    if (!ptr)
+        return;
+    free(ptr->props);
+    free(ptr->prop_values);
+    free(ptr);
+}
+
+drmModePropertyPtr drmModeGetProperty(int fd, uint32_t propertyId)
+{
+    (void)fd;
+    return device().getProperty(propertyId);
+}
+
+void drmModeFreeProperty(drmModePropertyPtr ptr)
+{
+    if (!ptr)
+        return;
+    free(ptr->values);
+    free(ptr->enums);
+    free(ptr->blob_ids);
+    free(ptr);
+}
+
+drmModePropertyBlobPtr drmModeGetPropertyBlob(int fd, uint32_t blobId)
+{
+    (void)fd;
+    return device().getBlob(blobId);
+}
+
+void drmModeFreePropertyBlob(drmModePropertyBlobPtr ptr)
+{
+    if (!ptr)
+        return;
+    free(ptr->data);
+    free(ptr);
+}
+
+int drmModeCreatePropertyBlob(int fd, const void *data, size_t size, uint32_t *id)
+{
+    (void)fd;
+    return modeResult(device().createBlob(data, size, id));
+}
+
+int drmModeDestroyPropertyBlob(int fd, uint32_t id)
+{
+    (void)fd;
+    return modeResult(device().destroyBlob(id));
+}
+
+drmModeFBPtr drmModeGetFB(int fd, uint32_t bufferId)
+{
+    (void)fd;
+    return device().getFramebuffer(bufferId);
+}
+
+void drmModeFreeFB(drmModeFBPtr ptr)
+{
+    free(ptr);
+}
+
+int drmModeAddFB2WithModifiers(int fd, uint32_t width, uint32_t height, uint32_t pixelFormat,
+                               const uint32_t boHandles[4], const uint32_t pitches[4], const uint32_t offsets[4],
+                               const uint64_t modifier[4], uint32_t *bufId, uint32_t flags)
+{
+    (void)fd;
+    drm_mode_fb_cmd2 cmd;
+    memset(&cmd, 0, sizeof cmd);
+    cmd.width = width;
+    cmd.height = height;
+    cmd.pixel_format = pixelFormat;
+    cmd.flags = flags;
+    memcpy(cmd.handles, boHandles, sizeof cmd.handles);
+    memcpy(cmd.pitches, pitches, sizeof cmd.pitches);
+    memcpy(cmd.offsets, offsets, sizeof cmd.offsets);
+    if (modifier)
+        memcpy(cmd.modifier, modifier, sizeof cmd.modifier);
+    const int ret = device().addFramebuffer(&cmd);
+    if (!ret)
+        *bufId = cmd.fb_id;
+    return modeResult(ret);
+}
+
+int drmModeAddFB2(int fd, uint32_t width, uint32_t height, uint32_t pixelFormat, const uint32_t boHandles[4],
+                  const uint32_t pitches[4], const uint32_t offsets[4], uint32_t *bufId, uint32_t flags)
+{
+    return drmModeAddFB2WithModifiers(fd, width, height, pixelFormat, boHandles, pitches, offsets,
+                                      nullptr, bufId, flags & ~DRM_MODE_FB_MODIFIERS);
+}
+
+int drmModeAddFB(int fd, uint32_t width, uint32_t height, uint8_t depth, uint8_t bpp, uint32_t pitch,
+                 uint32_t boHandle, uint32_t *bufId)
+{
+    uint32_t format = 0;
+    if (bpp == 32 && depth == 24)
+        format = DRM_FORMAT_XRGB8888;
+    else if (bpp == 32 && depth == 32)
+        format = DRM_FORMAT_ARGB8888;
+    else if (bpp == 32 && depth == 30)
+        format = DRM_FORMAT_XRGB2101010;
+    else if (bpp == 16 && depth == 16)
+        format = DRM_FORMAT_RGB565;
+    if (!format) {
+        device().countIoctl();
+        return modeResult(-EINVAL);
+    }
+    const uint32_t handles[4] = { boHandle, 0, 0, 0 };
+    const uint32_t pitches[4] = { pitch, 0, 0, 0 };
+    const uint32_t offsets[4] = { 0, 0, 0, 0 };
+    return drmModeAddFB2(fd, width, height, format, handles, pitches, offsets, bufId, 0);
+}
+
+int drmModeRmFB(int fd, uint32_t bufferId)
+{
+    (void)fd;
+    return modeResult(device().removeFramebuffer(bufferId));
+}
+
+int drmModeSetCrtc(int fd, uint32_t crtcId, uint32_t bufferId, uint32_t x, uint32_t y,
+                   uint32_t *connectors, int count, drmModeModeInfoPtr mode)
+{
+    (void)fd;
+    (void)x;
+    (void)y;
+    return modeResult(device().setCrtc(crtcId, bufferId, connectors, count, mode));
+}
+
+int drmModePageFlip(int fd, uint32_t crtcId, uint32_t fbId, uint32_t flags, void *userData)
+{
+    return modeResult(device().pageFlip(fd, crtcId, fbId, flags, userData));
+}
+
+int drmModeSetPlane(int fd, uint32_t planeId, uint32_t crtcId, uint32_t fbId, uint32_t flags,
+                    int32_t crtcX, int32_t crtcY, uint32_t crtcW, uint32_t crtcH,
+                    uint32_t srcX, uint32_t srcY, uint32_t srcW, uint32_t srcH)
+{
+    (void)fd;
+    (void)flags;
+    const std::vector<uint64_t> geometry { uint64_t(int64_t(crtcX)), uint64_t(int64_t(crtcY)), crtcW, crtcH,
+                                           srcX, srcY, srcW, srcH };
+    return modeResult(device().setPlane(planeId, crtcId, fbId, geometry));
+}
+
+int drmModeSetCursor(int fd, uint32_t crtcId, uint32_t boHandle, uint32_t width, uint32_t height)
+{
+    (void)fd;
+    (void)crtcId;
+    (void)boHandle;
+    (void)width;
+    (void)height;
+    return device().countIoctl();
+}
+
+int drmModeSetCursor2(int fd, uint32_t crtcId, uint32_t boHandle, uint32_t width, uint32_t height,
+                      int32_t hotX, int32_t hotY)
+{
+    (void)hotX;
+    (void)hotY;
+    return drmModeSetCursor(fd, crtcId, boHandle, width, height);
+}
+
+int drmModeMoveCursor(int fd, uint32_t crtcId, int x, int y)
+{
+    (void)fd;
+    (void)crtcId;
+    (void)x;
+    (void)y;
+    return device().countIoctl();
+}
+
+int drmModeConnectorSetProperty(int fd, uint32_t connectorId, uint32_t propertyId, uint64_t value)
+{
+    (void)fd;
+    return modeResult(device().setObjectProperty(connectorId, propertyId, value));
+}
+
+int drmModeObjectSetProperty(int fd, uint32_t objectId, uint32_t objectType, uint32_t propertyId, uint64_t value)
+{
+    (void)fd;
+    (void)objectType;
+    return modeResult(device().setObjectProperty(objectId, propertyId, value));
+}
+
+drmModeAtomicReqPtr drmModeAtomicAlloc(void)
+{
+    return new drmModeAtomicReq;
+}
+
+drmModeAtomicReqPtr drmModeAtomicDuplicate(const drmModeAtomicReqPtr req)
+{
+    if (!req)
+        return nullptr;
+    drmModeAtomicReqPtr copy = new drmModeAtomicReq;
+    copy->items.assign(req->items.begin(), req->items.begin() + req->cursor);
+    copy->cursor = req->cursor;
+    return copy;
+}
+
+int drmModeAtomicMerge(drmModeAtomicReqPtr base, const drmModeAtomicReqPtr augment)
+{
+    if (!base)
+        return -EINVAL;
+    if (!augment || !augment->cursor)
+        return 0;
+    base->items.resize(base->cursor);
+    base->items.insert(base->items.end(), augment->items.begin(), augment->items.begin() + augment->cursor);
+    base->cursor = base->items.size();
+    return 0;
+}
+
+void drmModeAtomicFree(drmModeAtomicReqPtr req)
+{
+    delete req;
+}
+
+int drmModeAtomicGetCursor(const drmModeAtomicReqPtr req)
+{
+    return req ? req->cursor : -EINVAL;
+}
+
+void drmModeAtomicSetCursor(drmModeAtomicReqPtr req, int cursor)
+{
+    if (req && cursor >= 0 && cursor <= req->cursor)
+        req->cursor = cursor;
+}
+
+int drmModeAtomicAddProperty(drmModeAtomicReqPtr req, uint32_t objectId, uint32_t propertyId, uint64_t value)
+{
+    if (!req)
+        return -EINVAL;
+    // Items past the cursor were rolled back
+    req->items.resize(req->cursor);
+    req->items.push_back({ objectId, propertyId, value });
+    return ++req->cursor;
+}
+
+int drmModeAtomicCommit(int fd, const drmModeAtomicReqPtr req, uint32_t flags, void *userData)
+{
+    if (!req)
+        return -EINVAL;
+    if (!req->cursor)
+        return 0;
+    const std::vector<FakeDrmDevice::AtomicItem> items(req->items.begin(), req->items.begin() + req->cursor);
+    return modeResult(device().atomicCommit(fd, items, flags, userData));
+}
+
+int drmWaitVBlank(int fd, drmVBlankPtr vbl)
+{
+    return ioctlResult(device().waitVBlank(fd, vbl));
+}
+
+int drmCrtcGetSequence(int fd, uint32_t crtcId, uint64_t *sequence, uint64_t *ns)
+{
+    (void)fd;
+    return ioctlResult(device().crtcGetSequence(crtcId, sequence, ns));
+}
+
+int drmCrtcQueueSequence(int fd, uint32_t crtcId, uint32_t flags, uint64_t sequence,
+                         uint64_t *sequenceQueued, uint64_t userData)
+{
+    return ioctlResult(device().crtcQueueSequence(fd, crtcId, flags, sequence, sequenceQueued, userData));
+}
+
+int drmHandleEvent(int fd, drmEventContextPtr context)
+{
+    return device().handleEvent(fd, context);
+}
+
+int drmPrimeFDToHandle(int fd, int primeFd, uint32_t *handle)
+{
+    (void)fd;
+    return ioctlResult(device().primeFdToHandle(primeFd, handle));
+}
+
+int drmPrimeHandleToFD(int fd, uint32_t handle, uint32_t flags, int *primeFd)
+{
+    (void)fd;
+    (void)flags;
+    return ioctlResult(device().primeHandleToFd(handle, primeFd));
+}
+
+int drmCloseBufferHandle(int fd, uint32_t handle)
+{
+    (void)fd;
+    return ioctlResult(device().closeHandle(handle));
+}
+
+}
@@ -0,0 +1,118 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+#ifndef FAKEDRM_H
+#define FAKEDRM_H
+
+#include <stdint.h>
+
+// Control interface of libfakedrm, a link-time stand-in for libdrm,
+// libgbm, EGL and GLESv2. It simulates one DRM device with connectors,
+// CRTCs, planes, atomic commits and a vblank clock, so that the display
+// plugins run end to end without hardware.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct FakeDrmConfig {
+    // Connected HDMI connectors, each with its own CRTC
+    int connectors;
+    // Per CRTC, besides the primary plane
+    int overlayPlanes;
+    int cursorPlane;
+    // Preferred mode, other rates of the same size are listed too
+    int width;
+    int height;
+    int refreshRate;
+    // Whether DRM_CLIENT_CAP_ATOMIC is accepted
+    int atomic;
+    int vrrCapable;
+};
+
+struct FakeDrmStats {
+    // Every call that enters the kernel on a real device
+    uint64_t ioctls;
+    // Applied commits, TEST_ONLY ones are counted apart
+    uint64_t atomicCommits;
+    uint64_t testCommits;
+    uint64_t testFailures;
+    // Failed with an error other than EBUSY
+    uint64_t rejectedCommits;
+    uint64_t busyCommits;
+    uint64_t pageFlips;
+    uint64_t propertiesWritten;
+    uint64_t vblanks;
+    uint64_t flipEvents;
+    uint64_t vblankEvents;
+    uint64_t framebuffersAdded;
+    uint64_t framebuffersRemoved;
+    uint64_t primeImports;
+    uint64_t gemCloses;
+    uint64_t blobsCreated;
+    uint64_t blobsDestroyed;
+    uint64_t inFences;
+    uint64_t outFences;
+    uint64_t bufferObjectsCreated;
+    uint64_t swapBuffers;
+    uint64_t damageRects;
+    // Alive at the time of the call, not reset
+    uint64_t framebuffers;
+    uint64_t bufferObjects;
+};
+
+struct FakeDrmPlaneState {
+    uint32_t id;
+    // DRM_PLANE_TYPE_*
+    uint32_t type;
+    uint32_t crtcId;
+    // Latched at the last vblank of the CRTC
+    uint32_t fbId;
+    int32_t crtcX;
+    int32_t crtcY;
+    uint32_t crtcWidth;
+    uint32_t crtcHeight;
+    uint64_t zpos;
+};
+
+void fakedrm_default_config(struct FakeDrmConfig *config);
+// Rebuilds the device, call it before the platform plugin opens it
+void fakedrm_configure(const struct FakeDrmConfig *config);
+// A FIFO standing in for /dev/dri/card0, removed at exit
+const char *fakedrm_device_path(void);
+
+void fakedrm_stats(struct FakeDrmStats *stats);
+void fakedrm_reset_stats(void);
+
+// The next count commits without TEST_ONLY fail with -error
+void fakedrm_fail_commits(int count, int error);
+
+int fakedrm_plane_count(void);
+int fakedrm_plane_state(int index, struct FakeDrmPlaneState *state);
+// Refresh rate of the current mode in mHz, 0 while the CRTC is off
+int fakedrm_crtc_refresh(int crtcIndex);
+uint64_t fakedrm_crtc_sequence(int crtcIndex);
+
+// Nonzero while the calling thread runs code that stands for the kernel,
+// so allocation counters can leave it out
+int fakedrm_in_kernel(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
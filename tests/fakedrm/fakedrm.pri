@@ -0,0 +1,32 @@
+# Copyright (c) 2024 LG Electronics, Inc.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+# http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# SPDX-License-Identifier: Apache-2.0
+
+# Links libfakedrm ahead of every other library, so that its libdrm, gbm,
+# EGL and GLES symbols win over the real ones for the executable and for
+# the plugins it loads later on.
+
+equals(QT_MAJOR_VERSION, 6) {
+    QMAKE_INCDIR_DRM = $$[QT_SYSROOT]/usr/include/libdrm
+}
+
+# fakedrm.h and the headers of the libraries it replaces
+INCLUDEPATH += $$PWD $$QMAKE_INCDIR_DRM $$QMAKE_INCDIR_GBM $$QMAKE_INCDIR_EGL
+
+FAKEDRM_LIBDIR = $$shadowed($$PWD)
+
+QMAKE_LFLAGS += -L$$FAKEDRM_LIBDIR -Wl,--no-as-needed -lfakedrm -Wl,--as-needed
+QMAKE_RPATHDIR += $$FAKEDRM_LIBDIR
+PRE_TARGETDEPS += $$FAKEDRM_LIBDIR/libfakedrm.so
@@ -0,0 +1,49 @@
+# Copyright (c) 2024 LG Electronics, Inc.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+# http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# SPDX-License-Identifier: Apache-2.0
+
+# libfakedrm stands in for libdrm, libgbm, EGL and GLESv2 at link time,
+# see fakedrm.pri for how the tests pull it in.
+
+TEMPLATE = lib
+TARGET = fakedrm
+
+CONFIG -= qt
+CONFIG += c++14 thread warn_on
+# Every libdrm, gbm and EGL symbol has to be exported
+CONFIG -= hide_symbols
+
+equals(QT_MAJOR_VERSION, 6) {
+    QMAKE_INCDIR_DRM = $$[QT_SYSROOT]/usr/include/libdrm
+}
+
+# Headers only, the library provides the symbols itself
+INCLUDEPATH += $$QMAKE_INCDIR_DRM $$QMAKE_INCDIR_GBM $$QMAKE_INCDIR_EGL $$QMAKE_INCDIR_OPENGL_ES2
+
+# Generic EGL native types, as the plugins use
+DEFINES += EGL_NO_X11 MESA_EGL_NO_X11_HEADERS
+
+plane_composition {
+    DEFINES += PLANE_COMPOSITION
+}
+
+SOURCES += $$PWD/fakedrm.cpp \
+           $$PWD/fakedrmdevice.cpp \
+           $$PWD/fakeegl.cpp \
+           $$PWD/fakegbm.cpp \
+           $$PWD/fakegles.cpp
+
+HEADERS += $$PWD/fakedrm.h \
+           $$PWD/fakedrm_p.h
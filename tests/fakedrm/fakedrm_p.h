@@ -0,0 +1,313 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+#ifndef FAKEDRM_P_H
+#define FAKEDRM_P_H
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+
+#include "fakedrm.h"
+
+struct gbm_surface;
+
+// The simulated device behind the libdrm entry points. Every method that
+// stands for an ioctl counts one and returns 0 or -errno. All state is
+// guarded by one mutex, a vblank thread latches queued commits.
+class FakeDrmDevice
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    struct AtomicItem {
+        uint32_t object;
+        uint32_t property;
+        uint64_t value;
+    };
+
+    static FakeDrmDevice &instance();
+    static FakeDrmConfig defaultConfig();
+
+    void configure(const FakeDrmConfig &config);
+    const char *devicePath();
+
+    FakeDrmStats stats();
+    void resetStats();
+    void failCommits(int count, int error);
+    int planeCount();
+    bool planeState(int index, FakeDrmPlaneState *state);
+    int crtcRefresh(int crtcIndex);
+    uint64_t crtcSequence(int crtcIndex);
+
+    int setClientCap(uint64_t capability, uint64_t value);
+    int getCap(uint64_t capability, uint64_t *value);
+
+    drmModeResPtr getResources();
+    drmModeConnectorPtr getConnector(uint32_t id);
+    drmModeEncoderPtr getEncoder(uint32_t id);
+    drmModeCrtcPtr getCrtc(uint32_t id);
+    drmModePlaneResPtr getPlaneResources();
+    drmModePlanePtr getPlane(uint32_t id);
+    drmModeObjectPropertiesPtr getObjectProperties(uint32_t id, uint32_t type);
+    drmModePropertyPtr getProperty(uint32_t id);
+    drmModePropertyBlobPtr getBlob(uint32_t id);
+    drmModeFBPtr getFramebuffer(uint32_t id);
+
+    int createBlob(const void *data, size_t size, uint32_t *id);
+    int destroyBlob(uint32_t id);
+    int addFramebuffer(drm_mode_fb_cmd2 *cmd);
+    int removeFramebuffer(uint32_t id);
+    int primeFdToHandle(int primeFd, uint32_t *handle);
+    int primeHandleToFd(uint32_t handle, int *primeFd);
+    int closeHandle(uint32_t handle);
+
+    int atomicCommit(int fd, const std::vector<AtomicItem> &items, uint32_t flags, void *userData);
+    int setObjectProperty(uint32_t object, uint32_t property, uint64_t value);
+    int pageFlip(int fd, uint32_t crtcId, uint32_t fbId, uint32_t flags, void *userData);
+    int setCrtc(uint32_t crtcId, uint32_t fbId, const uint32_t *connectors, int count, const drmModeModeInfo *mode);
+    int setPlane(uint32_t planeId, uint32_t crtcId, uint32_t fbId, const std::vector<uint64_t> &geometry);
+    int countIoctl();
+
+    int waitVBlank(int fd, drmVBlank *vbl);
+    int crtcGetSequence(uint32_t crtcId, uint64_t *sequence, uint64_t *ns);
+    int crtcQueueSequence(int fd, uint32_t crtcId, uint32_t flags, uint64_t sequence, uint64_t *queued, uint64_t userData);
+    int handleEvent(int fd, drmEventContext *context);
+
+    // For the gbm and EGL stand-ins
+    uint32_t createBuffer(int dmabufFd);
+    void destroyBuffer(uint32_t handle);
+    void countSwap(int damageRects);
+
+private:
+    enum Property {
+        PlaneType,
+        PlaneFbId,
+        PlaneCrtcId,
+        PlaneSrcX,
+        PlaneSrcY,
+        PlaneSrcW,
+        PlaneSrcH,
+        PlaneCrtcX,
+        PlaneCrtcY,
+        PlaneCrtcW,
+        PlaneCrtcH,
+        PlaneZpos,
+        PlaneInFormats,
+        PlaneInFenceFd,
+        PlaneBlendOp,
+        PlaneScalingFilter,
+        PlaneFbTranslationMode,
+        CrtcActive,
+        CrtcModeId,
+        CrtcOutFencePtr,
+        CrtcVrrEnabled,
+        ConnectorCrtcId,
+        ConnectorDpms,
+        ConnectorEdid,
+        ConnectorVrrCapable,
+        PropertyCount
+    };
+
+    struct PropertyDef {
+        uint32_t id;
+        uint32_t objectType;
+        std::string name;
+        uint32_t flags;
+        std::vector<uint64_t> values;
+        std::vector<std::pair<uint64_t, std::string>> enums;
+    };
+
+    struct Object {
+        uint32_t id = 0;
+        uint32_t type = 0;
+        // Property id and value, in the order they are listed
+        std::vector<std::pair<uint32_t, uint64_t>> properties;
+    };
+
+    struct Connector : Object {
+        uint32_t typeId = 0;
+        uint32_t encoderId = 0;
+        std::vector<drmModeModeInfo> modes;
+    };
+
+    struct Encoder {
+        uint32_t id = 0;
+        uint32_t crtcId = 0;
+        uint32_t possibleCrtcs = 0;
+    };
+
+    struct Crtc : Object {
+        int index = 0;
+        bool active = false;
+        drmModeModeInfo mode {};
+        uint64_t sequence = 0;
+        Clock::time_point lastVblank;
+        Clock::time_point nextVblank;
+        // A commit waits for the next vblank
+        bool pending = false;
+        // Mode of the legacy drmModeSetCrtc()
+        uint32_t legacyModeBlob = 0;
+    };
+
+    struct Plane : Object {
+        uint32_t planeType = 0;
+        uint32_t possibleCrtcs = 0;
+        bool canScale = false;
+        std::vector<uint32_t> formats;
+        // What the plane shows since the last vblank of its CRTC
+        uint32_t scanout = 0;
+        int scanoutCrtc = -1;
+    };
+
+    struct Blob {
+        std::vector<uint8_t> data;
+        bool immutable = false;
+        // Kept while a CRTC still uses it
+        bool destroyed = false;
+    };
+
+    struct Framebuffer {
+        uint32_t width = 0;
+        uint32_t height = 0;
+        uint32_t format = 0;
+        uint64_t modifier = 0;
+        uint32_t pitch = 0;
+        uint32_t handle = 0;
+    };
+
+    struct Buffer {
+        dev_t device = 0;
+        ino_t inode = 0;
+        // Not owned, for PRIME exports
+        int fd = -1;
+    };
+
+    struct PendingCommit {
+        int crtcIndex = 0;
+        int fd = -1;
+        bool event = false;
+        void *userData = nullptr;
+        int outFence = -1;
+        std::vector<int> inFences;
+        // Planes to show from the next vblank on
+        struct Latch {
+            uint32_t planeId;
+            uint32_t fbId;
+            int crtcIndex;
+        };
+        std::vector<Latch> latch;
+    };
+
+    struct VblankRequest {
+        int fd = -1;
+        int crtcIndex = 0;
+        uint64_t sequence = 0;
+        uint64_t userData = 0;
+        bool crtcSequence = false;
+    };
+
+    struct Event {
+        enum Type { PageFlip, Vblank, Sequence } type = PageFlip;
+        int fd = -1;
+        uint32_t crtcId = 0;
+        uint64_t sequence = 0;
+        Clock::time_point time;
+        uint64_t userData = 0;
+    };
+
+    FakeDrmDevice();
+    void run();
+
+    void build();
+    uint32_t addProperty(Property property, uint32_t objectType, const char *name, uint32_t flags,
+                         const std::vector<uint64_t> &values = std::vector<uint64_t>(),
+                         const std::vector<std::pair<uint64_t, std::string>> &enums = std::vector<std::pair<uint64_t, std::string>>());
+    uint32_t addBlob(const void *data, size_t size, bool immutable);
+    const PropertyDef *findProperty(uint32_t id) const;
+    Object *findObject(uint32_t id);
+    Crtc *findCrtc(uint32_t id);
+    Plane *findPlane(uint32_t id);
+    Connector *findConnector(uint32_t id);
+    Plane *primaryPlane(const Crtc &crtc);
+    static uint64_t value(const Object &object, uint32_t property);
+    static void setValue(Object *object, uint32_t property, uint64_t value);
+    uint32_t propertyId(Property property) const { return m_propertyIds[property]; }
+    bool validValue(const PropertyDef &def, uint64_t value);
+    int crtcIndexForId(uint64_t id);
+    bool busy(uint32_t crtcMask) const;
+    void collectBlobs();
+
+    int commitLocked(std::unique_lock<std::mutex> &lock, int fd, const std::vector<AtomicItem> &items,
+                     uint32_t flags, void *userData);
+    void vblank(Crtc *crtc, Clock::time_point time);
+    void latch(const PendingCommit &commit);
+    void queueEvent(const Event &event);
+    static Clock::duration framePeriod(const drmModeModeInfo &mode);
+
+    std::mutex m_mutex;
+    std::condition_variable m_changed;
+    FakeDrmConfig m_config {};
+    FakeDrmStats m_stats {};
+    std::string m_devicePath;
+    bool m_atomic = false;
+    bool m_universalPlanes = false;
+    int m_failCommits = 0;
+    int m_failError = 0;
+
+    uint32_t m_nextId = 1;
+    uint32_t m_nextHandle = 1;
+    uint32_t m_propertyIds[PropertyCount] {};
+    std::vector<PropertyDef> m_properties;
+    std::vector<Connector> m_connectors;
+    std::vector<Encoder> m_encoders;
+    std::vector<Crtc> m_crtcs;
+    std::vector<Plane> m_planes;
+    std::map<uint32_t, Blob> m_blobs;
+    std::map<uint32_t, Framebuffer> m_framebuffers;
+    std::map<uint32_t, Buffer> m_buffers;
+    std::vector<PendingCommit> m_pending;
+    std::vector<VblankRequest> m_vblankRequests;
+    std::deque<Event> m_events;
+};
+
+// Marks code that runs in the kernel on a real device
+class FakeDrmKernelScope
+{
+public:
+    FakeDrmKernelScope();
+    ~FakeDrmKernelScope();
+};
+
+// Shared by the gbm and EGL stand-ins
+void fakegbm_surface_size(gbm_surface *surface, int *width, int *height);
+bool fakegbm_surface_swap(gbm_surface *surface);
+int fakegbm_surface_buffer_age(gbm_surface *surface);
+
+// GLES entry points for eglGetProcAddress(), a stub for unknown gl* names
+typedef void (*FakeGlProc)();
+FakeGlProc fakegles_proc_address(const char *name);
+
+#endif
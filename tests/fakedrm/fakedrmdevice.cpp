@@ -0,0 +1,1759 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <limits>
+#include <thread>
+
+#include <drm_fourcc.h>
+
+#include "fakedrm_p.h"
+
+// DRM_CRTC_SEQUENCE_* of drm.h, not in every libdrm we build against
+static const uint32_t s_sequenceRelative = 0x1;
+static const uint32_t s_sequenceNextOnMiss = 0x2;
+
+static const uint32_t s_maxSize = 8192;
+static const uint32_t s_cursorSize = 64;
+
+static const uint32_t s_primaryFormats[] = {
+    DRM_FORMAT_XRGB8888, DRM_FORMAT_ARGB8888, DRM_FORMAT_XBGR8888, DRM_FORMAT_ABGR8888,
+    DRM_FORMAT_RGB565, DRM_FORMAT_XRGB2101010, DRM_FORMAT_ARGB2101010
+};
+
+static drmModeModeInfo makeMode(int width, int height, int rate, bool preferred)
+{
+    drmModeModeInfo mode;
+    memset(&mode, 0, sizeof mode);
+    mode.hdisplay = width;
+    mode.hsync_start = width + 88;
+    mode.hsync_end = width + 132;
+    mode.htotal = width + 280;
+    mode.vdisplay = height;
+    mode.vsync_start = height + 4;
+    mode.vsync_end = height + 9;
+    mode.vtotal = height + 45;
+    mode.clock = uint32_t(uint64_t(mode.htotal) * mode.vtotal * rate / 1000);
+    mode.vrefresh = rate;
+    mode.flags = DRM_MODE_FLAG_PHSYNC | DRM_MODE_FLAG_PVSYNC;
+    mode.type = DRM_MODE_TYPE_DRIVER | (preferred ? DRM_MODE_TYPE_PREFERRED : 0);
+    snprintf(mode.name, sizeof mode.name, "%dx%d", width, height);
+    return mode;
+}
+
+// CEA timings for the sizes TVs report, other sizes get generic blanking
+static std::vector<drmModeModeInfo> makeModes(const FakeDrmConfig &config)
+{
+    std::vector<drmModeModeInfo> modes;
+    modes.push_back(makeMode(config.width, config.height, config.refreshRate, true));
+    if (config.width == 1920 && config.height == 1080) {
+        drmModeModeInfo &preferred = modes.front();
+        preferred.hsync_start = 2008;
+        preferred.hsync_end = 2052;
+        preferred.htotal = 2200;
+        preferred.vtotal = 1125;
+        preferred.clock = uint32_t(uint64_t(2200) * 1125 * config.refreshRate / 1000);
+
+        drmModeModeInfo mode = makeMode(1920, 1080, 50, false);
+        mode.htotal = 2640;
+        mode.vtotal = 1125;
+        mode.clock = 148500;
+        modes.push_back(mode);
+        mode = makeMode(1920, 1080, 30, false);
+        mode.htotal = 2200;
+        mode.vtotal = 1125;
+        mode.clock = 74250;
+        modes.push_back(mode);
+        mode = makeMode(1920, 1080, 24, false);
+        mode.htotal = 2750;
+        mode.vtotal = 1125;
+        mode.clock = 74250;
+        modes.push_back(mode);
+    } else {
+        for (int rate : { 50, 30, 24 }) {
+            if (rate != config.refreshRate)
+                modes.push_back(makeMode(config.width, config.height, rate, false));
+        }
+    }
+    if (config.width != 1280 || config.height != 720) {
+        drmModeModeInfo mode = makeMode(1280, 720, 60, false);
+        mode.htotal = 1650;
+        mode.vtotal = 750;
+        mode.clock = 74250;
+        modes.push_back(mode);
+    }
+    return modes;
+}
+
+static std::vector<uint8_t> makeEdid(const FakeDrmConfig &config)
+{
+    std::vector<uint8_t> edid(128, 0);
+    static const uint8_t header[] = { 0x00, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x00 };
+    memcpy(edid.data(), header, sizeof header);
+    // "GSM", product 1, EDID 1.3, digital input
+    edid[8] = 0x1e;
+    edid[9] = 0x6d;
+    edid[10] = 0x01;
+    edid[18] = 1;
+    edid[19] = 3;
+    edid[20] = 0x80;
+    edid[21] = 121;
+    edid[22] = 68;
+    // Monitor name descriptor
+    uint8_t *name = &edid[72];
+    name[3] = 0xfc;
+    memcpy(name + 5, "fakedrm\n     ", 13);
+    (void)config;
+    uint8_t sum = 0;
+    for (int i = 0; i < 127; ++i)
+        sum += edid[i];
+    edid[127] = uint8_t(256 - sum);
+    return edid;
+}
+
+static std::vector<uint8_t> makeInFormats(const std::vector<uint32_t> &formats)
+{
+    drm_format_modifier_blob header;
+    memset(&header, 0, sizeof header);
+    header.version = FORMAT_BLOB_CURRENT;
+    header.count_formats = formats.size();
+    header.formats_offset = sizeof header;
+    header.count_modifiers = 1;
+    header.modifiers_offset = (header.formats_offset + formats.size() * sizeof(uint32_t) + 7) & ~7u;
+
+    drm_format_modifier modifier;
+    memset(&modifier, 0, sizeof modifier);
+    modifier.formats = formats.size() < 64 ? (uint64_t(1) << formats.size()) - 1 : ~uint64_t(0);
+    modifier.modifier = DRM_FORMAT_MOD_LINEAR;
+
+    std::vector<uint8_t> blob(header.modifiers_offset + sizeof modifier, 0);
+    memcpy(blob.data(), &header, sizeof header);
+    memcpy(blob.data() + header.formats_offset, formats.data(), formats.size() * sizeof(uint32_t));
+    memcpy(blob.data() + header.modifiers_offset, &modifier, sizeof modifier);
+    return blob;
+}
+
+static uint64_t toNs(FakeDrmDevice::Clock::time_point time)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+}
+
+static void removeDevice()
+{
+    const char *path = FakeDrmDevice::instance().devicePath();
+    if (!path)
+        return;
+    unlink(path);
+    std::string dir(path);
+    rmdir(dir.substr(0, dir.rfind('/')).c_str());
+}
+
+static thread_local int t_kernelDepth = 0;
+
+FakeDrmKernelScope::FakeDrmKernelScope()
+{
+    ++t_kernelDepth;
+}
+
+FakeDrmKernelScope::~FakeDrmKernelScope()
+{
+    --t_kernelDepth;
+}
+
+int fakedrm_in_kernel(void)
+{
+    return t_kernelDepth;
+}
+
+template<typename T>
+static T *allocArray(size_t count)
+{
+    return static_cast<T *>(calloc(count ? count : 1, sizeof(T)));
+}
+
+FakeDrmDevice &FakeDrmDevice::instance()
+{
+    // Leaked, the vblank thread runs until exit
+    static FakeDrmDevice *device = new FakeDrmDevice;
+    return *device;
+}
+
+FakeDrmConfig FakeDrmDevice::defaultConfig()
+{
+    FakeDrmConfig config;
+    memset(&config, 0, sizeof config);
+    config.connectors = 1;
+    config.overlayPlanes = 4;
+    config.cursorPlane = 1;
+    config.width = 1920;
+    config.height = 1080;
+    config.refreshRate = 60;
+    config.atomic = 1;
+    config.vrrCapable = 0;
+    return config;
+}
+
+FakeDrmDevice::FakeDrmDevice()
+    : m_config(defaultConfig())
+{
+    build();
+    std::thread(&FakeDrmDevice::run, this).detach();
+}
+
+void FakeDrmDevice::configure(const FakeDrmConfig &config)
+{
+    std::lock_guard<std::mutex> locker(m_mutex);
+    m_config = config;
+    m_config.connectors = std::max(1, std::min(config.connectors, 8));
+    m_config.overlayPlanes = std::max(0, std::min(config.overlayPlanes, 16));
+    if (m_config.width <= 0 || m_config.height <= 0 || m_config.refreshRate <= 0) {
+        const FakeDrmConfig fallback = defaultConfig();
+        m_config.width = fallback.width;
+        m_config.height = fallback.height;
+        m_config.refreshRate = fallback.refreshRate;
+    }
+    build();
+    m_changed.notify_all();
+}
+
+const char *FakeDrmDevice::devicePath()
+{
+    std::lock_guard<std::mutex> locker(m_mutex);
+    if (m_devicePath.empty()) {
+        const char *tmp = getenv("TMPDIR");
+        std::string dir = std::string(tmp && *tmp ? tmp : "/tmp") + "/fakedrm-XXXXXX";
+        std::vector<char> buffer(dir.begin(), dir.end());
+        buffer.push_back('\0');
+        if (!mkdtemp(buffer.data()))
+            return nullptr;
+        const std::string path = std::string(buffer.data()) + "/card0";
+        // Readable and writable like a card node, events show up as bytes
+        if (mkfifo(path.c_str(), 0600) != 0) {
+            rmdir(buffer.data());
+            return nullptr;
+        }
+        m_devicePath = path;
+        atexit(removeDevice);
+    }
+    return m_devicePath.c_str();
+}
+
+FakeDrmStats FakeDrmDevice::stats()
+{
+    std::lock_guard<std::mutex> locker(m_mutex);
+    FakeDrmStats stats = m_stats;
+    stats.framebuffers = m_framebuffers.size();
+    return stats;
+}
+
+void FakeDrmDevice::resetStats()
+{
+    std::lock_guard<std::mutex> locker(m_mutex);
+    const uint64_t bufferObjects = m_stats.bufferObjects;
+    memset(&m_stats, 0, sizeof m_stats);
+    m_stats.bufferObjects = bufferObjects;
+}
+
+void FakeDrmDevice::failCommits(int count, int error)
+{
+    std::lock_guard<std::mutex> locker(m_mutex);
+    m_failCommits = std::max(0, count);
+    m_failError = error > 0 ? error : EINVAL;
+}
+
+int FakeDrmDevice::planeCount()
+{
+    std::lock_guard<std::mutex> locker(m_mutex);
+    return m_planes.size();
+}
+
+bool FakeDrmDevice::planeState(int index, FakeDrmPlaneState *state)
+{
+    std::lock_guard<std::mutex> locker(m_mutex);
+    if (index < 0 || index >= int(m_planes.size()) || !state)
+        return false;
+    const Plane &plane = m_planes[index];
+    state->id = plane.id;
+    state->type = plane.planeType;
+    state->crtcId = plane.scanoutCrtc >= 0 ? m_crtcs[plane.scanoutCrtc].id : 0;
+    state->fbId = plane.scanout;
+    state->crtcX = int32_t(value(plane, propertyId(PlaneCrtcX)));
+    state->crtcY = int32_t(value(plane, propertyId(PlaneCrtcY)));
+    state->crtcWidth = uint32_t(value(plane, propertyId(PlaneCrtcW)));
+    state->crtcHeight = uint32_t(value(plane, propertyId(PlaneCrtcH)));
+    state->zpos = value(plane, propertyId(PlaneZpos));
+    return true;
+}
+
+int FakeDrmDevice::crtcRefresh(int crtcIndex)
+{
+    std::lock_guard<std::mutex> locker(m_mutex);
+    if (crtcIndex < 0 || crtcIndex >= int(m_crtcs.size()) || !m_crtcs[crtcIndex].active)
+        return 0;
+    const drmModeModeInfo &mode = m_crtcs[crtcIndex].mode;
+    if (!mode.htotal || !mode.vtotal)
+        return 0;
+    return int(uint64_t(mode.clock) * 1000000 / (uint64_t(mode.htotal) * mode.vtotal));
+}
+
+uint64_t FakeDrmDevice::crtcSequence(int crtcIndex)
+{
+    std::lock_guard<std::mutex> locker(m_mutex);
+    if (crtcIndex < 0 || crtcIndex >= int(m_crtcs.size()))
+        return 0;
+    return m_crtcs[crtcIndex].sequence;
+}
+
+void FakeDrmDevice::build()
+{
+    for (PendingCommit &commit : m_pending) {
+        for (int fence : commit.inFences)
+            close(fence);
+        if (commit.outFence >= 0)
+            close(commit.outFence);
+    }
+    m_pending.clear();
+    m_vblankRequests.clear();
+    m_events.clear();
+    m_properties.clear();
+    m_connectors.clear();
+    m_encoders.clear();
+    m_crtcs.clear();
+    m_planes.clear();
+    m_blobs.clear();
+    m_framebuffers.clear();
+    m_nextId = 1;
+
+    typedef std::vector<std::pair<uint64_t, std::string>> Enums;
+    const uint32_t atomicRange = DRM_MODE_PROP_ATOMIC | DRM_MODE_PROP_RANGE;
+    const uint32_t atomicSigned = DRM_MODE_PROP_ATOMIC | DRM_MODE_PROP_SIGNED_RANGE;
+    const uint32_t atomicObject = DRM_MODE_PROP_ATOMIC | DRM_MODE_PROP_OBJECT;
+    const uint64_t maxZpos = m_config.overlayPlanes + 1;
+
+    addProperty(PlaneType, DRM_MODE_OBJECT_PLANE, "type", DRM_MODE_PROP_ENUM | DRM_MODE_PROP_IMMUTABLE,
+                std::vector<uint64_t>(), Enums { { 0, "Overlay" }, { 1, "Primary" }, { 2, "Cursor" } });
+    addProperty(PlaneFbId, DRM_MODE_OBJECT_PLANE, "FB_ID", atomicObject, { DRM_MODE_OBJECT_FB });
+    addProperty(PlaneCrtcId, DRM_MODE_OBJECT_PLANE, "CRTC_ID", atomicObject, { DRM_MODE_OBJECT_CRTC });
+    addProperty(PlaneSrcX, DRM_MODE_OBJECT_PLANE, "SRC_X", atomicRange, { 0, UINT32_MAX });
+    addProperty(PlaneSrcY, DRM_MODE_OBJECT_PLANE, "SRC_Y", atomicRange, { 0, UINT32_MAX });
+    addProperty(PlaneSrcW, DRM_MODE_OBJECT_PLANE, "SRC_W", atomicRange, { 0, UINT32_MAX });
+    addProperty(PlaneSrcH, DRM_MODE_OBJECT_PLANE, "SRC_H", atomicRange, { 0, UINT32_MAX });
+    addProperty(PlaneCrtcX, DRM_MODE_OBJECT_PLANE, "CRTC_X", atomicSigned, { uint64_t(int64_t(INT32_MIN)), INT32_MAX });
+    addProperty(PlaneCrtcY, DRM_MODE_OBJECT_PLANE, "CRTC_Y", atomicSigned, { uint64_t(int64_t(INT32_MIN)), INT32_MAX });
+    addProperty(PlaneCrtcW, DRM_MODE_OBJECT_PLANE, "CRTC_W", atomicRange, { 0, INT32_MAX });
+    addProperty(PlaneCrtcH, DRM_MODE_OBJECT_PLANE, "CRTC_H", atomicRange, { 0, INT32_MAX });
+    addProperty(PlaneZpos, DRM_MODE_OBJECT_PLANE, "zpos", DRM_MODE_PROP_RANGE, { 0, maxZpos });
+    addProperty(PlaneInFormats, DRM_MODE_OBJECT_PLANE, "IN_FORMATS", DRM_MODE_PROP_BLOB | DRM_MODE_PROP_IMMUTABLE);
+    addProperty(PlaneInFenceFd, DRM_MODE_OBJECT_PLANE, "IN_FENCE_FD", DRM_MODE_PROP_SIGNED_RANGE, { uint64_t(int64_t(-1)), INT32_MAX });
+    addProperty(PlaneBlendOp, DRM_MODE_OBJECT_PLANE, "blend_op", DRM_MODE_PROP_ENUM, std::vector<uint64_t>(),
+                Enums { { 0, "not_defined" }, { 1, "opaque" }, { 2, "premultiplied" }, { 3, "coverage" } });
+    addProperty(PlaneScalingFilter, DRM_MODE_OBJECT_PLANE, "SCALING_FILTER", DRM_MODE_PROP_ENUM, std::vector<uint64_t>(),
+                Enums { { 0, "Default" }, { 1, "Nearest Neighbor" } });
+    addProperty(PlaneFbTranslationMode, DRM_MODE_OBJECT_PLANE, "fb_translation_mode", DRM_MODE_PROP_ENUM, std::vector<uint64_t>(),
+                Enums { { 0, "non_sec" }, { 1, "sec" } });
+    addProperty(CrtcActive, DRM_MODE_OBJECT_CRTC, "ACTIVE", atomicRange, { 0, 1 });
+    addProperty(CrtcModeId, DRM_MODE_OBJECT_CRTC, "MODE_ID", DRM_MODE_PROP_ATOMIC | DRM_MODE_PROP_BLOB);
+    addProperty(CrtcOutFencePtr, DRM_MODE_OBJECT_CRTC, "OUT_FENCE_PTR", atomicRange, { 0, UINT64_MAX });
+    addProperty(CrtcVrrEnabled, DRM_MODE_OBJECT_CRTC, "VRR_ENABLED", DRM_MODE_PROP_RANGE, { 0, 1 });
+    addProperty(ConnectorCrtcId, DRM_MODE_OBJECT_CONNECTOR, "CRTC_ID", atomicObject, { DRM_MODE_OBJECT_CRTC });
+    addProperty(ConnectorDpms, DRM_MODE_OBJECT_CONNECTOR, "DPMS", DRM_MODE_PROP_ENUM, std::vector<uint64_t>(),
+                Enums { { 0, "On" }, { 1, "Standby" }, { 2, "Suspend" }, { 3, "Off" } });
+    addProperty(ConnectorEdid, DRM_MODE_OBJECT_CONNECTOR, "EDID", DRM_MODE_PROP_BLOB | DRM_MODE_PROP_IMMUTABLE);
+    addProperty(ConnectorVrrCapable, DRM_MODE_OBJECT_CONNECTOR, "vrr_capable", DRM_MODE_PROP_RANGE | DRM_MODE_PROP_IMMUTABLE, { 0, 1 });
+
+    const int count = m_config.connectors;
+    const uint32_t allCrtcs = (1u << count) - 1;
+
+    for (int i = 0; i < count; ++i) {
+        Crtc crtc;
+        crtc.id = m_nextId++;
+        crtc.type = DRM_MODE_OBJECT_CRTC;
+        crtc.index = i;
+        setValue(&crtc, propertyId(CrtcActive), 0);
+        setValue(&crtc, propertyId(CrtcModeId), 0);
+        setValue(&crtc, propertyId(CrtcOutFencePtr), 0);
+        setValue(&crtc, propertyId(CrtcVrrEnabled), 0);
+        m_crtcs.push_back(crtc);
+    }
+
+    std::vector<uint32_t> overlayFormats(std::begin(s_primaryFormats), std::end(s_primaryFormats));
+    overlayFormats.push_back(DRM_FORMAT_NV12);
+    const std::vector<uint32_t> primaryFormats(std::begin(s_primaryFormats), std::end(s_primaryFormats));
+    const std::vector<uint32_t> cursorFormats { DRM_FORMAT_ARGB8888 };
+    const uint32_t primaryBlob = addBlob(nullptr, 0, true);
+    m_blobs[primaryBlob].data = makeInFormats(primaryFormats);
+    const uint32_t overlayBlob = addBlob(nullptr, 0, true);
+    m_blobs[overlayBlob].data = makeInFormats(overlayFormats);
+    const uint32_t cursorBlob = addBlob(nullptr, 0, true);
+    m_blobs[cursorBlob].data = makeInFormats(cursorFormats);
+
+    auto addPlane = [&](uint32_t type, uint32_t possibleCrtcs, uint64_t zpos) {
+        Plane plane;
+        plane.id = m_nextId++;
+        plane.type = DRM_MODE_OBJECT_PLANE;
+        plane.planeType = type;
+        plane.possibleCrtcs = possibleCrtcs;
+        plane.canScale = type != DRM_PLANE_TYPE_CURSOR;
+        plane.formats = type == DRM_PLANE_TYPE_PRIMARY ? primaryFormats
+                      : type == DRM_PLANE_TYPE_CURSOR ? cursorFormats : overlayFormats;
+        const uint32_t formatBlob = type == DRM_PLANE_TYPE_PRIMARY ? primaryBlob
+                                  : type == DRM_PLANE_TYPE_CURSOR ? cursorBlob : overlayBlob;
+        setValue(&plane, propertyId(PlaneType), type);
+        for (Property property : { PlaneFbId, PlaneCrtcId, PlaneSrcX, PlaneSrcY, PlaneSrcW, PlaneSrcH,
+                                   PlaneCrtcX, PlaneCrtcY, PlaneCrtcW, PlaneCrtcH })
+            setValue(&plane, propertyId(property), 0);
+        setValue(&plane, propertyId(PlaneZpos), zpos);
+        setValue(&plane, propertyId(PlaneInFormats), formatBlob);
+        setValue(&plane, propertyId(PlaneInFenceFd), uint64_t(int64_t(-1)));
+        setValue(&plane, propertyId(PlaneBlendOp), 0);
+        if (type == DRM_PLANE_TYPE_OVERLAY)
+            setValue(&plane, propertyId(PlaneScalingFilter), 0);
+        setValue(&plane, propertyId(PlaneFbTranslationMode), 0);
+        m_planes.push_back(plane);
+    };
+    for (int i = 0; i < count; ++i) {
+        addPlane(DRM_PLANE_TYPE_PRIMARY, 1u << i, 0);
+        for (int j = 0; j < m_config.overlayPlanes; ++j)
+            addPlane(DRM_PLANE_TYPE_OVERLAY, allCrtcs, j + 1);
+        if (m_config.cursorPlane)
+            addPlane(DRM_PLANE_TYPE_CURSOR, 1u << i, maxZpos);
+    }
+
+    // Bound to the CRTC like after a boot splash, with the CRTC off
+    for (int i = 0; i < count; ++i) {
+        Encoder encoder;
+        encoder.id = m_nextId++;
+        encoder.crtcId = m_crtcs[i].id;
+        encoder.possibleCrtcs = allCrtcs;
+        m_encoders.push_back(encoder);
+    }
+
+    const std::vector<drmModeModeInfo> modes = makeModes(m_config);
+    const std::vector<uint8_t> edid = makeEdid(m_config);
+    for (int i = 0; i < count; ++i) {
+        Connector connector;
+        connector.id = m_nextId++;
+        connector.type = DRM_MODE_OBJECT_CONNECTOR;
+        connector.typeId = i + 1;
+        connector.encoderId = m_encoders[i].id;
+        connector.modes = modes;
+        setValue(&connector, propertyId(ConnectorCrtcId), 0);
+        setValue(&connector, propertyId(ConnectorDpms), 0);
+        setValue(&connector, propertyId(ConnectorEdid), addBlob(edid.data(), edid.size(), true));
+        setValue(&connector, propertyId(ConnectorVrrCapable), m_config.vrrCapable ? 1 : 0);
+        m_connectors.push_back(connector);
+    }
+}
+
+uint32_t FakeDrmDevice::addProperty(Property property, uint32_t objectType, const char *name, uint32_t flags,
+                                    const std::vector<uint64_t> &values,
+                                    const std::vector<std::pair<uint64_t, std::string>> &enums)
+{
+    PropertyDef def;
+    def.id = m_nextId++;
+    def.objectType = objectType;
+    def.name = name;
+    def.flags = flags;
+    def.values = values;
+    def.enums = enums;
+    m_properties.push_back(def);
+    m_propertyIds[property] = def.id;
+    return def.id;
+}
+
+uint32_t FakeDrmDevice::addBlob(const void *data, size_t size, bool immutable)
+{
+    const uint32_t id = m_nextId++;
+    Blob &blob = m_blobs[id];
+    if (size)
+        blob.data.assign(static_cast<const uint8_t *>(data), static_cast<const uint8_t *>(data) + size);
+    blob.immutable = immutable;
+    return id;
+}
+
+const FakeDrmDevice::PropertyDef *FakeDrmDevice::findProperty(uint32_t id) const
+{
+    for (const PropertyDef &def : m_properties) {
+        if (def.id == id)
+            return &def;
+    }
+    return nullptr;
+}
+
+FakeDrmDevice::Object *FakeDrmDevice::findObject(uint32_t id)
+{
+    if (Crtc *crtc = findCrtc(id))
+        return crtc;
+    if (Plane *plane = findPlane(id))
+        return plane;
+    return findConnector(id);
+}
+
+FakeDrmDevice::Crtc *FakeDrmDevice::findCrtc(uint32_t id)
+{
+    for (Crtc &crtc : m_crtcs) {
+        if (crtc.id == id)
+            return &crtc;
+    }
+    return nullptr;
+}
+
+FakeDrmDevice::Plane *FakeDrmDevice::findPlane(uint32_t id)
+{
+    for (Plane &plane : m_planes) {
+        if (plane.id == id)
+            return &plane;
+    }
+    return nullptr;
+}
+
+FakeDrmDevice::Connector *FakeDrmDevice::findConnector(uint32_t id)
+{
+    for (Connector &connector : m_connectors) {
+        if (connector.id == id)
+            return &connector;
+    }
+    return nullptr;
+}
+
+FakeDrmDevice::Plane *FakeDrmDevice::primaryPlane(const Crtc &crtc)
+{
+    for (Plane &plane : m_planes) {
+        if (plane.planeType == DRM_PLANE_TYPE_PRIMARY && (plane.possibleCrtcs & (1u << crtc.index)))
+            return &plane;
+    }
+    return nullptr;
+}
+
+uint64_t FakeDrmDevice::value(const Object &object, uint32_t property)
+{
+    for (const auto &entry : object.properties) {
+        if (entry.first == property)
+            return entry.second;
+    }
+    return 0;
+}
+
+void FakeDrmDevice::setValue(Object *object, uint32_t property, uint64_t value)
+{
+    for (auto &entry : object->properties) {
+        if (entry.first == property) {
+            entry.second = value;
+            return;
+        }
+    }
+    object->properties.emplace_back(property, value);
+}
+
+bool FakeDrmDevice::validValue(const PropertyDef &def, uint64_t value)
+{
+    const uint32_t extended = def.flags & DRM_MODE_PROP_EXTENDED_TYPE;
+    if (extended == DRM_MODE_PROP_SIGNED_RANGE)
+        return int64_t(value) >= int64_t(def.values[0]) && int64_t(value) <= int64_t(def.values[1]);
+    if (extended == DRM_MODE_PROP_OBJECT) {
+        if (!value)
+            return true;
+        if (def.values[0] == DRM_MODE_OBJECT_FB)
+            return value <= UINT32_MAX && m_framebuffers.count(uint32_t(value));
+        return crtcIndexForId(value) >= 0;
+    }
+    if (def.flags & DRM_MODE_PROP_RANGE)
+        return value >= def.values[0] && value <= def.values[1];
+    if (def.flags & DRM_MODE_PROP_ENUM) {
+        for (const auto &entry : def.enums) {
+            if (entry.first == value)
+                return true;
+        }
+        return false;
+    }
+    if (def.flags & DRM_MODE_PROP_BLOB)
+        return !value || (value <= UINT32_MAX && m_blobs.count(uint32_t(value)));
+    return false;
+}
+
+int FakeDrmDevice::crtcIndexForId(uint64_t id)
+{
+    for (const Crtc &crtc : m_crtcs) {
+        if (crtc.id == id)
+            return crtc.index;
+    }
+    return -1;
+}
+
+bool FakeDrmDevice::busy(uint32_t crtcMask) const
+{
+    for (const Crtc &crtc : m_crtcs) {
+        if ((crtcMask & (1u << crtc.index)) && crtc.pending)
+            return true;
+    }
+    return false;
+}
+
+void FakeDrmDevice::collectBlobs()
+{
+    for (auto it = m_blobs.begin(); it != m_blobs.end();) {
+        bool used = false;
+        for (const Crtc &crtc : m_crtcs)
+            used = used || value(crtc, propertyId(CrtcModeId)) == it->first;
+        if (it->second.destroyed && !used)
+            it = m_blobs.erase(it);
+        else
+            ++it;
+    }
+}
+
+int FakeDrmDevice::setClientCap(uint64_t capability, uint64_t value)
+{
+    std::lock_guard<std::mutex> locker(m_mutex);
+    ++m_stats.ioctls;
+    switch (capability) {
+    case DRM_CLIENT_CAP_UNIVERSAL_PLANES:
+        m_universalPlanes = value;
+        return 0;
+    case DRM_CLIENT_CAP_ATOMIC:
+        if (!m_config.atomic)
+            return -EOPNOTSUPP;
+        m_atomic = value;
+        m_universalPlanes = m_universalPlanes || value;
+        return 0;
+    case DRM_CLIENT_CAP_STEREO_3D:
+    case DRM_CLIENT_CAP_ASPECT_RATIO:
+    case DRM_CLIENT_CAP_WRITEBACK_CONNECTORS:
+        return 0;
+    default:
+        return -EINVAL;
+    }
+}
+
+int FakeDrmDevice::getCap(uint64_t capability, uint64_t *value)
+{
+    std::lock_guard<std::mutex> locker(m_mutex);
+    ++m_stats.ioctls;
+    switch (capability) {
+    case DRM_CAP_DUMB_BUFFER:
+    case DRM_CAP_VBLANK_HIGH_CRTC:
+    case DRM_CAP_TIMESTAMP_MONOTONIC:
+    case DRM_CAP_ADDFB2_MODIFIERS:
+    case DRM_CAP_CRTC_IN_VBLANK_EVENT:
+        *value = 1;
+        return 0;
+    case DRM_CAP_PRIME:
+        *value = DRM_PRIME_CAP_IMPORT | DRM_PRIME_CAP_EXPORT;
+        return 0;
+    case DRM_CAP_CURSOR_WIDTH:
+    case DRM_CAP_CURSOR_HEIGHT:
+        *value = s_cursorSize;
+        return 0;
+    case DRM_CAP_ASYNC_PAGE_FLIP:
+    case DRM_CAP_PAGE_FLIP_TARGET:
+    case DRM_CAP_SYNCOBJ:
+        *value = 0;
+        return 0;
+    default:
+        return -EINVAL;
+    }
+}
+
+drmModeResPtr FakeDrmDevice::getResources()
+{
+    std::lock_guard<std::mutex> locker(m_mutex);
+    ++m_stats.ioctls;
+    drmModeResPtr resources = allocArray<drmModeRes>(1);
+    resources->count_fbs = m_framebuffers.size();
+    resources->fbs = allocArray<uint32_t>(m_framebuffers.size());
+    int i = 0;
+    for (const auto &entry : m_framebuffers)
+        resources->fbs[i++] = entry.first;
+    resources->count_crtcs = m_crtcs.size();
+    resources->crtcs = allocArray<uint32_t>(m_crtcs.size());
+    for (size_t j = 0; j < m_crtcs.size(); ++j)
+        resources->crtcs[j] = m_crtcs[j].id;
+    resources->count_connectors = m_connectors.size();
+    resources->connectors = allocArray<uint32_t>(m_connectors.size());
+    for (size_t j = 0; j < m_connectors.size(); ++j)
+        resources->connectors[j] = m_connectors[j].id;
+    resources->count_encoders = m_encoders.size();
+    resources->encoders = allocArray<uint32_t>(m_encoders.size());
+    for (size_t j = 0; j < m_encoders.size(); ++j)
+        resources->encoders[j] = m_encoders[j].id;
+    resources->min_width = 1;
+    resources->min_height = 1;
+    resources->max_width = s_maxSize;
+    resources->max_height = s_maxSize;
+    return resources;
+}
+
+drmModeConnectorPtr FakeDrmDevice::getConnector(uint32_t id)
+{
+    std::lock_guard<std::mutex> locker(m_mutex);
+    ++m_stats.ioctls;
+    const Connector *connector = findConnector(id);
+    if (!connector) {
+        errno = ENOENT;
+        return nullptr;
+    }
+    drmModeConnectorPtr result = allocArray<drmModeConnector>(1);
+    result->connector_id = connector->id;
+    result->encoder_id = connector->encoderId;
+    result->connector_type = DRM_MODE_CONNECTOR_HDMIA;
+    result->connector_type_id = connector->typeId;
+    result->connection = DRM_MODE_CONNECTED;
+    // A 55" panel
+    result->mmWidth = 1210;
+    result->mmHeight = 680;
+    result->subpixel = DRM_MODE_SUBPIXEL_UNKNOWN;
+    result->count_modes = connector->modes.size();
+    result->modes = allocArray<drmModeModeInfo>(connector->modes.size());
+    std::copy(connector->modes.begin(), connector->modes.end(), result->modes);
+    result->count_props = connector->properties.size();
+    result->props = allocArray<uint32_t>(connector->properties.size());
+    result->prop_values = allocArray<uint64_t>(connector->properties.size());
+    for (size_t i = 0; i < connector->properties.size(); ++i) {
+        result->props[i] = connector->properties[i].first;
+        result->prop_values[i] = connector->properties[i].second;
+    }
+    result->count_encoders = 1;
+    result->encoders = allocArray<uint32_t>(1);
+    result->encoders[0] = connector->encoderId;
+    return result;
+}
+
+drmModeEncoderPtr FakeDrmDevice::getEncoder(uint32_t id)
+{
+    std::lock_guard<std::mutex> locker(m_mutex);
+    ++m_stats.ioctls;
+    for (const Encoder &encoder : m_encoders) {
+        if (encoder.id != id)
+            continue;
+        drmModeEncoderPtr result = allocArray<drmModeEncoder>(1);
+        result->encoder_id = encoder.id;
+        result->encoder_type = DRM_MODE_ENCODER_TMDS;
+        result->crtc_id = encoder.crtcId;
+        result->possible_crtcs = encoder.possibleCrtcs;
+        return result;
+    }
+    errno = ENOENT;
+    return nullptr;
+}
+
+drmModeCrtcPtr FakeDrmDevice::getCrtc(uint32_t id)
+{
+    std::lock_guard<std::mutex> locker(m_mutex);
+    ++m_stats.ioctls;
+    Crtc *crtc = findCrtc(id);
+    if (!crtc) {
+        errno = ENOENT;
+        return nullptr;
+    }
+    drmModeCrtcPtr result = allocArray<drmModeCrtc>(1);
+    result->crtc_id = crtc->id;
+    const Plane *primary = primaryPlane(*crtc);
+    result->buffer_id = primary && primary->scanoutCrtc == crtc->index ? primary->scanout : 0;
+    if (crtc->active) {
+        result->width = crtc->mode.hdisplay;
+        result->height = crtc->mode.vdisplay;
+        result->mode_valid = 1;
+        result->mode = crtc->mode;
+    }
+    return result;
+}
+
+drmModePlaneResPtr FakeDrmDevice::getPlaneResources()
+{
+    std::lock_guard<std::mutex> locker(m_mutex);
+    ++m_stats.ioctls;
+    drmModePlaneResPtr result = allocArray<drmModePlaneRes>(1);
+    result->planes = allocArray<uint32_t>(m_planes.size());
+    for (const Plane &plane : m_planes) {
+        // Without universal planes only overlays are listed
+        if (m_universalPlanes || plane.planeType == DRM_PLANE_TYPE_OVERLAY)
+            result->planes[result->count_planes++] = plane.id;
+    }
+    return result;
+}
+
+drmModePlanePtr FakeDrmDevice::getPlane(uint32_t id)
+{
+    std::lock_guard<std::mutex> locker(m_mutex);
+    ++m_stats.ioctls;
+    const Plane *plane = findPlane(id);
+    if (!plane) {
+        errno = ENOENT;
+        return nullptr;
+    }
+    drmModePlanePtr result = allocArray<drmModePlane>(1);
+    result->count_formats = plane->formats.size();
+    result->formats = allocArray<uint32_t>(plane->formats.size());
+    std::copy(plane->formats.begin(), plane->formats.end(), result->formats);
+    result->plane_id = plane->id;
+    result->crtc_id = uint32_t(value(*plane, propertyId(PlaneCrtcId)));
+    result->fb_id = uint32_t(value(*plane, propertyId(PlaneFbId)));
+    result->crtc_x = uint32_t(value(*plane, propertyId(PlaneCrtcX)));
+    result->crtc_y = uint32_t(value(*plane, propertyId(PlaneCrtcY)));
+    result->x = uint32_t(value(*plane, propertyId(PlaneSrcX)) >> 16);
+    result->y = uint32_t(value(*plane, propertyId(PlaneSrcY)) >> 16);
+    result->possible_crtcs = plane->possibleCrtcs;
+    return result;
+}
+
+drmModeObjectPropertiesPtr FakeDrmDevice::getObjectProperties(uint32_t id, uint32_t type)
+{
+    std::lock_guard<std::mutex> locker(m_mutex);
+    ++m_stats.ioctls;
+    const Object *object = findObject(id);
+    if (!object || (type != DRM_MODE_OBJECT_ANY && object->type != type)) {
+        errno = ENOENT;
+        return nullptr;
+    }
+    drmModeObjectPropertiesPtr result = allocArray<drmModeObjectProperties>(1);
+    result->props = allocArray<uint32_t>(object->properties.size());
+    result->prop_values = allocArray<uint64_t>(object->properties.size());
+    for (const auto &entry : object->properties) {
+        // Atomic properties are hidden from legacy clients
+        const PropertyDef *def = findProperty(entry.first);
+        if (!m_atomic && (def->flags & DRM_MODE_PROP_ATOMIC))
+            continue;
+        result->props[result->count_props] = entry.first;
+        result->prop_values[result->count_props] = entry.second;
+        ++result->count_props;
+    }
+    return result;
+}
+
+drmModePropertyPtr FakeDrmDevice::getProperty(uint32_t id)
+{
+    std::lock_guard<std::mutex> locker(m_mutex);
+    ++m_stats.ioctls;
+    const PropertyDef *def = findProperty(id);
+    if (!def) {
+        errno = ENOENT;
+        return nullptr;
+    }
+    drmModePropertyPtr result = allocArray<drmModePropertyRes>(1);
+    result->prop_id = def->id;
+    result->flags = def->flags;
+    strncpy(result->name, def->name.c_str(), DRM_PROP_NAME_LEN - 1);
+    result->count_values = def->values.size();
+    result->values = allocArray<uint64_t>(def->values.size());
+    std::copy(def->values.begin(), def->values.end(), result->values);
+    if (!def->enums.empty()) {
+        // Enum values are listed as values as well
+        free(result->values);
+        result->count_values = def->enums.size();
+        result->values = allocArray<uint64_t>(def->enums.size());
+        result->count_enums = def->enums.size();
+        result->enums = allocArray<drm_mode_property_enum>(def->enums.size());
+        for (size_t i = 0; i < def->enums.size(); ++i) {
+            result->values[i] = def->enums[i].first;
+            result->enums[i].value = def->enums[i].first;
+            strncpy(result->enums[i].name, def->enums[i].second.c_str(), DRM_PROP_NAME_LEN - 1);
+        }
+    }
+    return result;
+}
+
+drmModePropertyBlobPtr FakeDrmDevice::getBlob(uint32_t id)
+{
+    std::lock_guard<std::mutex> locker(m_mutex);
+    ++m_stats.ioctls;
+    auto it = m_blobs.find(id);
+    if (it == m_blobs.end()) {
+        errno = ENOENT;
+        return nullptr;
+    }
+    drmModePropertyBlobPtr result = allocArray<drmModePropertyBlobRes>(1);
+    result->id = id;
+    result->length = it->second.data.size();
+    result->data = malloc(std::max<size_t>(1, it->second.data.size()));
+    if (!it->second.data.empty())
+        memcpy(result->data, it->second.data.data(), it->second.data.size());
+    return result;
+}
+
+drmModeFBPtr FakeDrmDevice::getFramebuffer(uint32_t id)
+{
+    std::lock_guard<std::mutex> locker(m_mutex);
+    ++m_stats.ioctls;
+    auto it = m_framebuffers.find(id);
+    if (it == m_framebuffers.end()) {
+        errno = ENOENT;
+        return nullptr;
+    }
+    const Framebuffer &framebuffer = it->second;
+    drmModeFBPtr result = allocArray<drmModeFB>(1);
+    result->fb_id = id;
+    result->width = framebuffer.width;
+    result->height = framebuffer.height;
+    result->pitch = framebuffer.pitch;
+    result->bpp = framebuffer.format == DRM_FORMAT_RGB565 ? 16 : framebuffer.format == DRM_FORMAT_NV12 ? 8 : 32;
+    result->depth = framebuffer.format == DRM_FORMAT_RGB565 ? 16 : framebuffer.format == DRM_FORMAT_XRGB8888 ? 24 : 32;
+    result->handle = framebuffer.handle;
+    return result;
+}
+
+int FakeDrmDevice::createBlob(const void *data, size_t size, uint32_t *id)
+{
+    FakeDrmKernelScope scope;
+    std::lock_guard<std::mutex> locker(m_mutex);
+    ++m_stats.ioctls;
+    if (!data || !size || !id)
+        return -EINVAL;
+    *id = addBlob(data, size, false);
+    ++m_stats.blobsCreated;
+    return 0;
+}
+
+int FakeDrmDevice::destroyBlob(uint32_t id)
+{
+    FakeDrmKernelScope scope;
+    std::lock_guard<std::mutex> locker(m_mutex);
+    ++m_stats.ioctls;
+    auto it = m_blobs.find(id);
+    if (it == m_blobs.end() || it->second.destroyed)
+        return -ENOENT;
+    if (it->second.immutable)
+        return -EPERM;
+    it->second.destroyed = true;
+    collectBlobs();
+    ++m_stats.blobsDestroyed;
+    return 0;
+}
+
+int FakeDrmDevice::addFramebuffer(drm_mode_fb_cmd2 *cmd)
+{
+    FakeDrmKernelScope scope;
+    std::lock_guard<std::mutex> locker(m_mutex);
+    ++m_stats.ioctls;
+    if (!cmd->width || !cmd->height || cmd->width > s_maxSize || cmd->height > s_maxSize)
+        return -EINVAL;
+    const bool known = cmd->pixel_format == DRM_FORMAT_NV12
+            || std::find(std::begin(s_primaryFormats), std::end(s_primaryFormats), cmd->pixel_format) != std::end(s_primaryFormats);
+    if (!known)
+        return -EINVAL;
+    const int planes = cmd->pixel_format == DRM_FORMAT_NV12 ? 2 : 1;
+    for (int i = 0; i < planes; ++i) {
+        if (!m_buffers.count(cmd->handles[i]))
+            return -ENOENT;
+        if (!cmd->pitches[i])
+            return -EINVAL;
+    }
+    Framebuffer framebuffer;
+    framebuffer.width = cmd->width;
+    framebuffer.height = cmd->height;
+    framebuffer.format = cmd->pixel_format;
+    framebuffer.modifier = (cmd->flags & DRM_MODE_FB_MODIFIERS) ? cmd->modifier[0] : DRM_FORMAT_MOD_INVALID;
+    framebuffer.pitch = cmd->pitches[0];
+    framebuffer.handle = cmd->handles[0];
+    cmd->fb_id = m_nextId++;
+    m_framebuffers[cmd->fb_id] = framebuffer;
+    ++m_stats.framebuffersAdded;
+    return 0;
+}
+
+int FakeDrmDevice::removeFramebuffer(uint32_t id)
+{
+    FakeDrmKernelScope scope;
+    std::lock_guard<std::mutex> locker(m_mutex);
+    ++m_stats.ioctls;
+    if (!m_framebuffers.erase(id))
+        return -ENOENT;
+    // Like the kernel, planes still showing it are turned off
+    for (Plane &plane : m_planes) {
+        if (plane.scanout == id || value(plane, propertyId(PlaneFbId)) == id) {
+            setValue(&plane, propertyId(PlaneFbId), 0);
+            setValue(&plane, propertyId(PlaneCrtcId), 0);
+            plane.scanout = 0;
+            plane.scanoutCrtc = -1;
+        }
+    }
+    for (PendingCommit &commit : m_pending) {
+        for (PendingCommit::Latch &latch : commit.latch) {
+            if (latch.fbId == id) {
+                latch.fbId = 0;
+                latch.crtcIndex = -1;
+            }
+        }
+    }
+    ++m_stats.framebuffersRemoved;
+    return 0;
+}
+
+int FakeDrmDevice::primeFdToHandle(int primeFd, uint32_t *handle)
+{
+    FakeDrmKernelScope scope;
+    std::lock_guard<std::mutex> locker(m_mutex);
+    ++m_stats.ioctls;
+    struct stat st;
+    if (fstat(primeFd, &st) != 0)
+        return -EBADF;
+    ++m_stats.primeImports;
+    // The same buffer always maps to the same handle
+    for (const auto &entry : m_buffers) {
+        if (entry.second.device == st.st_dev && entry.second.inode == st.st_ino) {
+            *handle = entry.first;
+            return 0;
+        }
+    }
+    Buffer buffer;
+    buffer.device = st.st_dev;
+    buffer.inode = st.st_ino;
+    *handle = m_nextHandle++;
+    m_buffers[*handle] = buffer;
+    return 0;
+}
+
+int FakeDrmDevice::primeHandleToFd(uint32_t handle, int *primeFd)
+{
+    FakeDrmKernelScope scope;
+    std::lock_guard<std::mutex> locker(m_mutex);
+    ++m_stats.ioctls;
+    auto it = m_buffers.find(handle);
+    if (it == m_buffers.end())
+        return -ENOENT;
+    if (it->second.fd < 0)
+        return -EINVAL;
+    const int fd = fcntl(it->second.fd, F_DUPFD_CLOEXEC, 0);
+    if (fd < 0)
+        return -errno;
+    *primeFd = fd;
+    return 0;
+}
+
+int FakeDrmDevice::closeHandle(uint32_t handle)
+{
+    FakeDrmKernelScope scope;
+    std::lock_guard<std::mutex> locker(m_mutex);
+    ++m_stats.ioctls;
+    if (!m_buffers.erase(handle))
+        return -EINVAL;
+    ++m_stats.gemCloses;
+    return 0;
+}
+
+int FakeDrmDevice::atomicCommit(int fd, const std::vector<AtomicItem> &items, uint32_t flags, void *userData)
+{
+    FakeDrmKernelScope scope;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    ++m_stats.ioctls;
+    if (!m_atomic)
+        return -EINVAL;
+    const bool testOnly = flags & DRM_MODE_ATOMIC_TEST_ONLY;
+    if (!testOnly && m_failCommits > 0) {
+        --m_failCommits;
+        ++m_stats.rejectedCommits;
+        return -m_failError;
+    }
+    const int ret = commitLocked(lock, fd, items, flags, userData);
+    if (testOnly) {
+        ++m_stats.testCommits;
+        if (ret)
+            ++m_stats.testFailures;
+    } else if (!ret) {
+        ++m_stats.atomicCommits;
+    } else if (ret == -EBUSY) {
+        ++m_stats.busyCommits;
+    } else {
+        ++m_stats.rejectedCommits;
+    }
+    return ret;
+}
+
+int FakeDrmDevice::setObjectProperty(uint32_t object, uint32_t property, uint64_t value)
+{
+    FakeDrmKernelScope scope;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    ++m_stats.ioctls;
+    const PropertyDef *def = findProperty(property);
+    if (!def || (!m_atomic && (def->flags & DRM_MODE_PROP_ATOMIC)))
+        return -EINVAL;
+    return commitLocked(lock, -1, { { object, property, value } }, DRM_MODE_ATOMIC_ALLOW_MODESET, nullptr);
+}
+
+int FakeDrmDevice::pageFlip(int fd, uint32_t crtcId, uint32_t fbId, uint32_t flags, void *userData)
+{
+    FakeDrmKernelScope scope;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    ++m_stats.ioctls;
+    Crtc *crtc = findCrtc(crtcId);
+    if (!crtc)
+        return -ENOENT;
+    Plane *primary = primaryPlane(*crtc);
+    if (!crtc->active || !primary || value(*primary, propertyId(PlaneCrtcId)) != crtcId
+            || (flags & ~DRM_MODE_PAGE_FLIP_FLAGS))
+        return -EINVAL;
+    if (m_failCommits > 0) {
+        --m_failCommits;
+        ++m_stats.rejectedCommits;
+        return -m_failError;
+    }
+    const int ret = commitLocked(lock, fd, { { primary->id, propertyId(PlaneFbId), fbId } },
+                                 DRM_MODE_ATOMIC_NONBLOCK | (flags & DRM_MODE_PAGE_FLIP_EVENT), userData);
+    if (!ret)
+        ++m_stats.pageFlips;
+    else if (ret == -EBUSY)
+        ++m_stats.busyCommits;
+    else
+        ++m_stats.rejectedCommits;
+    return ret;
+}
+
+int FakeDrmDevice::setCrtc(uint32_t crtcId, uint32_t fbId, const uint32_t *connectors, int count,
+                           const drmModeModeInfo *mode)
+{
+    FakeDrmKernelScope scope;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    ++m_stats.ioctls;
+    Crtc *crtc = findCrtc(crtcId);
+    if (!crtc)
+        return -ENOENT;
+    Plane *primary = primaryPlane(*crtc);
+    std::vector<AtomicItem> items;
+    uint32_t modeBlob = 0;
+    if (mode) {
+        auto fb = m_framebuffers.find(fbId);
+        if (fb == m_framebuffers.end())
+            return -ENOENT;
+        modeBlob = addBlob(mode, sizeof *mode, false);
+        items.push_back({ crtcId, propertyId(CrtcActive), 1 });
+        items.push_back({ crtcId, propertyId(CrtcModeId), modeBlob });
+        items.push_back({ primary->id, propertyId(PlaneFbId), fbId });
+        items.push_back({ primary->id, propertyId(PlaneCrtcId), crtcId });
+        items.push_back({ primary->id, propertyId(PlaneSrcX), 0 });
+        items.push_back({ primary->id, propertyId(PlaneSrcY), 0 });
+        items.push_back({ primary->id, propertyId(PlaneSrcW), uint64_t(std::min<uint32_t>(fb->second.width, mode->hdisplay)) << 16 });
+        items.push_back({ primary->id, propertyId(PlaneSrcH), uint64_t(std::min<uint32_t>(fb->second.height, mode->vdisplay)) << 16 });
+        items.push_back({ primary->id, propertyId(PlaneCrtcX), 0 });
+        items.push_back({ primary->id, propertyId(PlaneCrtcY), 0 });
+        items.push_back({ primary->id, propertyId(PlaneCrtcW), std::min<uint32_t>(fb->second.width, mode->hdisplay) });
+        items.push_back({ primary->id, propertyId(PlaneCrtcH), std::min<uint32_t>(fb->second.height, mode->vdisplay) });
+        for (int i = 0; i < count; ++i)
+            items.push_back({ connectors[i], propertyId(ConnectorCrtcId), crtcId });
+    } else {
+        items.push_back({ crtcId, propertyId(CrtcActive), 0 });
+        items.push_back({ crtcId, propertyId(CrtcModeId), 0 });
+        for (const Plane &plane : m_planes) {
+            if (value(plane, propertyId(PlaneCrtcId)) == crtcId) {
+                items.push_back({ plane.id, propertyId(PlaneFbId), 0 });
+                items.push_back({ plane.id, propertyId(PlaneCrtcId), 0 });
+            }
+        }
+        for (const Connector &connector : m_connectors) {
+            if (value(connector, propertyId(ConnectorCrtcId)) == crtcId)
+                items.push_back({ connector.id, propertyId(ConnectorCrtcId), 0 });
+        }
+    }
+    const int ret = commitLocked(lock, -1, items, DRM_MODE_ATOMIC_ALLOW_MODESET, nullptr);
+    // The blob of the previous legacy mode goes once it is replaced
+    const uint32_t oldBlob = ret ? modeBlob : crtc->legacyModeBlob;
+    if (!ret)
+        crtc->legacyModeBlob = modeBlob;
+    auto it = m_blobs.find(oldBlob);
+    if (oldBlob && it != m_blobs.end())
+        it->second.destroyed = true;
+    collectBlobs();
+    return ret;
+}
+
+int FakeDrmDevice::setPlane(uint32_t planeId, uint32_t crtcId, uint32_t fbId, const std::vector<uint64_t> &geometry)
+{
+    FakeDrmKernelScope scope;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    ++m_stats.ioctls;
+    if (!findPlane(planeId))
+        return -ENOENT;
+    std::vector<AtomicItem> items;
+    items.push_back({ planeId, propertyId(PlaneFbId), fbId });
+    items.push_back({ planeId, propertyId(PlaneCrtcId), fbId ? crtcId : 0 });
+    if (fbId) {
+        static const Property order[] = { PlaneCrtcX, PlaneCrtcY, PlaneCrtcW, PlaneCrtcH,
+                                          PlaneSrcX, PlaneSrcY, PlaneSrcW, PlaneSrcH };
+        for (size_t i = 0; i < geometry.size() && i < 8; ++i)
+            items.push_back({ planeId, propertyId(order[i]), geometry[i] });
+    }
+    return commitLocked(lock, -1, items, 0, nullptr);
+}
+
+int FakeDrmDevice::countIoctl()
+{
+    std::lock_guard<std::mutex> locker(m_mutex);
+    ++m_stats.ioctls;
+    return 0;
+}
+
+int FakeDrmDevice::commitLocked(std::unique_lock<std::mutex> &lock, int fd, const std::vector<AtomicItem> &request,
+                                uint32_t flags, void *userData)
+{
+    if (flags & ~DRM_MODE_ATOMIC_FLAGS)
+        return -EINVAL;
+    const bool testOnly = flags & DRM_MODE_ATOMIC_TEST_ONLY;
+    if ((testOnly && (flags & DRM_MODE_PAGE_FLIP_EVENT)) || (flags & DRM_MODE_PAGE_FLIP_ASYNC))
+        return -EINVAL;
+
+    // A later value for the same property wins
+    std::vector<AtomicItem> items;
+    items.reserve(request.size());
+    for (const AtomicItem &item : request) {
+        auto it = std::find_if(items.begin(), items.end(), [&item](const AtomicItem &other) {
+            return other.object == item.object && other.property == item.property;
+        });
+        if (it != items.end())
+            it->value = item.value;
+        else
+            items.push_back(item);
+    }
+
+    for (const AtomicItem &item : items) {
+        if (!findObject(item.object))
+            return -ENOENT;
+    }
+
+    // CRTCs the commit touches, through their planes and connectors too
+    auto affectedCrtcs = [this, &items]() {
+        uint32_t mask = 0;
+        for (const AtomicItem &item : items) {
+            const Object *object = findObject(item.object);
+            if (object->type == DRM_MODE_OBJECT_CRTC) {
+                mask |= 1u << static_cast<const Crtc *>(object)->index;
+                continue;
+            }
+            const uint32_t crtcProperty = propertyId(object->type == DRM_MODE_OBJECT_PLANE ? PlaneCrtcId : ConnectorCrtcId);
+            const int current = crtcIndexForId(value(*object, crtcProperty));
+            if (current >= 0)
+                mask |= 1u << current;
+            const int next = item.property == crtcProperty ? crtcIndexForId(item.value) : -1;
+            if (next >= 0)
+                mask |= 1u << next;
+        }
+        return mask;
+    };
+
+    uint32_t affected = affectedCrtcs();
+    if (!testOnly) {
+        while (busy(affected)) {
+            if (flags & DRM_MODE_ATOMIC_NONBLOCK)
+                return -EBUSY;
+            m_changed.wait(lock);
+            affected = affectedCrtcs();
+        }
+    }
+
+    // The new state of every object the commit writes
+    std::map<uint32_t, std::vector<std::pair<uint32_t, uint64_t>>> next;
+    std::map<uint32_t, int> inFences;
+    std::map<int, int32_t *> outFences;
+    for (const AtomicItem &item : items) {
+        Object *object = findObject(item.object);
+        const PropertyDef *def = findProperty(item.property);
+        bool attached = false;
+        for (const auto &entry : object->properties)
+            attached = attached || entry.first == item.property;
+        if (!def || !attached || (def->flags & DRM_MODE_PROP_IMMUTABLE))
+            return -EINVAL;
+        if (item.property == propertyId(PlaneInFenceFd)) {
+            const int fence = int(int64_t(item.value));
+            if (int64_t(item.value) < -1 || int64_t(item.value) > INT32_MAX || (fence >= 0 && fcntl(fence, F_GETFD) < 0))
+                return -EINVAL;
+            if (fence >= 0)
+                inFences[object->id] = fence;
+            continue;
+        }
+        if (item.property == propertyId(CrtcOutFencePtr)) {
+            if (item.value)
+                outFences[static_cast<Crtc *>(object)->index] = reinterpret_cast<int32_t *>(uintptr_t(item.value));
+            continue;
+        }
+        if (!validValue(*def, item.value))
+            return -EINVAL;
+        auto state = next.emplace(object->id, object->properties).first;
+        for (auto &entry : state->second) {
+            if (entry.first == item.property)
+                entry.second = item.value;
+        }
+    }
+    auto newValue = [this, &next](const Object &object, Property property) {
+        auto state = next.find(object.id);
+        if (state == next.end())
+            return value(object, propertyId(property));
+        Object copy;
+        copy.properties = state->second;
+        return value(copy, propertyId(property));
+    };
+
+    // CRTC state
+    std::vector<drmModeModeInfo> modes(m_crtcs.size());
+    for (Crtc &crtc : m_crtcs) {
+        const bool active = newValue(crtc, CrtcActive);
+        const uint32_t modeId = uint32_t(newValue(crtc, CrtcModeId));
+        modes[crtc.index] = crtc.mode;
+        if (!(affected & (1u << crtc.index)))
+            continue;
+        if (active && !modeId)
+            return -EINVAL;
+        if (modeId) {
+            const Blob &blob = m_blobs[modeId];
+            if (blob.data.size() != sizeof(drmModeModeInfo))
+                return -EINVAL;
+            memcpy(&modes[crtc.index], blob.data.data(), sizeof(drmModeModeInfo));
+        }
+        const drmModeModeInfo &mode = modes[crtc.index];
+        if (active && (!mode.hdisplay || !mode.vdisplay || !mode.htotal || !mode.vtotal || !mode.clock))
+            return -EINVAL;
+        const bool modeChanged = active != crtc.active
+                || (active && memcmp(&mode, &crtc.mode, sizeof mode) != 0);
+        // A refresh change at the same size is seamless on these panels
+        const bool seamless = active && crtc.active
+                && mode.hdisplay == crtc.mode.hdisplay && mode.vdisplay == crtc.mode.vdisplay;
+        if (modeChanged && !seamless && !(flags & DRM_MODE_ATOMIC_ALLOW_MODESET))
+            return -EINVAL;
+        if (!active && ((flags & DRM_MODE_PAGE_FLIP_EVENT) || outFences.count(crtc.index)))
+            return -EINVAL;
+    }
+    if ((flags & DRM_MODE_PAGE_FLIP_EVENT) && !affected)
+        return -EINVAL;
+
+    // Plane state, against the CRTC state above
+    for (const Plane &plane : m_planes) {
+        const uint32_t fbId = uint32_t(newValue(plane, PlaneFbId));
+        const uint32_t crtcId = uint32_t(newValue(plane, PlaneCrtcId));
+        if (!fbId != !crtcId)
+            return -EINVAL;
+        if (!fbId) {
+            if (inFences.count(plane.id))
+                return -EINVAL;
+            continue;
+        }
+        const int crtcIndex = crtcIndexForId(crtcId);
+        if (crtcIndex < 0 || !(plane.possibleCrtcs & (1u << crtcIndex)) || !newValue(m_crtcs[crtcIndex], CrtcActive))
+            return -EINVAL;
+        if (!next.count(plane.id) && !(affected & (1u << crtcIndex)))
+            continue;
+        const Framebuffer &framebuffer = m_framebuffers[fbId];
+        if (std::find(plane.formats.begin(), plane.formats.end(), framebuffer.format) == plane.formats.end())
+            return -EINVAL;
+        const uint64_t srcX = newValue(plane, PlaneSrcX);
+        const uint64_t srcY = newValue(plane, PlaneSrcY);
+        const uint64_t srcW = newValue(plane, PlaneSrcW);
+        const uint64_t srcH = newValue(plane, PlaneSrcH);
+        const uint64_t crtcW = newValue(plane, PlaneCrtcW);
+        const uint64_t crtcH = newValue(plane, PlaneCrtcH);
+        if (!srcW || !srcH || !crtcW || !crtcH)
+            return -EINVAL;
+        if (srcX + srcW > uint64_t(framebuffer.width) << 16 || srcY + srcH > uint64_t(framebuffer.height) << 16)
+            return -ENOSPC;
+        if (!plane.canScale && ((srcW >> 16) != crtcW || (srcH >> 16) != crtcH))
+            return -EINVAL;
+        affected |= 1u << crtcIndex;
+    }
+
+    if (testOnly)
+        return 0;
+
+    for (auto &state : next)
+        findObject(state.first)->properties = state.second;
+    m_stats.propertiesWritten += items.size();
+    for (Encoder &encoder : m_encoders) {
+        for (const Connector &connector : m_connectors) {
+            if (connector.encoderId == encoder.id && next.count(connector.id))
+                encoder.crtcId = uint32_t(value(connector, propertyId(ConnectorCrtcId)));
+        }
+    }
+
+    const Clock::time_point now = Clock::now();
+    for (Crtc &crtc : m_crtcs) {
+        if (!(affected & (1u << crtc.index)))
+            continue;
+        const bool active = value(crtc, propertyId(CrtcActive));
+        const drmModeModeInfo &mode = modes[crtc.index];
+        if (active && !crtc.active) {
+            crtc.lastVblank = now;
+            crtc.nextVblank = now + framePeriod(mode);
+        } else if (active && (mode.clock != crtc.mode.clock || mode.htotal != crtc.mode.htotal
+                              || mode.vtotal != crtc.mode.vtotal)) {
+            crtc.nextVblank = crtc.lastVblank + framePeriod(mode);
+        }
+        crtc.mode = mode;
+        crtc.active = active;
+
+        PendingCommit commit;
+        commit.crtcIndex = crtc.index;
+        commit.fd = fd;
+        for (const Plane &plane : m_planes) {
+            const int planeCrtc = crtcIndexForId(value(plane, propertyId(PlaneCrtcId)));
+            if (planeCrtc == crtc.index)
+                commit.latch.push_back({ plane.id, uint32_t(value(plane, propertyId(PlaneFbId))), crtc.index });
+            else if (plane.scanoutCrtc == crtc.index && planeCrtc < 0)
+                commit.latch.push_back({ plane.id, 0, -1 });
+            if (planeCrtc == crtc.index && inFences.count(plane.id)) {
+                const int fence = fcntl(inFences[plane.id], F_DUPFD_CLOEXEC, 0);
+                if (fence >= 0)
+                    commit.inFences.push_back(fence);
+                ++m_stats.inFences;
+            }
+        }
+        auto outFence = outFences.find(crtc.index);
+        if (outFence != outFences.end()) {
+            commit.outFence = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+            *outFence->second = commit.outFence >= 0 ? fcntl(commit.outFence, F_DUPFD_CLOEXEC, 0) : -1;
+            ++m_stats.outFences;
+        }
+
+        if (!crtc.active) {
+            // Nothing scans out, the commit is done at once
+            latch(commit);
+            for (int fence : commit.inFences)
+                close(fence);
+            if (commit.outFence >= 0) {
+                const uint64_t one = 1;
+                (void)!write(commit.outFence, &one, sizeof one);
+                close(commit.outFence);
+            }
+            continue;
+        }
+        commit.event = flags & DRM_MODE_PAGE_FLIP_EVENT;
+        commit.userData = userData;
+        crtc.pending = true;
+        m_pending.push_back(std::move(commit));
+    }
+    collectBlobs();
+    m_changed.notify_all();
+
+    if (!(flags & DRM_MODE_ATOMIC_NONBLOCK)) {
+        while (busy(affected))
+            m_changed.wait(lock);
+    }
+    return 0;
+}
+
+void FakeDrmDevice::latch(const PendingCommit &commit)
+{
+    for (const PendingCommit::Latch &entry : commit.latch) {
+        Plane *plane = findPlane(entry.planeId);
+        if (!plane)
+            continue;
+        plane->scanout = entry.fbId;
+        plane->scanoutCrtc = entry.fbId ? entry.crtcIndex : -1;
+    }
+}
+
+void FakeDrmDevice::queueEvent(const Event &event)
+{
+    if (event.fd < 0)
+        return;
+    m_events.push_back(event);
+    const char byte = 0;
+    (void)!write(event.fd, &byte, 1);
+}
+
+FakeDrmDevice::Clock::duration FakeDrmDevice::framePeriod(const drmModeModeInfo &mode)
+{
+    if (!mode.clock || !mode.htotal || !mode.vtotal)
+        return std::chrono::microseconds(16667);
+    return std::chrono::nanoseconds(uint64_t(mode.htotal) * mode.vtotal * 1000000 / mode.clock);
+}
+
+void FakeDrmDevice::vblank(Crtc *crtc, Clock::time_point time)
+{
+    ++crtc->sequence;
+    ++m_stats.vblanks;
+    crtc->lastVblank = time;
+    crtc->nextVblank = time + framePeriod(crtc->mode);
+
+    for (auto it = m_pending.begin(); it != m_pending.end(); ++it) {
+        if (it->crtcIndex != crtc->index)
+            continue;
+        // Scanout waits until the buffers are rendered
+        bool ready = true;
+        for (int fence : it->inFences) {
+            pollfd pfd = { fence, POLLIN, 0 };
+            ready = ready && poll(&pfd, 1, 0) > 0;
+        }
+        if (!ready)
+            break;
+        latch(*it);
+        for (int fence : it->inFences)
+            close(fence);
+        if (it->outFence >= 0) {
+            const uint64_t one = 1;
+            (void)!write(it->outFence, &one, sizeof one);
+            close(it->outFence);
+        }
+        if (it->event) {
+            Event event;
+            event.type = Event::PageFlip;
+            event.fd = it->fd;
+            event.crtcId = crtc->id;
+            event.sequence = crtc->sequence;
+            event.time = time;
+            event.userData = uint64_t(uintptr_t(it->userData));
+            queueEvent(event);
+        }
+        m_pending.erase(it);
+        crtc->pending = false;
+        break;
+    }
+
+    for (auto it = m_vblankRequests.begin(); it != m_vblankRequests.end();) {
+        if (it->crtcIndex != crtc->index || it->sequence > crtc->sequence) {
+            ++it;
+            continue;
+        }
+        Event event;
+        event.type = it->crtcSequence ? Event::Sequence : Event::Vblank;
+        event.fd = it->fd;
+        event.crtcId = crtc->id;
+        event.sequence = crtc->sequence;
+        event.time = time;
+        event.userData = it->userData;
+        queueEvent(event);
+        it = m_vblankRequests.erase(it);
+    }
+}
+
+void FakeDrmDevice::run()
+{
+    FakeDrmKernelScope scope;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;) {
+        Clock::time_point next = Clock::time_point::max();
+        for (const Crtc &crtc : m_crtcs) {
+            if (crtc.active)
+                next = std::min(next, crtc.nextVblank);
+        }
+        if (next == Clock::time_point::max()) {
+            m_changed.wait(lock);
+            continue;
+        }
+        if (Clock::now() < next) {
+            m_changed.wait_until(lock, next);
+            continue;
+        }
+        const Clock::time_point now = Clock::now();
+        for (Crtc &crtc : m_crtcs) {
+            if (!crtc.active || crtc.nextVblank > now)
+                continue;
+            vblank(&crtc, crtc.nextVblank);
+            // A stalled clock skips vblanks instead of bursting
+            const Clock::duration period = framePeriod(crtc.mode);
+            if (crtc.nextVblank <= now) {
+                const auto missed = (now - crtc.nextVblank) / period + 1;
+                crtc.sequence += missed;
+                crtc.nextVblank += missed * period;
+            }
+        }
+        m_changed.notify_all();
+    }
+}
+
+int FakeDrmDevice::waitVBlank(int fd, drmVBlank *vbl)
+{
+    FakeDrmKernelScope scope;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    ++m_stats.ioctls;
+    const uint32_t type = vbl->request.type;
+    const int index = (type & DRM_VBLANK_SECONDARY) ? 1 : int((type & DRM_VBLANK_HIGH_CRTC_MASK) >> DRM_VBLANK_HIGH_CRTC_SHIFT);
+    if (index >= int(m_crtcs.size()))
+        return -EINVAL;
+    Crtc &crtc = m_crtcs[index];
+    if (!crtc.active)
+        return -EINVAL;
+
+    uint64_t target = vbl->request.sequence;
+    if (type & DRM_VBLANK_RELATIVE)
+        target += crtc.sequence;
+    else
+        target |= crtc.sequence & ~uint64_t(UINT32_MAX);
+    if ((type & DRM_VBLANK_NEXTONMISS) && target <= crtc.sequence)
+        target = crtc.sequence + 1;
+
+    if (type & DRM_VBLANK_EVENT) {
+        VblankRequest request;
+        request.fd = fd;
+        request.crtcIndex = index;
+        request.sequence = target;
+        request.userData = vbl->request.signal;
+        if (target <= crtc.sequence) {
+            Event event;
+            event.type = Event::Vblank;
+            event.fd = fd;
+            event.crtcId = crtc.id;
+            event.sequence = crtc.sequence;
+            event.time = crtc.lastVblank;
+            event.userData = request.userData;
+            queueEvent(event);
+        } else {
+            m_vblankRequests.push_back(request);
+        }
+        vbl->reply.sequence = uint32_t(target);
+        vbl->reply.tval_sec = 0;
+        vbl->reply.tval_usec = 0;
+        return 0;
+    }
+
+    while (crtc.active && crtc.sequence < target)
+        m_changed.wait(lock);
+    if (!crtc.active)
+        return -EINVAL;
+    const uint64_t ns = toNs(crtc.lastVblank);
+    vbl->reply.type = drmVBlankSeqType(type);
+    vbl->reply.sequence = uint32_t(crtc.sequence);
+    vbl->reply.tval_sec = long(ns / 1000000000);
+    vbl->reply.tval_usec = long(ns % 1000000000 / 1000);
+    return 0;
+}
+
+int FakeDrmDevice::crtcGetSequence(uint32_t crtcId, uint64_t *sequence, uint64_t *ns)
+{
+    std::lock_guard<std::mutex> locker(m_mutex);
+    ++m_stats.ioctls;
+    const Crtc *crtc = findCrtc(crtcId);
+    if (!crtc)
+        return -ENOENT;
+    if (!crtc->active)
+        return -EINVAL;
+    if (sequence)
+        *sequence = crtc->sequence;
+    if (ns)
+        *ns = toNs(crtc->lastVblank);
+    return 0;
+}
+
+int FakeDrmDevice::crtcQueueSequence(int fd, uint32_t crtcId, uint32_t flags, uint64_t sequence,
+                                     uint64_t *queued, uint64_t userData)
+{
+    FakeDrmKernelScope scope;
+    std::lock_guard<std::mutex> locker(m_mutex);
+    ++m_stats.ioctls;
+    const Crtc *crtc = findCrtc(crtcId);
+    if (!crtc)
+        return -ENOENT;
+    if (!crtc->active || (flags & ~(s_sequenceRelative | s_sequenceNextOnMiss)))
+        return -EINVAL;
+    uint64_t target = (flags & s_sequenceRelative) ? crtc->sequence + sequence : sequence;
+    if ((flags & s_sequenceNextOnMiss) && target <= crtc->sequence)
+        target = crtc->sequence + 1;
+    VblankRequest request;
+    request.fd = fd;
+    request.crtcIndex = crtc->index;
+    request.sequence = target;
+    request.userData = userData;
+    request.crtcSequence = true;
+    m_vblankRequests.push_back(request);
+    if (queued)
+        *queued = target;
+    return 0;
+}
+
+int FakeDrmDevice::handleEvent(int fd, drmEventContext *context)
+{
+    // One byte stands for one queued event
+    char buffer[64];
+    const ssize_t count = read(fd, buffer, sizeof buffer);
+    if (count <= 0)
+        return -1;
+
+    std::vector<Event> events;
+    {
+        FakeDrmKernelScope scope;
+        std::lock_guard<std::mutex> locker(m_mutex);
+        for (auto it = m_events.begin(); it != m_events.end() && ssize_t(events.size()) < count;) {
+            if (it->fd != fd) {
+                ++it;
+                continue;
+            }
+            if (it->type == Event::PageFlip)
+                ++m_stats.flipEvents;
+            else
+                ++m_stats.vblankEvents;
+            events.push_back(*it);
+            it = m_events.erase(it);
+        }
+        // Every open file of the FIFO shares its bytes, give back the ones
+        // of other files
+        for (ssize_t i = events.size(); i < count; ++i)
+            (void)!write(fd, buffer, 1);
+    }
+
+    for (const Event &event : events) {
+        const uint64_t ns = toNs(event.time);
+        const unsigned int sec = unsigned(ns / 1000000000);
+        const unsigned int usec = unsigned(ns % 1000000000 / 1000);
+        void *userData = reinterpret_cast<void *>(uintptr_t(event.userData));
+        switch (event.type) {
+        case Event::PageFlip:
+            if (context->version >= 3 && context->page_flip_handler2)
+                context->page_flip_handler2(fd, unsigned(event.sequence), sec, usec, event.crtcId, userData);
+            else if (context->page_flip_handler)
+                context->page_flip_handler(fd, unsigned(event.sequence), sec, usec, userData);
+            break;
+        case Event::Vblank:
+            if (context->vblank_handler)
+                context->vblank_handler(fd, unsigned(event.sequence), sec, usec, userData);
+            break;
+        case Event::Sequence:
+            if (context->version >= 4 && context->sequence_handler)
+                context->sequence_handler(fd, event.sequence, ns, event.userData);
+            break;
+        }
+    }
+    return 0;
+}
+
+uint32_t FakeDrmDevice::createBuffer(int dmabufFd)
+{
+    FakeDrmKernelScope scope;
+    std::lock_guard<std::mutex> locker(m_mutex);
+    ++m_stats.ioctls;
+    struct stat st;
+    if (fstat(dmabufFd, &st) != 0)
+        return 0;
+    Buffer buffer;
+    buffer.device = st.st_dev;
+    buffer.inode = st.st_ino;
+    buffer.fd = dmabufFd;
+    const uint32_t handle = m_nextHandle++;
+    m_buffers[handle] = buffer;
+    ++m_stats.bufferObjectsCreated;
+    ++m_stats.bufferObjects;
+    return handle;
+}
+
+void FakeDrmDevice::destroyBuffer(uint32_t handle)
+{
+    FakeDrmKernelScope scope;
+    std::lock_guard<std::mutex> locker(m_mutex);
+    ++m_stats.ioctls;
+    m_buffers.erase(handle);
+    if (m_stats.bufferObjects)
+        --m_stats.bufferObjects;
+}
+
+void FakeDrmDevice::countSwap(int damageRects)
+{
+    std::lock_guard<std::mutex> locker(m_mutex);
+    ++m_stats.swapBuffers;
+    m_stats.damageRects += std::max(0, damageRects);
+}
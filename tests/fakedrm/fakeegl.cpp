@@ -0,0 +1,707 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include "fakedrm_p.h"
+
+// EGL for gbm surfaces of the fake gbm. Rendering does nothing, a swap
+// queues the back buffer of the surface for the plugin to lock.
+
+namespace {
+
+struct FakeEglConfig {
+    EGLint id;
+    EGLint red;
+    EGLint green;
+    EGLint blue;
+    EGLint alpha;
+    EGLint depth;
+    EGLint stencil;
+    // A gbm format
+    EGLint visual;
+};
+
+struct FakeEglSurface {
+    const FakeEglConfig *config = nullptr;
+    gbm_surface *window = nullptr;
+    EGLint width = 0;
+    EGLint height = 0;
+    // From eglSetDamageRegionKHR() until the swap
+    EGLint damageRects = 0;
+};
+
+struct FakeEglContext {
+    const FakeEglConfig *config = nullptr;
+    EGLint version = 2;
+};
+
+struct FakeEglSync {
+    EGLenum type = 0;
+    int fd = -1;
+};
+
+struct FakeEglImage {
+    EGLenum target = 0;
+};
+
+}
+
+#define FAKEEGL_FOURCC(a, b, c, d) EGLint(uint32_t(a) | uint32_t(b) << 8 | uint32_t(c) << 16 | uint32_t(d) << 24)
+
+static const FakeEglConfig s_configs[] = {
+    { 1, 8, 8, 8, 0, 0, 0, FAKEEGL_FOURCC('X', 'R', '2', '4') },
+    { 2, 8, 8, 8, 0, 24, 8, FAKEEGL_FOURCC('X', 'R', '2', '4') },
+    { 3, 8, 8, 8, 8, 0, 0, FAKEEGL_FOURCC('A', 'R', '2', '4') },
+    { 4, 8, 8, 8, 8, 24, 8, FAKEEGL_FOURCC('A', 'R', '2', '4') },
+    { 5, 5, 6, 5, 0, 0, 0, FAKEEGL_FOURCC('R', 'G', '1', '6') },
+    { 6, 5, 6, 5, 0, 16, 0, FAKEEGL_FOURCC('R', 'G', '1', '6') },
+};
+
+static const char s_extensions[] =
+    "EGL_KHR_create_context EGL_KHR_surfaceless_context EGL_KHR_fence_sync "
+    "EGL_ANDROID_native_fence_sync EGL_KHR_swap_buffers_with_damage "
+    "EGL_EXT_swap_buffers_with_damage EGL_KHR_partial_update EGL_EXT_buffer_age "
+    "EGL_KHR_image_base";
+
+static int s_display;
+
+static thread_local EGLint t_error = EGL_SUCCESS;
+static thread_local EGLenum t_api = EGL_OPENGL_ES_API;
+static thread_local EGLContext t_context = EGL_NO_CONTEXT;
+static thread_local EGLSurface t_draw = EGL_NO_SURFACE;
+static thread_local EGLSurface t_read = EGL_NO_SURFACE;
+
+static EGLDisplay display()
+{
+    return static_cast<EGLDisplay>(&s_display);
+}
+
+static EGLBoolean fail(EGLint error)
+{
+    t_error = error;
+    return EGL_FALSE;
+}
+
+static EGLBoolean succeed()
+{
+    t_error = EGL_SUCCESS;
+    return EGL_TRUE;
+}
+
+static const FakeEglConfig *toConfig(EGLConfig config)
+{
+    for (const FakeEglConfig &entry : s_configs) {
+        if (&entry == config)
+            return &entry;
+    }
+    return nullptr;
+}
+
+static bool configAttrib(const FakeEglConfig &config, EGLint attribute, EGLint *value)
+{
+    switch (attribute) {
+    case EGL_CONFIG_ID:
+        *value = config.id;
+        return true;
+    case EGL_RED_SIZE:
+        *value = config.red;
+        return true;
+    case EGL_GREEN_SIZE:
+        *value = config.green;
+        return true;
+    case EGL_BLUE_SIZE:
+        *value = config.blue;
+        return true;
+    case EGL_ALPHA_SIZE:
+        *value = config.alpha;
+        return true;
+    case EGL_BUFFER_SIZE:
+        *value = config.red + config.green + config.blue + config.alpha;
+        return true;
+    case EGL_DEPTH_SIZE:
+        *value = config.depth;
+        return true;
+    case EGL_STENCIL_SIZE:
+        *value = config.stencil;
+        return true;
+    case EGL_NATIVE_VISUAL_ID:
+        *value = config.visual;
+        return true;
+    case EGL_NATIVE_VISUAL_TYPE:
+        *value = EGL_NONE;
+        return true;
+    case EGL_SURFACE_TYPE:
+        *value = EGL_WINDOW_BIT | EGL_PBUFFER_BIT;
+        return true;
+    case EGL_RENDERABLE_TYPE:
+    case EGL_CONFORMANT:
+        *value = EGL_OPENGL_ES2_BIT | EGL_OPENGL_ES3_BIT_KHR;
+        return true;
+    case EGL_COLOR_BUFFER_TYPE:
+        *value = EGL_RGB_BUFFER;
+        return true;
+    case EGL_CONFIG_CAVEAT:
+    case EGL_TRANSPARENT_TYPE:
+        *value = EGL_NONE;
+        return true;
+    case EGL_NATIVE_RENDERABLE:
+        *value = EGL_TRUE;
+        return true;
+    case EGL_MAX_PBUFFER_WIDTH:
+    case EGL_MAX_PBUFFER_HEIGHT:
+        *value = 8192;
+        return true;
+    case EGL_MIN_SWAP_INTERVAL:
+        *value = 0;
+        return true;
+    case EGL_MAX_SWAP_INTERVAL:
+        *value = 1;
+        return true;
+    case EGL_LEVEL:
+    case EGL_SAMPLES:
+    case EGL_SAMPLE_BUFFERS:
+    case EGL_LUMINANCE_SIZE:
+    case EGL_ALPHA_MASK_SIZE:
+    case EGL_BIND_TO_TEXTURE_RGB:
+    case EGL_BIND_TO_TEXTURE_RGBA:
+    case EGL_TRANSPARENT_RED_VALUE:
+    case EGL_TRANSPARENT_GREEN_VALUE:
+    case EGL_TRANSPARENT_BLUE_VALUE:
+    case EGL_MAX_PBUFFER_PIXELS:
+        *value = 0;
+        return true;
+    default:
+        return false;
+    }
+}
+
+static bool matches(const FakeEglConfig &config, const EGLint *attribs)
+{
+    for (const EGLint *attrib = attribs; attrib && attrib[0] != EGL_NONE; attrib += 2) {
+        const EGLint wanted = attrib[1];
+        if (wanted == EGL_DONT_CARE)
+            continue;
+        EGLint value = 0;
+        if (!configAttrib(config, attrib[0], &value))
+            continue;
+        switch (attrib[0]) {
+        case EGL_SURFACE_TYPE:
+        case EGL_RENDERABLE_TYPE:
+        case EGL_CONFORMANT:
+            if ((value & wanted) != wanted)
+                return false;
+            break;
+        case EGL_CONFIG_ID:
+        case EGL_NATIVE_VISUAL_ID:
+        case EGL_COLOR_BUFFER_TYPE:
+        case EGL_CONFIG_CAVEAT:
+        case EGL_TRANSPARENT_TYPE:
+        case EGL_NATIVE_RENDERABLE:
+        case EGL_LEVEL:
+            if (value != wanted)
+                return false;
+            break;
+        case EGL_MIN_SWAP_INTERVAL:
+        case EGL_MAX_SWAP_INTERVAL:
+            break;
+        default:
+            if (value < wanted)
+                return false;
+            break;
+        }
+    }
+    return true;
+}
+
+static bool swap(EGLSurface eglSurface, EGLint damageRects)
+{
+    FakeEglSurface *surface = static_cast<FakeEglSurface *>(eglSurface);
+    if (!surface)
+        return fail(EGL_BAD_SURFACE);
+    if (!surface->window)
+        return succeed();
+    if (!fakegbm_surface_swap(surface->window))
+        return fail(EGL_BAD_ALLOC);
+    FakeDrmDevice::instance().countSwap(damageRects ? damageRects : surface->damageRects);
+    surface->damageRects = 0;
+    return succeed();
+}
+
+static EGLSyncKHR EGLAPIENTRY fakeCreateSync(EGLDisplay dpy, EGLenum type, const EGLint *attribs)
+{
+    (void)dpy;
+    if (type != EGL_SYNC_FENCE_KHR && type != EGL_SYNC_NATIVE_FENCE_ANDROID) {
+        fail(EGL_BAD_ATTRIBUTE);
+        return EGL_NO_SYNC_KHR;
+    }
+    FakeEglSync *sync = new FakeEglSync;
+    sync->type = type;
+    for (const EGLint *attrib = attribs; attrib && attrib[0] != EGL_NONE; attrib += 2) {
+        if (attrib[0] == EGL_SYNC_NATIVE_FENCE_FD_ANDROID && attrib[1] != EGL_NO_NATIVE_FENCE_FD_ANDROID)
+            sync->fd = attrib[1];
+    }
+    // Rendering is done at once, so is the fence
+    if (type == EGL_SYNC_NATIVE_FENCE_ANDROID && sync->fd < 0)
+        sync->fd = eventfd(1, EFD_CLOEXEC | EFD_NONBLOCK);
+    succeed();
+    return static_cast<EGLSyncKHR>(sync);
+}
+
+static EGLBoolean EGLAPIENTRY fakeDestroySync(EGLDisplay dpy, EGLSyncKHR eglSync)
+{
+    (void)dpy;
+    FakeEglSync *sync = static_cast<FakeEglSync *>(eglSync);
+    if (!sync)
+        return fail(EGL_BAD_PARAMETER);
+    if (sync->fd >= 0)
+        close(sync->fd);
+    delete sync;
+    return succeed();
+}
+
+static EGLint EGLAPIENTRY fakeClientWaitSync(EGLDisplay dpy, EGLSyncKHR sync, EGLint flags, EGLTimeKHR timeout)
+{
+    (void)dpy;
+    (void)sync;
+    (void)flags;
+    (void)timeout;
+    return EGL_CONDITION_SATISFIED_KHR;
+}
+
+static EGLint EGLAPIENTRY fakeWaitSync(EGLDisplay dpy, EGLSyncKHR sync, EGLint flags)
+{
+    (void)dpy;
+    (void)sync;
+    (void)flags;
+    return EGL_TRUE;
+}
+
+static EGLint EGLAPIENTRY fakeDupNativeFenceFD(EGLDisplay dpy, EGLSyncKHR eglSync)
+{
+    (void)dpy;
+    const FakeEglSync *sync = static_cast<const FakeEglSync *>(eglSync);
+    if (!sync || sync->fd < 0) {
+        fail(EGL_BAD_PARAMETER);
+        return EGL_NO_NATIVE_FENCE_FD_ANDROID;
+    }
+    return fcntl(sync->fd, F_DUPFD_CLOEXEC, 0);
+}
+
+static EGLBoolean EGLAPIENTRY fakeSwapBuffersWithDamage(EGLDisplay dpy, EGLSurface surface, const EGLint *rects, EGLint count)
+{
+    (void)dpy;
+    (void)rects;
+    return swap(surface, count);
+}
+
+static EGLBoolean EGLAPIENTRY fakeSetDamageRegion(EGLDisplay dpy, EGLSurface eglSurface, EGLint *rects, EGLint count)
+{
+    (void)dpy;
+    (void)rects;
+    FakeEglSurface *surface = static_cast<FakeEglSurface *>(eglSurface);
+    if (!surface || !surface->window)
+        return fail(EGL_BAD_SURFACE);
+    surface->damageRects = count;
+    return succeed();
+}
+
+static EGLImageKHR EGLAPIENTRY fakeCreateImage(EGLDisplay dpy, EGLContext context, EGLenum target,
+                                               EGLClientBuffer buffer, const EGLint *attribs)
+{
+    (void)dpy;
+    (void)context;
+    (void)buffer;
+    (void)attribs;
+    FakeEglImage *image = new FakeEglImage;
+    image->target = target;
+    succeed();
+    return static_cast<EGLImageKHR>(image);
+}
+
+static EGLBoolean EGLAPIENTRY fakeDestroyImage(EGLDisplay dpy, EGLImageKHR image)
+{
+    (void)dpy;
+    delete static_cast<FakeEglImage *>(image);
+    return succeed();
+}
+
+extern "C" {
+
+EGLAPI EGLint EGLAPIENTRY eglGetError(void)
+{
+    const EGLint error = t_error;
+    t_error = EGL_SUCCESS;
+    return error;
+}
+
+EGLAPI EGLDisplay EGLAPIENTRY eglGetDisplay(EGLNativeDisplayType nativeDisplay)
+{
+    (void)nativeDisplay;
+    return display();
+}
+
+EGLAPI EGLDisplay EGLAPIENTRY eglGetPlatformDisplay(EGLenum platform, void *nativeDisplay, const EGLAttrib *attribs)
+{
+    (void)platform;
+    (void)nativeDisplay;
+    (void)attribs;
+    return display();
+}
+
+EGLAPI EGLBoolean EGLAPIENTRY eglInitialize(EGLDisplay dpy, EGLint *major, EGLint *minor)
+{
+    if (dpy != display())
+        return fail(EGL_BAD_DISPLAY);
+    if (major)
+        *major = 1;
+    if (minor)
+        *minor = 4;
+    return succeed();
+}
+
+EGLAPI EGLBoolean EGLAPIENTRY eglTerminate(EGLDisplay dpy)
+{
+    (void)dpy;
+    return succeed();
+}
+
+EGLAPI const char *EGLAPIENTRY eglQueryString(EGLDisplay dpy, EGLint name)
+{
+    // No platform extensions, Qt falls back to eglGetDisplay()
+    if (dpy == EGL_NO_DISPLAY)
+        return name == EGL_EXTENSIONS ? "EGL_EXT_client_extensions" : nullptr;
+    switch (name) {
+    case EGL_VENDOR:
+        return "fakedrm";
+    case EGL_VERSION:
+        return "1.4 fakedrm";
+    case EGL_CLIENT_APIS:
+        return "OpenGL_ES";
+    case EGL_EXTENSIONS:
+        return s_extensions;
+    default:
+        fail(EGL_BAD_PARAMETER);
+        return nullptr;
+    }
+}
+
+EGLAPI EGLBoolean EGLAPIENTRY eglBindAPI(EGLenum api)
+{
+    if (api != EGL_OPENGL_ES_API)
+        return fail(EGL_BAD_PARAMETER);
+    t_api = api;
+    return succeed();
+}
+
+EGLAPI EGLenum EGLAPIENTRY eglQueryAPI(void)
+{
+    return t_api;
+}
+
+EGLAPI EGLBoolean EGLAPIENTRY eglGetConfigs(EGLDisplay dpy, EGLConfig *configs, EGLint size, EGLint *count)
+{
+    (void)dpy;
+    if (!count)
+        return fail(EGL_BAD_PARAMETER);
+    const EGLint total = sizeof s_configs / sizeof s_configs[0];
+    *count = configs ? std::min(size, total) : total;
+    for (EGLint i = 0; configs && i < *count; ++i)
+        configs[i] = const_cast<FakeEglConfig *>(&s_configs[i]);
+    return succeed();
+}
+
+EGLAPI EGLBoolean EGLAPIENTRY eglChooseConfig(EGLDisplay dpy, const EGLint *attribs, EGLConfig *configs,
+                                              EGLint size, EGLint *count)
+{
+    (void)dpy;
+    if (!count)
+        return fail(EGL_BAD_PARAMETER);
+    *count = 0;
+    for (const FakeEglConfig &config : s_configs) {
+        if (!matches(config, attribs))
+            continue;
+        if (configs && *count >= size)
+            break;
+        if (configs)
+            configs[*count] = const_cast<FakeEglConfig *>(&config);
+        ++*count;
+    }
+    return succeed();
+}
+
+EGLAPI EGLBoolean EGLAPIENTRY eglGetConfigAttrib(EGLDisplay dpy, EGLConfig eglConfig, EGLint attribute, EGLint *value)
+{
+    (void)dpy;
+    const FakeEglConfig *config = toConfig(eglConfig);
+    if (!config)
+        return fail(EGL_BAD_CONFIG);
+    if (!configAttrib(*config, attribute, value))
+        return fail(EGL_BAD_ATTRIBUTE);
+    return succeed();
+}
+
+EGLAPI EGLSurface EGLAPIENTRY eglCreateWindowSurface(EGLDisplay dpy, EGLConfig config, EGLNativeWindowType window,
+                                                     const EGLint *attribs)
+{
+    (void)dpy;
+    (void)attribs;
+    if (!toConfig(config)) {
+        fail(EGL_BAD_CONFIG);
+        return EGL_NO_SURFACE;
+    }
+    if (!window) {
+        fail(EGL_BAD_NATIVE_WINDOW);
+        return EGL_NO_SURFACE;
+    }
+    FakeEglSurface *surface = new FakeEglSurface;
+    surface->config = toConfig(config);
+    surface->window = reinterpret_cast<gbm_surface *>(window);
+    fakegbm_surface_size(surface->window, &surface->width, &surface->height);
+    succeed();
+    return static_cast<EGLSurface>(surface);
+}
+
+EGLAPI EGLSurface EGLAPIENTRY eglCreatePlatformWindowSurface(EGLDisplay dpy, EGLConfig config, void *window,
+                                                             const EGLAttrib *attribs)
+{
+    (void)attribs;
+    return eglCreateWindowSurface(dpy, config, reinterpret_cast<EGLNativeWindowType>(window), nullptr);
+}
+
+EGLAPI EGLSurface EGLAPIENTRY eglCreatePbufferSurface(EGLDisplay dpy, EGLConfig config, const EGLint *attribs)
+{
+    (void)dpy;
+    if (!toConfig(config)) {
+        fail(EGL_BAD_CONFIG);
+        return EGL_NO_SURFACE;
+    }
+    FakeEglSurface *surface = new FakeEglSurface;
+    surface->config = toConfig(config);
+    for (const EGLint *attrib = attribs; attrib && attrib[0] != EGL_NONE; attrib += 2) {
+        if (attrib[0] == EGL_WIDTH)
+            surface->width = attrib[1];
+        else if (attrib[0] == EGL_HEIGHT)
+            surface->height = attrib[1];
+    }
+    succeed();
+    return static_cast<EGLSurface>(surface);
+}
+
+EGLAPI EGLBoolean EGLAPIENTRY eglDestroySurface(EGLDisplay dpy, EGLSurface surface)
+{
+    (void)dpy;
+    if (!surface)
+        return fail(EGL_BAD_SURFACE);
+    delete static_cast<FakeEglSurface *>(surface);
+    return succeed();
+}
+
+EGLAPI EGLBoolean EGLAPIENTRY eglQuerySurface(EGLDisplay dpy, EGLSurface eglSurface, EGLint attribute, EGLint *value)
+{
+    (void)dpy;
+    const FakeEglSurface *surface = static_cast<const FakeEglSurface *>(eglSurface);
+    if (!surface)
+        return fail(EGL_BAD_SURFACE);
+    switch (attribute) {
+    case EGL_WIDTH:
+        *value = surface->width;
+        break;
+    case EGL_HEIGHT:
+        *value = surface->height;
+        break;
+    case EGL_CONFIG_ID:
+        *value = surface->config->id;
+        break;
+    case EGL_RENDER_BUFFER:
+        *value = surface->window ? EGL_BACK_BUFFER : EGL_SINGLE_BUFFER;
+        break;
+    case EGL_SWAP_BEHAVIOR:
+        *value = EGL_BUFFER_DESTROYED;
+        break;
+    case EGL_BUFFER_AGE_KHR:
+        *value = surface->window ? fakegbm_surface_buffer_age(surface->window) : 0;
+        break;
+    default:
+        return fail(EGL_BAD_ATTRIBUTE);
+    }
+    return succeed();
+}
+
+EGLAPI EGLBoolean EGLAPIENTRY eglSurfaceAttrib(EGLDisplay dpy, EGLSurface surface, EGLint attribute, EGLint value)
+{
+    (void)dpy;
+    (void)attribute;
+    (void)value;
+    return surface ? succeed() : fail(EGL_BAD_SURFACE);
+}
+
+EGLAPI EGLContext EGLAPIENTRY eglCreateContext(EGLDisplay dpy, EGLConfig config, EGLContext shareContext,
+                                               const EGLint *attribs)
+{
+    (void)dpy;
+    (void)shareContext;
+    FakeEglContext *context = new FakeEglContext;
+    context->config = toConfig(config);
+    for (const EGLint *attrib = attribs; attrib && attrib[0] != EGL_NONE; attrib += 2) {
+        if (attrib[0] == EGL_CONTEXT_CLIENT_VERSION)
+            context->version = attrib[1];
+    }
+    succeed();
+    return static_cast<EGLContext>(context);
+}
+
+EGLAPI EGLBoolean EGLAPIENTRY eglDestroyContext(EGLDisplay dpy, EGLContext context)
+{
+    (void)dpy;
+    if (!context)
+        return fail(EGL_BAD_CONTEXT);
+    if (t_context == context) {
+        t_context = EGL_NO_CONTEXT;
+        t_draw = EGL_NO_SURFACE;
+        t_read = EGL_NO_SURFACE;
+    }
+    delete static_cast<FakeEglContext *>(context);
+    return succeed();
+}
+
+EGLAPI EGLBoolean EGLAPIENTRY eglQueryContext(EGLDisplay dpy, EGLContext eglContext, EGLint attribute, EGLint *value)
+{
+    (void)dpy;
+    const FakeEglContext *context = static_cast<const FakeEglContext *>(eglContext);
+    if (!context)
+        return fail(EGL_BAD_CONTEXT);
+    switch (attribute) {
+    case EGL_CONFIG_ID:
+        *value = context->config ? context->config->id : 0;
+        break;
+    case EGL_CONTEXT_CLIENT_TYPE:
+        *value = EGL_OPENGL_ES_API;
+        break;
+    case EGL_CONTEXT_CLIENT_VERSION:
+        *value = context->version;
+        break;
+    case EGL_RENDER_BUFFER:
+        *value = EGL_BACK_BUFFER;
+        break;
+    default:
+        return fail(EGL_BAD_ATTRIBUTE);
+    }
+    return succeed();
+}
+
+EGLAPI EGLBoolean EGLAPIENTRY eglMakeCurrent(EGLDisplay dpy, EGLSurface draw, EGLSurface read, EGLContext context)
+{
+    (void)dpy;
+    t_context = context;
+    t_draw = context ? draw : EGL_NO_SURFACE;
+    t_read = context ? read : EGL_NO_SURFACE;
+    return succeed();
+}
+
+EGLAPI EGLContext EGLAPIENTRY eglGetCurrentContext(void)
+{
+    return t_context;
+}
+
+EGLAPI EGLDisplay EGLAPIENTRY eglGetCurrentDisplay(void)
+{
+    return t_context ? display() : EGL_NO_DISPLAY;
+}
+
+EGLAPI EGLSurface EGLAPIENTRY eglGetCurrentSurface(EGLint readdraw)
+{
+    return readdraw == EGL_READ ? t_read : t_draw;
+}
+
+EGLAPI EGLBoolean EGLAPIENTRY eglSwapBuffers(EGLDisplay dpy, EGLSurface surface)
+{
+    (void)dpy;
+    return swap(surface, 0);
+}
+
+EGLAPI EGLBoolean EGLAPIENTRY eglSwapInterval(EGLDisplay dpy, EGLint interval)
+{
+    (void)dpy;
+    (void)interval;
+    return succeed();
+}
+
+EGLAPI EGLBoolean EGLAPIENTRY eglWaitClient(void)
+{
+    return succeed();
+}
+
+EGLAPI EGLBoolean EGLAPIENTRY eglWaitGL(void)
+{
+    return succeed();
+}
+
+EGLAPI EGLBoolean EGLAPIENTRY eglWaitNative(EGLint engine)
+{
+    (void)engine;
+    return succeed();
+}
+
+EGLAPI EGLBoolean EGLAPIENTRY eglReleaseThread(void)
+{
+    t_context = EGL_NO_CONTEXT;
+    t_draw = EGL_NO_SURFACE;
+    t_read = EGL_NO_SURFACE;
+    t_api = EGL_OPENGL_ES_API;
+    return succeed();
+}
+
+EGLAPI __eglMustCastToProperFunctionPointerType EGLAPIENTRY eglGetProcAddress(const char *name)
+{
+    typedef __eglMustCastToProperFunctionPointerType Proc;
+    struct Entry {
+        const char *name;
+        Proc proc;
+    };
+    static const Entry entries[] = {
+        { "eglCreateSyncKHR", reinterpret_cast<Proc>(&fakeCreateSync) },
+        { "eglDestroySyncKHR", reinterpret_cast<Proc>(&fakeDestroySync) },
+        { "eglClientWaitSyncKHR", reinterpret_cast<Proc>(&fakeClientWaitSync) },
+        { "eglWaitSyncKHR", reinterpret_cast<Proc>(&fakeWaitSync) },
+        { "eglDupNativeFenceFDANDROID", reinterpret_cast<Proc>(&fakeDupNativeFenceFD) },
+        { "eglSwapBuffersWithDamageKHR", reinterpret_cast<Proc>(&fakeSwapBuffersWithDamage) },
+        { "eglSwapBuffersWithDamageEXT", reinterpret_cast<Proc>(&fakeSwapBuffersWithDamage) },
+        { "eglSetDamageRegionKHR", reinterpret_cast<Proc>(&fakeSetDamageRegion) },
+        { "eglCreateImageKHR", reinterpret_cast<Proc>(&fakeCreateImage) },
+        { "eglDestroyImageKHR", reinterpret_cast<Proc>(&fakeDestroyImage) },
+        { "eglGetPlatformDisplay", reinterpret_cast<Proc>(&eglGetPlatformDisplay) },
+        { "eglCreatePlatformWindowSurface", reinterpret_cast<Proc>(&eglCreatePlatformWindowSurface) },
+    };
+    if (!name)
+        return nullptr;
+    for (const Entry &entry : entries) {
+        if (!strcmp(entry.name, name))
+            return entry.proc;
+    }
+    return reinterpret_cast<Proc>(fakegles_proc_address(name));
+}
+
+}
@@ -0,0 +1,580 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <deque>
+
+#include <drm_fourcc.h>
+#include <gbm.h>
+#ifdef PLANE_COMPOSITION
+#include <gbm_priv.h>
+#endif
+
+#include "fakedrm_p.h"
+
+// gbm on top of the simulated device. Buffer objects are memfds, which
+// stand for dma-bufs well enough for PRIME and the plugin caches keyed by
+// inode. The structs are our own, the gbm types stay opaque to callers.
+
+namespace {
+
+struct FakeGbmSurface;
+
+struct FakeGbmDevice {
+    int fd = -1;
+};
+
+struct FakeGbmBo {
+    FakeGbmDevice *device = nullptr;
+    FakeGbmSurface *surface = nullptr;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t format = 0;
+    uint32_t stride = 0;
+    uint32_t flags = 0;
+    size_t size = 0;
+    int planes = 1;
+    int fd = -1;
+    uint32_t handle = 0;
+    bool imported = false;
+    void *userData = nullptr;
+    void (*destroyUserData)(gbm_bo *, void *) = nullptr;
+};
+
+struct FakeGbmSurface {
+    enum State { Free, Queued, Locked };
+    struct Slot {
+        FakeGbmBo *bo = nullptr;
+        State state = Free;
+        // Frame the slot was last queued in, 0 before
+        uint64_t frame = 0;
+    };
+
+    FakeGbmDevice *device = nullptr;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t format = 0;
+    uint32_t flags = 0;
+    // Triple buffered like Mesa
+    Slot slots[3];
+    int back = -1;
+    uint64_t frame = 0;
+    std::deque<int> queue;
+};
+
+}
+
+static gbm_device *toGbm(FakeGbmDevice *device)
+{
+    return reinterpret_cast<gbm_device *>(device);
+}
+
+static FakeGbmDevice *fromGbm(gbm_device *device)
+{
+    return reinterpret_cast<FakeGbmDevice *>(device);
+}
+
+static gbm_bo *toGbm(FakeGbmBo *bo)
+{
+    return reinterpret_cast<gbm_bo *>(bo);
+}
+
+static FakeGbmBo *fromGbm(gbm_bo *bo)
+{
+    return reinterpret_cast<FakeGbmBo *>(bo);
+}
+
+static gbm_surface *toGbm(FakeGbmSurface *surface)
+{
+    return reinterpret_cast<gbm_surface *>(surface);
+}
+
+static FakeGbmSurface *fromGbm(gbm_surface *surface)
+{
+    return reinterpret_cast<FakeGbmSurface *>(surface);
+}
+
+static uint32_t bytesPerPixel(uint32_t format)
+{
+    switch (format) {
+    case DRM_FORMAT_RGB565:
+        return 2;
+    case DRM_FORMAT_NV12:
+        return 1;
+    case DRM_FORMAT_XRGB8888:
+    case DRM_FORMAT_ARGB8888:
+    case DRM_FORMAT_XBGR8888:
+    case DRM_FORMAT_ABGR8888:
+    case DRM_FORMAT_XRGB2101010:
+    case DRM_FORMAT_ARGB2101010:
+        return 4;
+    default:
+        return 0;
+    }
+}
+
+static FakeGbmBo *createBo(FakeGbmDevice *device, uint32_t width, uint32_t height, uint32_t format, uint32_t flags)
+{
+    const uint32_t bpp = bytesPerPixel(format);
+    if (!device || !width || !height || !bpp) {
+        errno = EINVAL;
+        return nullptr;
+    }
+    FakeGbmBo *bo = new FakeGbmBo;
+    bo->device = device;
+    bo->width = width;
+    bo->height = height;
+    bo->format = format;
+    bo->flags = flags;
+    bo->stride = (width * bpp + 63) & ~63u;
+    bo->planes = format == DRM_FORMAT_NV12 ? 2 : 1;
+    bo->size = format == DRM_FORMAT_NV12 ? size_t(bo->stride) * height * 3 / 2 : size_t(bo->stride) * height;
+    bo->fd = memfd_create("fakegbm", MFD_CLOEXEC);
+    if (bo->fd < 0 || ftruncate(bo->fd, bo->size) != 0) {
+        if (bo->fd >= 0)
+            close(bo->fd);
+        delete bo;
+        return nullptr;
+    }
+    bo->handle = FakeDrmDevice::instance().createBuffer(bo->fd);
+    return bo;
+}
+
+static void destroyBo(FakeGbmBo *bo)
+{
+    if (bo->destroyUserData)
+        bo->destroyUserData(toGbm(bo), bo->userData);
+    if (!bo->imported)
+        FakeDrmDevice::instance().destroyBuffer(bo->handle);
+    close(bo->fd);
+    delete bo;
+}
+
+// The back buffer is picked when rendering starts, as in Mesa
+static bool acquireBack(FakeGbmSurface *surface)
+{
+    if (surface->back >= 0)
+        return true;
+    for (int i = 0; i < 3; ++i) {
+        FakeGbmSurface::Slot &slot = surface->slots[i];
+        if (slot.state != FakeGbmSurface::Free)
+            continue;
+        if (!slot.bo) {
+            slot.bo = createBo(surface->device, surface->width, surface->height, surface->format, surface->flags);
+            if (!slot.bo)
+                return false;
+            slot.bo->surface = surface;
+        }
+        surface->back = i;
+        return true;
+    }
+    return false;
+}
+
+void fakegbm_surface_size(gbm_surface *surface, int *width, int *height)
+{
+    *width = fromGbm(surface)->width;
+    *height = fromGbm(surface)->height;
+}
+
+bool fakegbm_surface_swap(gbm_surface *gbmSurface)
+{
+    FakeGbmSurface *surface = fromGbm(gbmSurface);
+    if (!acquireBack(surface))
+        return false;
+    FakeGbmSurface::Slot &slot = surface->slots[surface->back];
+    slot.state = FakeGbmSurface::Queued;
+    slot.frame = ++surface->frame;
+    surface->queue.push_back(surface->back);
+    surface->back = -1;
+    acquireBack(surface);
+    return true;
+}
+
+int fakegbm_surface_buffer_age(gbm_surface *gbmSurface)
+{
+    FakeGbmSurface *surface = fromGbm(gbmSurface);
+    if (!acquireBack(surface))
+        return 0;
+    const FakeGbmSurface::Slot &slot = surface->slots[surface->back];
+    return slot.frame ? int(surface->frame + 1 - slot.frame) : 0;
+}
+
+extern "C" {
+
+gbm_device *gbm_create_device(int fd)
+{
+    FakeGbmDevice *device = new FakeGbmDevice;
+    device->fd = fd;
+    return toGbm(device);
+}
+
+void gbm_device_destroy(gbm_device *device)
+{
+    delete fromGbm(device);
+}
+
+int gbm_device_get_fd(gbm_device *device)
+{
+    return fromGbm(device)->fd;
+}
+
+const char *gbm_device_get_backend_name(gbm_device *device)
+{
+    (void)device;
+    return "fakedrm";
+}
+
+int gbm_device_is_format_supported(gbm_device *device, uint32_t format, uint32_t flags)
+{
+    (void)device;
+    if ((flags & GBM_BO_USE_CURSOR) && format != DRM_FORMAT_ARGB8888)
+        return 0;
+    return bytesPerPixel(format) ? 1 : 0;
+}
+
+int gbm_device_get_format_modifier_plane_count(gbm_device *device, uint32_t format, uint64_t modifier)
+{
+    (void)device;
+    if (modifier != DRM_FORMAT_MOD_LINEAR || !bytesPerPixel(format))
+        return -1;
+    return format == DRM_FORMAT_NV12 ? 2 : 1;
+}
+
+gbm_bo *gbm_bo_create(gbm_device *device, uint32_t width, uint32_t height, uint32_t format, uint32_t flags)
+{
+    return toGbm(createBo(fromGbm(device), width, height, format, flags));
+}
+
+gbm_bo *gbm_bo_create_with_modifiers(gbm_device *device, uint32_t width, uint32_t height, uint32_t format,
+                                     const uint64_t *modifiers, const unsigned int count)
+{
+    if (count && std::find(modifiers, modifiers + count, DRM_FORMAT_MOD_LINEAR) == modifiers + count) {
+        errno = ENOSYS;
+        return nullptr;
+    }
+    return gbm_bo_create(device, width, height, format, GBM_BO_USE_SCANOUT | GBM_BO_USE_RENDERING);
+}
+
+gbm_bo *gbm_bo_import(gbm_device *device, uint32_t type, void *buffer, uint32_t flags)
+{
+    if (type != GBM_BO_IMPORT_FD) {
+        errno = EINVAL;
+        return nullptr;
+    }
+    const gbm_import_fd_data *data = static_cast<const gbm_import_fd_data *>(buffer);
+    FakeGbmBo *bo = new FakeGbmBo;
+    bo->device = fromGbm(device);
+    bo->width = data->width;
+    bo->height = data->height;
+    bo->format = data->format;
+    bo->stride = data->stride;
+    bo->flags = flags;
+    bo->imported = true;
+    bo->fd = fcntl(data->fd, F_DUPFD_CLOEXEC, 0);
+    if (bo->fd < 0 || FakeDrmDevice::instance().primeFdToHandle(bo->fd, &bo->handle) != 0) {
+        if (bo->fd >= 0)
+            close(bo->fd);
+        delete bo;
+        errno = EINVAL;
+        return nullptr;
+    }
+    return toGbm(bo);
+}
+
+void gbm_bo_destroy(gbm_bo *bo)
+{
+    // Buffers of a surface go with it
+    if (bo && !fromGbm(bo)->surface)
+        destroyBo(fromGbm(bo));
+}
+
+void *gbm_bo_map(gbm_bo *gbmBo, uint32_t x, uint32_t y, uint32_t width, uint32_t height, uint32_t flags,
+                 uint32_t *stride, void **mapData)
+{
+    (void)width;
+    (void)height;
+    (void)flags;
+    FakeGbmBo *bo = fromGbm(gbmBo);
+    void *data = mmap(nullptr, bo->size, PROT_READ | PROT_WRITE, MAP_SHARED, bo->fd, 0);
+    if (data == MAP_FAILED)
+        return nullptr;
+    *mapData = data;
+    *stride = bo->stride;
+    return static_cast<uint8_t *>(data) + size_t(y) * bo->stride + size_t(x) * bytesPerPixel(bo->format);
+}
+
+void gbm_bo_unmap(gbm_bo *bo, void *mapData)
+{
+    munmap(mapData, fromGbm(bo)->size);
+}
+
+int gbm_bo_write(gbm_bo *gbmBo, const void *buffer, size_t count)
+{
+    FakeGbmBo *bo = fromGbm(gbmBo);
+    if (count > bo->size || pwrite(bo->fd, buffer, count, 0) != ssize_t(count))
+        return -1;
+    return 0;
+}
+
+uint32_t gbm_bo_get_width(gbm_bo *bo)
+{
+    return fromGbm(bo)->width;
+}
+
+uint32_t gbm_bo_get_height(gbm_bo *bo)
+{
+    return fromGbm(bo)->height;
+}
+
+uint32_t gbm_bo_get_stride(gbm_bo *bo)
+{
+    return fromGbm(bo)->stride;
+}
+
+uint32_t gbm_bo_get_stride_for_plane(gbm_bo *bo, int plane)
+{
+    return plane < fromGbm(bo)->planes ? fromGbm(bo)->stride : 0;
+}
+
+uint32_t gbm_bo_get_format(gbm_bo *bo)
+{
+    return fromGbm(bo)->format;
+}
+
+uint32_t gbm_bo_get_bpp(gbm_bo *bo)
+{
+    return bytesPerPixel(fromGbm(bo)->format) * 8;
+}
+
+uint32_t gbm_bo_get_offset(gbm_bo *gbmBo, int plane)
+{
+    const FakeGbmBo *bo = fromGbm(gbmBo);
+    return plane == 1 && bo->planes == 2 ? bo->stride * bo->height : 0;
+}
+
+uint64_t gbm_bo_get_modifier(gbm_bo *bo)
+{
+    (void)bo;
+    return DRM_FORMAT_MOD_LINEAR;
+}
+
+int gbm_bo_get_plane_count(gbm_bo *bo)
+{
+    return fromGbm(bo)->planes;
+}
+
+gbm_device *gbm_bo_get_device(gbm_bo *bo)
+{
+    return toGbm(fromGbm(bo)->device);
+}
+
+union gbm_bo_handle gbm_bo_get_handle(gbm_bo *bo)
+{
+    union gbm_bo_handle handle;
+    handle.u64 = 0;
+    handle.u32 = fromGbm(bo)->handle;
+    return handle;
+}
+
+union gbm_bo_handle gbm_bo_get_handle_for_plane(gbm_bo *bo, int plane)
+{
+    union gbm_bo_handle handle;
+    handle.u64 = 0;
+    if (plane < fromGbm(bo)->planes)
+        handle.u32 = fromGbm(bo)->handle;
+    return handle;
+}
+
+int gbm_bo_get_fd(gbm_bo *bo)
+{
+#ifdef PLANE_COMPOSITION
+    // The QTI gbm hands out the fd of the bo itself
+    return fromGbm(bo)->fd;
+#else
+    return fcntl(fromGbm(bo)->fd, F_DUPFD_CLOEXEC, 0);
+#endif
+}
+
+int gbm_bo_get_fd_for_plane(gbm_bo *bo, int plane)
+{
+    if (plane >= fromGbm(bo)->planes)
+        return -1;
+    return fcntl(fromGbm(bo)->fd, F_DUPFD_CLOEXEC, 0);
+}
+
+void gbm_bo_set_user_data(gbm_bo *gbmBo, void *data, void (*destroyUserData)(gbm_bo *, void *))
+{
+    FakeGbmBo *bo = fromGbm(gbmBo);
+    bo->userData = data;
+    bo->destroyUserData = destroyUserData;
+}
+
+void *gbm_bo_get_user_data(gbm_bo *bo)
+{
+    return fromGbm(bo)->userData;
+}
+
+gbm_surface *gbm_surface_create(gbm_device *device, uint32_t width, uint32_t height, uint32_t format, uint32_t flags)
+{
+    if (!width || !height || !bytesPerPixel(format)) {
+        errno = EINVAL;
+        return nullptr;
+    }
+    FakeGbmSurface *surface = new FakeGbmSurface;
+    surface->device = fromGbm(device);
+    surface->width = width;
+    surface->height = height;
+    surface->format = format;
+    surface->flags = flags;
+    return toGbm(surface);
+}
+
+gbm_surface *gbm_surface_create_with_modifiers(gbm_device *device, uint32_t width, uint32_t height, uint32_t format,
+                                               const uint64_t *modifiers, const unsigned int count)
+{
+    if (count && std::find(modifiers, modifiers + count, DRM_FORMAT_MOD_LINEAR) == modifiers + count) {
+        errno = ENOSYS;
+        return nullptr;
+    }
+    return gbm_surface_create(device, width, height, format, GBM_BO_USE_SCANOUT | GBM_BO_USE_RENDERING);
+}
+
+void gbm_surface_destroy(gbm_surface *gbmSurface)
+{
+    FakeGbmSurface *surface = fromGbm(gbmSurface);
+    if (!surface)
+        return;
+    for (FakeGbmSurface::Slot &slot : surface->slots) {
+        if (slot.bo)
+            destroyBo(slot.bo);
+    }
+    delete surface;
+}
+
+gbm_bo *gbm_surface_lock_front_buffer(gbm_surface *gbmSurface)
+{
+    FakeGbmSurface *surface = fromGbm(gbmSurface);
+    if (surface->queue.empty())
+        return nullptr;
+    FakeGbmSurface::Slot &slot = surface->slots[surface->queue.front()];
+    surface->queue.pop_front();
+    slot.state = FakeGbmSurface::Locked;
+    return toGbm(slot.bo);
+}
+
+void gbm_surface_release_buffer(gbm_surface *gbmSurface, gbm_bo *bo)
+{
+    FakeGbmSurface *surface = fromGbm(gbmSurface);
+    for (FakeGbmSurface::Slot &slot : surface->slots) {
+        if (slot.bo == fromGbm(bo) && slot.state == FakeGbmSurface::Locked)
+            slot.state = FakeGbmSurface::Free;
+    }
+}
+
+int gbm_surface_has_free_buffers(gbm_surface *gbmSurface)
+{
+    FakeGbmSurface *surface = fromGbm(gbmSurface);
+    if (surface->back >= 0)
+        return 1;
+    for (const FakeGbmSurface::Slot &slot : surface->slots) {
+        if (slot.state == FakeGbmSurface::Free)
+            return 1;
+    }
+    return 0;
+}
+
+#ifdef PLANE_COMPOSITION
+int gbm_perform(int operation, ...)
+{
+    va_list args;
+    va_start(args, operation);
+    int ret = GBM_ERROR_NONE;
+    switch (operation) {
+    case GBM_PERFORM_GET_BO_ALIGNED_WIDTH: {
+        const FakeGbmBo *bo = fromGbm(va_arg(args, gbm_bo *));
+        uint32_t *width = va_arg(args, uint32_t *);
+        if (bo && width)
+            *width = bo->stride / bytesPerPixel(bo->format);
+        else
+            ret = GBM_ERROR_BAD_HANDLE;
+        break;
+    }
+    case GBM_PERFORM_GET_BO_ALIGNED_HEIGHT: {
+        const FakeGbmBo *bo = fromGbm(va_arg(args, gbm_bo *));
+        uint32_t *height = va_arg(args, uint32_t *);
+        if (bo && height)
+            *height = bo->height;
+        else
+            ret = GBM_ERROR_BAD_HANDLE;
+        break;
+    }
+    case GBM_PERFORM_GET_UBWC_STATUS: {
+        // Buffers are never compressed
+        gbm_bo *bo = va_arg(args, gbm_bo *);
+        uint32_t *status = va_arg(args, uint32_t *);
+        if (bo && status)
+            *status = 0;
+        else
+            ret = GBM_ERROR_BAD_HANDLE;
+        break;
+    }
+    case GBM_PERFORM_GET_SECURE_BUFFER_STATUS: {
+        gbm_bo *bo = va_arg(args, gbm_bo *);
+        int *secure = va_arg(args, int *);
+        if (bo && secure)
+            *secure = 0;
+        else
+            ret = GBM_ERROR_BAD_HANDLE;
+        break;
+    }
+    case GBM_PERFORM_GET_PLANE_INFO: {
+        const FakeGbmBo *bo = fromGbm(va_arg(args, gbm_bo *));
+        generic_buf_layout_t *layout = va_arg(args, generic_buf_layout_t *);
+        if (!bo || !layout) {
+            ret = GBM_ERROR_BAD_HANDLE;
+            break;
+        }
+        memset(layout, 0, sizeof *layout);
+        layout->pixel_format = bo->format;
+        layout->num_planes = bo->planes;
+        for (int i = 0; i < bo->planes; ++i) {
+            layout->planes[i].offset = i ? bo->stride * bo->height : 0;
+            layout->planes[i].bits_per_pixel = bytesPerPixel(bo->format) * 8;
+            layout->planes[i].h_increment = 1;
+            layout->planes[i].v_increment = bo->stride;
+            layout->planes[i].size = i ? bo->stride * bo->height / 2 : bo->stride * bo->height;
+        }
+        break;
+    }
+    default:
+        ret = GBM_ERROR_UNSUPPORTED;
+        break;
+    }
+    va_end(args);
+    return ret;
+}
+#endif
+
+}
@@ -0,0 +1,526 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+#include <string.h>
+
+#include <atomic>
+
+#include <GLES3/gl3.h>
+
+#include "fakedrm_p.h"
+
+// GLES 3.0 that draws nothing. Queries answer enough for Qt to create
+// contexts, framebuffers and shader programs, the rest are no-ops.
+
+// Every GLES 3.0 function without an answer of its own
+#define FAKEGL_FUNCTIONS(F) \
+    F(void, glActiveTexture, (GLenum)) \
+    F(void, glAttachShader, (GLuint, GLuint)) \
+    F(void, glBindAttribLocation, (GLuint, GLuint, const GLchar *)) \
+    F(void, glBindBuffer, (GLenum, GLuint)) \
+    F(void, glBindFramebuffer, (GLenum, GLuint)) \
+    F(void, glBindRenderbuffer, (GLenum, GLuint)) \
+    F(void, glBindTexture, (GLenum, GLuint)) \
+    F(void, glBlendColor, (GLfloat, GLfloat, GLfloat, GLfloat)) \
+    F(void, glBlendEquation, (GLenum)) \
+    F(void, glBlendEquationSeparate, (GLenum, GLenum)) \
+    F(void, glBlendFunc, (GLenum, GLenum)) \
+    F(void, glBlendFuncSeparate, (GLenum, GLenum, GLenum, GLenum)) \
+    F(void, glBufferData, (GLenum, GLsizeiptr, const void *, GLenum)) \
+    F(void, glBufferSubData, (GLenum, GLintptr, GLsizeiptr, const void *)) \
+    F(void, glClear, (GLbitfield)) \
+    F(void, glClearColor, (GLfloat, GLfloat, GLfloat, GLfloat)) \
+    F(void, glClearDepthf, (GLfloat)) \
+    F(void, glClearStencil, (GLint)) \
+    F(void, glColorMask, (GLboolean, GLboolean, GLboolean, GLboolean)) \
+    F(void, glCompileShader, (GLuint)) \
+    F(void, glCompressedTexImage2D, (GLenum, GLint, GLenum, GLsizei, GLsizei, GLint, GLsizei, const void *)) \
+    F(void, glCompressedTexSubImage2D, (GLenum, GLint, GLint, GLint, GLsizei, GLsizei, GLenum, GLsizei, const void *)) \
+    F(void, glCopyTexImage2D, (GLenum, GLint, GLenum, GLint, GLint, GLsizei, GLsizei, GLint)) \
+    F(void, glCopyTexSubImage2D, (GLenum, GLint, GLint, GLint, GLint, GLint, GLsizei, GLsizei)) \
+    F(void, glCullFace, (GLenum)) \
+    F(void, glDeleteBuffers, (GLsizei, const GLuint *)) \
+    F(void, glDeleteFramebuffers, (GLsizei, const GLuint *)) \
+    F(void, glDeleteProgram, (GLuint)) \
+    F(void, glDeleteRenderbuffers, (GLsizei, const GLuint *)) \
+    F(void, glDeleteShader, (GLuint)) \
+    F(void, glDeleteTextures, (GLsizei, const GLuint *)) \
+    F(void, glDepthFunc, (GLenum)) \
+    F(void, glDepthMask, (GLboolean)) \
+    F(void, glDepthRangef, (GLfloat, GLfloat)) \
+    F(void, glDetachShader, (GLuint, GLuint)) \
+    F(void, glDisable, (GLenum)) \
+    F(void, glDisableVertexAttribArray, (GLuint)) \
+    F(void, glDrawArrays, (GLenum, GLint, GLsizei)) \
+    F(void, glDrawElements, (GLenum, GLsizei, GLenum, const void *)) \
+    F(void, glEnable, (GLenum)) \
+    F(void, glEnableVertexAttribArray, (GLuint)) \
+    F(void, glFinish, (void)) \
+    F(void, glFlush, (void)) \
+    F(void, glFramebufferRenderbuffer, (GLenum, GLenum, GLenum, GLuint)) \
+    F(void, glFramebufferTexture2D, (GLenum, GLenum, GLenum, GLuint, GLint)) \
+    F(void, glFrontFace, (GLenum)) \
+    F(void, glGenerateMipmap, (GLenum)) \
+    F(void, glGetActiveAttrib, (GLuint, GLuint, GLsizei, GLsizei *, GLint *, GLenum *, GLchar *)) \
+    F(void, glGetActiveUniform, (GLuint, GLuint, GLsizei, GLsizei *, GLint *, GLenum *, GLchar *)) \
+    F(void, glGetAttachedShaders, (GLuint, GLsizei, GLsizei *, GLuint *)) \
+    F(GLint, glGetAttribLocation, (GLuint, const GLchar *)) \
+    F(void, glGetBufferParameteriv, (GLenum, GLenum, GLint *)) \
+    F(void, glGetFramebufferAttachmentParameteriv, (GLenum, GLenum, GLenum, GLint *)) \
+    F(void, glGetRenderbufferParameteriv, (GLenum, GLenum, GLint *)) \
+    F(void, glGetShaderPrecisionFormat, (GLenum, GLenum, GLint *, GLint *)) \
+    F(void, glGetShaderSource, (GLuint, GLsizei, GLsizei *, GLchar *)) \
+    F(void, glGetTexParameterfv, (GLenum, GLenum, GLfloat *)) \
+    F(void, glGetTexParameteriv, (GLenum, GLenum, GLint *)) \
+    F(void, glGetUniformfv, (GLuint, GLint, GLfloat *)) \
+    F(void, glGetUniformiv, (GLuint, GLint, GLint *)) \
+    F(GLint, glGetUniformLocation, (GLuint, const GLchar *)) \
+    F(void, glGetVertexAttribfv, (GLuint, GLenum, GLfloat *)) \
+    F(void, glGetVertexAttribiv, (GLuint, GLenum, GLint *)) \
+    F(void, glGetVertexAttribPointerv, (GLuint, GLenum, void **)) \
+    F(void, glHint, (GLenum, GLenum)) \
+    F(GLboolean, glIsBuffer, (GLuint)) \
+    F(GLboolean, glIsEnabled, (GLenum)) \
+    F(GLboolean, glIsFramebuffer, (GLuint)) \
+    F(GLboolean, glIsProgram, (GLuint)) \
+    F(GLboolean, glIsRenderbuffer, (GLuint)) \
+    F(GLboolean, glIsShader, (GLuint)) \
+    F(GLboolean, glIsTexture, (GLuint)) \
+    F(void, glLineWidth, (GLfloat)) \
+    F(void, glLinkProgram, (GLuint)) \
+    F(void, glPixelStorei, (GLenum, GLint)) \
+    F(void, glPolygonOffset, (GLfloat, GLfloat)) \
+    F(void, glReleaseShaderCompiler, (void)) \
+    F(void, glRenderbufferStorage, (GLenum, GLenum, GLsizei, GLsizei)) \
+    F(void, glSampleCoverage, (GLfloat, GLboolean)) \
+    F(void, glScissor, (GLint, GLint, GLsizei, GLsizei)) \
+    F(void, glShaderBinary, (GLsizei, const GLuint *, GLenum, const void *, GLsizei)) \
+    F(void, glShaderSource, (GLuint, GLsizei, const GLchar *const*, const GLint *)) \
+    F(void, glStencilFunc, (GLenum, GLint, GLuint)) \
+    F(void, glStencilFuncSeparate, (GLenum, GLenum, GLint, GLuint)) \
+    F(void, glStencilMask, (GLuint)) \
+    F(void, glStencilMaskSeparate, (GLenum, GLuint)) \
+    F(void, glStencilOp, (GLenum, GLenum, GLenum)) \
+    F(void, glStencilOpSeparate, (GLenum, GLenum, GLenum, GLenum)) \
+    F(void, glTexImage2D, (GLenum, GLint, GLint, GLsizei, GLsizei, GLint, GLenum, GLenum, const void *)) \
+    F(void, glTexParameterf, (GLenum, GLenum, GLfloat)) \
+    F(void, glTexParameterfv, (GLenum, GLenum, const GLfloat *)) \
+    F(void, glTexParameteri, (GLenum, GLenum, GLint)) \
+    F(void, glTexParameteriv, (GLenum, GLenum, const GLint *)) \
+    F(void, glTexSubImage2D, (GLenum, GLint, GLint, GLint, GLsizei, GLsizei, GLenum, GLenum, const void *)) \
+    F(void, glUniform1f, (GLint, GLfloat)) \
+    F(void, glUniform1fv, (GLint, GLsizei, const GLfloat *)) \
+    F(void, glUniform1i, (GLint, GLint)) \
+    F(void, glUniform1iv, (GLint, GLsizei, const GLint *)) \
+    F(void, glUniform2f, (GLint, GLfloat, GLfloat)) \
+    F(void, glUniform2fv, (GLint, GLsizei, const GLfloat *)) \
+    F(void, glUniform2i, (GLint, GLint, GLint)) \
+    F(void, glUniform2iv, (GLint, GLsizei, const GLint *)) \
+    F(void, glUniform3f, (GLint, GLfloat, GLfloat, GLfloat)) \
+    F(void, glUniform3fv, (GLint, GLsizei, const GLfloat *)) \
+    F(void, glUniform3i, (GLint, GLint, GLint, GLint)) \
+    F(void, glUniform3iv, (GLint, GLsizei, const GLint *)) \
+    F(void, glUniform4f, (GLint, GLfloat, GLfloat, GLfloat, GLfloat)) \
+    F(void, glUniform4fv, (GLint, GLsizei, const GLfloat *)) \
+    F(void, glUniform4i, (GLint, GLint, GLint, GLint, GLint)) \
+    F(void, glUniform4iv, (GLint, GLsizei, const GLint *)) \
+    F(void, glUniformMatrix2fv, (GLint, GLsizei, GLboolean, const GLfloat *)) \
+    F(void, glUniformMatrix3fv, (GLint, GLsizei, GLboolean, const GLfloat *)) \
+    F(void, glUniformMatrix4fv, (GLint, GLsizei, GLboolean, const GLfloat *)) \
+    F(void, glUseProgram, (GLuint)) \
+    F(void, glValidateProgram, (GLuint)) \
+    F(void, glVertexAttrib1f, (GLuint, GLfloat)) \
+    F(void, glVertexAttrib1fv, (GLuint, const GLfloat *)) \
+    F(void, glVertexAttrib2f, (GLuint, GLfloat, GLfloat)) \
+    F(void, glVertexAttrib2fv, (GLuint, const GLfloat *)) \
+    F(void, glVertexAttrib3f, (GLuint, GLfloat, GLfloat, GLfloat)) \
+    F(void, glVertexAttrib3fv, (GLuint, const GLfloat *)) \
+    F(void, glVertexAttrib4f, (GLuint, GLfloat, GLfloat, GLfloat, GLfloat)) \
+    F(void, glVertexAttrib4fv, (GLuint, const GLfloat *)) \
+    F(void, glVertexAttribPointer, (GLuint, GLint, GLenum, GLboolean, GLsizei, const void *)) \
+    F(void, glViewport, (GLint, GLint, GLsizei, GLsizei)) \
+    F(void, glReadBuffer, (GLenum)) \
+    F(void, glDrawRangeElements, (GLenum, GLuint, GLuint, GLsizei, GLenum, const void *)) \
+    F(void, glTexImage3D, (GLenum, GLint, GLint, GLsizei, GLsizei, GLsizei, GLint, GLenum, GLenum, const void *)) \
+    F(void, glTexSubImage3D, (GLenum, GLint, GLint, GLint, GLint, GLsizei, GLsizei, GLsizei, GLenum, GLenum, const void *)) \
+    F(void, glCopyTexSubImage3D, (GLenum, GLint, GLint, GLint, GLint, GLint, GLint, GLsizei, GLsizei)) \
+    F(void, glCompressedTexImage3D, (GLenum, GLint, GLenum, GLsizei, GLsizei, GLsizei, GLint, GLsizei, const void *)) \
+    F(void, glCompressedTexSubImage3D, (GLenum, GLint, GLint, GLint, GLint, GLsizei, GLsizei, GLsizei, GLenum, GLsizei, const void *)) \
+    F(void, glDeleteQueries, (GLsizei, const GLuint *)) \
+    F(GLboolean, glIsQuery, (GLuint)) \
+    F(void, glBeginQuery, (GLenum, GLuint)) \
+    F(void, glEndQuery, (GLenum)) \
+    F(void, glGetQueryiv, (GLenum, GLenum, GLint *)) \
+    F(void, glGetQueryObjectuiv, (GLuint, GLenum, GLuint *)) \
+    F(GLboolean, glUnmapBuffer, (GLenum)) \
+    F(void, glGetBufferPointerv, (GLenum, GLenum, void **)) \
+    F(void, glDrawBuffers, (GLsizei, const GLenum *)) \
+    F(void, glUniformMatrix2x3fv, (GLint, GLsizei, GLboolean, const GLfloat *)) \
+    F(void, glUniformMatrix3x2fv, (GLint, GLsizei, GLboolean, const GLfloat *)) \
+    F(void, glUniformMatrix2x4fv, (GLint, GLsizei, GLboolean, const GLfloat *)) \
+    F(void, glUniformMatrix4x2fv, (GLint, GLsizei, GLboolean, const GLfloat *)) \
+    F(void, glUniformMatrix3x4fv, (GLint, GLsizei, GLboolean, const GLfloat *)) \
+    F(void, glUniformMatrix4x3fv, (GLint, GLsizei, GLboolean, const GLfloat *)) \
+    F(void, glBlitFramebuffer, (GLint, GLint, GLint, GLint, GLint, GLint, GLint, GLint, GLbitfield, GLenum)) \
+    F(void, glRenderbufferStorageMultisample, (GLenum, GLsizei, GLenum, GLsizei, GLsizei)) \
+    F(void, glFramebufferTextureLayer, (GLenum, GLenum, GLuint, GLint, GLint)) \
+    F(void *, glMapBufferRange, (GLenum, GLintptr, GLsizeiptr, GLbitfield)) \
+    F(void, glFlushMappedBufferRange, (GLenum, GLintptr, GLsizeiptr)) \
+    F(void, glBindVertexArray, (GLuint)) \
+    F(void, glDeleteVertexArrays, (GLsizei, const GLuint *)) \
+    F(GLboolean, glIsVertexArray, (GLuint)) \
+    F(void, glGetIntegeri_v, (GLenum, GLuint, GLint *)) \
+    F(void, glBeginTransformFeedback, (GLenum)) \
+    F(void, glEndTransformFeedback, (void)) \
+    F(void, glBindBufferRange, (GLenum, GLuint, GLuint, GLintptr, GLsizeiptr)) \
+    F(void, glBindBufferBase, (GLenum, GLuint, GLuint)) \
+    F(void, glTransformFeedbackVaryings, (GLuint, GLsizei, const GLchar *const*, GLenum)) \
+    F(void, glGetTransformFeedbackVarying, (GLuint, GLuint, GLsizei, GLsizei *, GLsizei *, GLenum *, GLchar *)) \
+    F(void, glVertexAttribIPointer, (GLuint, GLint, GLenum, GLsizei, const void *)) \
+    F(void, glGetVertexAttribIiv, (GLuint, GLenum, GLint *)) \
+    F(void, glGetVertexAttribIuiv, (GLuint, GLenum, GLuint *)) \
+    F(void, glVertexAttribI4i, (GLuint, GLint, GLint, GLint, GLint)) \
+    F(void, glVertexAttribI4ui, (GLuint, GLuint, GLuint, GLuint, GLuint)) \
+    F(void, glVertexAttribI4iv, (GLuint, const GLint *)) \
+    F(void, glVertexAttribI4uiv, (GLuint, const GLuint *)) \
+    F(void, glGetUniformuiv, (GLuint, GLint, GLuint *)) \
+    F(GLint, glGetFragDataLocation, (GLuint, const GLchar *)) \
+    F(void, glUniform1ui, (GLint, GLuint)) \
+    F(void, glUniform2ui, (GLint, GLuint, GLuint)) \
+    F(void, glUniform3ui, (GLint, GLuint, GLuint, GLuint)) \
+    F(void, glUniform4ui, (GLint, GLuint, GLuint, GLuint, GLuint)) \
+    F(void, glUniform1uiv, (GLint, GLsizei, const GLuint *)) \
+    F(void, glUniform2uiv, (GLint, GLsizei, const GLuint *)) \
+    F(void, glUniform3uiv, (GLint, GLsizei, const GLuint *)) \
+    F(void, glUniform4uiv, (GLint, GLsizei, const GLuint *)) \
+    F(void, glClearBufferiv, (GLenum, GLint, const GLint *)) \
+    F(void, glClearBufferuiv, (GLenum, GLint, const GLuint *)) \
+    F(void, glClearBufferfv, (GLenum, GLint, const GLfloat *)) \
+    F(void, glClearBufferfi, (GLenum, GLint, GLfloat, GLint)) \
+    F(void, glCopyBufferSubData, (GLenum, GLenum, GLintptr, GLintptr, GLsizeiptr)) \
+    F(void, glGetUniformIndices, (GLuint, GLsizei, const GLchar *const*, GLuint *)) \
+    F(void, glGetActiveUniformsiv, (GLuint, GLsizei, const GLuint *, GLenum, GLint *)) \
+    F(GLuint, glGetUniformBlockIndex, (GLuint, const GLchar *)) \
+    F(void, glGetActiveUniformBlockiv, (GLuint, GLuint, GLenum, GLint *)) \
+    F(void, glGetActiveUniformBlockName, (GLuint, GLuint, GLsizei, GLsizei *, GLchar *)) \
+    F(void, glUniformBlockBinding, (GLuint, GLuint, GLuint)) \
+    F(void, glDrawArraysInstanced, (GLenum, GLint, GLsizei, GLsizei)) \
+    F(void, glDrawElementsInstanced, (GLenum, GLsizei, GLenum, const void *, GLsizei)) \
+    F(GLsync, glFenceSync, (GLenum, GLbitfield)) \
+    F(GLboolean, glIsSync, (GLsync)) \
+    F(void, glDeleteSync, (GLsync)) \
+    F(GLenum, glClientWaitSync, (GLsync, GLbitfield, GLuint64)) \
+    F(void, glWaitSync, (GLsync, GLbitfield, GLuint64)) \
+    F(void, glGetSynciv, (GLsync, GLenum, GLsizei, GLsizei *, GLint *)) \
+    F(void, glGetInteger64i_v, (GLenum, GLuint, GLint64 *)) \
+    F(void, glGetBufferParameteri64v, (GLenum, GLenum, GLint64 *)) \
+    F(void, glDeleteSamplers, (GLsizei, const GLuint *)) \
+    F(GLboolean, glIsSampler, (GLuint)) \
+    F(void, glBindSampler, (GLuint, GLuint)) \
+    F(void, glSamplerParameteri, (GLuint, GLenum, GLint)) \
+    F(void, glSamplerParameteriv, (GLuint, GLenum, const GLint *)) \
+    F(void, glSamplerParameterf, (GLuint, GLenum, GLfloat)) \
+    F(void, glSamplerParameterfv, (GLuint, GLenum, const GLfloat *)) \
+    F(void, glGetSamplerParameteriv, (GLuint, GLenum, GLint *)) \
+    F(void, glGetSamplerParameterfv, (GLuint, GLenum, GLfloat *)) \
+    F(void, glVertexAttribDivisor, (GLuint, GLuint)) \
+    F(void, glBindTransformFeedback, (GLenum, GLuint)) \
+    F(void, glDeleteTransformFeedbacks, (GLsizei, const GLuint *)) \
+    F(GLboolean, glIsTransformFeedback, (GLuint)) \
+    F(void, glPauseTransformFeedback, (void)) \
+    F(void, glResumeTransformFeedback, (void)) \
+    F(void, glGetProgramBinary, (GLuint, GLsizei, GLsizei *, GLenum *, void *)) \
+    F(void, glProgramBinary, (GLuint, GLenum, const void *, GLsizei)) \
+    F(void, glProgramParameteri, (GLuint, GLenum, GLint)) \
+    F(void, glInvalidateFramebuffer, (GLenum, GLsizei, const GLenum *)) \
+    F(void, glInvalidateSubFramebuffer, (GLenum, GLsizei, const GLenum *, GLint, GLint, GLsizei, GLsizei)) \
+    F(void, glTexStorage2D, (GLenum, GLsizei, GLenum, GLsizei, GLsizei)) \
+    F(void, glTexStorage3D, (GLenum, GLsizei, GLenum, GLsizei, GLsizei, GLsizei)) \
+    F(void, glGetInternalformativ, (GLenum, GLenum, GLenum, GLsizei, GLint *))
+
+
+#define FAKEGL_EXPLICIT_FUNCTIONS(F) \
+    F(glGetString) \
+    F(glGetStringi) \
+    F(glGetIntegerv) \
+    F(glGetInteger64v) \
+    F(glGetFloatv) \
+    F(glGetBooleanv) \
+    F(glGetError) \
+    F(glCheckFramebufferStatus) \
+    F(glGenTextures) \
+    F(glGenBuffers) \
+    F(glGenFramebuffers) \
+    F(glGenRenderbuffers) \
+    F(glGenVertexArrays) \
+    F(glGenQueries) \
+    F(glGenSamplers) \
+    F(glGenTransformFeedbacks) \
+    F(glCreateShader) \
+    F(glCreateProgram) \
+    F(glGetShaderiv) \
+    F(glGetProgramiv) \
+    F(glGetShaderInfoLog) \
+    F(glGetProgramInfoLog) \
+    F(glReadPixels)
+
+static std::atomic<GLuint> s_nextName(1);
+
+template<typename T>
+static T zero()
+{
+    return T();
+}
+
+static void generate(GLsizei count, GLuint *names)
+{
+    for (GLsizei i = 0; i < count; ++i)
+        names[i] = s_nextName++;
+}
+
+static GLint integer(GLenum name, GLint *values)
+{
+    switch (name) {
+    case GL_VIEWPORT:
+    case GL_SCISSOR_BOX:
+        values[0] = 0;
+        values[1] = 0;
+        values[2] = 8192;
+        values[3] = 8192;
+        return 4;
+    case GL_MAX_VIEWPORT_DIMS:
+        values[0] = 8192;
+        values[1] = 8192;
+        return 2;
+    case GL_MAX_TEXTURE_SIZE:
+    case GL_MAX_RENDERBUFFER_SIZE:
+        values[0] = 8192;
+        return 1;
+    case GL_MAX_TEXTURE_IMAGE_UNITS:
+    case GL_MAX_COMBINED_TEXTURE_IMAGE_UNITS:
+    case GL_MAX_VERTEX_ATTRIBS:
+        values[0] = 16;
+        return 1;
+    case GL_MAJOR_VERSION:
+        values[0] = 3;
+        return 1;
+    case GL_RED_BITS:
+    case GL_GREEN_BITS:
+    case GL_BLUE_BITS:
+    case GL_ALPHA_BITS:
+        values[0] = 8;
+        return 1;
+    default:
+        values[0] = 0;
+        return 1;
+    }
+}
+
+extern "C" {
+
+#define FAKEGL_DEFINE(ret, name, params) \
+    GL_APICALL ret GL_APIENTRY name params { return zero<ret>(); }
+FAKEGL_FUNCTIONS(FAKEGL_DEFINE)
+#undef FAKEGL_DEFINE
+
+GL_APICALL const GLubyte *GL_APIENTRY glGetString(GLenum name)
+{
+    switch (name) {
+    case GL_VENDOR:
+        return reinterpret_cast<const GLubyte *>("fakedrm");
+    case GL_RENDERER:
+        return reinterpret_cast<const GLubyte *>("fakedrm");
+    case GL_VERSION:
+        return reinterpret_cast<const GLubyte *>("OpenGL ES 3.0 fakedrm");
+    case GL_SHADING_LANGUAGE_VERSION:
+        return reinterpret_cast<const GLubyte *>("OpenGL ES GLSL ES 3.00");
+    case GL_EXTENSIONS:
+        return reinterpret_cast<const GLubyte *>("");
+    default:
+        return nullptr;
+    }
+}
+
+GL_APICALL const GLubyte *GL_APIENTRY glGetStringi(GLenum name, GLuint index)
+{
+    (void)name;
+    (void)index;
+    return nullptr;
+}
+
+GL_APICALL void GL_APIENTRY glGetIntegerv(GLenum name, GLint *data)
+{
+    integer(name, data);
+}
+
+GL_APICALL void GL_APIENTRY glGetInteger64v(GLenum name, GLint64 *data)
+{
+    GLint values[4];
+    const GLint count = integer(name, values);
+    for (GLint i = 0; i < count; ++i)
+        data[i] = values[i];
+}
+
+GL_APICALL void GL_APIENTRY glGetFloatv(GLenum name, GLfloat *data)
+{
+    GLint values[4];
+    const GLint count = integer(name, values);
+    for (GLint i = 0; i < count; ++i)
+        data[i] = GLfloat(values[i]);
+}
+
+GL_APICALL void GL_APIENTRY glGetBooleanv(GLenum name, GLboolean *data)
+{
+    if (name == GL_COLOR_WRITEMASK) {
+        memset(data, GL_TRUE, 4);
+        return;
+    }
+    GLint values[4];
+    const GLint count = integer(name, values);
+    for (GLint i = 0; i < count; ++i)
+        data[i] = values[i] ? GL_TRUE : GL_FALSE;
+}
+
+GL_APICALL GLenum GL_APIENTRY glGetError(void)
+{
+    return GL_NO_ERROR;
+}
+
+GL_APICALL GLenum GL_APIENTRY glCheckFramebufferStatus(GLenum target)
+{
+    (void)target;
+    return GL_FRAMEBUFFER_COMPLETE;
+}
+
+GL_APICALL void GL_APIENTRY glGenTextures(GLsizei n, GLuint *textures)
+{
+    generate(n, textures);
+}
+
+GL_APICALL void GL_APIENTRY glGenBuffers(GLsizei n, GLuint *buffers)
+{
+    generate(n, buffers);
+}
+
+GL_APICALL void GL_APIENTRY glGenFramebuffers(GLsizei n, GLuint *framebuffers)
+{
+    generate(n, framebuffers);
+}
+
+GL_APICALL void GL_APIENTRY glGenRenderbuffers(GLsizei n, GLuint *renderbuffers)
+{
+    generate(n, renderbuffers);
+}
+
+GL_APICALL void GL_APIENTRY glGenVertexArrays(GLsizei n, GLuint *arrays)
+{
+    generate(n, arrays);
+}
+
+GL_APICALL void GL_APIENTRY glGenQueries(GLsizei n, GLuint *ids)
+{
+    generate(n, ids);
+}
+
+GL_APICALL void GL_APIENTRY glGenSamplers(GLsizei count, GLuint *samplers)
+{
+    generate(count, samplers);
+}
+
+GL_APICALL void GL_APIENTRY glGenTransformFeedbacks(GLsizei n, GLuint *ids)
+{
+    generate(n, ids);
+}
+
+GL_APICALL GLuint GL_APIENTRY glCreateShader(GLenum type)
+{
+    (void)type;
+    return s_nextName++;
+}
+
+GL_APICALL GLuint GL_APIENTRY glCreateProgram(void)
+{
+    return s_nextName++;
+}
+
+// Compiles and links always succeed
+GL_APICALL void GL_APIENTRY glGetShaderiv(GLuint shader, GLenum name, GLint *params)
+{
+    (void)shader;
+    *params = name == GL_COMPILE_STATUS ? GL_TRUE : 0;
+}
+
+GL_APICALL void GL_APIENTRY glGetProgramiv(GLuint program, GLenum name, GLint *params)
+{
+    (void)program;
+    *params = name == GL_LINK_STATUS || name == GL_VALIDATE_STATUS ? GL_TRUE : 0;
+}
+
+GL_APICALL void GL_APIENTRY glGetShaderInfoLog(GLuint shader, GLsizei bufSize, GLsizei *length, GLchar *infoLog)
+{
+    (void)shader;
+    if (length)
+        *length = 0;
+    if (bufSize > 0 && infoLog)
+        infoLog[0] = '\0';
+}
+
+GL_APICALL void GL_APIENTRY glGetProgramInfoLog(GLuint program, GLsizei bufSize, GLsizei *length, GLchar *infoLog)
+{
+    glGetShaderInfoLog(program, bufSize, length, infoLog);
+}
+
+GL_APICALL void GL_APIENTRY glReadPixels(GLint x, GLint y, GLsizei width, GLsizei height, GLenum format,
+                                         GLenum type, void *pixels)
+{
+    (void)x;
+    (void)y;
+    if (!pixels || width <= 0 || height <= 0)
+        return;
+    const size_t bpp = type == GL_UNSIGNED_BYTE ? (format == GL_RGBA ? 4 : format == GL_RGB ? 3 : 1) : 4;
+    memset(pixels, 0, size_t(width) * height * bpp);
+}
+
+}
+
+static long stub()
+{
+    return 0;
+}
+
+FakeGlProc fakegles_proc_address(const char *name)
+{
+    struct Entry {
+        const char *name;
+        FakeGlProc proc;
+    };
+#define FAKEGL_ENTRY(ret, name, params) { #name, reinterpret_cast<FakeGlProc>(&name) },
+#define FAKEGL_EXPLICIT_ENTRY(name) { #name, reinterpret_cast<FakeGlProc>(&name) },
+    static const Entry entries[] = {
+        FAKEGL_FUNCTIONS(FAKEGL_ENTRY)
+        FAKEGL_EXPLICIT_FUNCTIONS(FAKEGL_EXPLICIT_ENTRY)
+    };
+#undef FAKEGL_ENTRY
+#undef FAKEGL_EXPLICIT_ENTRY
+    for (const Entry &entry : entries) {
+        if (!strcmp(entry.name, name))
+            return entry.proc;
+    }
+    // Extensions are advertised by none of the strings, a caller asking
+    // anyway gets a no-op returning 0
+    return !strncmp(name, "gl", 2) ? reinterpret_cast<FakeGlProc>(&stub) : nullptr;
+}